@@ -24,6 +24,8 @@
 #include "CallbackUtils.h"
 #include "NioUtils.h"
 
+#include <vector>
+
 using namespace filament;
 using namespace driver;
 
@@ -49,6 +51,19 @@ Java_com_google_android_filament_Renderer_nRender(JNIEnv *, jclass, jlong native
     renderer->render(view);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_Renderer_nRenderViews(JNIEnv *env, jclass, jlong nativeRenderer,
+        jlongArray nativeViews, jint count) {
+    Renderer *renderer = (Renderer *) nativeRenderer;
+    jlong *views = env->GetLongArrayElements(nativeViews, nullptr);
+    std::vector<View const*> list(size_t(count));
+    for (jint i = 0; i < count; i++) {
+        list[i] = (View const*) views[i];
+    }
+    env->ReleaseLongArrayElements(nativeViews, views, JNI_ABORT);
+    renderer->render(list.data(), list.size());
+}
+
 extern "C" JNIEXPORT jint JNICALL
 Java_com_google_android_filament_Renderer_nReadPixels(JNIEnv *env, jclass,
         jlong nativeRenderer, jlong nativeEngine,
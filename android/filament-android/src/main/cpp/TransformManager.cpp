@@ -24,6 +24,8 @@ using namespace utils;
 using namespace filament;
 
 static_assert(sizeof(jint) == sizeof(Entity), "jint and Entity are not compatible!!");
+static_assert(sizeof(jint) == sizeof(TransformManager::Instance),
+        "jint and TransformManager::Instance are not compatible!!");
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_android_filament_TransformManager_nHasComponent(JNIEnv*, jclass,
@@ -94,6 +96,19 @@ Java_com_google_android_filament_TransformManager_nSetTransform(JNIEnv* env,
     env->ReleaseFloatArrayElements(localTransform_, localTransform, JNI_ABORT);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_TransformManager_nSetTransforms(JNIEnv* env,
+        jclass, jlong nativeTransformManager, jintArray instances_,
+        jfloatArray localTransforms_, jint count) {
+    TransformManager* tm = (TransformManager*) nativeTransformManager;
+    jint *instances = env->GetIntArrayElements(instances_, NULL);
+    jfloat *localTransforms = env->GetFloatArrayElements(localTransforms_, NULL);
+    tm->setTransforms(reinterpret_cast<const TransformManager::Instance *>(instances),
+            reinterpret_cast<const math::mat4f *>(localTransforms), (size_t) count);
+    env->ReleaseFloatArrayElements(localTransforms_, localTransforms, JNI_ABORT);
+    env->ReleaseIntArrayElements(instances_, instances, JNI_ABORT);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_TransformManager_nGetTransform(JNIEnv* env,
         jclass, jlong nativeTransformManager, jint i,
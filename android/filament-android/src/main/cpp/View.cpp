@@ -94,6 +94,13 @@ Java_com_google_android_filament_View_nSetShadowsEnabled(JNIEnv*, jclass,
     view->setShadowsEnabled(enabled);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_View_nInvalidateShadowMaps(JNIEnv*, jclass,
+        jlong nativeView) {
+    View* view = (View*) nativeView;
+    view->invalidateShadowMaps();
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetSampleCount(JNIEnv*, jclass,
         jlong nativeView, jint count) {
@@ -50,6 +50,18 @@ public class Renderer {
         nRender(getNativeObject(), view.getNativeObject());
     }
 
+    /**
+     * Renders several views, in order. This is more efficient than calling
+     * {@link #render(View)} for each view, in particular when views share a {@link Scene}.
+     */
+    public void render(@NonNull View[] views) {
+        long[] nativeViews = new long[views.length];
+        for (int i = 0; i < views.length; i++) {
+            nativeViews[i] = views[i].getNativeObject();
+        }
+        nRenderViews(getNativeObject(), nativeViews, nativeViews.length);
+    }
+
     /**
      * This method MUST be called before endFrame.
      */
@@ -88,6 +100,7 @@ public class Renderer {
     private static native boolean nBeginFrame(long nativeRenderer, long nativeSwapChain);
     private static native void nEndFrame(long nativeRenderer);
     private static native void nRender(long nativeRenderer, long nativeView);
+    private static native void nRenderViews(long nativeRenderer, long[] nativeViews, int count);
     private static native int nReadPixels(long nativeRenderer, long nativeEngine,
             int xoffset, int yoffset, int width, int height,
             Buffer storage, int remaining,
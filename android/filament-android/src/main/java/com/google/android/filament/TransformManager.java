@@ -63,6 +63,22 @@ public class TransformManager {
         nSetTransform(mNativeObject, i, localTransform);
     }
 
+    /**
+     * Sets the local transforms of <code>count</code> transform components in a single call.
+     * <code>localTransforms</code> holds <code>count</code> consecutive 4x4 matrices, the
+     * <code>i</code>-th one is set to <code>instances[i]</code>.
+     */
+    public void setTransforms(@NonNull @EntityInstance int[] instances,
+            @NonNull float[] localTransforms, int count) {
+        if (instances.length < count) {
+            throw new ArrayIndexOutOfBoundsException("Array length must be at least count");
+        }
+        if (localTransforms.length < count * 16) {
+            throw new ArrayIndexOutOfBoundsException("Array length must be at least 16 * count");
+        }
+        nSetTransforms(mNativeObject, instances, localTransforms, count);
+    }
+
     @NonNull
     @Size(min = 16)
     public float[] getTransform(@EntityInstance int i,
@@ -105,6 +121,7 @@ public class TransformManager {
     private static native void nDestroy(long nativeTransformManager, int entity);
     private static native void nSetParent(long nativeTransformManager, int i, int newParent);
     private static native void nSetTransform(long nativeTransformManager, int i, float[] localTransform);
+    private static native void nSetTransforms(long nativeTransformManager, int[] instances, float[] localTransforms, int count);
     private static native void nGetTransform(long nativeTransformManager, int i, float[] outLocalTransform);
     private static native void nGetWorldTransform(long nativeTransformManager, int i, float[] outWorldTransform);
     private static native void nOpenLocalTransformTransaction(long nativeTransformManager);
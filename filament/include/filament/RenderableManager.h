@@ -53,6 +53,9 @@ public:
 
     Instance getInstance(utils::Entity e) const noexcept;
 
+    // maximum number of levels of detail of a renderable
+    static constexpr size_t MAX_LEVEL_OF_DETAIL_COUNT = 4;
+
     struct Bone {
         math::quatf unitQuaternion = { 1, 0, 0, 0 };
         math::float3 translation = { 0, 0, 0 };
@@ -82,13 +85,38 @@ public:
         Builder& culling(bool enable) noexcept; // true by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
+        // Occluders hide the renderables behind them when occlusion culling is enabled on the
+        // View. Their bounding box is assumed to be entirely filled, e.g. walls or buildings.
+        Builder& occluder(bool enable) noexcept; // false by default
         Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
         Builder& skinning(size_t boneCount, Bone const* transforms) noexcept;
         Builder& skinning(size_t boneCount, math::mat4f const* transforms) noexcept;
+        // Shares the bones of another skinned renderable, e.g. for crowds playing the same
+        // animation pose. Setting the bones of any of these renderables affects all of them.
+        Builder& skinning(utils::Entity source) noexcept;
 
         // Sets an ordering index for blended primitives that all live at the same Z value.
         Builder& blendOrder(size_t index, uint16_t order) noexcept; // 0 by default
 
+        /**
+         * Starts a level of detail. By default all the primitives belong to the level 0, which
+         * is the most detailed one.
+         *
+         * The level 'level' is made of the primitives from 'firstPrimitive' up to the first
+         * primitive of the next level, it's drawn when the screen size of the renderable is
+         * smaller than 'screenSize'. The screen size is the projected radius of the renderable's
+         * bounding sphere as a fraction of the viewport's height, e.g. 0.5 when it's as tall as
+         * the viewport.
+         *
+         * Levels must be contiguous and start at increasing primitives, with decreasing screen
+         * sizes, otherwise build() fails.
+         *
+         * @param level in the range [1, MAX_LEVEL_OF_DETAIL_COUNT - 1]
+         * @param firstPrimitive index of the first primitive of this level
+         * @param screenSize screen size below which this level is used
+         */
+        Builder& levelOfDetail(uint8_t level, size_t firstPrimitive, float screenSize) noexcept;
+
         /**
          * Adds the Renderable component to an entity.
          *
@@ -136,17 +164,27 @@ public:
     void setReceiveShadows(Instance instance, bool enable) noexcept;
     bool isShadowCaster(Instance instance) const noexcept;
     bool isShadowReceiver(Instance instance) const noexcept;
+    void setOccluder(Instance instance, bool enable) noexcept;
+    bool isOccluder(Instance instance) const noexcept;
 
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
 
+    // Sets all the bones of several renderables at once. 'transforms' holds the bones of
+    // instances[0], followed by the bones of instances[1], and so on; each renderable uses as
+    // many bones as it was built with. Renderables sharing their bones must appear only once.
+    void setBones(Instance const* instances, size_t count, math::mat4f const* transforms) noexcept;
+
 
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
 
-    // number of render primitives in this renderable
+    // number of render primitives in this renderable, across all its levels of detail
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
+    // number of levels of detail of this renderable
+    size_t getLevelOfDetailCount(Instance instance) const noexcept;
+
     // set/change the material of a given render primitive
     void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept;
@@ -23,6 +23,7 @@
 
 #include <utils/compiler.h>
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace filament {
@@ -136,6 +137,34 @@ public:
      */
     void render(View const* view);
 
+    /**
+     * Render several Views into this renderer's window, in order.
+     *
+     * This is equivalent to calling render() for each View, but it's more efficient:
+     * - the culling of a View and the generation of its commands run while the previous View
+     *   is rendered.
+     * - Views that use the same Scene share the update of that Scene, only the first of them
+     *   gathers the changes of its entities.
+     *
+     * The rendering commands are generated in the order of the \p views array, and a View
+     * is drawn on top of the previous ones where their viewports overlap.
+     *
+     * @param views An array of \p count pointers to distinct views to render. Null pointers
+     *              and views without a Scene are skipped.
+     * @param count The number of views in the array.
+     *
+     * @attention
+     * render() must be called *after* beginFrame() and *before* endFrame().
+     *
+     * @note
+     * render() must be called from the Engine's main thread (or external synchronization
+     * must be provided).
+     *
+     * @see
+     * render(View const*)
+     */
+    void render(View const* const* views, size_t count);
+
     /**
      * Read-back the content of the SwapChain associated with this Renderer.
      *
@@ -114,6 +114,29 @@ public:
      * @return The total number of Light objects in the Scene.
      */
     size_t getLightCount() const noexcept;
+
+    /**
+     * Enables or disables the culling hierarchy of this Scene.
+     *
+     * When enabled, a bounding volume hierarchy is maintained over the world-space bounding
+     * boxes of all Renderable objects of the Scene, and used to reject entire groups of
+     * objects during frustum culling. This is beneficial for large scenes made mostly of
+     * static objects, where the camera sees only a small portion of the world. The hierarchy
+     * is refit every frame, which costs more than it saves when most objects are moving.
+     *
+     * Disabled by default.
+     *
+     * @param enabled true to enable the culling hierarchy, false to disable it.
+     */
+    void setCullingHierarchyEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether the culling hierarchy is enabled.
+     *
+     * @return true if the culling hierarchy is enabled, false otherwise.
+     * @see setCullingHierarchyEnabled()
+     */
+    bool isCullingHierarchyEnabled() const noexcept;
 };
 
 } // namespace filament
@@ -24,6 +24,8 @@
 #include <utils/EntityInstance.h>
 
 #include <math/mat4.h>
+#include <math/quat.h>
+#include <math/vec3.h>
 
 namespace filament {
 
@@ -57,6 +59,14 @@ namespace filament {
  *  tcm.destroy(object);
  * ~~~~~~~~~~~
  *
+ * Instances
+ * =========
+ *
+ * Transform components are kept sorted by their depth in the hierarchy, so that world transforms
+ * can be computed efficiently. Because of this, create(), destroy() and setParent() can change
+ * the Instance of other components. Instances must be retrieved again with getInstance()
+ * after calling these methods.
+ *
  */
 class UTILS_PUBLIC TransformManager : public FilamentAPI {
 public:
@@ -124,6 +134,39 @@ public:
      */
     void setTransform(Instance ci, const math::mat4f& localTransform) noexcept;
 
+    /**
+     * Sets the local transforms of several transform components at once. World transforms are
+     * propagated only once, after all local transforms are set.
+     *
+     * @param instances         Array of count instances of transform components.
+     * @param localTransforms   Array of count local transforms (i.e. relative to the parent),
+     *                          localTransforms[i] is set to instances[i].
+     * @param count             Number of transforms to set.
+     *
+     * This is intended for animation systems or bindings updating many transforms each frame.
+     * Inside a local transform transaction, only the local transforms are updated.
+     *
+     * @see setTransform(), openLocalTransformTransaction()
+     */
+    void setTransforms(Instance const* instances, math::mat4f const* localTransforms,
+            size_t count) noexcept;
+
+    /**
+     * Sets the local transforms of several transform components at once, from their
+     * translation, rotation and scale components. The local transform of instances[i] becomes
+     * translate(translations[i]) * rotations[i] * scale(scales[i]).
+     *
+     * @param instances     Array of count instances of transform components.
+     * @param translations  Array of count translations.
+     * @param rotations     Array of count unit quaternions.
+     * @param scales        Array of count scales, or nullptr for no scaling.
+     * @param count         Number of transforms to set.
+     *
+     * @see setTransforms(Instance const*, math::mat4f const*, size_t)
+     */
+    void setTransforms(Instance const* instances, math::float3 const* translations,
+            math::quatf const* rotations, math::float3 const* scales, size_t count) noexcept;
+
     /**
      * Returns the local transform of a transform component.
      * @param ci The instance of the transform component to query the local transform from.
@@ -116,12 +116,56 @@ public:
         bool homogeneousScaling = false;                //!< set to true to force homogeneous scaling
     };
 
+    //! Maximum number of froxels, see FroxelOptions
+    static constexpr uint16_t MAX_FROXEL_COUNT = 8192;
+
+    //! Maximum number of froxel slices along the view direction, see FroxelOptions
+    static constexpr uint8_t MAX_FROXEL_SLICE_COUNT = 64;
+
+    /**
+     * Options for the froxel grid used to cull point and spot lights.
+     *
+     * The view frustum is divided in froxels (frustum voxels), the list of lights affecting
+     * each froxel is computed and uploaded to the GPU every frame. More froxels cull the
+     * lights more tightly, fewer froxels use less CPU time, memory and bandwidth.
+     *
+     * Froxels are as square as possible on screen and always cover the whole viewport, their
+     * dimensions are derived from froxelCount, sliceCount and the viewport's aspect ratio.
+     *
+     * @see setFroxelOptions(), setDynamicLightingOptions()
+     */
+    struct FroxelOptions {
+        //! maximum number of froxels, clamped to MAX_FROXEL_COUNT
+        uint16_t froxelCount = MAX_FROXEL_COUNT;
+        //! number of slices between zLightNear and zLightFar, in [2, MAX_FROXEL_SLICE_COUNT]
+        uint8_t sliceCount = 16;
+        //! set to true to use fewer froxels (at least 1024) when few lights are visible
+        bool adaptive = false;
+    };
+
     enum class DepthPrepass : int8_t {
         DEFAULT = -1,
         DISABLED,
         ENABLED,
     };
 
+    //! Maximum number of cascades of the directional shadow map
+    static constexpr uint8_t MAX_SHADOW_CASCADES = 4;
+
+    /**
+     * How the view frustum is split between the cascades of the directional shadow map.
+     *
+     * UNIFORM:      the cascades have the same depth range. This wastes resolution far away.
+     * LOGARITHMIC:  the depth range of each cascade grows geometrically with its distance,
+     *               which matches the perspective, but the first cascade is often very short.
+     * PRACTICAL:    the average of the uniform and logarithmic splits.
+     */
+    enum class CascadeSplitScheme : uint8_t {
+        UNIFORM,
+        LOGARITHMIC,
+        PRACTICAL,
+    };
+
     /**
      * Sets whether this view is rendered with or without a depth pre-pass.
      *
@@ -290,6 +334,42 @@ public:
      */
     void setShadowsEnabled(bool enabled) noexcept;
 
+    /**
+     * Forces the shadow maps of this View to be rendered again on the next frame.
+     *
+     * The shadow maps are kept across frames and only rendered again when the shadow casters
+     * or the shadow cameras change: renderables added, removed or modified (including their
+     * transforms and bones), the light, the camera, or the parameters of a material instance
+     * whose material has a custom depth shader (e.g. masked materials or materials that
+     * displace vertices).
+     *
+     * Other changes that affect the shadows are not detected, and the shadow maps are stale
+     * until this is called, e.g. when the content of a texture sampled by the depth shader
+     * of a masked material, or of a vertex buffer, is updated.
+     */
+    void invalidateShadowMaps() noexcept;
+
+    /**
+     * Sets the number of cascades of the directional shadow map, and how the view frustum is
+     * split between them. 1 cascade by default.
+     *
+     * Each cascade is a separate shadow map covering a slice of the view frustum, so that the
+     * shadows close to the camera get more resolution than the distant ones. This allows large
+     * view distances without an enormous shadow map. All the cascades use the shadow map size
+     * of the light.
+     *
+     * @param count     number of cascades, clamped to [1, MAX_SHADOW_CASCADES].
+     * @param scheme    how the view frustum is split between the cascades.
+     *
+     * @see LightManager::Builder::shadowOptions()
+     */
+    void setShadowCascades(uint8_t count,
+            CascadeSplitScheme scheme = CascadeSplitScheme::PRACTICAL) noexcept;
+
+    uint8_t getShadowCascadeCount() const noexcept;
+
+    CascadeSplitScheme getShadowCascadeSplitScheme() const noexcept;
+
     /**
      * Specifies which buffers can be discarded before rendering.
      *
@@ -379,6 +459,20 @@ public:
      */
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
 
+    /**
+     * Sets the froxel grid options of this view. For instance, mobile targets with few lights
+     * can use fewer froxels to reduce the per-frame upload.
+     *
+     * @param options Options to set, see FroxelOptions.
+     */
+    void setFroxelOptions(FroxelOptions const& options) noexcept;
+
+    /**
+     * Returns the froxel grid options associated with this view.
+     * @return value set by setFroxelOptions().
+     */
+    FroxelOptions getFroxelOptions() const noexcept;
+
     /**
      * Enable or disable post processing. Enabled by default.
      *
@@ -397,6 +491,48 @@ public:
 
     bool isPostProcessingEnabled() const noexcept;
 
+    /**
+     * Enable or disable the packing of the per-renderable uniforms. Disabled by default.
+     *
+     * When enabled, the uniforms of all the visible renderables are packed into a single
+     * uniform buffer every frame, which is uploaded in one transfer and bound at a different
+     * offset for each draw. This reduces the number of small uploads and driver calls, which
+     * helps scenes with many renderables.
+     *
+     * @param enabled true enables the packing, false disables it.
+     */
+    void setRenderableUniformPackingEnabled(bool enabled) noexcept;
+
+    bool isRenderableUniformPackingEnabled() const noexcept;
+
+    /**
+     * Enable or disable occlusion culling. Disabled by default.
+     *
+     * When enabled, the renderables designated as occluders (see
+     * RenderableManager::Builder::occluder()) are rasterized on the CPU into a low resolution
+     * depth buffer after frustum culling, and the renderables entirely hidden behind them are
+     * culled as well. This is only useful for scenes with large occluders, such as walls or
+     * buildings. Occlusion culling has no effect when culling is disabled.
+     *
+     * @param enabled true enables occlusion culling, false disables it.
+     */
+    void setOcclusionCullingEnabled(bool enabled) noexcept;
+
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Sets the contribution culling threshold, 0 by default (disabled).
+     *
+     * Renderables whose projected bounding sphere has a radius smaller than this many pixels
+     * of the viewport are culled, they don't contribute enough to the image to be worth
+     * drawing. This has no effect when culling is disabled.
+     *
+     * @param pixels projected radius, in pixels, below which renderables are culled.
+     */
+    void setContributionCullingThreshold(float pixels) noexcept;
+
+    float getContributionCullingThreshold() const noexcept;
+
     // for debugging...
 
     //! debugging: allows to entirely disable culling. (culling enabled by default).
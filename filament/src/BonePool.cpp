@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BonePool.h"
+
+#include "driver/DriverApi.h"
+#include "driver/UniformBuffer.h"
+
+#include <utils/compiler.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <string.h>
+
+using namespace math;
+
+namespace filament {
+
+using namespace driver;
+
+namespace details {
+
+static_assert(BonePool::SLOT_SIZE % sizeof(BonePool::Bone) == 0,
+        "a slot must hold a whole number of bones");
+
+BonePool::BonePool() noexcept = default;
+
+BonePool::~BonePool() noexcept = default;
+
+void BonePool::terminate(DriverApi& driver) {
+    if (mHandle) {
+        driver.destroyUniformBuffer(mHandle);
+        mHandle = {};
+        mHandleSize = 0;
+    }
+}
+
+uint32_t BonePool::allocate(size_t count) noexcept {
+    assert(count > 0 && count <= CONFIG_MAX_BONE_COUNT);
+    const size_t slots = getSlotCount(count);
+
+    // first-fit in the free list, otherwise use the end of the pool
+    size_t first = 0;
+    auto& freeList = mFreeList;
+    auto pos = std::find_if(freeList.begin(), freeList.end(),
+            [slots](Range const& r) { return r.count >= slots; });
+    if (pos != freeList.end()) {
+        first = pos->first;
+        pos->first += slots;
+        pos->count -= slots;
+        if (pos->count == 0) {
+            freeList.erase(pos);
+        }
+    } else {
+        first = mUsed;
+        mUsed += slots;
+        // any bound range must fit in the buffer, even when it starts at the last slot
+        const size_t needed = mUsed * BONES_PER_SLOT + CONFIG_MAX_BONE_COUNT;
+        if (UTILS_UNLIKELY(mBones.size() < needed)) {
+            // grow geometrically, so the uniform buffer is rarely recreated
+            mBones.resize(std::max(needed, mBones.size() * 2));
+            mAllocations.resize(mBones.size() / BONES_PER_SLOT);
+        }
+    }
+
+    mAllocations[first] = { uint16_t(slots), 1 };
+    std::fill_n(mBones.data() + first * BONES_PER_SLOT, count, Bone{});
+    mDirty = true;
+    return uint32_t(first * SLOT_SIZE);
+}
+
+void BonePool::acquire(uint32_t offset) noexcept {
+    Allocation& allocation = mAllocations[offset / SLOT_SIZE];
+    assert(allocation.references);
+    allocation.references++;
+}
+
+void BonePool::release(uint32_t offset) noexcept {
+    const uint32_t first = uint32_t(offset / SLOT_SIZE);
+    Allocation& allocation = mAllocations[first];
+    assert(allocation.references);
+    if (--allocation.references) {
+        return;
+    }
+
+    // put the slots back in the free list, merged with their neighbors
+    auto& freeList = mFreeList;
+    Range range = { first, allocation.count };
+    allocation = {};
+    auto pos = std::lower_bound(freeList.begin(), freeList.end(), range,
+            [](Range const& lhs, Range const& rhs) { return lhs.first < rhs.first; });
+    if (pos != freeList.end() && range.first + range.count == pos->first) {
+        range.count += pos->count;
+        pos = freeList.erase(pos);
+    }
+    if (pos != freeList.begin() && (pos - 1)->first + (pos - 1)->count == range.first) {
+        --pos;
+        range.first = pos->first;
+        range.count += pos->count;
+        pos = freeList.erase(pos);
+    }
+
+    if (range.first + range.count == mUsed) {
+        // the last slots of the pool are free, just shrink it
+        mUsed = range.first;
+    } else {
+        freeList.insert(pos, range);
+    }
+}
+
+BonePool::Bone* BonePool::edit(uint32_t offset, size_t first, size_t count) noexcept {
+    assert(mAllocations[offset / SLOT_SIZE].references);
+    assert(first + count <= mAllocations[offset / SLOT_SIZE].count * BONES_PER_SLOT);
+    mDirty = true;
+    return mBones.data() + offset / sizeof(Bone) + first;
+}
+
+void BonePool::convert(Bone* UTILS_RESTRICT out, mat4f const* UTILS_RESTRICT in,
+        size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        mat4f const& m = in[i];
+        // 4 times the square of each component comes from the diagonal, and 4 times the
+        // product of each pair of components from the off-diagonal elements. The components
+        // are computed from the row of products of the largest one, which is always well
+        // conditioned, even for rotations close to 180 degrees. This uses selects rather than
+        // branches like mat4f::toQuaternion() does, so the loop can be vectorized.
+        const float m00 = m[0][0];
+        const float m11 = m[1][1];
+        const float m22 = m[2][2];
+        const float ww = 1.0f + m00 + m11 + m22;
+        const float xx = 1.0f + m00 - m11 - m22;
+        const float yy = 1.0f - m00 + m11 - m22;
+        const float zz = 1.0f - m00 - m11 + m22;
+        const float wx = m[1][2] - m[2][1];
+        const float wy = m[2][0] - m[0][2];
+        const float wz = m[0][1] - m[1][0];
+        const float xy = m[0][1] + m[1][0];
+        const float xz = m[2][0] + m[0][2];
+        const float yz = m[1][2] + m[2][1];
+
+        // start with w as the largest component, the quaternion is then scaled by 4w
+        float w = ww, x = wx, y = wy, z = wz, largest = ww;
+        const bool useX = xx > largest;
+        w = useX ? wx : w;  x = useX ? xx : x;  y = useX ? xy : y;  z = useX ? xz : z;
+        largest = useX ? xx : largest;
+        const bool useY = yy > largest;
+        w = useY ? wy : w;  x = useY ? xy : x;  y = useY ? yy : y;  z = useY ? yz : z;
+        largest = useY ? yy : largest;
+        const bool useZ = zz > largest;
+        w = useZ ? wz : w;  x = useZ ? xz : x;  y = useZ ? yz : y;  z = useZ ? zz : z;
+
+        // normalize, and keep w positive
+        const float n = std::copysign(1.0f, w) / std::sqrt(w * w + x * x + y * y + z * z);
+        out[i].unitQuaternion = { w * n, x * n, y * n, z * n };
+        out[i].translation = m[3].xyz;
+    }
+}
+
+void BonePool::commit(DriverApi& driver) noexcept {
+    const size_t size = mBones.size() * sizeof(Bone);
+    if (UTILS_UNLIKELY(mHandleSize < size)) {
+        SYSTRACE_NAME("BonePool::grow");
+        if (mHandle) {
+            driver.destroyUniformBuffer(mHandle);
+        }
+        mHandle = driver.createUniformBuffer(size);
+        mHandleSize = size;
+        mDirty = true;
+    }
+
+    if (mDirty) {
+        UniformBuffer bones(size);
+        memcpy(bones.invalidateUniforms(0, size), mBones.data(), size);
+        driver.updateUniformBuffer(mHandle, std::move(bones));
+        mDirty = false;
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -18,27 +18,83 @@
 
 #include <math/fast.h>
 
+#include <memory>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   define CULLER_X86 1
+#   include <immintrin.h>
+#   if defined(_MSC_VER) && !defined(__clang__)
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define CULLER_NEON 1
+#   include <arm_neon.h>
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#   define CULLER_TARGET(isa) __attribute__((target(isa)))
+#else
+#   define CULLER_TARGET(isa)
+#endif
+
 using namespace math;
 
 namespace filament {
 namespace details {
 
-void Culler::intersects(
+using result_type = Culler::result_type;
+
+using BoxesKernel = void(*)(result_type* results, float4 const* planes,
+        float3 const* center, float3 const* extent, size_t count, size_t bit);
+
+using SpheresKernel = void(*)(result_type* results, float4 const* planes,
+        float4 const* b, size_t count);
+
+// The frustum planes in SoA form, so each component can be broadcast to all SIMD lanes
+struct PlanesSoa {
+    float x[6];
+    float y[6];
+    float z[6];
+    float ax[6];    // |x|
+    float ay[6];    // |y|
+    float az[6];    // |z|
+    float w[6];
+
+    explicit PlanesSoa(float4 const* planes) noexcept {
+        for (size_t j = 0; j < 6; j++) {
+            x[j] = planes[j].x;
+            y[j] = planes[j].y;
+            z[j] = planes[j].z;
+            ax[j] = std::abs(planes[j].x);
+            ay[j] = std::abs(planes[j].y);
+            az[j] = std::abs(planes[j].z);
+            w[j] = planes[j].w;
+        }
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+// Scalar kernels, these rely on the compiler's auto-vectorizer
+// ------------------------------------------------------------------------------------------------
+
+static void intersectsSpheresScalar(
         result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
-        math::float4 const* UTILS_RESTRICT b,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
         size_t count) noexcept {
 
-    math::float4 const * const UTILS_RESTRICT planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allow the compiler to write 8
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
-        math::float4 const sphere(b[i]);
+        float4 const sphere(b[i]);
 
         #pragma clang loop unroll(full)
         for (size_t j = 0; j < 6; j++) {
@@ -54,19 +110,16 @@ void Culler::intersects(
     }
 }
 
-void Culler::intersects(
+static void intersectsBoxesScalar(
         result_type* UTILS_RESTRICT results,
-        Frustum const& UTILS_RESTRICT frustum,
-        math::float3 const* UTILS_RESTRICT center,
-        math::float3 const* UTILS_RESTRICT extent,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
         size_t count, size_t bit) noexcept {
 
-    math::float4 const * UTILS_RESTRICT const planes = frustum.mPlanes;
-
     // we use a vectorize width of 8 because, on ARMv8 it allows the compiler to write eight
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -88,6 +141,509 @@ void Culler::intersects(
     }
 }
 
+// ------------------------------------------------------------------------------------------------
+// x86 kernels
+// ------------------------------------------------------------------------------------------------
+
+#if defined(CULLER_X86)
+
+// loads 4 float3 and transposes them to x, y, z
+CULLER_TARGET("sse4.1")
+static inline void load4(float3 const* p, __m128& x, __m128& y, __m128& z) noexcept {
+    float const* f = &p[0].x;
+    const __m128 a = _mm_loadu_ps(f + 0);                           // x0 y0 z0 x1
+    const __m128 b = _mm_loadu_ps(f + 4);                           // y1 z1 x2 y2
+    const __m128 c = _mm_loadu_ps(f + 8);                           // z2 x3 y3 z3
+    const __m128 t0 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1)); // y0 z0 y1 z1
+    const __m128 t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2)); // x2 y2 x3 y3
+    x = _mm_shuffle_ps(a, t1, _MM_SHUFFLE(2, 0, 3, 0));             // x0 x1 x2 x3
+    y = _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 1, 2, 0));            // y0 y1 y2 y3
+    z = _mm_shuffle_ps(t0, c, _MM_SHUFFLE(3, 0, 3, 1));             // z0 z1 z2 z3
+}
+
+// loads 4 float4 and transposes them to x, y, z, w
+CULLER_TARGET("sse4.1")
+static inline void load4(float4 const* p, __m128& x, __m128& y, __m128& z, __m128& w) noexcept {
+    float const* f = &p[0].x;
+    x = _mm_loadu_ps(f + 0);
+    y = _mm_loadu_ps(f + 4);
+    z = _mm_loadu_ps(f + 8);
+    w = _mm_loadu_ps(f + 12);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+}
+
+// packs the sign bits of 2 x 4 floats into 8 bytes (0 or 1) in the low 64 bits
+CULLER_TARGET("sse4.1")
+static inline __m128i packSignBits(__m128 lo, __m128 hi) noexcept {
+    const __m128i l = _mm_srli_epi32(_mm_castps_si128(lo), 31);
+    const __m128i h = _mm_srli_epi32(_mm_castps_si128(hi), 31);
+    const __m128i w = _mm_packus_epi32(l, h);
+    return _mm_packus_epi16(w, w);
+}
+
+CULLER_TARGET("sse4.1")
+static inline __m128 boxes4(PlanesSoa const& p, float3 const* center, float3 const* extent) noexcept {
+    __m128 cx, cy, cz, ex, ey, ez;
+    load4(center, cx, cy, cz);
+    load4(extent, ex, ey, ez);
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (size_t j = 0; j < 6; j++) {
+        __m128 dot = _mm_mul_ps(_mm_set1_ps(p.x[j]), cx);
+        dot = _mm_sub_ps(dot, _mm_mul_ps(_mm_set1_ps(p.ax[j]), ex));
+        dot = _mm_add_ps(dot, _mm_mul_ps(_mm_set1_ps(p.y[j]), cy));
+        dot = _mm_sub_ps(dot, _mm_mul_ps(_mm_set1_ps(p.ay[j]), ey));
+        dot = _mm_add_ps(dot, _mm_mul_ps(_mm_set1_ps(p.z[j]), cz));
+        dot = _mm_sub_ps(dot, _mm_mul_ps(_mm_set1_ps(p.az[j]), ez));
+        dot = _mm_add_ps(dot, _mm_set1_ps(p.w[j]));
+        visible = _mm_and_ps(visible, dot);
+    }
+    return visible; // the sign bit is set for visible boxes
+}
+
+CULLER_TARGET("sse4.1")
+static inline __m128 spheres4(PlanesSoa const& p, float4 const* b) noexcept {
+    __m128 sx, sy, sz, sr;
+    load4(b, sx, sy, sz, sr);
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (size_t j = 0; j < 6; j++) {
+        __m128 dot = _mm_mul_ps(_mm_set1_ps(p.x[j]), sx);
+        dot = _mm_add_ps(dot, _mm_mul_ps(_mm_set1_ps(p.y[j]), sy));
+        dot = _mm_add_ps(dot, _mm_mul_ps(_mm_set1_ps(p.z[j]), sz));
+        dot = _mm_add_ps(dot, _mm_set1_ps(p.w[j]));
+        dot = _mm_sub_ps(dot, sr);
+        visible = _mm_and_ps(visible, dot);
+    }
+    return visible; // the sign bit is set for visible spheres
+}
+
+CULLER_TARGET("sse4.1")
+static void intersectsBoxesSse4(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const PlanesSoa p(planes);
+    const __m128i shift = _mm_cvtsi32_si128(int(bit));
+    for (size_t i = 0; i < count; i += 8) {
+        const __m128 v0 = boxes4(p, center + i,     extent + i);
+        const __m128 v1 = boxes4(p, center + i + 4, extent + i + 4);
+        const __m128i r = _mm_sll_epi64(packSignBits(v0, v1), shift);
+        __m128i* const out = reinterpret_cast<__m128i*>(results + i);
+        _mm_storel_epi64(out, _mm_or_si128(_mm_loadl_epi64(out), r));
+    }
+}
+
+CULLER_TARGET("sse4.1")
+static void intersectsSpheresSse4(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const PlanesSoa p(planes);
+    for (size_t i = 0; i < count; i += 8) {
+        const __m128 v0 = spheres4(p, b + i);
+        const __m128 v1 = spheres4(p, b + i + 4);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(results + i), packSignBits(v0, v1));
+    }
+}
+
+CULLER_TARGET("avx2")
+static inline __m256 combine(__m128 lo, __m128 hi) noexcept {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+CULLER_TARGET("avx2")
+static inline __m128i packSignBits(__m256 v) noexcept {
+    const __m256i s = _mm256_srli_epi32(_mm256_castps_si256(v), 31);
+    const __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    return _mm_packus_epi16(w, w);
+}
+
+CULLER_TARGET("avx2")
+static inline __m256 boxes8(PlanesSoa const& p, float3 const* center, float3 const* extent) noexcept {
+    __m128 cx0, cy0, cz0, ex0, ey0, ez0;
+    __m128 cx1, cy1, cz1, ex1, ey1, ez1;
+    load4(center,     cx0, cy0, cz0);
+    load4(center + 4, cx1, cy1, cz1);
+    load4(extent,     ex0, ey0, ez0);
+    load4(extent + 4, ex1, ey1, ez1);
+    const __m256 cx = combine(cx0, cx1);
+    const __m256 cy = combine(cy0, cy1);
+    const __m256 cz = combine(cz0, cz1);
+    const __m256 ex = combine(ex0, ex1);
+    const __m256 ey = combine(ey0, ey1);
+    const __m256 ez = combine(ez0, ez1);
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (size_t j = 0; j < 6; j++) {
+        __m256 dot = _mm256_mul_ps(_mm256_set1_ps(p.x[j]), cx);
+        dot = _mm256_sub_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.ax[j]), ex));
+        dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.y[j]), cy));
+        dot = _mm256_sub_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.ay[j]), ey));
+        dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.z[j]), cz));
+        dot = _mm256_sub_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.az[j]), ez));
+        dot = _mm256_add_ps(dot, _mm256_set1_ps(p.w[j]));
+        visible = _mm256_and_ps(visible, dot);
+    }
+    return visible; // the sign bit is set for visible boxes
+}
+
+CULLER_TARGET("avx2")
+static inline __m256 spheres8(PlanesSoa const& p, float4 const* b) noexcept {
+    __m128 sx0, sy0, sz0, sr0;
+    __m128 sx1, sy1, sz1, sr1;
+    load4(b,     sx0, sy0, sz0, sr0);
+    load4(b + 4, sx1, sy1, sz1, sr1);
+    const __m256 sx = combine(sx0, sx1);
+    const __m256 sy = combine(sy0, sy1);
+    const __m256 sz = combine(sz0, sz1);
+    const __m256 sr = combine(sr0, sr1);
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (size_t j = 0; j < 6; j++) {
+        __m256 dot = _mm256_mul_ps(_mm256_set1_ps(p.x[j]), sx);
+        dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.y[j]), sy));
+        dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(p.z[j]), sz));
+        dot = _mm256_add_ps(dot, _mm256_set1_ps(p.w[j]));
+        dot = _mm256_sub_ps(dot, sr);
+        visible = _mm256_and_ps(visible, dot);
+    }
+    return visible; // the sign bit is set for visible spheres
+}
+
+CULLER_TARGET("avx2")
+static void intersectsBoxesAvx2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const PlanesSoa p(planes);
+    const __m128i shift = _mm_cvtsi32_si128(int(bit));
+    for (size_t i = 0; i < count; i += 8) {
+        const __m128i r = _mm_sll_epi64(packSignBits(boxes8(p, center + i, extent + i)), shift);
+        __m128i* const out = reinterpret_cast<__m128i*>(results + i);
+        _mm_storel_epi64(out, _mm_or_si128(_mm_loadl_epi64(out), r));
+    }
+}
+
+CULLER_TARGET("avx2")
+static void intersectsSpheresAvx2(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const PlanesSoa p(planes);
+    for (size_t i = 0; i < count; i += 8) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(results + i), packSignBits(spheres8(p, b + i)));
+    }
+}
+
+CULLER_TARGET("avx512f")
+static inline __m512 combine(__m256 lo, __m256 hi) noexcept {
+    return _mm512_castpd_ps(_mm512_insertf64x4(
+            _mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+}
+
+// converts the sign bits of 16 floats into 16 bytes, with the given value (or 0)
+CULLER_TARGET("avx512f")
+static inline __m128i packSignBits(__m512 v, int value) noexcept {
+    const __mmask16 visible = _mm512_test_epi32_mask(
+            _mm512_castps_si512(v), _mm512_set1_epi32(int(0x80000000)));
+    return _mm512_cvtepi32_epi8(_mm512_maskz_set1_epi32(visible, value));
+}
+
+// AVX-512F doesn't have _mm512_and_ps, use the integer version
+CULLER_TARGET("avx512f")
+static inline __m512 andps(__m512 a, __m512 b) noexcept {
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+}
+
+CULLER_TARGET("avx512f")
+static void intersectsBoxesAvx512(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const PlanesSoa p(planes);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128 c[12], e[12];
+        for (size_t k = 0; k < 4; k++) {
+            load4(center + i + 4 * k, c[k], c[4 + k], c[8 + k]);
+            load4(extent + i + 4 * k, e[k], e[4 + k], e[8 + k]);
+        }
+        const __m512 cx = combine(combine(c[0], c[1]), combine(c[2],  c[3]));
+        const __m512 cy = combine(combine(c[4], c[5]), combine(c[6],  c[7]));
+        const __m512 cz = combine(combine(c[8], c[9]), combine(c[10], c[11]));
+        const __m512 ex = combine(combine(e[0], e[1]), combine(e[2],  e[3]));
+        const __m512 ey = combine(combine(e[4], e[5]), combine(e[6],  e[7]));
+        const __m512 ez = combine(combine(e[8], e[9]), combine(e[10], e[11]));
+        __m512 visible = _mm512_castsi512_ps(_mm512_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m512 dot = _mm512_mul_ps(_mm512_set1_ps(p.x[j]), cx);
+            dot = _mm512_sub_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.ax[j]), ex));
+            dot = _mm512_add_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.y[j]), cy));
+            dot = _mm512_sub_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.ay[j]), ey));
+            dot = _mm512_add_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.z[j]), cz));
+            dot = _mm512_sub_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.az[j]), ez));
+            dot = _mm512_add_ps(dot, _mm512_set1_ps(p.w[j]));
+            visible = andps(visible, dot);
+        }
+        const __m128i r = packSignBits(visible, 1 << bit);
+        __m128i* const out = reinterpret_cast<__m128i*>(results + i);
+        _mm_storeu_si128(out, _mm_or_si128(_mm_loadu_si128(out), r));
+    }
+    if (i < count) {
+        // count is a multiple of 8, so we have 8 items left at most
+        intersectsBoxesAvx2(results + i, planes, center + i, extent + i, count - i, bit);
+    }
+}
+
+CULLER_TARGET("avx512f")
+static void intersectsSpheresAvx512(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const PlanesSoa p(planes);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128 s[16];
+        for (size_t k = 0; k < 4; k++) {
+            load4(b + i + 4 * k, s[k], s[4 + k], s[8 + k], s[12 + k]);
+        }
+        const __m512 sx = combine(combine(s[0],  s[1]),  combine(s[2],  s[3]));
+        const __m512 sy = combine(combine(s[4],  s[5]),  combine(s[6],  s[7]));
+        const __m512 sz = combine(combine(s[8],  s[9]),  combine(s[10], s[11]));
+        const __m512 sr = combine(combine(s[12], s[13]), combine(s[14], s[15]));
+        __m512 visible = _mm512_castsi512_ps(_mm512_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m512 dot = _mm512_mul_ps(_mm512_set1_ps(p.x[j]), sx);
+            dot = _mm512_add_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.y[j]), sy));
+            dot = _mm512_add_ps(dot, _mm512_mul_ps(_mm512_set1_ps(p.z[j]), sz));
+            dot = _mm512_add_ps(dot, _mm512_set1_ps(p.w[j]));
+            dot = _mm512_sub_ps(dot, sr);
+            visible = andps(visible, dot);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(results + i), packSignBits(visible, 1));
+    }
+    if (i < count) {
+        // count is a multiple of 8, so we have 8 items left at most
+        intersectsSpheresAvx2(results + i, planes, b + i, count - i);
+    }
+}
+
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuidex(r, int(leaf), int(subleaf));
+    regs[0] = uint32_t(r[0]);
+    regs[1] = uint32_t(r[1]);
+    regs[2] = uint32_t(r[2]);
+    regs[3] = uint32_t(r[3]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t xgetbv() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (uint64_t(hi) << 32) | lo;
+#endif
+}
+
+#endif // CULLER_X86
+
+// ------------------------------------------------------------------------------------------------
+// ARM kernels
+// ------------------------------------------------------------------------------------------------
+
+#if defined(CULLER_NEON)
+
+static inline uint32x4_t boxes4(PlanesSoa const& p, float3 const* center, float3 const* extent) noexcept {
+    const float32x4x3_t c = vld3q_f32(&center[0].x);
+    const float32x4x3_t e = vld3q_f32(&extent[0].x);
+    uint32x4_t visible = vdupq_n_u32(~0u);
+    for (size_t j = 0; j < 6; j++) {
+        float32x4_t dot = vmulq_n_f32(c.val[0], p.x[j]);
+        dot = vsubq_f32(dot, vmulq_n_f32(e.val[0], p.ax[j]));
+        dot = vaddq_f32(dot, vmulq_n_f32(c.val[1], p.y[j]));
+        dot = vsubq_f32(dot, vmulq_n_f32(e.val[1], p.ay[j]));
+        dot = vaddq_f32(dot, vmulq_n_f32(c.val[2], p.z[j]));
+        dot = vsubq_f32(dot, vmulq_n_f32(e.val[2], p.az[j]));
+        dot = vaddq_f32(dot, vdupq_n_f32(p.w[j]));
+        visible = vandq_u32(visible, vreinterpretq_u32_f32(dot));
+    }
+    return vshrq_n_u32(visible, 31);
+}
+
+static inline uint32x4_t spheres4(PlanesSoa const& p, float4 const* b) noexcept {
+    const float32x4x4_t s = vld4q_f32(&b[0].x);
+    uint32x4_t visible = vdupq_n_u32(~0u);
+    for (size_t j = 0; j < 6; j++) {
+        float32x4_t dot = vmulq_n_f32(s.val[0], p.x[j]);
+        dot = vaddq_f32(dot, vmulq_n_f32(s.val[1], p.y[j]));
+        dot = vaddq_f32(dot, vmulq_n_f32(s.val[2], p.z[j]));
+        dot = vaddq_f32(dot, vdupq_n_f32(p.w[j]));
+        dot = vsubq_f32(dot, s.val[3]);
+        visible = vandq_u32(visible, vreinterpretq_u32_f32(dot));
+    }
+    return vshrq_n_u32(visible, 31);
+}
+
+static inline uint8x8_t pack(uint32x4_t lo, uint32x4_t hi) noexcept {
+    return vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+
+static void intersectsBoxesNeon(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    const PlanesSoa p(planes);
+    const int8x8_t shift = vdup_n_s8(int8_t(bit));
+    for (size_t i = 0; i < count; i += 8) {
+        const uint32x4_t v0 = boxes4(p, center + i,     extent + i);
+        const uint32x4_t v1 = boxes4(p, center + i + 4, extent + i + 4);
+        const uint8x8_t r = vshl_u8(pack(v0, v1), shift);
+        vst1_u8(results + i, vorr_u8(vld1_u8(results + i), r));
+    }
+}
+
+static void intersectsSpheresNeon(
+        result_type* UTILS_RESTRICT results,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    const PlanesSoa p(planes);
+    for (size_t i = 0; i < count; i += 8) {
+        vst1_u8(results + i, pack(spheres4(p, b + i), spheres4(p, b + i + 4)));
+    }
+}
+
+#endif // CULLER_NEON
+
+// ------------------------------------------------------------------------------------------------
+// Runtime dispatch
+// ------------------------------------------------------------------------------------------------
+
+struct Kernels {
+    BoxesKernel boxes;
+    SpheresKernel spheres;
+};
+
+static bool isIsaSupported(Culler::Isa isa) noexcept {
+    switch (isa) {
+        case Culler::Isa::SCALAR:
+            return true;
+#if defined(CULLER_X86)
+        case Culler::Isa::SSE4:
+        case Culler::Isa::AVX2:
+        case Culler::Isa::AVX512: {
+            struct Features {
+                bool sse4 = false;
+                bool avx2 = false;
+                bool avx512 = false;
+                Features() noexcept {
+                    uint32_t regs[4];
+                    cpuid(0, 0, regs);
+                    const uint32_t maxLeaf = regs[0];
+                    cpuid(1, 0, regs);
+                    sse4 = (regs[2] & (1u << 19)) != 0;
+                    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+                    const bool avx = (regs[2] & (1u << 28)) != 0;
+                    // the OS must save the YMM (and ZMM) registers on context switches
+                    const uint64_t xcr0 = osxsave ? xgetbv() : 0;
+                    const bool ymm = avx && (xcr0 & 0x06) == 0x06;
+                    const bool zmm = ymm && (xcr0 & 0xE0) == 0xE0;
+                    if (maxLeaf >= 7) {
+                        cpuid(7, 0, regs);
+                        avx2 = ymm && (regs[1] & (1u << 5)) != 0;
+                        avx512 = zmm && avx2 && (regs[1] & (1u << 16)) != 0;
+                    }
+                }
+            };
+            static const Features features;
+            return isa == Culler::Isa::SSE4 ? features.sse4 :
+                   isa == Culler::Isa::AVX2 ? features.avx2 : features.avx512;
+        }
+#endif
+#if defined(CULLER_NEON)
+        case Culler::Isa::NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+static Kernels getKernels(Culler::Isa isa) noexcept {
+    switch (isa) {
+#if defined(CULLER_X86)
+        case Culler::Isa::SSE4:
+            return { intersectsBoxesSse4, intersectsSpheresSse4 };
+        case Culler::Isa::AVX2:
+            return { intersectsBoxesAvx2, intersectsSpheresAvx2 };
+        case Culler::Isa::AVX512:
+            return { intersectsBoxesAvx512, intersectsSpheresAvx512 };
+#endif
+#if defined(CULLER_NEON)
+        case Culler::Isa::NEON:
+            return { intersectsBoxesNeon, intersectsSpheresNeon };
+#endif
+        default:
+            return { intersectsBoxesScalar, intersectsSpheresScalar };
+    }
+}
+
+static Culler::Isa selectIsa() noexcept {
+    // in order of preference
+    for (Culler::Isa isa : { Culler::Isa::AVX512, Culler::Isa::AVX2,
+                             Culler::Isa::SSE4, Culler::Isa::NEON }) {
+        if (isIsaSupported(isa)) {
+            return isa;
+        }
+    }
+    return Culler::Isa::SCALAR;
+}
+
+static Kernels const& kernels() noexcept {
+    static const Kernels sKernels = getKernels(selectIsa());
+    return sKernels;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+Culler::Isa Culler::getIsa() noexcept {
+    static const Isa sIsa = selectIsa();
+    return sIsa;
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float4 const* UTILS_RESTRICT b,
+        size_t count) noexcept {
+    count = round(count); // capacity guaranteed to be multiple of 8
+    kernels().spheres(results, frustum.mPlanes, b, count);
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    count = round(count); // capacity guaranteed to be multiple of 8
+    kernels().boxes(results, frustum.mPlanes, center, extent, count, bit);
+}
+
 /*
  * returns whether a box intersects with the frustum
  */
@@ -119,20 +675,79 @@ bool Culler::intersects(Frustum const& frustum, math::float4 const& sphere) noex
 
 // For testing...
 
-void Culler::Test::intersects(
+static constexpr Culler::Isa ALL_ISAS[] = {
+        Culler::Isa::SCALAR, Culler::Isa::SSE4, Culler::Isa::AVX2,
+        Culler::Isa::AVX512, Culler::Isa::NEON };
+
+bool Culler::Test::isSupported(Isa isa) noexcept {
+    return isIsaSupported(isa);
+}
+
+bool Culler::Test::intersects(
         result_type* UTILS_RESTRICT results,
         Frustum const& UTILS_RESTRICT frustum,
         math::float3 const* UTILS_RESTRICT c,
         math::float3 const* UTILS_RESTRICT e,
         size_t count) noexcept {
     Culler::intersects(results, frustum, c, e, count, 0);
+
+    const size_t capacity = round(count);
+    std::unique_ptr<result_type[]> expected(new result_type[capacity]());
+    std::unique_ptr<result_type[]> actual(new result_type[capacity]);
+    getKernels(Isa::SCALAR).boxes(expected.get(), frustum.getNormalizedPlanes(), c, e, capacity, 0);
+    bool same = true;
+    for (Isa isa : ALL_ISAS) {
+        if (isa != Isa::SCALAR && isIsaSupported(isa)) {
+            std::fill_n(actual.get(), capacity, result_type(0));
+            getKernels(isa).boxes(actual.get(), frustum.getNormalizedPlanes(), c, e, capacity, 0);
+            same = same && !memcmp(expected.get(), actual.get(), count);
+        }
+    }
+    return same;
 }
 
-void Culler::Test::intersects(
+bool Culler::Test::intersects(
         result_type* UTILS_RESTRICT results,
         Frustum const& UTILS_RESTRICT frustum,
         math::float4 const* UTILS_RESTRICT b, size_t count) noexcept {
     Culler::intersects(results, frustum, b, count);
+
+    const size_t capacity = round(count);
+    std::unique_ptr<result_type[]> expected(new result_type[capacity]);
+    std::unique_ptr<result_type[]> actual(new result_type[capacity]);
+    getKernels(Isa::SCALAR).spheres(expected.get(), frustum.getNormalizedPlanes(), b, capacity);
+    bool same = true;
+    for (Isa isa : ALL_ISAS) {
+        if (isa != Isa::SCALAR && isIsaSupported(isa)) {
+            getKernels(isa).spheres(actual.get(), frustum.getNormalizedPlanes(), b, capacity);
+            same = same && !memcmp(expected.get(), actual.get(), count);
+        }
+    }
+    return same;
+}
+
+bool Culler::Test::intersects(Isa isa,
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float3 const* UTILS_RESTRICT c,
+        math::float3 const* UTILS_RESTRICT e,
+        size_t count) noexcept {
+    if (!isIsaSupported(isa)) {
+        return false;
+    }
+    getKernels(isa).boxes(results, frustum.getNormalizedPlanes(), c, e, round(count), 0);
+    return true;
+}
+
+bool Culler::Test::intersects(Isa isa,
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float4 const* UTILS_RESTRICT b, size_t count) noexcept {
+    if (!isIsaSupported(isa)) {
+        return false;
+    }
+    getKernels(isa).spheres(results, frustum.getNormalizedPlanes(), b, round(count));
+    return true;
 }
 
 } // namespace details
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/CullingHierarchy.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <assert.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+static_assert(CullingHierarchy::LEAF_SIZE % Culler::MODULO == 0,
+        "LEAF_SIZE must be a multiple of Culler::MODULO");
+
+CullingHierarchy::CullingHierarchy() noexcept = default;
+
+CullingHierarchy::~CullingHierarchy() noexcept = default;
+
+void CullingHierarchy::clear() noexcept {
+    mItems.clear();
+    mItemCount = 0;
+    mNodes.clear();
+    mBuildSurfaceArea = 0;
+}
+
+bool CullingHierarchy::update(float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        Instance const* UTILS_RESTRICT instances, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    if (UTILS_UNLIKELY(count != getItemCount() || mNodes.empty())) {
+        build(center, extent, instances, count);
+        return true;
+    }
+
+    float3* const UTILS_RESTRICT itemCenter = mItems.data<CENTER>();
+    float3* const UTILS_RESTRICT itemExtent = mItems.data<EXTENT>();
+    uint32_t const* const UTILS_RESTRICT itemIndex = mItems.data<INDEX>();
+    Instance const* const UTILS_RESTRICT itemInstance = mItems.data<INSTANCE>();
+
+    // refit the leaves, only the ones whose items moved are marked dirty
+    bool changed = false;
+    Node* const nodes = mNodes.data();
+    for (size_t i = 0, c = mNodes.size(); i < c; i++) {
+        Node& node = nodes[i];
+        node.dirty = 0;
+        if (node.right) {
+            continue;
+        }
+        for (size_t k = node.first, e = node.first + node.count; k < e; k++) {
+            const uint32_t j = itemIndex[k];
+            if (UTILS_UNLIKELY(instances[j] != itemInstance[k])) {
+                // the source arrays have been reordered (entities or components were added
+                // or removed), our indices are meaningless.
+                build(center, extent, instances, count);
+                return true;
+            }
+            if (center[j] != itemCenter[k] || extent[j] != itemExtent[k]) {
+                itemCenter[k] = center[j];
+                itemExtent[k] = extent[j];
+                node.dirty = 1;
+            }
+        }
+    }
+
+    // propagate bottom-up, children are always stored after their parent
+    for (size_t i = mNodes.size(); i-- > 0;) {
+        Node& node = nodes[i];
+        if (node.right) {
+            node.dirty = nodes[i + 1].dirty | nodes[node.right].dirty;
+        }
+        if (node.dirty) {
+            computeNodeBounds(node);
+            changed = true;
+        }
+    }
+
+    // moving objects make the tree looser over time, start over when it gets too bad
+    if (changed && computeSurfaceArea() > mBuildSurfaceArea * REBUILD_SURFACE_AREA_RATIO) {
+        build(center, extent, instances, count);
+        return true;
+    }
+    return false;
+}
+
+void CullingHierarchy::build(float3 const* center, float3 const* extent,
+        Instance const* instances, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    mNodes.clear();
+    mItems.clear();
+    mItemCount = count;
+    if (count == 0) {
+        mBuildSurfaceArea = 0;
+        return;
+    }
+
+    // the leaf test reads up to Culler::MODULO-1 items past the end of the last leaf, so
+    // these padding items are part of mItems
+    mItems.resize(count + Culler::MODULO);
+
+    uint32_t* const indices = mItems.data<INDEX>();
+    for (uint32_t i = 0; i < count; i++) {
+        indices[i] = i;
+    }
+
+    mNodes.reserve(2 * (count + LEAF_SIZE - 1) / LEAF_SIZE);
+    buildRecursive(indices, 0, uint32_t(count), center);
+
+    float3* const UTILS_RESTRICT itemCenter = mItems.data<CENTER>();
+    float3* const UTILS_RESTRICT itemExtent = mItems.data<EXTENT>();
+    Instance* const UTILS_RESTRICT itemInstance = mItems.data<INSTANCE>();
+    for (size_t k = 0; k < count; k++) {
+        const uint32_t j = indices[k];
+        itemCenter[k] = center[j];
+        itemExtent[k] = extent[j];
+        itemInstance[k] = instances[j];
+    }
+    for (size_t k = count, e = count + Culler::MODULO; k < e; k++) {
+        itemCenter[k] = 0;
+        itemExtent[k] = 0;
+        indices[k] = 0;
+        itemInstance[k] = {};
+    }
+
+    Node* const nodes = mNodes.data();
+    for (size_t i = mNodes.size(); i-- > 0;) {
+        computeNodeBounds(nodes[i]);
+    }
+
+    mBuildSurfaceArea = computeSurfaceArea();
+}
+
+uint32_t CullingHierarchy::buildRecursive(uint32_t* indices, uint32_t first, uint32_t count,
+        float3 const* center) noexcept {
+    const uint32_t index = uint32_t(mNodes.size());
+    mNodes.push_back({ {}, {}, first, count, 0, 0 });
+    if (count <= LEAF_SIZE) {
+        return index;
+    }
+
+    // split along the largest axis of the centers' bounds, at the median
+    float3 lo = std::numeric_limits<float>::max();
+    float3 hi = std::numeric_limits<float>::lowest();
+    for (size_t k = first, e = first + count; k < e; k++) {
+        lo = min(lo, center[indices[k]]);
+        hi = max(hi, center[indices[k]]);
+    }
+    const float3 size = hi - lo;
+    const size_t axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+
+    // keep the left side a multiple of the leaf size, so that leaves are as full as possible
+    uint32_t half = ((count / 2) + LEAF_SIZE - 1) & ~uint32_t(LEAF_SIZE - 1);
+    half = std::min(half, count - 1);
+    std::nth_element(indices + first, indices + first + half, indices + first + count,
+            [center, axis](uint32_t lhs, uint32_t rhs) {
+                return center[lhs][axis] < center[rhs][axis];
+            });
+
+    buildRecursive(indices, first, half, center);
+    const uint32_t right = buildRecursive(indices, first + half, count - half, center);
+    mNodes[index].right = right;
+    return index;
+}
+
+void CullingHierarchy::computeNodeBounds(Node& node) const noexcept {
+    float3 lo = std::numeric_limits<float>::max();
+    float3 hi = std::numeric_limits<float>::lowest();
+    if (node.right) {
+        Node const& l = (&node)[1];
+        Node const& r = mNodes[node.right];
+        lo = min(l.center - l.extent, r.center - r.extent);
+        hi = max(l.center + l.extent, r.center + r.extent);
+    } else {
+        float3 const* const UTILS_RESTRICT itemCenter = mItems.data<CENTER>();
+        float3 const* const UTILS_RESTRICT itemExtent = mItems.data<EXTENT>();
+        for (size_t k = node.first, e = node.first + node.count; k < e; k++) {
+            lo = min(lo, itemCenter[k] - itemExtent[k]);
+            hi = max(hi, itemCenter[k] + itemExtent[k]);
+        }
+    }
+    node.center = (hi + lo) * 0.5f;
+    node.extent = (hi - lo) * 0.5f;
+}
+
+float CullingHierarchy::computeSurfaceArea() const noexcept {
+    float area = 0;
+    for (Node const& node : mNodes) {
+        float3 const& e = node.extent;
+        area += e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+    return area;
+}
+
+CullingHierarchy::Classification CullingHierarchy::classify(float4 const* planes,
+        float3 const& center, float3 const& extent) noexcept {
+    // same convention as Culler: a point is inside when it's behind all 6 planes
+    bool inside = true;
+    for (size_t j = 0; j < 6; j++) {
+        const float d = dot(planes[j].xyz, center) + planes[j].w;
+        const float r = dot(abs(planes[j].xyz), extent);
+        if (d - r > 0) {
+            return Classification::OUTSIDE;
+        }
+        inside &= (d + r < 0);
+    }
+    return inside ? Classification::INSIDE : Classification::INTERSECTS;
+}
+
+void CullingHierarchy::cull(JobSystem& js, Culler::result_type* visibleMask,
+        Frustum const& frustum, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    if (UTILS_UNLIKELY(mNodes.empty())) {
+        return;
+    }
+
+    float4 const* const planes = frustum.getNormalizedPlanes();
+    Node const* const nodes = mNodes.data();
+
+    // Traverse the tree and collect the leaves that need to be tested as well as the subtrees
+    // that are entirely visible. The tree is reasonably balanced, so 64 levels is plenty.
+    std::vector<WorkItem>& workList = mWorkList;
+    workList.clear();
+    size_t workCount = 0;
+    uint32_t stack[64];
+    size_t sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        Node const& node = nodes[stack[--sp]];
+        Classification c = classify(planes, node.center, node.extent);
+        if (c == Classification::OUTSIDE) {
+            continue;
+        }
+        if (c == Classification::INSIDE || !node.right) {
+            workList.push_back({ node.first, node.count, c == Classification::INSIDE });
+            workCount += node.count;
+            continue;
+        }
+        assert(sp + 2 <= sizeof(stack) / sizeof(stack[0]));
+        stack[sp++] = node.right;
+        stack[sp++] = uint32_t(&node - nodes) + 1;
+    }
+
+    // when few items survived the traversal, it's not worth going wide
+    if (workCount < Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT * LEAF_SIZE) {
+        for (WorkItem const& item : workList) {
+            processWorkItem(item, visibleMask, frustum, bit);
+        }
+        return;
+    }
+
+    auto functor = [this, visibleMask, &frustum, bit](uint32_t index, uint32_t c) {
+        WorkItem const* const items = mWorkList.data();
+        for (size_t i = index, e = index + c; i < e; i++) {
+            processWorkItem(items[i], visibleMask, frustum, bit);
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(workList.size()),
+            std::ref(functor), jobs::CountSplitter<Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.runAndWait(job);
+}
+
+void CullingHierarchy::processWorkItem(WorkItem const& item,
+        Culler::result_type* UTILS_RESTRICT visibleMask,
+        Frustum const& frustum, size_t bit) const noexcept {
+    uint32_t const* const UTILS_RESTRICT itemIndex = mItems.data<INDEX>() + item.first;
+    if (item.inside) {
+        const Culler::result_type visible = Culler::result_type(1u << bit);
+        for (size_t k = 0; k < item.count; k++) {
+            visibleMask[itemIndex[k]] |= visible;
+        }
+    } else {
+        // leaves have at most LEAF_SIZE items, which is a multiple of Culler::MODULO
+        Culler::result_type results[LEAF_SIZE] = {};
+        Culler::intersects(results, frustum,
+                mItems.data<CENTER>() + item.first,
+                mItems.data<EXTENT>() + item.first, item.count, bit);
+        for (size_t k = 0; k < item.count; k++) {
+            visibleMask[itemIndex[k]] |= results[k];
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
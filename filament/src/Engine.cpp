@@ -33,6 +33,10 @@
 #include "details/View.h"
 #include "driver/Program.h"
 
+#if defined(FILAMENT_ENABLE_CAPTURE)
+#include "driver/capture/CaptureDriver.h"
+#endif
+
 #include "PrecompiledMaterials.h"
 
 #include <filament/Exposure.h>
@@ -85,6 +89,9 @@ FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void
     if (!UTILS_HAS_THREADING) {
         instance->mExternalContext = ExternalContext::create(&instance->mBackend);
         instance->mDriver = instance->mExternalContext->createDriver(sharedGLContext);
+#if defined(FILAMENT_ENABLE_CAPTURE)
+        instance->mDriver = CaptureDriver::create(std::move(instance->mDriver));
+#endif
         instance->init();
         instance->execute();
         return instance;
@@ -144,7 +151,7 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
         mSharedGLContext(sharedGLContext),
         mEntityManager(EntityManager::get()),
         mRenderableManager(*this),
-        mTransformManager(),
+        mTransformManager(&mJobSystem),
         mLightManager(*this),
         mCameraManager(*this),
         mPerViewUib(PerViewUib::getUib()),
@@ -153,7 +160,9 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
         mPostProcessUib(PostProcessingUib::getUib()),
         mPostProcessSib(PostProcessSib::getSib()),
         mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
-        mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE),
+        mPerRenderPassAllocators{
+                { "per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE },
+                { "per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE } },
         mEpoch(std::chrono::steady_clock::now()),
         mDriverBarrier(1)
 {
@@ -327,7 +336,11 @@ void FEngine::prepare() {
     // UBOs that are visible only. It's not such a big issue because the actual upload() is
     // skipped is the UBO hasn't changed. Still we could have a lot of these.
     for (auto& materialInstanceList : mMaterialInstances) {
+        const bool customDepth = materialInstanceList.first->hasCustomDepthShader();
         for (auto& item : materialInstanceList.second) {
+            if (customDepth && item->isDirty()) {
+                mDepthMaterialsGeneration++;
+            }
             item->commit(*this);
         }
     }
@@ -368,6 +381,9 @@ int FEngine::loop() {
 #endif
     }
     mDriver = mExternalContext->createDriver(mSharedGLContext);
+#if defined(FILAMENT_ENABLE_CAPTURE)
+    mDriver = CaptureDriver::create(std::move(mDriver));
+#endif
     mDriverBarrier.latch();
     if (UTILS_UNLIKELY(!mDriver)) {
         // if we get here, it's because the driver couldn't be initialized and the problem has
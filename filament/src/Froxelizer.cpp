@@ -44,13 +44,6 @@ using namespace driver;
 
 namespace details {
 
-/*
- * This enables froxels to be rectangular which allows us to use a but more froxel
- * with the same amount of memory in the GPU.
- * This requires backward compatibility breaking changes in the shaders.
- */
-static constexpr bool SUPPORTS_NON_SQUARE_FROXELS = false;
-
 /*
  * This changes the layout of the froxel info on the GPU such that it is more cache friendly,
  * i.e. the major axis is Z instead of X, because in a given froxel there is more chance to
@@ -69,43 +62,57 @@ constexpr size_t FROXEL_BUFFER_WIDTH        = 1u << FROXEL_BUFFER_WIDTH_SHIFT;
 constexpr size_t FROXEL_BUFFER_WIDTH_MASK   = FROXEL_BUFFER_WIDTH - 1u;
 constexpr size_t FROXEL_BUFFER_HEIGHT       = (FROXEL_BUFFER_ENTRY_COUNT_MAX + FROXEL_BUFFER_WIDTH_MASK) / FROXEL_BUFFER_WIDTH;
 
-constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 5u;
+constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 6u;
 constexpr size_t RECORD_BUFFER_WIDTH        = 1u << RECORD_BUFFER_WIDTH_SHIFT;
 constexpr size_t RECORD_BUFFER_WIDTH_MASK   = RECORD_BUFFER_WIDTH - 1u;
 
 constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
-constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
+constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 128K
 
 // Buffer needed for Froxelizer internal data structures (~256 KiB)
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
                                                  (FROXEL_BUFFER_ENTRY_COUNT_MAX +
                                                   FROXEL_BUFFER_ENTRY_COUNT_MAX + 3 +
-                                                  FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
+                                                  FROXEL_SLICE_COUNT_MAX / 4 + 1);
+
+// smallest froxel budget used when the froxel count adapts to the number of lights
+static constexpr size_t MIN_ADAPTIVE_FROXEL_COUNT = 1024;
+
+// froxels used per light when the froxel count adapts to the number of lights, i.e. the full
+// budget of 8192 froxels is used with 32 lights or more
+static constexpr size_t ADAPTIVE_FROXEL_COUNT_PER_LIGHT = 256;
 
 
 // number of lights processed by one group (e.g. 32)
 static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8;
 
-// number of groups (i.e. jobs) to use for froxelization (e.g. 8)
+// number of groups (i.e. jobs) to use for froxelization (e.g. 16)
 static constexpr size_t GROUP_COUNT =
         (CONFIG_MAX_LIGHT_COUNT + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
 
+// minimum number of froxels processed by a job when merging the groups' data
+static constexpr size_t MERGE_FROXEL_COUNT = 512;
+
 
-// record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
-// so its maximum size is 128 KiB
-static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
-        "RecordBuffer cannot be larger than 65536 entries");
+// record buffer offsets are stored on 32 bits in the froxel buffer, but its height is limited
+// by the supported texture dimension, like the froxel buffer.
+static_assert(RECORD_BUFFER_HEIGHT <= 2048,
+        "RecordBuffer cannot be taller than 2048 rows");
+
+// the froxelization groups of light indices are interleaved with a mask (see below)
+static_assert((GROUP_COUNT & (GROUP_COUNT - 1)) == 0,
+        "CONFIG_MAX_LIGHT_COUNT / LIGHT_PER_GROUP must be a power of two");
 
 Froxelizer::Froxelizer(FEngine& engine)
         : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
 
     DriverApi& driverApi = engine.getDriverApi();
 
-    // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
+    // light indices are uint8_t with up to 256 lights, uint16_t otherwise
     GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
                                   ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
     mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
-    mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
+    mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT32, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
 }
 
@@ -134,6 +141,19 @@ void Froxelizer::setOptions(float zLightNear, float zLightFar) noexcept {
     }
 }
 
+void Froxelizer::setFroxelOptions(size_t froxelCount, size_t sliceCount, bool adaptive) noexcept {
+    sliceCount = std::min(std::max(sliceCount, size_t(2)), FROXEL_SLICE_COUNT_MAX);
+    // we need at least one froxel per slice
+    froxelCount = std::min(std::max(froxelCount, sliceCount), FROXEL_BUFFER_ENTRY_COUNT_MAX);
+    if (UTILS_UNLIKELY(mMaxFroxelCount != froxelCount || mSliceCount != sliceCount ||
+                       mAdaptive != adaptive)) {
+        mMaxFroxelCount = uint16_t(froxelCount);
+        mFroxelBudget = uint16_t(froxelCount);
+        mSliceCount = uint8_t(sliceCount);
+        mAdaptive = adaptive;
+        mDirtyFlags |= VIEWPORT_CHANGED;
+    }
+}
 
 void Froxelizer::setViewport(Viewport const& viewport) noexcept {
     if (UTILS_UNLIKELY(mViewport != viewport)) {
@@ -152,10 +172,24 @@ void Froxelizer::setProjection(const mat4f& projection, float near, float far) n
 
 bool Froxelizer::prepare(
         FEngine::DriverApi& driverApi, ArenaScope& arena, Viewport const& viewport,
-        const math::mat4f& projection, float projectionNear, float projectionFar) noexcept {
+        const math::mat4f& projection, float projectionNear, float projectionFar,
+        size_t lightCount) noexcept {
     setViewport(viewport);
     setProjection(projection, projectionNear, projectionFar);
 
+    if (mAdaptive) {
+        // The budget grows as soon as more lights are visible, but only shrinks when the light
+        // count is well below the threshold, so a light count oscillating around a threshold
+        // doesn't cause the froxel grid to be recomputed every frame.
+        const size_t maxFroxelCount = mMaxFroxelCount;
+        const size_t budget = computeAdaptiveFroxelCount(lightCount, maxFroxelCount);
+        if (UTILS_UNLIKELY(budget > mFroxelBudget ||
+                computeAdaptiveFroxelCount(lightCount * 2, maxFroxelCount) < mFroxelBudget)) {
+            mFroxelBudget = uint16_t(budget);
+            mDirtyFlags |= VIEWPORT_CHANGED;
+        }
+    }
+
     bool uniformsNeedUpdating = false;
     if (UTILS_UNLIKELY(mDirtyFlags)) {
         uniformsNeedUpdating = update();
@@ -166,12 +200,14 @@ bool Froxelizer::prepare(
      * the command stream.
      */
 
-    // froxel buffer (~32 KiB)
+    // froxel buffer (~64 KiB max), rounded up to whole rows of the GPU buffer
+    const size_t froxelBufferEntryCount =
+            (getFroxelCount() + FROXEL_BUFFER_WIDTH_MASK) & ~FROXEL_BUFFER_WIDTH_MASK;
     mFroxelBufferUser = {
-            driverApi.allocatePod<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
-            FROXEL_BUFFER_ENTRY_COUNT_MAX };
+            driverApi.allocatePod<FroxelEntry>(froxelBufferEntryCount, CACHELINE_SIZE),
+            uint32_t(froxelBufferEntryCount) };
 
-    // record buffer (~64 KiB)
+    // record buffer (~256 KiB)
     mRecordBufferUser = {
             driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT, CACHELINE_SIZE),
             RECORD_BUFFER_ENTRY_COUNT };
@@ -180,12 +216,12 @@ bool Froxelizer::prepare(
      * Temporary allocations for processing all froxel data
      */
 
-    // light records per froxel (~256 KiB)
+    // light records per froxel (~512 KiB)
     mLightRecords = {
             arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // froxel thread data (~256 KiB)
+    // froxel thread data (~512 KiB)
     mFroxelShardedData = {
             arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
             uint32_t(GROUP_COUNT)
@@ -207,44 +243,45 @@ bool Froxelizer::prepare(
 
 void Froxelizer::computeFroxelLayout(
         uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-        Viewport const& viewport) noexcept {
-
-    if (SUPPORTS_NON_SQUARE_FROXELS == false) {
-        // calculate froxel dimension from FROXEL_BUFFER_ENTRY_COUNT_MAX and viewport
-        // - Start from the maximum number of froxels we can use in the x-y plane
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
-        size_t froxelPlaneCount = FROXEL_BUFFER_ENTRY_COUNT_MAX / froxelSliceCount;
-        // - compute the number of square froxels we need in width and height, rounded down
-        //   solving: |  froxelCountX * froxelCountY == froxelPlaneCount
-        //            |  froxelCountX / froxelCountY == width / height
-        size_t froxelCountX = size_t(std::sqrt(froxelPlaneCount * viewport.width  / viewport.height));
-        size_t froxelCountY = size_t(std::sqrt(froxelPlaneCount * viewport.height / viewport.width));
-        // - copmute the froxels dimensions, rounded up
-        size_t froxelSizeX = (viewport.width  + froxelCountX - 1) / froxelCountX;
-        size_t froxelSizeY = (viewport.height + froxelCountY - 1) / froxelCountY;
-        // - and since our froxels must be square, only keep the largest dimension
-        size_t froxelDimension = std::max(froxelSizeX, froxelSizeY);
-
-        // Here we recompute the froxel counts which may have changed a little due to the rounding
-        // and the squareness requirement of froxels
-        froxelCountX = (viewport.width  + froxelDimension - 1) / froxelDimension;
-        froxelCountY = (viewport.height + froxelDimension - 1) / froxelDimension;
-
-        *dim = froxelDimension;
-        *countX = uint16_t(froxelCountX);
-        *countY = uint16_t(froxelCountY);
-        *countZ = uint16_t(froxelSliceCount);
-    } else {
-        // TODO: don't hardcode this
-        *countX = uint16_t(32);
-        *countY = uint16_t(16);
-        if (viewport.height > viewport.width) {
-            std::swap(*countX, *countY);
-        }
-        *countZ = uint16_t(FEngine::CONFIG_FROXEL_SLICE_COUNT);
-         dim->x = (viewport.width  + *countX - 1) / *countX;
-         dim->y = (viewport.height + *countY - 1) / *countY;
+        Viewport const& viewport, size_t froxelCount, size_t sliceCount) noexcept {
+
+    const size_t width  = std::max(viewport.width,  uint32_t(1));
+    const size_t height = std::max(viewport.height, uint32_t(1));
+
+    // calculate froxel dimension from the froxel budget and viewport
+    // - Start from the maximum number of froxels we can use in the x-y plane
+    const size_t froxelPlaneCount = std::max(froxelCount / sliceCount, size_t(1));
+    // - compute the number of froxels we need in width, rounded down
+    //   solving: |  froxelCountX * froxelCountY == froxelPlaneCount
+    //            |  froxelCountX / froxelCountY == width / height
+    size_t froxelCountX = size_t(std::sqrt(float(froxelPlaneCount * width) / height));
+    // - froxels can't be smaller than a pixel, and minMaxX in update() limits us to 2048
+    froxelCountX = std::min(std::max(froxelCountX, size_t(1)), std::min(width, size_t(2048)));
+    froxelCountX = std::min(froxelCountX, froxelPlaneCount);
+    // - give the rest of the budget to the height, instead of rounding it down as well
+    size_t froxelCountY = std::min(froxelPlaneCount / froxelCountX, height);
+    // - compute the froxels dimensions, rounded up
+    const size_t froxelSizeX = (width  + froxelCountX - 1) / froxelCountX;
+    const size_t froxelSizeY = (height + froxelCountY - 1) / froxelCountY;
+
+    // Here we recompute the froxel counts which may have changed a little due to the rounding,
+    // they can only get smaller.
+    froxelCountX = (width  + froxelSizeX - 1) / froxelSizeX;
+    froxelCountY = (height + froxelSizeY - 1) / froxelSizeY;
+
+    *dim = uint2(uint32_t(froxelSizeX), uint32_t(froxelSizeY));
+    *countX = uint16_t(froxelCountX);
+    *countY = uint16_t(froxelCountY);
+    *countZ = uint16_t(sliceCount);
+}
+
+size_t Froxelizer::computeAdaptiveFroxelCount(size_t lightCount, size_t froxelCount) noexcept {
+    // round the light count to a power of two so the budget only takes a few values
+    size_t budget = MIN_ADAPTIVE_FROXEL_COUNT;
+    while (budget < froxelCount && budget < lightCount * ADAPTIVE_FROXEL_COUNT_PER_LIGHT) {
+        budget *= 2;
     }
+    return std::min(budget, froxelCount);
 }
 
 UTILS_NOINLINE
@@ -255,7 +292,8 @@ bool Froxelizer::update() noexcept {
 
         uint2 froxelDimension;
         uint16_t froxelCountX, froxelCountY, froxelCountZ;
-        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ, viewport);
+        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ,
+                viewport, mFroxelBudget, mSliceCount);
 
         mFroxelDimension = froxelDimension;
         mClipToFroxelX = (0.5f * viewport.width)  / froxelDimension.x;
@@ -265,12 +303,11 @@ bool Froxelizer::update() noexcept {
         uniformsNeedUpdating = true;
 
 #ifndef NDEBUG
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
         slog.d << "Froxel: " << viewport.width << "x" << viewport.height << " / "
                << froxelDimension.x << "x" << froxelDimension.y << io::endl
-               << "Froxel: " << froxelCountX << "x" << froxelCountY << "x" << froxelSliceCount
-               << " = " << (froxelCountX * froxelCountY * froxelSliceCount)
-               << " (" << FROXEL_BUFFER_ENTRY_COUNT_MAX - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
+               << "Froxel: " << froxelCountX << "x" << froxelCountY << "x" << froxelCountZ
+               << " = " << (froxelCountX * froxelCountY * froxelCountZ)
+               << " (" << mFroxelBudget - froxelCountX * froxelCountY * froxelCountZ << " lost)"
                << io::endl;
 #endif
 
@@ -539,7 +576,7 @@ void Froxelizer::froxelizeLights(FEngine& engine,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
     froxelizeLoop(engine, camera, lightData);
-    froxelizeAssignRecordsCompress();
+    froxelizeAssignRecordsCompress(engine.getJobSystem());
 
 #ifndef NDEBUG
     if (lightData.size()) {
@@ -571,7 +608,6 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
     SYSTRACE_CALL();
 
     Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-    memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
 
     auto& lcm = engine.getLightManager();
     auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
@@ -582,6 +618,12 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
                      spheres, directions, instances, &camera, &lcm ]
             (size_t count, size_t offset, size_t stride) {
 
+        // each job clears the data of the groups it processes, only the froxels in use (and
+        // the light types entry) are needed
+        for (size_t group = offset; group < GROUP_COUNT; group += stride) {
+            std::fill_n(froxelThreadData[group].data(), getFroxelCount() + 1, 0);
+        }
+
         const mat4f& projection = mProjection;
         const mat3f& vn = camera.view.upperLeft();
 
@@ -625,7 +667,7 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
     }
 }
 
-void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
+void Froxelizer::froxelizeAssignRecordsCompress(JobSystem& js) noexcept {
 
     SYSTRACE_CALL();
 
@@ -633,7 +675,7 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 
     // convert froxel data from N groups of M bits to LightRecord::bitset, so we can
     // easily compare adjacent froxels, for compaction. The conversion loops below get
-    // inlined and vectorized in release builds.
+    // inlined and vectorized in release builds. Only the froxels in use are converted.
 
     // keep these two loops separate, it helps the compiler a lot
     LightRecord::bitset spotLights;
@@ -647,28 +689,33 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
         spotLights.getBitsAt(i) = b;
     }
 
-    // this gets very well vectorized...
+    // this gets very well vectorized, and runs in parallel over the froxels
     utils::Slice<LightRecord> records(mLightRecords);
-    for (size_t j = 1, jc = FROXEL_BUFFER_ENTRY_COUNT_MAX; j < jc; j++) {
-        for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
-            using container_type = LightRecord::bitset::container_type;
-            constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
-            container_type b = froxelThreadData[i * r][j];
-            for (size_t k = 0; k < r; k++) {
-                b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+    auto merge = [&froxelThreadData, &records](uint32_t first, uint32_t count) {
+        for (size_t j = first + 1, jc = first + count + 1; j < jc; j++) {
+            for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
+                using container_type = LightRecord::bitset::container_type;
+                constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
+                container_type b = froxelThreadData[i * r][j];
+                for (size_t k = 0; k < r; k++) {
+                    b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+                }
+                records[j - 1].lights.getBitsAt(i) = b;
             }
-            records[j - 1].lights.getBitsAt(i) = b;
         }
-    }
+    };
+    auto jobMerge = jobs::parallel_for(js, nullptr, 0, uint32_t(getFroxelCount()),
+            std::cref(merge), jobs::CountSplitter<MERGE_FROXEL_COUNT, 8>());
+    js.runAndWait(jobMerge);
 
-    uint16_t offset = 0;
+    uint32_t offset = 0;
     FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
 
     const size_t froxelCountX = mFroxelCountX;
-    auto remap = [stride = size_t(froxelCountX * mFroxelCountY)](size_t i) -> size_t {
+    auto remap = [stride = size_t(froxelCountX * mFroxelCountY),
+                  froxelCountZ = size_t(mFroxelCountZ)](size_t i) -> size_t {
         if (SUPPORTS_REMAPPED_FROXELS) {
-            // TODO: with the non-square froxel change these would be mask ops instead of divide.
-            i = (i % stride) * FEngine::CONFIG_FROXEL_SLICE_COUNT + (i / stride);
+            i = (i % stride) * froxelCountZ + (i / stride);
         }
         return i;
     };
@@ -681,15 +728,15 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
     for (size_t i = 0, c = getFroxelCount(); i < c;) {
         LightRecord b = records[i];
         if (b.lights.none()) {
-            froxels[remap(i++)].u32 = 0;
+            froxels[remap(i++)].u64 = 0;
             continue;
         }
 
-        // We have a limitation of 255 spot + 255 point lights per froxel.
+        // We have a limitation of 65535 spot + 65535 point lights per froxel.
         FroxelEntry entry = {
                 .offset = offset,
-                .pointLightCount = (uint8_t)std::min(size_t(255), (b.lights & ~spotLights).count()),
-                .spotLightCount  = (uint8_t)std::min(size_t(255), (b.lights &  spotLights).count())
+                .pointLightCount = (uint16_t)std::min(size_t(65535), (b.lights & ~spotLights).count()),
+                .spotLightCount  = (uint16_t)std::min(size_t(65535), (b.lights &  spotLights).count())
         };
         const size_t lightCount = entry.count[0] + entry.count[1];
 
@@ -700,7 +747,7 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
             // note: instead of dropping froxels we could look for similar records we've already
             // filed up.
             do { // this compiles to memset() when remap() is identity
-                froxels[remap(i++)].u32 = 0;
+                froxels[remap(i++)].u64 = 0;
             } while(i < c);
             goto out_of_memory;
         }
@@ -722,9 +769,9 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
             l = (bit * GROUP_COUNT) | (word % GROUP_COUNT);
 
             *p = (RecordBufferType)l;
-            // we need to "cancel" the write if we have more than 255 spot or point lights
+            // we need to "cancel" the write if we have more than 65535 spot or point lights
             // (this is a limitation of the data type used to store the light counts per froxel)
-            p += (p - s < 255) ? 1 : 0;
+            p += (p - s < 65535) ? 1 : 0;
         });
 
         offset += lightCount;
@@ -736,7 +783,7 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
 #ifndef NDEBUG
             if (lightCount) { reused++; }
 #endif
-            froxels[remap(i++)].u32 = entry.u32;
+            froxels[remap(i++)].u64 = entry.u64;
             if (i >= c) break;
 
             if (records[i].lights != b.lights && i >= froxelCountX) {
@@ -744,14 +791,14 @@ void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
                 // we re-try with the record above it, which saves many froxel records
                 // (north of 10% in practice).
                 b = records[i - froxelCountX];
-                entry.u32 = froxels[remap(i - froxelCountX)].u32;
+                entry.u64 = froxels[remap(i - froxelCountX)].u64;
             }
         } while(records[i].lights == b.lights);
     }
 out_of_memory:
 
-    // froxel buffer is always fully invalidated
-    mFroxelBuffer.invalidate();
+    // froxel buffer is always fully invalidated, up to the number of froxels in use
+    mFroxelBuffer.invalidate(0, mFroxelBufferUser.size() >> FROXEL_BUFFER_WIDTH_SHIFT);
 
     // needed record buffer size may change at each frame
     mRecordsBuffer.invalidate(0, (offset + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT);
@@ -860,23 +907,20 @@ void Froxelizer::froxelizePointAndSpotLight(
                     cy = spherePlaneIntersection(cz, plane.y, plane.z);
                 }
                 if (cy.w > 0) { // intersection of light with this horizontal plane
-                    size_t bx, ex; // horizontal begin/end indices
-                    // find the begin index (left side)
-                    for (bx = x0; bx <= xcenter; ++bx) {
-                        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
-                            // intersection
-                            break;
-                        }
+                    // The planes that don't intersect the light are all on the outside of the
+                    // ones that do, i.e. they're the first ones on the left side and the last
+                    // ones on the right side. So, instead of looking for the first intersection
+                    // on each side, we count the planes that don't intersect, which is
+                    // branch-less and these loops get vectorized.
+                    size_t bx = x0; // horizontal begin index (left side)
+                    for (size_t ix = x0; ix <= xcenter; ++ix) {
+                        bx += spherePlaneDistanceSquared(cy, planesX[ix].x, planesX[ix].z) <= 0;
                     }
 
-                    // find the end index (right side), x1 is past the end
-                    for (ex = x1; --ex > xcenter;) {
-                        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
-                            // intersection
-                            break;
-                        }
+                    size_t ex = x1; // horizontal end index (right side), x1 is past the end
+                    for (size_t ix = xcenter + 1; ix < x1; ++ix) {
+                        ex -= spherePlaneDistanceSquared(cy, planesX[ix].x, planesX[ix].z) <= 0;
                     }
-                    ++ex;
 
                     if (UTILS_UNLIKELY(bx >= ex)) {
                         continue;
@@ -939,22 +983,20 @@ void Froxelizer::computeLightTree(
                 lightTree[index] = {
                         .min = min,
                         .max = max,
+                        .offset = uint32_t(lightRecordsOffset + col),
                         .next = uint16_t(next),
-                        .offset = uint16_t(lightRecordsOffset + col),
                         .isLeaf = 1,
                         .count = 1,
-                        .reserved = 0,
                 };
             },
             [lightTree](size_t index, size_t l, size_t r, size_t next) {
                 lightTree[index] = {
                         .min = std::min(lightTree[l].min, lightTree[r].min),
                         .max = std::max(lightTree[l].max, lightTree[r].max),
-                        .next = uint16_t(next),
                         .offset = 0,
+                        .next = uint16_t(next),
                         .isLeaf = 0,
                         .count = 0,
-                        .reserved = 0,
                 };
             });
 }
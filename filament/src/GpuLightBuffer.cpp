@@ -20,7 +20,7 @@
 
 #include <filament/EngineEnums.h>
 
-#include <private/filament/UibGenerator.h>
+#include <utils/architecture.h>
 
 namespace filament {
 
@@ -28,31 +28,37 @@ using namespace driver;
 
 namespace details {
 
+static constexpr size_t LIGHT_BUFFER_HEIGHT =
+        (CONFIG_MAX_LIGHT_COUNT + GpuLightBuffer::LIGHT_BUFFER_WIDTH_MASK) /
+                GpuLightBuffer::LIGHT_BUFFER_WIDTH;
+
+// each light is stored in 4 texels of a row
+static constexpr size_t TEXELS_PER_LIGHT =
+        sizeof(GpuLightBuffer::LightParameters) / sizeof(math::float4);
+
 GpuLightBuffer::GpuLightBuffer(FEngine& engine) noexcept
-        : mLightsUb(UibGenerator::getLightsUib()) {
-    DriverApi& driverApi = engine.getDriverApi();
-    mLightUbh = driverApi.createUniformBuffer(mLightsUb.getSize());
-    driverApi.bindUniforms(BindingPoints::LIGHTS, mLightUbh);
+        : mLightsBuffer(engine.getDriverApi(), { GPUBuffer::ElementType::FLOAT, 4 },
+                LIGHT_BUFFER_WIDTH * TEXELS_PER_LIGHT, LIGHT_BUFFER_HEIGHT) {
 }
 
 GpuLightBuffer::~GpuLightBuffer() noexcept = default;
 
 void GpuLightBuffer::terminate(FEngine& engine) {
-    DriverApi& driverApi = engine.getDriverApi();
-    driverApi.destroyUniformBuffer(mLightUbh);
+    mLightsBuffer.terminate(engine.getDriverApi());
 }
 
-void GpuLightBuffer::commit(FEngine& engine) noexcept {
-    if (UTILS_UNLIKELY(mLightsUb.isDirty())) {
-        commitSlow(engine);
-    }
-    engine.getDriverApi().bindUniforms(BindingPoints::LIGHTS, mLightUbh);
+void GpuLightBuffer::prepare(FEngine& engine, size_t count) noexcept {
+    assert(count <= CONFIG_MAX_LIGHT_COUNT);
+    // the data must stay valid until the driver consumes it, and the buffer is uploaded in
+    // whole rows.
+    count = (count + LIGHT_BUFFER_WIDTH_MASK) & ~LIGHT_BUFFER_WIDTH_MASK;
+    mLights = { engine.getDriverApi().allocatePod<LightParameters>(count, utils::CACHELINE_SIZE),
+            uint32_t(count) };
 }
 
-void GpuLightBuffer::commitSlow(FEngine& engine) noexcept {
-    DriverApi& driverApi = engine.getDriverApi();
-    driverApi.updateUniformBuffer(mLightUbh, UniformBuffer(mLightsUb));
-    mLightsUb.clean();
+void GpuLightBuffer::commit(FEngine& engine) noexcept {
+    mLightsBuffer.commit(engine.getDriverApi(), mLights);
+    mLights.clear();
 }
 
 } // namespace details
@@ -299,8 +299,8 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
             .withFragmentShader(fs)
             .withSamplerBindings(&mSamplerBindings)
             .addUniformBlock(BindingPoints::PER_VIEW, &UibGenerator::getPerViewUib())
-            .addUniformBlock(BindingPoints::LIGHTS, &UibGenerator::getLightsUib())
             .addUniformBlock(BindingPoints::PER_RENDERABLE, &UibGenerator::getPerRenderableUib())
+            .addUniformBlock(BindingPoints::PER_RENDERABLE_INSTANCES, &UibGenerator::getPerRenderableInstancesUib())
             .addUniformBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mUniformInterfaceBlock)
             .addSamplerBlock(BindingPoints::PER_VIEW, &SibGenerator::getPerViewSib())
             .addSamplerBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mSamplerInterfaceBlock);
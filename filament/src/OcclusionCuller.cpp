@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/OcclusionCuller.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <math.h>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+// value of the pixels not covered by an occluder, nothing can be behind them
+static constexpr float CLEAR_DEPTH = std::numeric_limits<float>::infinity();
+
+// silhouettes with a smaller area (in pixels) don't cover anything worth rasterizing
+static constexpr float MIN_SILHOUETTE_AREA = 1e-4f;
+
+// a box has 8 corners and 12 edges, each edge can cross the near plane
+static constexpr size_t MAX_SILHOUETTE_POINTS = 8 + 12;
+
+static inline float3 getCorner(float3 const& center, float3 const& extent, size_t i) noexcept {
+    return center + extent * float3{ (i & 1u) ? 1 : -1, (i & 2u) ? 1 : -1, (i & 4u) ? 1 : -1 };
+}
+
+// from clip space to depth buffer coordinates, z is NDC z
+static inline float3 toScreen(float4 const& p) noexcept {
+    const float iw = 1.0f / p.w;
+    return { (p.x * iw * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+             (p.y * iw * 0.5f + 0.5f) * OcclusionCuller::HEIGHT,
+             p.z * iw };
+}
+
+// signed distance to the near plane, in clip space (OpenGL convention)
+static inline float nearDistance(float4 const& p) noexcept {
+    return p.z + p.w;
+}
+
+static inline uint16_t clampPixel(float v, uint32_t size) noexcept {
+    return uint16_t(std::min(std::max(v, 0.0f), float(size)));
+}
+
+static inline float cross(float2 const& o, float2 const& a, float2 const& b) noexcept {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Convex hull of the points (monotone chain), counter-clockwise. 'hull' must have room for
+// 2 * count points, returns the number of points in the hull.
+static size_t convexHull(float2* points, size_t count, float2* hull) noexcept {
+    if (count < 3) {
+        return 0;
+    }
+    std::sort(points, points + count, [](float2 const& lhs, float2 const& rhs) {
+        return lhs.x < rhs.x || (lhs.x == rhs.x && lhs.y < rhs.y);
+    });
+    size_t k = 0;
+    for (size_t i = 0; i < count; i++) {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    for (size_t i = count - 1, lower = k + 1; i-- > 0;) {
+        while (k >= lower && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    // the last point is the first one
+    return k > 1 ? k - 1 : k;
+}
+
+OcclusionCuller::OcclusionCuller() noexcept
+        : mDepth(new float[WIDTH * HEIGHT]) {
+    std::fill_n(mDepth.get(), WIDTH * HEIGHT, CLEAR_DEPTH);
+    mOccluders.reserve(MAX_OCCLUDER_COUNT);
+    mEdges.reserve(MAX_OCCLUDER_COUNT * MAX_SILHOUETTE_POINTS);
+}
+
+OcclusionCuller::~OcclusionCuller() noexcept = default;
+
+void OcclusionCuller::reset(mat4f const& clipFromWorld) noexcept {
+    mClipFromWorld = clipFromWorld;
+    mOccluders.clear();
+    mEdges.clear();
+    mOccluderCount = 0;
+}
+
+bool OcclusionCuller::addOccluder(mat4f const& worldFromModel, Box const& box) noexcept {
+    if (mOccluderCount >= MAX_OCCLUDER_COUNT) {
+        return false;
+    }
+    mOccluderCount++;
+
+    const mat4f clipFromModel(mClipFromWorld * worldFromModel);
+    float4 corners[8];
+    for (size_t i = 0; i < 8; i++) {
+        corners[i] = clipFromModel * float4{ getCorner(box.center, box.halfExtent, i), 1.0f };
+    }
+
+    // The silhouette is the convex hull of the box clipped by the near plane, i.e. of the
+    // corners in front of it and of the points where the edges cross it. The other planes are
+    // taken care of by the pixel bounds.
+    float2 points[MAX_SILHOUETTE_POINTS];
+    size_t count = 0;
+    float zmin = std::numeric_limits<float>::max();
+    float zmax = std::numeric_limits<float>::lowest();
+    bool clipped = false;
+    auto addPoint = [&](float4 const& p) {
+        const float3 s = toScreen(p);
+        points[count++] = s.xy;
+        zmin = std::min(zmin, s.z);
+        zmax = std::max(zmax, s.z);
+    };
+    for (size_t i = 0; i < 8; i++) {
+        const float di = nearDistance(corners[i]);
+        if (di >= 0) {
+            addPoint(corners[i]);
+        }
+        for (size_t bit = 1; bit < 8; bit <<= 1u) {
+            const size_t j = i | bit;
+            const float dj = nearDistance(corners[j]);
+            if (j != i && ((di >= 0) != (dj >= 0))) {
+                addPoint(corners[i] + (corners[j] - corners[i]) * (di / (di - dj)));
+                clipped = true;
+            }
+        }
+    }
+
+    float2 hull[MAX_SILHOUETTE_POINTS * 2];
+    const size_t hullCount = convexHull(points, count, hull);
+    float area = 0;
+    for (size_t i = 0; i < hullCount; i++) {
+        area += cross(hull[0], hull[i], hull[(i + 1) % hullCount]);
+    }
+    if (hullCount < 3 || !(area * 0.5f > MIN_SILHOUETTE_AREA)) {
+        // this also rejects NaNs
+        return true;
+    }
+
+    // only the pixels entirely inside the silhouette's bounds can be covered
+    float2 smin = hull[0];
+    float2 smax = hull[0];
+    for (size_t i = 1; i < hullCount; i++) {
+        smin = min(smin, hull[i]);
+        smax = max(smax, hull[i]);
+    }
+    Occluder o;
+    o.xmin = clampPixel(std::ceil (smin.x), WIDTH);
+    o.xmax = clampPixel(std::floor(smax.x), WIDTH);
+    o.ymin = clampPixel(std::ceil (smin.y), HEIGHT);
+    o.ymax = clampPixel(std::floor(smax.y), HEIGHT);
+    if (o.xmin >= o.xmax || o.ymin >= o.ymax) {
+        return true;
+    }
+
+    // The front faces, which are the faces whose inside is behind them (l.z < 0). Their planes
+    // are transformed to clip space with the inverse transpose, in double because the faces
+    // seen edge-on have a very small l.z.
+    const mat4 modelFromClipTransposed(transpose(inverse(mat4(clipFromModel))));
+    size_t planeCount = 0;
+    for (size_t i = 0; i < 6 && planeCount < 3; i++) {
+        // outward plane of the face, dot(plane, p) > 0 outside of the box
+        const size_t axis = i / 2;
+        const double sign = (i & 1u) ? 1.0 : -1.0;
+        double4 plane{ 0.0 };
+        plane[axis] = sign;
+        plane.w = -(sign * box.center[axis] + box.halfExtent[axis]);
+        const double4 l = modelFromClipTransposed * plane;
+        if (!(l.z < 0)) {
+            continue;
+        }
+        // NDC z = -(l.x * x + l.y * y + l.w) / l.z, with x and y in depth buffer coordinates
+        const float dzdx = float(-2.0 * l.x / (WIDTH * l.z));
+        const float dzdy = float(-2.0 * l.y / (HEIGHT * l.z));
+        const float z0 = float(-(l.w - l.x - l.y) / l.z);
+        if (std::isfinite(dzdx) && std::isfinite(dzdy) && std::isfinite(z0)) {
+            o.dzdx[planeCount] = dzdx;
+            o.dzdy[planeCount] = dzdy;
+            o.z0[planeCount] = z0;
+            planeCount++;
+        }
+    }
+    if (planeCount == 0) {
+        if (!clipped) {
+            // no front face and not clipped, the box is too thin to be seen
+            return true;
+        }
+        // the camera is inside the box, which is clipped by the near plane
+        o.dzdx[0] = 0;
+        o.dzdy[0] = 0;
+        o.z0[0] = zmin;
+        planeCount = 1;
+    }
+    for (size_t i = planeCount; i < 3; i++) {
+        o.dzdx[i] = o.dzdx[0];
+        o.dzdy[i] = o.dzdy[0];
+        o.z0[i] = o.z0[0];
+    }
+    o.zmin = zmin;
+    o.zmax = zmax;
+
+    // edges of the counter-clockwise silhouette, positive inside
+    o.firstEdge = uint32_t(mEdges.size());
+    o.edgeCount = uint32_t(hullCount);
+    for (size_t i = 0; i < hullCount; i++) {
+        float2 const& p0 = hull[i];
+        float2 const& p1 = hull[(i + 1) % hullCount];
+        mEdges.push_back({ p0.y - p1.y, p1.x - p0.x, p0.x * p1.y - p1.x * p0.y });
+    }
+    mOccluders.push_back(o);
+    return true;
+}
+
+void OcclusionCuller::rasterize(JobSystem& js) noexcept {
+    SYSTRACE_CALL();
+
+    // each job clears and rasterizes all the occluders in a band of rows
+    auto functor = [this](uint32_t band, uint32_t count) {
+        rasterizeBand(band * BAND_HEIGHT, (band + count) * BAND_HEIGHT);
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, HEIGHT / BAND_HEIGHT,
+            std::ref(functor), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+}
+
+void OcclusionCuller::rasterizeBand(uint32_t y0, uint32_t y1) noexcept {
+    float* const UTILS_RESTRICT depth = mDepth.get();
+    std::fill(depth + y0 * WIDTH, depth + y1 * WIDTH, CLEAR_DEPTH);
+
+    for (Occluder const& o : mOccluders) {
+        float3 const* const edges = mEdges.data() + o.firstEdge;
+        const uint32_t ymin = std::max(y0, uint32_t(o.ymin));
+        const uint32_t ymax = std::min(y1, uint32_t(o.ymax));
+        for (uint32_t y = ymin; y < ymax; y++) {
+            // the pixel at x covers [x, x + 1] x [y, y + 1], find the ones entirely inside
+            // the silhouette, i.e. where every edge function is positive at all 4 corners
+            float lo = o.xmin;
+            float hi = o.xmax - 1.0f;
+            for (uint32_t i = 0; i < o.edgeCount; i++) {
+                float3 const& edge = edges[i];
+                const float e = edge.y * y + std::min(edge.y, 0.0f) + edge.z;
+                if (edge.x > 0) {
+                    lo = std::max(lo, -e / edge.x);
+                } else if (edge.x < 0) {
+                    hi = std::min(hi, -e / edge.x - 1.0f);
+                } else if (e < 0) {
+                    hi = lo - 1.0f;
+                }
+            }
+            const uint32_t xmin = clampPixel(std::ceil(lo), WIDTH);
+            const uint32_t xmax = clampPixel(std::floor(hi) + 1.0f, WIDTH);
+
+            // the farthest depth over the pixel, the planes are at their maximum on one of
+            // its corners, and so is the front surface which is their maximum
+            const float3 z = o.dzdy * y + o.z0 +
+                    max(o.dzdx, float3{ 0.0f }) + max(o.dzdy, float3{ 0.0f });
+            float* const UTILS_RESTRICT row = depth + y * WIDTH;
+
+            #pragma clang loop vectorize_width(8)
+            for (uint32_t x = xmin; x < xmax; x++) {
+                const float d0 = o.dzdx.x * x + z.x;
+                const float d1 = o.dzdx.y * x + z.y;
+                const float d2 = o.dzdx.z * x + z.z;
+                // clamped to the occluder's depth range, which is more robust for the faces
+                // seen (almost) edge-on and still bounds the front surface
+                const float d = std::min(std::max(std::max(std::max(d0, d1), d2), o.zmin), o.zmax);
+                row[x] = std::min(row[x], d);
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(float3 const& center, float3 const& extent) const noexcept {
+    // screen-space bounds of the box, and its nearest point
+    float2 smin{ std::numeric_limits<float>::max() };
+    float2 smax{ std::numeric_limits<float>::lowest() };
+    float zmin = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < 8; i++) {
+        const float4 p = mClipFromWorld * float4{ getCorner(center, extent, i), 1.0f };
+        if (!(nearDistance(p) > 0)) {
+            // the box crosses the near plane
+            return false;
+        }
+        const float3 s = toScreen(p);
+        smin = min(smin, s.xy);
+        smax = max(smax, s.xy);
+        zmin = std::min(zmin, s.z);
+    }
+
+    // all the pixels touched by the box
+    const uint32_t xmin = clampPixel(std::floor(smin.x), WIDTH);
+    const uint32_t xmax = clampPixel(std::ceil (smax.x), WIDTH);
+    const uint32_t ymin = clampPixel(std::floor(smin.y), HEIGHT);
+    const uint32_t ymax = clampPixel(std::ceil (smax.y), HEIGHT);
+    if (xmin >= xmax || ymin >= ymax) {
+        // off-screen, that's the frustum culling's job
+        return false;
+    }
+
+    float const* const UTILS_RESTRICT depth = mDepth.get();
+    for (uint32_t y = ymin; y < ymax; y++) {
+        float const* const UTILS_RESTRICT row = depth + y * WIDTH;
+        float farthest = row[xmin];
+        for (uint32_t x = xmin + 1; x < xmax; x++) {
+            farthest = std::max(farthest, row[x]);
+        }
+        if (farthest >= zmin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OcclusionCuller::cull(JobSystem& js, Culler::result_type* results,
+        float3 const* center, float3 const* extent, size_t count, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    const Culler::result_type mask = Culler::result_type(1u << bit);
+    auto functor = [this, results, center, extent, mask](uint32_t index, uint32_t c) {
+        for (uint32_t i = index, e = index + c; i < e; i++) {
+            if ((results[i] & mask) && isOccluded(center[i], extent[i])) {
+                results[i] &= ~mask;
+            }
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::ref(functor), jobs::CountSplitter<64, 8>());
+    js.runAndWait(job);
+}
+
+} // namespace details
+} // namespace filament
@@ -135,7 +135,7 @@ void PostProcessManager::finish(driver::TargetBufferFlags discarded,
 
             // draw a full screen triangle
             driver.beginRenderPass(target->target, params);
-            driver.draw(commands[i].program, rs, fullScreenRenderPrimitive);
+            driver.draw(commands[i].program, rs, fullScreenRenderPrimitive, 1);
             driver.endRenderPass();
         } else {
             driver.blit(TargetBufferFlags::COLOR,
@@ -162,7 +162,7 @@ void PostProcessManager::finish(driver::TargetBufferFlags discarded,
 
         setSource(params.width, params.height, previous);
         driver.beginRenderPass(viewRenderTarget, params);
-        driver.draw(commands.back().program, rs, fullScreenRenderPrimitive);
+        driver.draw(commands.back().program, rs, fullScreenRenderPrimitive, 1);
         driver.endRenderPass();
 
     } else {
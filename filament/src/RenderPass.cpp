@@ -29,6 +29,11 @@
 #include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <functional>
+
+#include <string.h>
+
 using namespace utils;
 using namespace math;
 
@@ -47,32 +52,71 @@ void RenderPass::render(
         FScene::RenderableSoa const& soa, Range<uint32_t> vr,
         uint32_t commandTypeFlags, RenderFlags renderFlags,
         const CameraInfo& camera, Viewport const& viewport,
-        GrowingSlice<Command>& commands) noexcept {
+        GrowingSlice<Command>& commands, CommandCache* cache) noexcept {
+
+    // up-to-date summed primitive counts needed for generateCommands()
+    updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
+
+    Slice<Command> sortedCommands = generate(js, soa, vr, commandTypeFlags, renderFlags,
+            camera, commands, cache);
+
+    execute(engine, soa, vr, camera, viewport, sortedCommands);
+}
+
+Slice<RenderPass::Command> RenderPass::generate(JobSystem& js,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags, const CameraInfo& camera,
+        GrowingSlice<Command>& commands, CommandCache* cache, uint8_t visibilityMask) noexcept {
 
     SYSTRACE_CONTEXT();
 
     // trace the number of visible renderables
     SYSTRACE_VALUE32("visibleRenderables", vr.size());
 
-    // up-to-date summed primitive counts needed for generateCommands()
-    updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
+    // we extract camera position/forward outside of the loop, because these are not cheap.
+    const float3 cameraPosition(camera.getPosition());
+    const float3 cameraForwardVector(camera.getForwardVector());
+
+    if (cache && vr.size() >= MAX_RENDERABLE_COUNT) {
+        cache->invalidate();
+        cache = nullptr;
+    }
+
+    if (cache && cache->isValid(soa, vr, commandTypeFlags, renderFlags, visibilityMask)) {
+        SYSTRACE_NAME("cached commands");
+        Command* const first = cache->mCommands.data();
+        const size_t count = cache->mCommands.size();
+        if (cache->update(soa, vr, cameraPosition, cameraForwardVector)) {
+            // the camera moved enough to change the order of some commands
+            if (UTILS_LIKELY(commands.remain() >= count)) {
+                sortCommands(js, first, count, commands.end());
+            } else {
+                std::sort(first, first + count);
+            }
+        }
+        return Slice<Command>(first, uint32_t(count));
+    }
 
     // compute how much maximum storage we need for this pass
-    uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
+    uint32_t growBy = FScene::getPrimitiveCount(soa, vr.first, vr.last);
     // double the color pass for transparents that need to render twice
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
     growBy *= uint32_t(colorPass * 2 + depthPass);
     Command* const curr = commands.grow(growBy);
 
-    // we extract camera position/forward outside of the loop, because these are not cheap.
-    const float3 cameraPosition(camera.getPosition());
-    const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
+    // the commands are tagged with their renderable, needed by the cache and batchInstances()
+    const bool tag = vr.size() < MAX_RENDERABLE_COUNT;
+    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector,
+            visibilityMask, tag, first = vr.first]
             (uint32_t startIndex, uint32_t indexCount) {
         RenderPass::generateCommands(commandTypeFlags, curr,
-                soa, { startIndex, startIndex + indexCount }, renderFlags,
-                cameraPosition, cameraForwardVector);
+                soa, { startIndex, startIndex + indexCount }, first, renderFlags,
+                cameraPosition, cameraForwardVector, visibilityMask);
+        if (tag) {
+            RenderPass::tagCommands(commandTypeFlags, curr,
+                    soa, { startIndex, startIndex + indexCount }, first);
+        }
     };
 
     auto jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
@@ -90,15 +134,56 @@ void RenderPass::render(
 
     { // sort all commands
         SYSTRACE_NAME("sort commands");
-        std::sort(commands.begin(), commands.end());
+        // the unused part of the command buffer is large enough for the radix sort most of
+        // the time, otherwise we fallback to std::sort().
+        if (UTILS_LIKELY(commands.remain() >= commands.size())) {
+            sortCommands(js, commands.begin(), commands.size(), commands.end());
+        } else {
+            std::sort(commands.begin(), commands.end());
+        }
     }
 
+    if (cache) {
+        cache->mGeneration++;
+        if (!cache->mChanged) {
+            cache->store(soa, vr, commandTypeFlags, renderFlags, visibilityMask, commands,
+                    cameraPosition, cameraForwardVector);
+        }
+        // if nothing changes until the next frame, the commands will be cached then
+        cache->mChanged = false;
+    }
+
+    return commands;
+}
+
+UTILS_ALWAYS_INLINE // this allows the compiler to devirtualize some calls
+inline              // this removes the code from the compilation unit
+void RenderPass::execute(FEngine& engine,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        const CameraInfo& camera, Viewport const& viewport,
+        Slice<Command> sortedCommands) noexcept {
+
     // Take care not to upload data within the render pass (synchronize can commit froxel data)
     driver::DriverApi& driver = engine.getDriverApi();
+
+    // the first instance buffer is always bound, even if there are no instanced draws
+    size_t instanceBufferCount = 1;
+    mInstanceBuffers.get(driver, 0);
+    if (vr.size() < MAX_RENDERABLE_COUNT) {
+        instanceBufferCount = std::max(instanceBufferCount, batchInstances(engine,
+                mInstanceBuffers, sortedCommands.begin(), soa, vr.first));
+    }
+
     beginRenderPass(driver, viewport, camera);
 
+    // the slots of the uniform ring are found with the commands' tags
+    const Handle<HwUniformBuffer> uniformRing =
+            vr.size() < MAX_RENDERABLE_COUNT ? mUniformRing : Handle<HwUniformBuffer>{};
+
     // Now, execute all commands
-    RenderPass::recordDriverCommands(driver, commands);
+    RenderPass::recordDriverCommandsParallel(engine, engine.getJobSystem(), sortedCommands,
+            { mInstanceBuffers.mBuffers.data(), uint32_t(instanceBufferCount) }, uniformRing, vr.first,
+            engine.getRenderableManager().getBonesUbh());
 
     endRenderPass(driver, viewport);
 
@@ -108,42 +193,378 @@ void RenderPass::render(
     engine.flush();
 }
 
+void RenderPass::sortCommands(JobSystem& js,
+        Command* commands, size_t count, Command* scratch) noexcept {
+    SYSTRACE_CALL();
+
+    if (count < RADIX_SORT_MIN_COUNT) {
+        std::sort(commands, commands + count);
+        return;
+    }
+
+    // Each block of commands is counted and scattered by its own job. Keeping the blocks in
+    // order and giving each of them its own range of output slots keeps the sort stable.
+    const size_t blockCount = std::max(size_t(1),
+            std::min(RADIX_SORT_MAX_BLOCKS, count / RADIX_SORT_BLOCK_COUNT));
+    const size_t blockSize = (count + blockCount - 1) / blockCount;
+
+    auto runBlocks = [&js, blockCount](auto& functor) {
+        if (blockCount == 1) {
+            functor(0, 1);
+        } else {
+            auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(blockCount),
+                    std::ref(functor), jobs::CountSplitter<1, 8>());
+            js.runAndWait(job);
+        }
+    };
+
+    // find the bytes of the keys that vary across the buffer, the others don't need a pass
+    CommandKey keyAnd[RADIX_SORT_MAX_BLOCKS];
+    CommandKey keyOr[RADIX_SORT_MAX_BLOCKS];
+    auto reduce = [commands, count, blockSize, &keyAnd, &keyOr](uint32_t first, uint32_t c) {
+        for (size_t b = first, e = first + c; b < e; b++) {
+            CommandKey a = ~CommandKey(0);
+            CommandKey o = 0;
+            for (size_t i = b * blockSize, n = std::min(count, (b + 1) * blockSize); i < n; i++) {
+                a &= commands[i].key;
+                o |= commands[i].key;
+            }
+            keyAnd[b] = a;
+            keyOr[b] = o;
+        }
+    };
+    runBlocks(reduce);
+
+    CommandKey varying = 0;
+    for (size_t b = 0; b < blockCount; b++) {
+        varying |= keyAnd[0] ^ keyAnd[b];
+        varying |= keyAnd[b] ^ keyOr[b];
+    }
+
+    uint32_t histograms[RADIX_SORT_MAX_BLOCKS][256];
+    Command* UTILS_RESTRICT src = commands;
+    Command* UTILS_RESTRICT dst = scratch;
+    for (size_t shift = 0; shift < 64; shift += 8) {
+        if (!((varying >> shift) & 0xFF)) {
+            continue;
+        }
+
+        // count the digits in each block
+        auto histogram = [src, count, blockSize, shift, &histograms](uint32_t first, uint32_t c) {
+            for (size_t b = first, e = first + c; b < e; b++) {
+                uint32_t* const UTILS_RESTRICT h = histograms[b];
+                std::fill_n(h, 256, 0);
+                for (size_t i = b * blockSize, n = std::min(count, (b + 1) * blockSize); i < n; i++) {
+                    h[(src[i].key >> shift) & 0xFF]++;
+                }
+            }
+        };
+        runBlocks(histogram);
+
+        // turn the counts into output offsets: digits first, then blocks
+        uint32_t offset = 0;
+        for (size_t digit = 0; digit < 256; digit++) {
+            for (size_t b = 0; b < blockCount; b++) {
+                const uint32_t n = histograms[b][digit];
+                histograms[b][digit] = offset;
+                offset += n;
+            }
+        }
+
+        // move the commands to their new place
+        auto scatter = [src, dst, count, blockSize, shift, &histograms](uint32_t first, uint32_t c) {
+            for (size_t b = first, e = first + c; b < e; b++) {
+                uint32_t* const UTILS_RESTRICT h = histograms[b];
+                for (size_t i = b * blockSize, n = std::min(count, (b + 1) * blockSize); i < n; i++) {
+                    dst[h[(src[i].key >> shift) & 0xFF]++] = src[i];
+                }
+            }
+        };
+        runBlocks(scatter);
+
+        std::swap(src, dst);
+    }
+
+    if (src != commands) {
+        std::copy_n(src, count, commands);
+    }
+}
+
 UTILS_NOINLINE // no need to be inlined
 void RenderPass::recordDriverCommands(
         FEngine::DriverApi& UTILS_RESTRICT driver,  // using restrict here is very important
-        Slice<Command> const& commands) noexcept {
+        Slice<Command> const& commands,
+        Slice<const Handle<HwUniformBuffer>> const& instanceBuffers,
+        Handle<HwUniformBuffer> uniformRing, uint32_t first,
+        Handle<HwUniformBuffer> bones) noexcept {
     SYSTRACE_CALL();
 
     if (!commands.empty()) {
-        FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
-        FMaterial const* UTILS_RESTRICT ma = nullptr;
-        Command const* UTILS_RESTRICT c;
-        for (c = commands.cbegin(); c->key != -1LLU; ++c) {
-            /*
-             * Be careful when changing code below, this is the hot inner-loop
-             */
-
-            // per-renderable uniform
-            PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
+        driver.bindUniforms(BindingPoints::PER_RENDERABLE_INSTANCES, *instanceBuffers.cbegin());
+        UTILS_UNUSED size_t drawCount = recordDraws(driver, commands.cbegin(), nullptr,
+                instanceBuffers, 0, uniformRing, first, bones);
+        SYSTRACE_VALUE32("drawCount", drawCount);
+    }
+}
+
+template<RenderPass::RecordMode MODE>
+size_t RenderPass::recordDraws(FEngine::DriverApi& UTILS_RESTRICT driver,
+        Command const* begin, Command const* end,
+        Slice<const Handle<HwUniformBuffer>> const& instanceBuffers, size_t instanceBufferIndex,
+        Handle<HwUniformBuffer> uniformRing, uint32_t first,
+        Handle<HwUniformBuffer> bones) noexcept {
+    Handle<HwUniformBuffer> const* UTILS_RESTRICT instanceBuffer =
+            instanceBuffers.cbegin() + instanceBufferIndex;
+    FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
+    FMaterial const* UTILS_RESTRICT ma = nullptr;
+
+    // State bound by the previous draw, only changes are recorded. Nothing is known about the
+    // state bound before this call, so the first draw always records everything.
+    constexpr bool fullState = MODE == RecordMode::FULL_STATE;
+    uint32_t previousSlot = ~0u;
+    Handle<HwUniformBuffer> previousUniforms;
+    uint32_t previousBonesOffset = 0;
+    Handle<HwProgram> previousProgram;
+    Driver::RasterState previousRasterState;
+
+    size_t drawCount = 0;
+    for (Command const* UTILS_RESTRICT c = begin; c != end && c->key != -1LLU;
+            c += c->primitive.instanceCount) {
+        /*
+         * Be careful when changing code below, this is the hot inner-loop
+         */
+
+        // per-renderable uniform, shared by all the primitives of a renderable
+        PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
+        if (uniformRing) {
+            const uint32_t slot = first + CommandCache::getRenderable(*c);
+            if (fullState || slot != previousSlot) {
+                previousSlot = slot;
+                driver.bindUniformsRange(BindingPoints::PER_RENDERABLE, uniformRing,
+                        RenderableUniformRing::getSlotOffset(slot),
+                        RenderableUniformRing::UNIFORMS_SIZE);
+            }
+        } else if (fullState ||
+                info.perRenderableUniforms.getId() != previousUniforms.getId()) {
+            previousUniforms = info.perRenderableUniforms;
             driver.bindUniforms(BindingPoints::PER_RENDERABLE, info.perRenderableUniforms);
-            if (info.perRenderableBones) {
-                driver.bindUniforms(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
+        }
+        if (info.bonesOffset && (fullState || info.bonesOffset != previousBonesOffset)) {
+            previousBonesOffset = info.bonesOffset;
+            driver.bindUniformsRange(BindingPoints::PER_RENDERABLE_BONES, bones,
+                    info.bonesOffset, BonePool::RANGE_SIZE);
+        }
+        if (UTILS_UNLIKELY(info.instanceCount > 1)) {
+            // each instanced draw has its own instance buffer, the first one is bound already
+            if (instanceBuffer != instanceBuffers.cbegin()) {
+                driver.bindUniforms(BindingPoints::PER_RENDERABLE_INSTANCES, *instanceBuffer);
+            }
+            ++instanceBuffer;
+        }
+
+        FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
+        if (UTILS_UNLIKELY(mi != previousMi)) {
+            // this is always taken the first time
+            previousMi = mi;
+            mi->use(driver);
+            ma = mi->getMaterial();
+        }
+
+        Handle<HwProgram> const ph = ma->getProgram(info.materialVariant.key);
+        if (fullState) {
+            driver.draw(ph, info.rasterState, info.primitiveHandle, info.instanceCount);
+        } else {
+            if (ph.getId() != previousProgram.getId() ||
+                    info.rasterState != previousRasterState) {
+                previousProgram = ph;
+                previousRasterState = info.rasterState;
+                driver.bindPipeline(ph, info.rasterState);
             }
+            driver.drawPrimitive(info.primitiveHandle, info.instanceCount);
+        }
+        drawCount++;
+    }
+    return drawCount;
+}
+
+template size_t RenderPass::recordDraws<RenderPass::RecordMode::CHANGED_STATE>(
+        FEngine::DriverApi&, Command const*, Command const*,
+        Slice<const Handle<HwUniformBuffer>> const&, size_t,
+        Handle<HwUniformBuffer>, uint32_t, Handle<HwUniformBuffer>) noexcept;
+template size_t RenderPass::recordDraws<RenderPass::RecordMode::FULL_STATE>(
+        FEngine::DriverApi&, Command const*, Command const*,
+        Slice<const Handle<HwUniformBuffer>> const&, size_t,
+        Handle<HwUniformBuffer>, uint32_t, Handle<HwUniformBuffer>) noexcept;
+
+// Upper bound of the size of the driver commands recorded by recordDraws() for each draw,
+// see the loop above.
+static constexpr size_t MAX_DRAW_COMMANDS_SIZE =
+        std::max(COMMAND_SIZE(bindUniforms), COMMAND_SIZE(bindUniformsRange)) + // per-renderable
+        COMMAND_SIZE(bindUniformsRange) +   // bones
+        COMMAND_SIZE(bindUniforms) +        // instances
+        COMMAND_SIZE(bindUniforms) +        // FMaterialInstance::use()
+        COMMAND_SIZE(bindSamplers) +
+        COMMAND_SIZE(setViewportScissor) +
+        COMMAND_SIZE(bindPipeline) +
+        COMMAND_SIZE(drawPrimitive);
+
+// number of draws recorded by each job of recordDriverCommandsParallel()
+static constexpr size_t PARALLEL_RECORD_DRAW_COUNT = 256;
+
+// size reserved in the command stream for each chunk of recordDriverCommandsParallel()
+static constexpr size_t PARALLEL_RECORD_CHUNK_SIZE = CommandBase::align(
+        PARALLEL_RECORD_DRAW_COUNT * MAX_DRAW_COMMANDS_SIZE + sizeof(NoopCommand));
+
+// The chunks are recorded in rounds, each round uses at most half of the space the command
+// stream guarantees after a flush.
+static constexpr size_t PARALLEL_RECORD_ROUND_CHUNK_COUNT =
+        (FEngine::CONFIG_MIN_COMMAND_BUFFERS_SIZE / 2) / PARALLEL_RECORD_CHUNK_SIZE;
+
+static_assert(PARALLEL_RECORD_ROUND_CHUNK_COUNT >= 2,
+        "PARALLEL_RECORD_DRAW_COUNT is too large for the command buffers");
+
+UTILS_NOINLINE // no need to be inlined
+void RenderPass::recordDriverCommandsParallel(FEngine& engine, JobSystem& js,
+        Slice<Command> const& commands,
+        Slice<const Handle<HwUniformBuffer>> const& instanceBuffers,
+        Handle<HwUniformBuffer> uniformRing, uint32_t first,
+        Handle<HwUniformBuffer> bones) noexcept {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    if (commands.size() < PARALLEL_RECORD_MIN_COUNT) {
+        recordDriverCommands(driver, commands, instanceBuffers, uniformRing, first, bones);
+        return;
+    }
+
+    SYSTRACE_CALL();
 
-            FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
-            if (UTILS_UNLIKELY(mi != previousMi)) {
-                // this is always taken the first time
-                previousMi = mi;
-                mi->use(driver);
-                ma = mi->getMaterial();
+    struct Chunk {
+        Command const* begin;
+        Command const* end;
+        size_t instanceBuffer;  // index of the instance buffer of the first instanced draw
+        void* data;             // reserved in the command stream
+        size_t drawCount;       // number of draws recorded
+    };
+    Chunk chunks[PARALLEL_RECORD_ROUND_CHUNK_COUNT];
+
+    auto record = [&driver, &chunks, &instanceBuffers, uniformRing, first, bones](size_t i) {
+        Chunk& chunk = chunks[i];
+        CircularBuffer buffer(chunk.data, PARALLEL_RECORD_CHUNK_SIZE);
+        CommandStream stream(driver, buffer);
+        chunk.drawCount = recordDraws(stream, chunk.begin, chunk.end,
+                instanceBuffers, chunk.instanceBuffer, uniformRing, first, bones);
+        stream.jump(static_cast<char*>(chunk.data) + PARALLEL_RECORD_CHUNK_SIZE);
+    };
+
+    driver.bindUniforms(BindingPoints::PER_RENDERABLE_INSTANCES, *instanceBuffers.cbegin());
+
+    UTILS_UNUSED size_t drawCount = 0;
+    size_t instanceBuffer = 0;
+    Command const* c = commands.cbegin();
+    while (c->key != uint64_t(Pass::SENTINEL)) {
+        // Split the next commands in chunks of draws. The programs are created here if needed,
+        // because creating them records driver commands.
+        size_t chunkCount = 0;
+        while (chunkCount < PARALLEL_RECORD_ROUND_CHUNK_COUNT &&
+                c->key != uint64_t(Pass::SENTINEL)) {
+            Chunk& chunk = chunks[chunkCount++];
+            chunk.begin = c;
+            chunk.instanceBuffer = instanceBuffer;
+            for (size_t i = 0; i < PARALLEL_RECORD_DRAW_COUNT &&
+                    c->key != uint64_t(Pass::SENTINEL); i++) {
+                PrimitiveInfo const& info = c->primitive;
+                info.mi->getMaterial()->getProgram(info.materialVariant.key);
+                instanceBuffer += info.instanceCount > 1 ? 1 : 0;
+                c += info.instanceCount;
             }
+            chunk.end = c;
+        }
 
-            Handle<HwProgram> const ph = ma->getProgram(info.materialVariant.key);
-            driver.draw(ph, info.rasterState, info.primitiveHandle);
+        // make sure the command stream has room for this round, then reserve the chunks, which
+        // are contiguous and executed in order
+        engine.flush();
+        for (size_t i = 0; i < chunkCount; i++) {
+            chunks[i].data = driver.reserve(PARALLEL_RECORD_CHUNK_SIZE);
         }
 
-        SYSTRACE_VALUE32("commandCount", c - commands.cbegin());
+        auto parent = js.createJob();
+        for (size_t i = 0; i < chunkCount; i++) {
+            js.run(jobs::createJob(js, parent, std::cref(record), i));
+        }
+        js.runAndWait(parent);
+
+        for (size_t i = 0; i < chunkCount; i++) {
+            drawCount += chunks[i].drawCount;
+        }
     }
+    SYSTRACE_VALUE32("drawCount", drawCount);
+}
+
+UTILS_ALWAYS_INLINE
+inline bool RenderPass::isInstanceOf(PrimitiveInfo const& UTILS_RESTRICT instance,
+        PrimitiveInfo const& UTILS_RESTRICT first) noexcept {
+    // skinned renderables can only be instanced if they share their bones
+    return instance.mi == first.mi &&
+           instance.primitiveHandle.getId() == first.primitiveHandle.getId() &&
+           instance.materialVariant.key == first.materialVariant.key &&
+           instance.rasterState == first.rasterState &&
+           instance.bonesOffset == first.bonesOffset;
+}
+
+UTILS_NOINLINE // no need to be inlined
+size_t RenderPass::batchInstances(FEngine& engine, InstanceBufferPool& instanceBuffers,
+        Command* const commands, FScene::RenderableSoa const& soa, uint32_t first) noexcept {
+    SYSTRACE_CALL();
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    auto const* const UTILS_RESTRICT soaInstances = soa.data<FScene::RENDERABLE_INSTANCE>() + first;
+
+    size_t bufferCount = 0;
+    Command* UTILS_RESTRICT c = commands;
+    while (c->key != uint64_t(Pass::SENTINEL)) {
+        Command const* const end = c + CONFIG_MAX_INSTANCE_COUNT;
+        Command* UTILS_RESTRICT last = c + 1;
+        while (last != end && last->key != uint64_t(Pass::SENTINEL) &&
+                isInstanceOf(last->primitive, c->primitive)) {
+            ++last;
+        }
+
+        const size_t count = size_t(last - c);
+        c->primitive.instanceCount = uint16_t(count);
+        if (count > 1) {
+            // The first instance uses its own per-renderable uniforms, which are bound by
+            // recordDriverCommands(), the others read a copy of theirs from the instance buffer.
+            UniformBuffer instances(count * INSTANCE_UNIFORMS_SIZE);
+            char* const UTILS_RESTRICT p = static_cast<char*>(
+                    instances.invalidateUniforms(0, count * INSTANCE_UNIFORMS_SIZE));
+            for (size_t i = 1; i < count; i++) {
+                auto ri = soaInstances[CommandCache::getRenderable(c[i])];
+                UniformBuffer const& uniforms = rcm.getUniformBuffer(ri);
+                assert(uniforms.getSize() == INSTANCE_UNIFORMS_SIZE);
+                memcpy(p + i * INSTANCE_UNIFORMS_SIZE, uniforms.getBuffer(), INSTANCE_UNIFORMS_SIZE);
+            }
+            driver.updateUniformBuffer(instanceBuffers.get(driver, bufferCount++),
+                    std::move(instances));
+        }
+        c = last;
+    }
+    return bufferCount;
+}
+
+Handle<HwUniformBuffer> RenderPass::InstanceBufferPool::get(
+        driver::DriverApi& driver, size_t index) {
+    while (mBuffers.size() <= index) {
+        mBuffers.push_back(driver.createUniformBuffer(
+                CONFIG_MAX_INSTANCE_COUNT * INSTANCE_UNIFORMS_SIZE));
+    }
+    return mBuffers[index];
+}
+
+void RenderPass::InstanceBufferPool::terminate(driver::DriverApi& driver) noexcept {
+    for (Handle<HwUniformBuffer> ubh : mBuffers) {
+        driver.destroyUniformBuffer(ubh);
+    }
+    mBuffers.clear();
 }
 
 /* static */
@@ -197,8 +618,9 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
 /* static */
 UTILS_NOINLINE
 void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const commands,
-        FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
-        math::float3 cameraPosition, math::float3 cameraForward) noexcept {
+        FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, uint32_t first,
+        RenderFlags renderFlags,
+        math::float3 cameraPosition, math::float3 cameraForward, uint8_t visibilityMask) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
     // we go throw the list of renderables just once.
@@ -206,7 +628,7 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     // the list twice)
 
     // compute how much maximum storage we need
-    uint32_t offset = FScene::getPrimitiveCount(soa, range.first);
+    uint32_t offset = FScene::getPrimitiveCount(soa, first, range.first);
     // double the color pass for transparents that need to render twice
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
@@ -233,15 +655,15 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
         default: // squash IDE warning -- should never happen.
         case CommandTypeFlags::COLOR:
             generateCommandsImpl<CommandTypeFlags::COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, cameraPosition, cameraForward, visibilityMask);
             break;
         case CommandTypeFlags::DEPTH_AND_COLOR:
             generateCommandsImpl<CommandTypeFlags::DEPTH_AND_COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, cameraPosition, cameraForward, visibilityMask);
             break;
         case CommandTypeFlags::SHADOW:
             generateCommandsImpl<CommandTypeFlags::SHADOW>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, cameraPosition, cameraForward, visibilityMask);
             break;
     }
 }
@@ -253,7 +675,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
         Command* UTILS_RESTRICT curr,
         FScene::RenderableSoa const& UTILS_RESTRICT soa, utils::Range<uint32_t> range,
         RenderFlags renderFlags,
-        float3 cameraPosition, float3 cameraForward) noexcept {
+        float3 cameraPosition, float3 cameraForward, uint8_t visibilityMask) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
     // we go throw the list of renderables just once.
@@ -268,7 +690,8 @@ void RenderPass::generateCommandsImpl(uint32_t,
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
     auto const* const UTILS_RESTRICT soaUbh             = soa.data<FScene::UBH>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaBonesOffset     = soa.data<FScene::BONES_OFFSET>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
     Variant materialVariant;
@@ -319,7 +742,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdColor.primitive.perRenderableUniforms = soaUbh[i];
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdColor.primitive.bonesOffset = soaBonesOffset[i];
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning);
 
@@ -329,12 +752,17 @@ void RenderPass::generateCommandsImpl(uint32_t,
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
         cmdDepth.primitive.perRenderableUniforms = soaUbh[i];
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdDepth.primitive.bonesOffset = soaBonesOffset[i];
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
 
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadows = shadowPass & shadowCaster;
 
+        // with a visibility mask, renderables outside of it don't get shadow commands
+        // (e.g. the shadow casters of other cascades)
+        const bool skipShadow = shadowPass & (visibilityMask != 0) &
+                !(soaVisibleMask[i] & visibilityMask);
+
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
 
         /*
@@ -444,7 +872,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 bool issueDepth =
                         (rs.depthWrite & !(colorPass & (rs.alphaToCoverage | rs.hasBlending())))
                         | writeDepthForShadows;
-                curr->key |= select(!issueDepth);
+                curr->key |= select(!issueDepth | skipShadow);
 
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
@@ -454,6 +882,128 @@ void RenderPass::generateCommandsImpl(uint32_t,
     }
 }
 
+/* static */
+void RenderPass::tagCommands(uint32_t commandTypeFlags, Command* const commands,
+        FScene::RenderableSoa const& soa, Range<uint32_t> range, uint32_t first) noexcept {
+    // each renderable's commands are stored contiguously by generateCommands()
+    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+    const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
+    const uint32_t commandsPerPrimitive = uint32_t(colorPass * 2 + depthPass);
+    for (uint32_t i = range.first; i < range.last; ++i) {
+        Command* curr = commands + FScene::getPrimitiveCount(soa, first, i) * commandsPerPrimitive;
+        Command* const last = commands + FScene::getPrimitiveCount(soa, first, i + 1) * commandsPerPrimitive;
+        for (; curr != last; ++curr) {
+            CommandCache::setRenderable(*curr, i - first);
+        }
+    }
+}
+
+bool RenderPass::CommandCache::isValid(FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags,
+        uint8_t visibilityMask) const noexcept {
+    if (!mValid || mCommandTypeFlags != commandTypeFlags || mRenderFlags != renderFlags ||
+            mVisibilityMask != visibilityMask || mRenderables.size() != vr.size()) {
+        return false;
+    }
+
+    // the visible renderables must be the same, in the same order, with the same primitives
+    auto const* const UTILS_RESTRICT soaInstances   = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaPrimitives  = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaVisibleMask = soa.data<FScene::VISIBLE_MASK>();
+    Renderable const* UTILS_RESTRICT renderable = mRenderables.data();
+    for (uint32_t i = vr.first; i < vr.last; ++i, ++renderable) {
+        if (renderable->instance != soaInstances[i] ||
+            renderable->primitives != soaPrimitives[i].begin() ||
+            renderable->primitiveCount != soaPrimitives[i].size() ||
+            renderable->visibleMask != (soaVisibleMask[i] & visibilityMask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RenderPass::CommandCache::store(FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags, uint8_t visibilityMask,
+        Slice<Command> const& commands, float3 cameraPosition, float3 cameraForward) {
+    SYSTRACE_CALL();
+
+    auto const* const UTILS_RESTRICT soaInstances   = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaPrimitives  = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaVisibleMask = soa.data<FScene::VISIBLE_MASK>();
+    mRenderables.resize(vr.size());
+    Renderable* UTILS_RESTRICT renderable = mRenderables.data();
+    for (uint32_t i = vr.first; i < vr.last; ++i, ++renderable) {
+        renderable->instance = soaInstances[i];
+        renderable->primitives = soaPrimitives[i].begin();
+        renderable->primitiveCount = uint32_t(soaPrimitives[i].size());
+        renderable->visibleMask = uint8_t(soaVisibleMask[i] & visibilityMask);
+    }
+
+    // commands past the first SENTINEL are no-ops, we only keep the first SENTINEL
+    Command const* const sentinel = std::lower_bound(commands.begin(), commands.end(),
+            uint64_t(Pass::SENTINEL),
+            [](Command const& lhs, CommandKey key) { return lhs.key < key; });
+    assert(sentinel != commands.end());
+    mCommands.assign(commands.begin(), sentinel + 1);
+
+    mCameraPosition = cameraPosition;
+    mCameraForward = cameraForward;
+    mCommandTypeFlags = commandTypeFlags;
+    mRenderFlags = renderFlags;
+    mVisibilityMask = visibilityMask;
+    mValid = true;
+}
+
+bool RenderPass::CommandCache::update(FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        float3 cameraPosition, float3 cameraForward) noexcept {
+    if (cameraPosition == mCameraPosition && cameraForward == mCameraForward) {
+        return false;
+    }
+    mCameraPosition = cameraPosition;
+    mCameraForward = cameraForward;
+
+    SYSTRACE_CALL();
+
+    // This must compute the keys exactly like generateCommandsImpl() does
+    auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
+    const bool depthPass = bool(mCommandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
+    const float cameraDistance = dot(cameraPosition, cameraForward);
+
+    bool sorted = true;
+    CommandKey previousKey = 0;
+    Command* UTILS_RESTRICT curr = mCommands.data();
+    Command* const last = curr + mCommands.size() - 1; // skip the SENTINEL
+    for (; curr != last; ++curr) {
+        const uint32_t i = vr.first + getRenderable(*curr);
+        float distance = -(dot(soaWorldAABBCenter[i], cameraForward) - cameraDistance);
+        const uint32_t distanceBits = reinterpret_cast<uint32_t&>(distance);
+
+        CommandKey key = curr->key;
+        switch (Pass(key & PASS_MASK)) {
+            case Pass::DEPTH:
+                key &= ~DISTANCE_BITS_MASK;
+                key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
+                break;
+            case Pass::COLOR:
+                if (!depthPass) {
+                    key &= ~Z_BUCKET_MASK;
+                    key |= makeField(distanceBits >> 22, Z_BUCKET_MASK, Z_BUCKET_SHIFT);
+                }
+                break;
+            case Pass::BLENDED:
+                key &= ~BLEND_DISTANCE_MASK;
+                key |= makeField(~distanceBits, BLEND_DISTANCE_MASK, BLEND_DISTANCE_SHIFT);
+                break;
+            default:
+                break;
+        }
+        curr->key = key;
+        sorted &= previousKey <= key;
+        previousKey = key;
+    }
+    return !sorted;
+}
+
 void RenderPass::updateSummedPrimitiveCounts(
         FScene::RenderableSoa& renderableData, Range<uint32_t> vr) noexcept {
     auto const* const UTILS_RESTRICT primitives = renderableData.data<FScene::PRIMITIVES>();
@@ -472,9 +1022,9 @@ void RenderPass::updateSummedPrimitiveCounts(
 // inlining and devirtualization.
 // ------------------------------------------------------------------------------------------------
 
-FRenderer::ColorPass::ColorPass(const char* name,
+FRenderer::ColorPass::ColorPass(const char* name, InstanceBufferPool& instanceBuffers,
         JobSystem& js, JobSystem::Job* jobFroxelize,FView* view, Handle<HwRenderTarget> const rth)
-        : RenderPass(name), js(js), jobFroxelize(jobFroxelize), view(view), rth(rth) {
+        : RenderPass(name, instanceBuffers, view->getRenderableUniformRing()), js(js), jobFroxelize(jobFroxelize), view(view), rth(rth) {
 }
 
 void FRenderer::ColorPass::beginRenderPass(
@@ -536,30 +1086,17 @@ void FRenderer::ColorPass::endRenderPass(DriverApi& driver, Viewport const& view
     }
 }
 
-void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
-        Handle<HwRenderTarget> const rth, FView* view, Viewport const& scaledViewport,
-        GrowingSlice<Command>& commands) noexcept {
-
-    // start the froxelization immediately, it has no dependencies
-    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
-            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
-    js.run(jobFroxelize);
-
-    CameraInfo const& cameraInfo = view->getCameraInfo();
-    auto& soa = view->getScene()->getRenderableData();
-    auto vr = view->getVisibleRenderables();
-
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
-
-    DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, scaledViewport);
-    view->commitUniforms(driver);
-
+static RenderPass::RenderFlags getRenderFlags(FView const* view) noexcept {
     RenderPass::RenderFlags flags = 0;
     if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
     if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
     if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    return flags;
+}
+
+Slice<RenderPass::Command> FRenderer::ColorPass::generateColorPass(JobSystem& js,
+        FView const* view, GrowingSlice<Command>& commands) noexcept {
+    SYSTRACE_CALL();
 
     CommandTypeFlags commandType;
     switch (view->getDepthPrepass()) {
@@ -579,57 +1116,149 @@ void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
             break;
     }
 
-    ColorPass colorPass("ColorPass", js, jobFroxelize, view, rth);
+    return RenderPass::generate(js, view->getRenderableData(),
+            view->getVisibleRenderables(), commandType, getRenderFlags(view),
+            view->getCameraInfo(), commands, &view->getColorPassCommandCache());
+}
+
+void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
+        InstanceBufferPool& instanceBuffers, Handle<HwRenderTarget> const rth, FView* view,
+        Viewport const& scaledViewport, JobSystem::Job* jobFroxelize,
+        Slice<Command> commands) noexcept {
+
+    CameraInfo const& cameraInfo = view->getCameraInfo();
+    auto& soa = view->getRenderableData();
+    auto vr = view->getVisibleRenderables();
+
+    DriverApi& driver = engine.getDriverApi();
+    view->prepareCamera(cameraInfo, scaledViewport);
+    view->commitUniforms(driver);
+
+    ColorPass colorPass("ColorPass", instanceBuffers, js, jobFroxelize, view, rth);
     driver.pushGroupMarker("Color Pass");
-    colorPass.render(engine, js, soa, vr, commandType, flags, cameraInfo, scaledViewport, commands);
+    colorPass.execute(engine, soa, vr, cameraInfo, scaledViewport, commands);
     driver.popGroupMarker();
 }
 
 // ------------------------------------------------------------------------------------------------
 
-FRenderer::ShadowPass::ShadowPass(const char* name,
-        ShadowMap const& shadowMap) noexcept
-        : RenderPass(name), shadowMap(shadowMap) {
+FRenderer::ShadowPass::ShadowPass(const char* name, InstanceBufferPool& instanceBuffers,
+        Handle<HwUniformBuffer> uniformRing, ShadowMap const& shadowMap,
+        size_t cascade, bool clear) noexcept
+        : RenderPass(name, instanceBuffers, uniformRing), shadowMap(shadowMap),
+          cascade(cascade), clear(clear) {
 }
 
 void FRenderer::ShadowPass::beginRenderPass(driver::DriverApi& driver, Viewport const&, const CameraInfo&) noexcept {
-    shadowMap.beginRenderPass(driver);
+    shadowMap.beginRenderPass(driver, cascade, clear);
 }
 
-void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
-        FView* view, GrowingSlice<Command>& commands) noexcept {
+void FRenderer::ShadowPass::generateShadowMap(JobSystem& js,
+        FView const* view, GrowingSlice<Command>& commands, Cascades& cascades) noexcept {
+    SYSTRACE_CALL();
 
-    auto& soa = view->getScene()->getRenderableData();
+    auto& soa = view->getRenderableData();
     auto vr = view->getVisibleShadowCasters();
     ShadowMap const& shadowMap = view->getShadowMap();
-    Viewport const& viewport = shadowMap.getViewport();
-    FCamera const& camera = shadowMap.getCamera();
-
-    CameraInfo cameraInfo = {
-            .projection         = mat4f{ camera.getProjectionMatrix() },
-            .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
-            .model              = camera.getModelMatrix(),
-            .view               = camera.getViewMatrix(),
-            .zn                 = camera.getNear(),
-            .zf                 = camera.getCullingFar(),
+    const size_t cascadeCount = shadowMap.getCascadeCount();
+
+    for (size_t i = 0; i < cascadeCount; i++) {
+        FCamera const& camera = shadowMap.getCamera(i);
+        cascades.cameraInfos[i] = {
+                .projection         = mat4f{ camera.getProjectionMatrix() },
+                .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
+                .model              = camera.getModelMatrix(),
+                .view               = camera.getViewMatrix(),
+                .zn                 = camera.getNear(),
+                .zf                 = camera.getCullingFar(),
+        };
+        cascades.commands[i] = {};
+    }
+
+    const RenderPass::RenderFlags flags = getRenderFlags(view);
+
+    // Each cascade generates and sorts its commands in its own share of the command buffer,
+    // so that they can all run concurrently.
+    const size_t share = commands.remain() / cascadeCount;
+    GrowingSlice<Command> shares[CONFIG_MAX_SHADOW_CASCADES];
+    for (size_t i = 0; i < cascadeCount; i++) {
+        shares[i] = GrowingSlice<Command>(commands.end() + i * share, share);
+    }
+
+    auto generate = [&js, &soa, vr, flags, view, &cascades, &shares, &shadowMap,
+            cascadeCount](size_t i) {
+        if (shadowMap.hasVisibleShadows(i)) {
+            cascades.commands[i] = RenderPass::generate(js, soa, vr,
+                    CommandTypeFlags::SHADOW, flags, cascades.cameraInfos[i], shares[i],
+                    &view->getShadowPassCommandCache(i),
+                    FView::getShadowCascadeVisibleMask(i, cascadeCount));
+        }
     };
 
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
+    if (cascadeCount > 1) {
+        SYSTRACE_NAME("generate cascades");
+        auto parent = js.createJob();
+        for (size_t i = 0; i < cascadeCount; i++) {
+            js.run(jobs::createJob(js, parent, std::cref(generate), i));
+        }
+        js.runAndWait(parent);
+    } else {
+        generate(0);
+    }
 
-    driver::DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, viewport);
-    view->commitUniforms(driver);
+    // only for keeping track of the high watermark, the cascades use equal shares
+    size_t used = 0;
+    for (size_t i = 0; i < cascadeCount; i++) {
+        used = std::max(used, size_t(shares[i].size()));
+    }
+    commands.grow(uint32_t(used * cascadeCount));
+}
 
-    RenderPass::RenderFlags flags = 0;
-    if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
-    if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
-    if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+void FRenderer::ShadowPass::renderShadowMap(FEngine& engine,
+        InstanceBufferPool& instanceBuffers, FView* view, Cascades const& cascades) noexcept {
 
-    ShadowPass shadowPass("ShadowPass", shadowMap);
+    auto& soa = view->getRenderableData();
+    auto vr = view->getVisibleShadowCasters();
+    ShadowMap& shadowMap = view->getShadowMap();
+    const size_t cascadeCount = shadowMap.getCascadeCount();
+
+    // Nothing needs to be rendered if the shadow map still has the same content, e.g. when the
+    // light, the camera and the shadow casters didn't move since the previous frame.
+    const uint64_t materialsGeneration = engine.getDepthMaterialsGeneration();
+    bool upToDate = true;
+    for (size_t i = 0; i < cascadeCount; i++) {
+        upToDate &= shadowMap.isCascadeUpToDate(i,
+                view->getShadowPassCommandCache(i).getGeneration(), materialsGeneration);
+    }
+    if (upToDate) {
+        return;
+    }
+
+    // the cascades are drawn in order, each one updates the camera's uniforms
+    driver::DriverApi& driver = engine.getDriverApi();
     driver.pushGroupMarker("Shadow map Pass");
-    shadowPass.render(engine, js, soa, vr, CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands);
+    bool clear = true;
+    for (size_t i = 0; i < cascadeCount; i++) {
+        if (!shadowMap.hasVisibleShadows(i)) {
+            continue;
+        }
+        Viewport const& viewport = shadowMap.getViewport(i);
+        view->prepareCamera(cascades.cameraInfos[i], viewport);
+        view->commitUniforms(driver);
+
+        ShadowPass shadowPass("ShadowPass", instanceBuffers, view->getRenderableUniformRing(),
+                shadowMap, i, clear);
+        shadowPass.execute(engine, soa, vr, cascades.cameraInfos[i], viewport,
+                cascades.commands[i]);
+        clear = false;
+    }
     driver.popGroupMarker();
+
+    // all the cascades are up-to-date, including the cleared ones
+    for (size_t i = 0; i < cascadeCount; i++) {
+        shadowMap.setCascadeRendered(i,
+                view->getShadowPassCommandCache(i).getGeneration(), materialsGeneration);
+    }
 }
 
 void FRenderer::ShadowPass::endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept {
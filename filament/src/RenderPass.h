@@ -21,6 +21,7 @@
 
 #include "details/Camera.h"
 #include "details/Material.h"
+#include "details/RenderableUniformRing.h"
 #include "details/Scene.h"
 
 #include "driver/DriverApiForward.h"
@@ -28,8 +29,13 @@
 #include <private/filament/Variant.h>
 
 #include <utils/compiler.h>
+#include <utils/Range.h>
 #include <utils/Slice.h>
 
+#include <math/vec3.h>
+
+#include <vector>
+
 namespace utils {
 class JobSystem;
 }
@@ -172,14 +178,15 @@ public:
         return boolish ? -1llu : 0llu;
     }
 
-    struct PrimitiveInfo { // 28 bytes
+    struct PrimitiveInfo { // 30 bytes
         FMaterialInstance const* mi = nullptr;              // 8 bytes (4)
         Handle<HwRenderPrimitive> primitiveHandle;          // 4 bytes
         Handle<HwUniformBuffer> perRenderableUniforms;      // 4 bytes
-        Handle<HwUniformBuffer> perRenderableBones;         // 4 bytes
+        uint32_t bonesOffset = 0;                           // 4 bytes (0 if not skinned)
         Driver::RasterState rasterState;                    // 4 bytes
         Variant materialVariant;                            // 1 byte
-        uint8_t reserved[3] = { };                          // 3 bytes (that helps the compiler)
+        uint8_t renderable[3] = { };                        // 3 bytes (index of the renderable)
+        uint16_t instanceCount = 1;                         // 2 bytes (set by batchInstances())
     };
 
     struct alignas(8) Command {     // 32 bytes
@@ -196,23 +203,170 @@ public:
             "Command isn't trivially destructible");
 
 
+    // commands can be tagged with their renderable index only up to this many renderables
+    static constexpr size_t MAX_RENDERABLE_COUNT = 1u << 24u;
+
     using RenderFlags = uint8_t;
     static constexpr RenderFlags HAS_SHADOWING          = 0x01;
     static constexpr RenderFlags HAS_DIRECTIONAL_LIGHT  = 0x02;
     static constexpr RenderFlags HAS_DYNAMIC_LIGHTING   = 0x04;
 
 
-    RenderPass(const char* name) noexcept : mName(name) { }
+    /*
+     * Keeps the sorted commands of a pass across frames. They're reused as long as the
+     * renderables and their visibility don't change; when the camera moves, only the
+     * distance-dependent part of the keys is updated, which skips generating and, most of the
+     * time, sorting the commands.
+     *
+     * The owner must call invalidate() whenever the renderables' data might have changed.
+     */
+    class CommandCache {
+    public:
+        void invalidate() noexcept {
+            mValid = false;
+            mChanged = true;
+            mGeneration++;
+        }
+
+        // Changes every time the commands are not reused from the cache, i.e. if it's the same
+        // as after a previous pass, the same commands have been used since then (only their
+        // order may have changed, if the camera moved).
+        uint64_t getGeneration() const noexcept { return mGeneration; }
+
+    private:
+        friend class RenderPass;
+
+        struct Renderable {
+            utils::EntityInstance<RenderableManager> instance;
+            uint32_t primitiveCount;
+            FRenderPrimitive const* primitives;
+            uint8_t visibleMask;    // VISIBLE_MASK bits of the renderable, within mVisibilityMask
+        };
+
+        static void setRenderable(Command& cmd, uint32_t index) noexcept {
+            cmd.primitive.renderable[0] = uint8_t(index);
+            cmd.primitive.renderable[1] = uint8_t(index >> 8u);
+            cmd.primitive.renderable[2] = uint8_t(index >> 16u);
+        }
+
+        static uint32_t getRenderable(Command const& cmd) noexcept {
+            return uint32_t(cmd.primitive.renderable[0]) |
+                   uint32_t(cmd.primitive.renderable[1]) << 8u |
+                   uint32_t(cmd.primitive.renderable[2]) << 16u;
+        }
+
+        bool isValid(FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+                uint32_t commandTypeFlags, RenderFlags renderFlags,
+                uint8_t visibilityMask) const noexcept;
+
+        void store(FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+                uint32_t commandTypeFlags, RenderFlags renderFlags, uint8_t visibilityMask,
+                utils::Slice<Command> const& commands,
+                math::float3 cameraPosition, math::float3 cameraForward);
+
+        // returns true if the commands need to be sorted again
+        bool update(FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+                math::float3 cameraPosition, math::float3 cameraForward) noexcept;
+
+        std::vector<Command> mCommands;         // sorted, ends with a SENTINEL command
+        std::vector<Renderable> mRenderables;   // the renderables the commands were made of
+        math::float3 mCameraPosition;
+        math::float3 mCameraForward;
+        uint32_t mCommandTypeFlags = 0;
+        RenderFlags mRenderFlags = 0;
+        uint8_t mVisibilityMask = 0;
+        uint64_t mGeneration = 0;
+        bool mValid = false;
+        bool mChanged = true;   // don't bother caching the commands while the scene is changing
+    };
+
+    /*
+     * Uniform buffers holding the per-renderable uniforms of the instances of instanced draws.
+     * They're owned by the Renderer and reused by all its passes.
+     */
+    class InstanceBufferPool {
+    public:
+        void terminate(driver::DriverApi& driver) noexcept;
+
+    private:
+        friend class RenderPass;
+
+        // returns the index-th buffer, which is created if needed
+        Handle<HwUniformBuffer> get(driver::DriverApi& driver, size_t index);
+
+        std::vector<Handle<HwUniformBuffer>> mBuffers;
+    };
+
+    // 'uniformRing' holds the per-renderable uniforms of all renderables (see FView), or is null
+    // if each renderable uses its own uniform buffer
+    RenderPass(const char* name, InstanceBufferPool& instanceBuffers,
+            Handle<HwUniformBuffer> uniformRing) noexcept
+            : mName(name), mInstanceBuffers(instanceBuffers), mUniformRing(uniformRing) { }
+
+    /*
+     * Sorts commands by key, using a LSD radix sort, parallelized over the JobSystem for large
+     * command buffers. The bytes of the key that are the same for all commands (e.g. the pass
+     * or priority bytes) are skipped. 'scratch' must have room for 'count' commands.
+     * Small buffers are sorted with std::sort.
+     */
+    static void sortCommands(utils::JobSystem& js,
+            Command* commands, size_t count, Command* scratch) noexcept;
 
     virtual ~RenderPass() noexcept;
 
-    // appends rendering commands for the given view
+    // appends rendering commands for the given view, or reuses the ones in 'cache' if possible
     void render(
             FEngine& engine, utils::JobSystem& js,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> visibleRenderables,
             uint32_t commandTypeFlags, RenderFlags renderFlags,
             const CameraInfo& camera, Viewport const& viewport,
-            utils::GrowingSlice<Command>& commands) noexcept;
+            utils::GrowingSlice<Command>& commands, CommandCache* cache = nullptr) noexcept;
+
+    /*
+     * The two halves of render(), so that the commands of several passes can be generated
+     * concurrently, before they're executed in order on the driver thread.
+     *
+     * generate() appends the sorted commands to 'commands', or reuses the ones in 'cache', and
+     * returns them. It doesn't touch the driver, and can run concurrently with other calls of
+     * generate() as long as they don't share 'commands' or 'cache'. The summed primitive counts
+     * of 'soa' must be up-to-date (see updateSummedPrimitiveCounts()).
+     * If 'visibilityMask' is not 0, the SHADOW commands of the renderables that have none of
+     * its VISIBLE_MASK bits set are skipped.
+     */
+    static utils::Slice<Command> generate(utils::JobSystem& js,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> visibleRenderables,
+            uint32_t commandTypeFlags, RenderFlags renderFlags, const CameraInfo& camera,
+            utils::GrowingSlice<Command>& commands, CommandCache* cache = nullptr,
+            uint8_t visibilityMask = 0) noexcept;
+
+    // executes commands returned by generate()
+    void execute(FEngine& engine,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> visibleRenderables,
+            const CameraInfo& camera, Viewport const& viewport,
+            utils::Slice<Command> commands) noexcept;
+
+    // The summed primitive counts are only used as differences, so they can be computed once
+    // for a range that covers the visible renderables of several passes.
+    static void updateSummedPrimitiveCounts(
+            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
+
+    // State recorded by recordDraws() for each draw. FULL_STATE records everything, as was
+    // done before the state was tracked, it's only used to measure the size of the commands.
+    enum class RecordMode : uint8_t {
+        CHANGED_STATE,  // only the state that changed since the previous draw
+        FULL_STATE      // all the state of each draw
+    };
+
+    // Records the draws of [begin, end), which must start at a draw (i.e. not in the middle of
+    // instanced commands). 'instanceBuffer' is the index of the instance buffer of the first
+    // instanced draw. Stops at the end of the commands if 'end' is null.
+    // Returns the number of draws.
+    template<RecordMode MODE = RecordMode::CHANGED_STATE>
+    static size_t recordDraws(FEngine::DriverApi& driver,
+            Command const* begin, Command const* end,
+            utils::Slice<const Handle<HwUniformBuffer>> const& instanceBuffers,
+            size_t instanceBuffer, Handle<HwUniformBuffer> uniformRing, uint32_t first,
+            Handle<HwUniformBuffer> bones) noexcept;
 
 private:
     // Called just before rendering, make sure all needed asynchronous tasks are finished.
@@ -237,25 +391,67 @@ private:
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
+    // below this many commands, std::sort is used
+    static constexpr size_t RADIX_SORT_MIN_COUNT = 2048;
+    // the radix sort processes blocks of at least this many commands per job
+    static constexpr size_t RADIX_SORT_BLOCK_COUNT = 4096;
+    // maximum number of blocks (i.e. jobs) of the radix sort
+    static constexpr size_t RADIX_SORT_MAX_BLOCKS = 16;
+    // below this many commands, the driver commands are recorded on the calling thread
+    static constexpr size_t PARALLEL_RECORD_MIN_COUNT = 4096;
+
+    // 'first' is the first renderable of the pass, its commands are written at 'commands'
     static inline void generateCommands(uint32_t commandTypeFlags, Command* const commands,
-            FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
-            math::float3 cameraPosition, math::float3 cameraForward) noexcept;
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, uint32_t first,
+            RenderFlags renderFlags,
+            math::float3 cameraPosition, math::float3 cameraForward,
+            uint8_t visibilityMask) noexcept;
 
     template<uint32_t commandTypeFlags>
     static inline void generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
             utils::Range<uint32_t> range, RenderFlags renderFlags, math::float3 cameraPosition,
-            math::float3 cameraForward) noexcept;
+            math::float3 cameraForward, uint8_t visibilityMask) noexcept;
 
     static void setupColorCommand(Command& cmdDraw, bool hasDepthPass,
             FMaterialInstance const* const mi) noexcept;
 
-    static void recordDriverCommands(FEngine::DriverApi& driver,
-            utils::Slice<Command> const& commands) noexcept;
+    // size of the per-renderable uniforms, i.e. of each instance in the instance buffers
+    static constexpr size_t INSTANCE_UNIFORMS_SIZE = RenderableUniformRing::UNIFORMS_SIZE;
 
-    static void updateSummedPrimitiveCounts(
-            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
+    static inline bool isInstanceOf(PrimitiveInfo const& instance,
+            PrimitiveInfo const& first) noexcept;
+
+    // Merges runs of compatible commands into instanced draws, i.e. sets the instanceCount of
+    // the first command of each run, and uploads the uniforms of the instances into the
+    // instance buffers. Returns the number of instance buffers used.
+    static size_t batchInstances(FEngine& engine, InstanceBufferPool& instanceBuffers,
+            Command* commands, FScene::RenderableSoa const& soa, uint32_t first) noexcept;
+
+    // Draws with more than one instance use the next instance buffer, in order.
+    // If uniformRing is set, the per-renderable uniforms are bound from the slot of the
+    // command's renderable, i.e. (first + tag), instead of the renderable's own uniform buffer.
+    // The bones of skinned renderables are bound as a range of the 'bones' buffer.
+    static void recordDriverCommands(FEngine::DriverApi& driver,
+            utils::Slice<Command> const& commands,
+            utils::Slice<const Handle<HwUniformBuffer>> const& instanceBuffers,
+            Handle<HwUniformBuffer> uniformRing, uint32_t first,
+            Handle<HwUniformBuffer> bones) noexcept;
+
+    // Same as recordDriverCommands(), but large passes are split in chunks of draws that are
+    // recorded concurrently, each in its own part of the driver's command stream.
+    static void recordDriverCommandsParallel(FEngine& engine, utils::JobSystem& js,
+            utils::Slice<Command> const& commands,
+            utils::Slice<const Handle<HwUniformBuffer>> const& instanceBuffers,
+            Handle<HwUniformBuffer> uniformRing, uint32_t first,
+            Handle<HwUniformBuffer> bones) noexcept;
+
+    static void tagCommands(uint32_t commandTypeFlags, Command* commands,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> range,
+            uint32_t first) noexcept;
 
     const char* const mName;
+    InstanceBufferPool& mInstanceBuffers;
+    Handle<HwUniformBuffer> const mUniformRing;
 };
 
 } // namespace details
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/RenderableUniformRing.h"
+
+#include "driver/DriverApi.h"
+#include "driver/UniformBuffer.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+
+using namespace driver;
+
+namespace details {
+
+RenderableUniformRing::RenderableUniformRing() noexcept = default;
+
+RenderableUniformRing::~RenderableUniformRing() noexcept = default;
+
+void RenderableUniformRing::terminate(DriverApi& driver) {
+    for (Buffer& buffer : mBuffers) {
+        if (buffer.handle) {
+            driver.destroyUniformBuffer(buffer.handle);
+        }
+        buffer = {};
+    }
+}
+
+void RenderableUniformRing::commit(DriverApi& driver, FRenderableManager const& rcm,
+        FRenderableManager::Instance const* UTILS_RESTRICT instances,
+        Range<uint32_t> list) noexcept {
+    SYSTRACE_CALL();
+
+    mCurrent = (mCurrent + 1) % BUFFER_COUNT;
+    Buffer& buffer = mBuffers[mCurrent];
+
+    const size_t count = list.last;
+    if (UTILS_UNLIKELY(buffer.capacity < count)) {
+        // grow geometrically, so this doesn't happen every frame when the scene grows
+        if (buffer.handle) {
+            driver.destroyUniformBuffer(buffer.handle);
+        }
+        buffer.capacity = std::max(count, buffer.capacity * 2);
+        buffer.handle = driver.createUniformBuffer(buffer.capacity * SLOT_SIZE);
+    }
+
+    if (count) {
+        UniformBuffer uniforms(count * SLOT_SIZE);
+        char* const UTILS_RESTRICT p = static_cast<char*>(
+                uniforms.invalidateUniforms(0, count * SLOT_SIZE));
+        for (uint32_t i : list) {
+            UniformBuffer const& ub = rcm.getUniformBuffer(instances[i]);
+            assert(ub.getSize() == UNIFORMS_SIZE);
+            memcpy(p + i * SLOT_SIZE, ub.getBuffer(), UNIFORMS_SIZE);
+        }
+        driver.updateUniformBuffer(buffer.handle, std::move(uniforms));
+    }
+}
+
+} // namespace details
+} // namespace filament
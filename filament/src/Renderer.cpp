@@ -32,6 +32,9 @@
 #include <utils/Systrace.h>
 #include <utils/vector.h>
 
+#include <new>
+#include <type_traits>
+
 #include <assert.h>
 
 using namespace math;
@@ -49,7 +52,8 @@ FRenderer::FRenderer(FEngine& engine) :
         mFrameInfoManager(engine),
         mIsRGB16FSupported(false),
         mIsRGB8Supported(false),
-        mPerRenderPassArena(engine.getPerRenderPassAllocator())
+        mPerRenderPassArenas{ &engine.getPerRenderPassAllocator(0),
+                              &engine.getPerRenderPassAllocator(1) }
 {
 }
 
@@ -81,6 +85,7 @@ void FRenderer::terminate(FEngine& engine) {
     // shut down threads if we created any.
     DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderTarget(mRenderTarget);
+    mInstanceBuffers.terminate(driver);
 
     // before we can destroy this Renderer's resources, we must make sure
     // that all pending commands have been executed (as they could reference data in this
@@ -96,33 +101,132 @@ void FRenderer::terminate(FEngine& engine) {
 }
 
 void FRenderer::render(FView const* view) {
+    View const* const views[] = { view };
+    render(views, 1);
+}
+
+void FRenderer::render(View const* const* views, size_t count) {
     SYSTRACE_CALL();
 
     assert(mSwapChain);
 
-    if (UTILS_LIKELY(view && view->getScene())) {
-        // per-renderpass data
-        ArenaScope rootArena(mPerRenderPassArena);
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
+
+    // create a master job so no other job can escape
+    auto masterJob = js.setMasterJob(js.createJob());
+
+    /*
+     * The views are pipelined: the culling of a view and the generation of its commands run
+     * as a job while the previous view is recorded on this thread. Each view has its own
+     * per-frame data, and the two views in flight use different arenas.
+     */
+
+    std::aligned_storage<sizeof(ViewFrame), alignof(ViewFrame)>::type storage[2];
+    size_t next = 0;
+    size_t slot = 0;
+    auto prepareNextView = [&]() -> ViewFrame* {
+        while (next < count) {
+            FView* const view = const_cast<FView*>(upcast(views[next++]));
+            if (UTILS_UNLIKELY(!view || !view->getScene())) {
+                continue;
+            }
+
+            const bool hasPostProcess = view->hasPostProcessPass();
+            float2 scale = view->updateScale(mFrameInfoManager.getLastFrameTime());
+            bool useFXAA = view->getAntiAliasing() == View::AntiAliasing::FXAA;
+            if (!hasPostProcess) {
+                // dynamic scaling and FXAA are part of the post-process phase and can't happen
+                // if it's disabled.
+                useFXAA = false;
+                scale = 1.0f;
+            }
+            Viewport const svp = view->getViewport().scale(scale);
+            if (svp.empty()) {
+                continue;
+            }
+
+            ViewFrame* const frame =
+                    new(&storage[slot]) ViewFrame(*mPerRenderPassArenas[slot], view);
+            slot ^= 1;
+            frame->svp = svp;
+            frame->scale = scale;
+            frame->useFXAA = useFXAA;
+            frame->job = jobs::createJob(js, nullptr, &FRenderer::prepareViewJob, this, frame);
+            js.run(frame->job);
+            return frame;
+        }
+        return nullptr;
+    };
 
-        FEngine& engine = mEngine;
-        JobSystem& js = engine.getJobSystem();
+    ViewFrame* frame = prepareNextView();
+    while (frame) {
+        js.wait(frame->job);
 
-        // create a master job so no other job can escape
-        auto masterJob = js.setMasterJob(js.createJob());
+        // prepare the next view while this one is rendered (this must start after this view is
+        // prepared, as both views may use the same scene)
+        ViewFrame* const nextFrame = prepareNextView();
 
         // execute the render pass
-        renderJob(rootArena, const_cast<FView*>(view));
+        renderJob(*frame);
+        frame->~ViewFrame();
 
-        // make sure to flush the command buffer
+        // make sure to flush the command buffer, so the GPU can start on this view
         engine.flush();
 
-        // and wait for all jobs to finish as a safety (this should be a no-op)
-        js.runAndWait(masterJob);
-        js.reset();
+        frame = nextFrame;
     }
+
+    // and wait for all jobs to finish as a safety (this should be a no-op)
+    js.runAndWait(masterJob);
+    js.reset();
 }
 
-void FRenderer::renderJob(ArenaScope& arena, FView* view) {
+void FRenderer::prepareViewJob(ViewFrame* frame) {
+    SYSTRACE_CALL();
+
+    FEngine& engine = getEngine();
+    JobSystem& js = engine.getJobSystem();
+    FView* const view = frame->view;
+    ArenaScope& arena = frame->arena;
+
+    view->prepareVisibility(engine, arena);
+
+    // Select the level of detail of all the visible renderables and shadow casters, and compute
+    // their summed primitive counts. This is needed by the commands of both passes, which
+    // only read them and can then run concurrently.
+    FScene::RenderableSoa& soa = view->getRenderableData();
+    const Range<uint32_t> visibles{ 0, std::max(
+            view->getVisibleRenderables().last, view->getVisibleShadowCasters().last) };
+    view->updatePrimitivesLod(engine, view->getCameraInfo(), soa, visibles);
+    RenderPass::updateSummedPrimitiveCounts(soa, visibles);
+
+    /*
+     * Allocate the command buffers, the passes use their own so they can be generated
+     * concurrently.
+     */
+
+    const size_t commandsSize = FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE;
+    const size_t commandsCount = commandsSize / sizeof(Command);
+    frame->commands = GrowingSlice<Command>(
+            arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
+
+    auto parent = js.createJob();
+    if (view->hasShadowing()) {
+        frame->shadowCommands = GrowingSlice<Command>(
+                arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
+        js.run(js.createJob(parent, [frame](JobSystem& js, JobSystem::Job*) {
+            ShadowPass::generateShadowMap(js, frame->view, frame->shadowCommands,
+                    frame->cascades);
+        }));
+    }
+    js.run(js.createJob(parent, [frame](JobSystem& js, JobSystem::Job*) {
+        frame->colorCommands = ColorPass::generateColorPass(js, frame->view, frame->commands);
+    }));
+    js.runAndWait(parent);
+}
+
+void FRenderer::renderJob(ViewFrame& frame) {
     FEngine& engine = getEngine();
     JobSystem& js = engine.getJobSystem();
     FEngine::DriverApi& driver = engine.getDriverApi();
@@ -132,44 +236,37 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     // DEBUG: driver commands must all happen from the same thread. Enforce that on debug builds.
     engine.getDriverApi().debugThreading();
 
+    FView* const view = frame.view;
     Viewport const& vp = view->getViewport();
     const bool hasPostProcess = view->hasPostProcessPass();
-    float2 scale = view->updateScale(mFrameInfoManager.getLastFrameTime());
-    bool mUseFXAA = view->getAntiAliasing() == View::AntiAliasing::FXAA;
-    if (!hasPostProcess) {
-        // dynamic scaling and FXAA are part of the post-process phase and can't happen if
-        // it's disabled.
-        mUseFXAA = false;
-        scale = 1.0f;
-    }
+    const bool scaled = any(notEqual(frame.scale, float2(1.0f)));
+    const bool useFXAA = frame.useFXAA;
+    Viewport svp = frame.svp;
 
-    const bool scaled = any(notEqual(scale, float2(1.0f)));
-    Viewport svp = vp.scale(scale);
-    if (svp.empty()) {
-        return;
-    }
-
-    view->prepare(engine, driver, arena, svp);
-    // TODO: froxelization could actually start now, instead of in ColorPass::renderColorPass()
+    view->prepare(engine, driver, frame.arena, svp);
 
     /*
-     * Allocate command buffer.
+     * The CPU work of the passes ran in prepareViewJob(), while the previous view was rendered.
+     * Only the froxelization, which needs the froxel grid set up by prepare(), overlaps with
+     * the recording of the driver commands on this thread:
+     *
+     *   froxelize -----------------------------------------+
+     *                                                      v
+     *                                  record shadows --> record color --> post-process
      */
 
-    const size_t commandsSize = FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE;
-    const size_t commandsCount = commandsSize / sizeof(Command);
-    GrowingSlice<Command> commands(
-            arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
+    // start the froxelization immediately, it's only needed by the color pass
+    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
+            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
+    js.run(jobFroxelize);
 
     /*
      * Shadow pass
      */
 
     if (view->hasShadowing()) {
-        ShadowPass::renderShadowMap(engine, js, view, commands);
-        recordHighWatermark(commands); // for debugging
-        // reset the command buffer
-        commands.clear();
+        ShadowPass::renderShadowMap(engine, mInstanceBuffers, view, frame.cascades);
+        recordHighWatermark(frame.shadowCommands); // for debugging
     }
 
     /*
@@ -190,8 +287,9 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
 
     // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
     const Handle<HwRenderTarget> viewRenderTarget = getRenderTarget();
-    ColorPass::renderColorPass(engine, js,
-            colorTarget ? colorTarget->target : viewRenderTarget, view, svp, commands);
+    ColorPass::renderColorPass(engine, js, mInstanceBuffers,
+            colorTarget ? colorTarget->target : viewRenderTarget, view, svp, jobFroxelize,
+            frame.colorCommands);
 
     /*
      * Post Processing...
@@ -213,9 +311,9 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
         Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
                 translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
                             : PostProcessStage::TONE_MAPPING_OPAQUE);
-        ppm.pass(mUseFXAA ? TextureFormat::RGBA8 : ldrFormat, toneMappingProgram);
+        ppm.pass(useFXAA ? TextureFormat::RGBA8 : ldrFormat, toneMappingProgram);
 
-        if (mUseFXAA) {
+        if (useFXAA) {
             Handle<HwProgram> antiAliasingProgram = engine.getPostProcessProgram(
                     translucent ? PostProcessStage::ANTI_ALIASING_TRANSLUCENT
                                 : PostProcessStage::ANTI_ALIASING_OPAQUE);
@@ -232,7 +330,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     }
 
     // for debugging
-    recordHighWatermark(commands);
+    recordHighWatermark(frame.commands);
 }
 
 bool FRenderer::beginFrame(FSwapChain* swapChain) {
@@ -312,6 +410,9 @@ void FRenderer::endFrame() {
     rtp.gc();           // gc post-processing targets (this can generate driver commands)
     engine.flush();     // flush command stream
 
+    // this frame's commands, flushed in several command buffers
+    SYSTRACE_VALUE32("commandBytes", uint32_t(engine.takeFlushedCommandBytes()));
+
     // make sure we're done with the gcs
     js.wait(job);
 
@@ -383,6 +484,10 @@ void Renderer::render(View const* view) {
     upcast(this)->render(upcast(view));
 }
 
+void Renderer::render(View const* const* views, size_t count) {
+    upcast(this)->render(views, count);
+}
+
 bool Renderer::beginFrame(SwapChain* swapChain) {
     return upcast(this)->beginFrame(upcast(swapChain));
 }
@@ -27,10 +27,13 @@
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <functional>
 
 using namespace math;
 using namespace utils;
@@ -44,31 +47,78 @@ FScene::FScene(FEngine& engine) :
         mEngine(engine),
         mIndirectLight(engine.getDefaultIndirectLight()),
         mGpuLightData(engine) {
+    engine.getEntityManager().registerListener(&mEntityListener);
 }
 
 FScene::~FScene() noexcept = default;
 
 
-void FScene::prepare(const math::mat4f& worldOriginTansform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+void FScene::update(const math::mat4f& worldOriginTansform) {
+    SYSTRACE_CALL();
 
     FEngine& engine = mEngine;
-    EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     FTransformManager& tcm = engine.getTransformManager();
     FLightManager& lcm = engine.getLightManager();
-    // go through the list of entities, and gather the data of those that are renderables
-    auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
-    auto const& entities = mEntities;
 
+    // find out what changed since the last time we were prepared
+    Slice<const Entity> transformChanges;
+    Slice<const Entity> renderableChanges;
+    Slice<const Entity> lightChanges;
+    bool regather = mEntitiesChanged;
+    regather |= mEntityListener.destroyed.exchange(false, std::memory_order_relaxed);
+    regather |= !tcm.getChangeList().getChangesSince(mTransformSequence, transformChanges);
+    regather |= !rcm.getChangeList().getChangesSince(mRenderableSequence, renderableChanges);
+    regather |= !lcm.getChangeList().getChangesSince(mLightSequence, lightChanges);
+    for (size_t i = 0; i < 4; i++) {
+        regather |= worldOriginTansform[i] != mWorldOriginTransform[i];
+    }
+
+    if (regather || !transformChanges.empty() || !renderableChanges.empty()) {
+        mRenderableGeneration++;
+    }
 
-    // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
-    // component can be added after the entity is added to the scene.
+    if (regather) {
+        gather(worldOriginTansform);
+    } else {
+        mPrepareStamp++;
+        updateChanges(transformChanges, worldOriginTansform);
+        updateChanges(renderableChanges, worldOriginTansform);
+        updateChanges(lightChanges, worldOriginTansform);
+    }
+
+    mEntitiesChanged = false;
+    mWorldOriginTransform = worldOriginTansform;
+    mTransformSequence = tcm.getChangeList().getSequence();
+    mRenderableSequence = rcm.getChangeList().getSequence();
+    mLightSequence = lcm.getChangeList().getSequence();
+
+    // refit (or rebuild) the culling hierarchy with the new world AABBs, the per-frame arrays
+    // are copies of the cache, so the hierarchy's indices are valid for both.
+    if (mCullingHierarchyEnabled && mCullingHierarchyGeneration != mRenderableGeneration) {
+        auto const& renderableCache = mRenderableCache;
+        mCullingHierarchy.update(
+                renderableCache.data<WORLD_AABB_CENTER>(),
+                renderableCache.data<WORLD_AABB_EXTENT>(),
+                renderableCache.data<RENDERABLE_INSTANCE>(),
+                renderableCache.size());
+        mCullingHierarchyGeneration = mRenderableGeneration;
+    }
+}
+
+void FScene::prepare(RenderableSoa& renderableData, LightSoa& lightData) const noexcept {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    FLightManager& lcm = engine.getLightManager();
+
+    // FView reorders the per-frame arrays, so they're copied from our caches every time
+    auto& sceneData = renderableData;
+    auto const& renderableCache = mRenderableCache;
+    auto const& lightCache = mLightCache;
 
     // for the purpose of allocation, we'll assume all our entities are renderables
-    size_t capacity = entities.size();
+    size_t capacity = mEntities.size();
     // we need the capacity to be multiple of 16 for SIMD loops
     capacity = (capacity + 0xF) & ~0xF;
     // we need 1 extra entry at the end for teh summed primitive count
@@ -83,85 +133,244 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
     if (lightData.capacity() < capacity) {
         lightData.setCapacity(capacity);
     }
-    // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
 
+    const size_t renderableCount = renderableCache.size();
+    sceneData.resize(renderableCount);
+    std::copy_n(renderableCache.data<RENDERABLE_INSTANCE>(), renderableCount, sceneData.data<RENDERABLE_INSTANCE>());
+    std::copy_n(renderableCache.data<WORLD_TRANSFORM>(),     renderableCount, sceneData.data<WORLD_TRANSFORM>());
+    std::copy_n(renderableCache.data<VISIBILITY_STATE>(),    renderableCount, sceneData.data<VISIBILITY_STATE>());
+    std::copy_n(renderableCache.data<UBH>(),                 renderableCount, sceneData.data<UBH>());
+    std::copy_n(renderableCache.data<BONES_OFFSET>(),        renderableCount, sceneData.data<BONES_OFFSET>());
+    std::copy_n(renderableCache.data<WORLD_AABB_CENTER>(),   renderableCount, sceneData.data<WORLD_AABB_CENTER>());
+    std::copy_n(renderableCache.data<LAYERS>(),              renderableCount, sceneData.data<LAYERS>());
+    std::copy_n(renderableCache.data<WORLD_AABB_EXTENT>(),   renderableCount, sceneData.data<WORLD_AABB_EXTENT>());
+    std::fill_n(sceneData.data<VISIBLE_MASK>(), renderableCount, 0);
 
-    // find the max intensity directional light index in our local array
+    // the first entries are reserved for the directional lights (currently only one)
+    const size_t lightCount = lightCache.size();
+    lightData.resize(DIRECTIONAL_LIGHTS_COUNT + lightCount);
+    std::copy_n(lightCache.data<POSITION_RADIUS>(), lightCount, lightData.data<POSITION_RADIUS>() + DIRECTIONAL_LIGHTS_COUNT);
+    std::copy_n(lightCache.data<DIRECTION>(),       lightCount, lightData.data<DIRECTION>()       + DIRECTIONAL_LIGHTS_COUNT);
+    std::copy_n(lightCache.data<LIGHT_INSTANCE>(),  lightCount, lightData.data<LIGHT_INSTANCE>()  + DIRECTIONAL_LIGHTS_COUNT);
+
+    // find the dominant directional light, we don't store the others because we only
+    // have a single one
     float maxIntensity = 0;
+    for (DirectionalLight const& light : mDirectionalLights) {
+        const float intensity = lcm.getIntensity(light.instance);
+        if (intensity >= maxIntensity) {
+            maxIntensity = intensity;
+            lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+            lightData.elementAt<FScene::DIRECTION>(0)       = light.direction;
+            lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = light.instance;
+        }
+    }
 
-    for (Entity e : entities) {
-        if (!em.isAlive(e))
-            continue;
+    // some elements past the end of the array will be accessed by SIMD code, we need to make
+    // sure the data is valid enough as not to produce errors such as divide-by-zero
+    // (e.g. in computeLightRanges())
+    for (size_t i = lightData.size(), e = (lightData.size() + 3) & ~3; i < e; i++) {
+        new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+    }
 
-        // getInstance() always returns null if the entity is the Null entity
-        // so we don't need to check for that, but we need to check it's alive
-        auto ri = rcm.getInstance(e);
-        auto li = lcm.getInstance(e);
-        if (!ri & !li)
-            continue;
+}
 
-        // get the world transform
-        auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTansform * tcm.getWorldTransform(ti);
+void FScene::gather(const math::mat4f& worldOriginTansform) {
+    SYSTRACE_CALL();
 
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
+    EntityManager& em = engine.getEntityManager();
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+
+    // we need random access to the entities to process them in parallel
+    if (mEntitiesChanged || mEntityList.size() != mEntities.size()) {
+        mEntityList.assign(mEntities.begin(), mEntities.end());
+    }
+    const uint32_t count = uint32_t(mEntityList.size());
+    mEntityRows.resize(count);
+    mEntityComponents.resize(count);
+    mEntityIndicesValid = false;
+
+    Entity const* const UTILS_RESTRICT entities = mEntityList.data();
+    EntityRows* const UTILS_RESTRICT entityRows = mEntityRows.data();
+    EntityComponents* const UTILS_RESTRICT components = mEntityComponents.data();
+
+    /*
+     * 1) find the components of all entities, in parallel. This is where most of the time goes,
+     *    as this is 3 lookups in the component managers' hash-maps per entity.
+     */
+
+    auto lookup = [entities, components, &em, &rcm, &lcm, &tcm](uint32_t first, uint32_t c) {
+        for (size_t i = first, e = first + c; i < e; i++) {
+            const Entity entity = entities[i];
+            // getInstance() always returns null if the entity is the Null entity
+            // so we don't need to check for that, but we need to check it's alive
+            EntityComponents& ec = components[i];
+            ec.alive = em.isAlive(entity);
+            if (ec.alive) {
+                ec.ri = rcm.getInstance(entity);
+                ec.li = lcm.getInstance(entity);
+                ec.ti = tcm.getInstance(entity);
+            }
+        }
+    };
+
+    auto lookupJob = jobs::parallel_for(js, nullptr, 0, count,
+            std::ref(lookup), jobs::CountSplitter<GATHER_MIN_LOOP_COUNT, 8>());
+    js.runAndWait(lookupJob);
+
+    /*
+     * 2) assign the rows, compacting the entities that are neither renderables nor lights
+     *    (this is just counting, so it's fast enough to do serially)
+     */
+
+    uint32_t renderableCount = 0;
+    uint32_t lightCount = 0;
+    uint32_t directionalLightCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        EntityComponents const& ec = components[i];
+        EntityRows& rows = entityRows[i];
+        rows = { NO_ROW, NO_ROW, mPrepareStamp };
+        if (!ec.alive) {
+            continue;
+        }
         // don't even draw this object if it doesn't have a transform (which shouldn't happen
         // because one is always created when creating a Renderable component).
-        if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
-            // we know there is enough space in the array
-            sceneData.push_back_unsafe(
-                    ri,
-                    worldTransform,
-                    rcm.getVisibility(ri),
-                    rcm.getUbh(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
-                    0,
-                    rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
+        if (ec.ri && ec.ti) {
+            rows.renderable = renderableCount++;
         }
-
-        if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) = float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                }
+        if (ec.li) {
+            if (UTILS_UNLIKELY(lcm.isDirectionalLight(ec.li))) {
+                rows.light = DIRECTIONAL_ROW | directionalLightCount++;
             } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                rows.light = lightCount++;
+            }
+        }
+    }
+
+    mRenderableCache.resize(renderableCount);
+    mLightCache.resize(lightCount);
+    mDirectionalLights.resize(directionalLightCount);
+
+    /*
+     * 3) compute the world-space data of all entities, in parallel. Each entity writes its own
+     *    rows only.
+     */
+
+    auto fill = [this, entityRows, components, &worldOriginTansform](uint32_t first, uint32_t c) {
+        for (size_t i = first, e = first + c; i < e; i++) {
+            EntityRows const& rows = entityRows[i];
+            EntityComponents const& ec = components[i];
+            if (rows.renderable != NO_ROW) {
+                mRenderableCache.elementAt<RENDERABLE_INSTANCE>(rows.renderable) = ec.ri;
+                mRenderableCache.elementAt<VISIBLE_MASK>(rows.renderable) = 0;
+            }
+            if (rows.light != NO_ROW) {
+                if (UTILS_UNLIKELY(rows.light & DIRECTIONAL_ROW)) {
+                    mDirectionalLights[rows.light & ~DIRECTIONAL_ROW].instance = ec.li;
+                } else {
+                    mLightCache.elementAt<LIGHT_INSTANCE>(rows.light) = ec.li;
                 }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {});
             }
+            updateRows(rows, ec.ti, worldOriginTansform);
         }
+    };
+
+    auto fillJob = jobs::parallel_for(js, nullptr, 0, count,
+            std::ref(fill), jobs::CountSplitter<GATHER_MIN_LOOP_COUNT, 8>());
+    js.runAndWait(fillJob);
+}
+
+void FScene::updateChanges(Slice<const Entity> changes,
+        const math::mat4f& worldOriginTansform) noexcept {
+    if (changes.empty()) {
+        return;
     }
 
-    // some elements past the end of the array will be accessed by SIMD code, we need to make
-    // sure the data is valid enough as not to produce errors such as divide-by-zero
-    // (e.g. in computeLightRanges())
-    for (size_t i = lightData.size(), e = (lightData.size() + 3) & ~3; i < e; i++) {
-        new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+    FTransformManager& tcm = mEngine.getTransformManager();
+    auto& entityIndices = mEntityIndices;
+    if (!mEntityIndicesValid) {
+        mEntityIndicesValid = true;
+        entityIndices.clear();
+        entityIndices.reserve(mEntityList.size());
+        for (size_t i = 0, c = mEntityList.size(); i < c; i++) {
+            entityIndices.insert({ mEntityList[i], uint32_t(i) });
+        }
+    }
+
+    EntityRows* const UTILS_RESTRICT entityRows = mEntityRows.data();
+    const uint32_t stamp = mPrepareStamp;
+    for (Entity e : changes) {
+        auto pos = entityIndices.find(e);
+        if (pos == entityIndices.end()) {
+            continue;
+        }
+        // the same entity can be logged several times, and by several managers
+        EntityRows& rows = entityRows[pos->second];
+        if (rows.stamp != stamp) {
+            rows.stamp = stamp;
+            updateRows(rows, tcm.getInstance(e), worldOriginTansform);
+        }
+    }
+}
+
+void FScene::updateRows(EntityRows const& rows, TransformManager::Instance ti,
+        const math::mat4f& worldOriginTansform) noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+
+    // get the world transform
+    const mat4f worldTransform = worldOriginTansform * tcm.getWorldTransform(ti);
+
+    if (rows.renderable != NO_ROW) {
+        auto& renderableCache = mRenderableCache;
+        const size_t i = rows.renderable;
+        auto ri = renderableCache.elementAt<RENDERABLE_INSTANCE>(i);
+
+        // compute the world AABB so we can perform culling
+        const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
+
+        renderableCache.elementAt<WORLD_TRANSFORM>(i)   = worldTransform;
+        renderableCache.elementAt<VISIBILITY_STATE>(i)  = rcm.getVisibility(ri);
+        renderableCache.elementAt<UBH>(i)               = rcm.getUbh(ri);
+        renderableCache.elementAt<BONES_OFFSET>(i)      = rcm.getBonesOffset(ri);
+        renderableCache.elementAt<WORLD_AABB_CENTER>(i) = worldAABB.center;
+        renderableCache.elementAt<LAYERS>(i)            = rcm.getLayerMask(ri);
+        renderableCache.elementAt<WORLD_AABB_EXTENT>(i) = worldAABB.halfExtent;
+    }
+
+    if (rows.light != NO_ROW) {
+        if (UTILS_UNLIKELY(rows.light & DIRECTIONAL_ROW)) {
+            DirectionalLight& light = mDirectionalLights[rows.light & ~DIRECTIONAL_ROW];
+            float3 d = lcm.getLocalDirection(light.instance);
+            // using the inverse-transpose handles non-uniform scaling
+            light.direction = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+        } else {
+            auto& lightCache = mLightCache;
+            const size_t i = rows.light;
+            auto li = lightCache.elementAt<LIGHT_INSTANCE>(i);
+            const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
+            float3 d = 0;
+            if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+                d = lcm.getLocalDirection(li);
+                // using the inverse-transpose handles non-uniform scaling
+                d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+            }
+            lightCache.elementAt<POSITION_RADIUS>(i) = float4{ p.xyz, lcm.getRadius(li) };
+            lightCache.elementAt<DIRECTION>(i)       = d;
+        }
     }
 }
 
-void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept {
+void FScene::updateUBOs(RenderableSoa const& renderableData,
+        utils::Range<uint32_t> visibleRenderables) const noexcept {
     FRenderableManager& rcm = mEngine.getRenderableManager();
-    auto& sceneData = mRenderableData;
+    auto const& sceneData = renderableData;
     for (uint32_t i : visibleRenderables) {
         auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(i);
         rcm.updateLocalUBO(ri, sceneData.elementAt<WORLD_TRANSFORM>(i));
@@ -169,31 +378,57 @@ void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcep
 }
 
 void FScene::terminate(FEngine& engine) {
+    engine.getEntityManager().unregisterListener(&mEntityListener);
+
     // free-up the lights buffer
     mGpuLightData.terminate(engine);
 }
 
-void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena) noexcept {
+void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena,
+        LightSoa& lightData) const noexcept {
     FLightManager& lcm = mEngine.getLightManager();
-    GpuLightBuffer& gpuLightData = mGpuLightData;
-    FScene::LightSoa& lightData = getLightData();
 
     /*
-     * Here we copy our lights data into the GPU buffer, some lights might be left out if there
-     * are more than the GPU buffer allows (i.e. 256).
+     * Some lights might be left out if there are more than the GPU buffer allows
+     * (i.e. CONFIG_MAX_LIGHT_COUNT).
      *
-     * We always sort lights by distance to the camera plane so that:
-     * - we can build light trees
-     * - lights farther from the camera are dropped when in excess
-     *   (note this doesn't work well, e.g. for search-lights)
+     * The lights have been culled against the view frustum already, when there are still too
+     * many of them we keep the ones with the largest influence on this view, i.e. the
+     * brightest ones, weighted by the solid angle their sphere of influence covers.
+     *
+     * We then sort lights by distance to the camera plane so that we can build light trees.
      */
 
     ArenaScope arena(rootArena.getAllocator());
+    float4 const* const UTILS_RESTRICT spheres = lightData.data<FScene::POSITION_RADIUS>();
+
+    if (UTILS_UNLIKELY(lightData.size() > CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT)) {
+        float* const UTILS_RESTRICT influences =
+                arena.allocate<float>(lightData.size(), CACHELINE_SIZE);
+        auto const* UTILS_RESTRICT instances = lightData.data<FScene::LIGHT_INSTANCE>();
+        const float3 position = camera.getPosition();
+        for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
+            const float3 d = spheres[i].xyz - position;
+            const float r2 = spheres[i].w * spheres[i].w;
+            // this is 1 when the camera is inside the light's sphere of influence
+            const float solidAngle = r2 / std::max(r2, dot(d, d));
+            influences[i] = lcm.getIntensity(instances[i]) * solidAngle;
+        }
+
+        // skip directional light, and keep the most influential lights first
+        Zip2Iterator<FScene::LightSoa::iterator, float*> b = { lightData.begin(), influences };
+        std::nth_element(b + DIRECTIONAL_LIGHTS_COUNT,
+                b + DIRECTIONAL_LIGHTS_COUNT + CONFIG_MAX_LIGHT_COUNT, b + lightData.size(),
+                [](auto const& lhs, auto const& rhs) { return lhs.second > rhs.second; });
+
+        // drop excess lights
+        lightData.resize(CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT);
+    }
+
     float* const UTILS_RESTRICT distances = arena.allocate<float>(lightData.size(), CACHELINE_SIZE);
 
     // pre-compute the lights' distance to the camera plane, for sorting below
     // - we don't skip the directional light, because we don't care, it's ignored during sorting
-    float4 const* const UTILS_RESTRICT spheres = lightData.data<FScene::POSITION_RADIUS>();
     computeLightCameraPlaneDistances(distances, camera, spheres, lightData.size());
 
     // skip directional light
@@ -201,13 +436,19 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
     std::sort(b + DIRECTIONAL_LIGHTS_COUNT, b + lightData.size(),
             [](auto const& lhs, auto const& rhs) { return lhs.second < rhs.second; });
 
-    // drop excess lights
-    lightData.resize(std::min(lightData.size(), CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT));
-
     // compute the light ranges (needed when building light trees)
     float2* const zrange = lightData.data<FScene::SCREEN_SPACE_Z_RANGE>();
     computeLightRanges(zrange, camera, spheres + DIRECTIONAL_LIGHTS_COUNT, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
+}
 
+void FScene::commitDynamicLights(LightSoa const& lightData) noexcept {
+    FLightManager& lcm = mEngine.getLightManager();
+    GpuLightBuffer& gpuLightData = mGpuLightData;
+
+    // Here we copy the lights kept by prepareDynamicLights() into the GPU buffer
+    gpuLightData.prepare(mEngine, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
+
+    float4 const* const UTILS_RESTRICT spheres = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
@@ -217,7 +458,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
         lp.positionFalloff      = { spheres[i].xyz, lcm.getSquaredFalloffInv(li) };
         lp.colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
         lp.directionIES         = { directions[i], 0 };
-        lp.spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        lp.spotScaleOffset      = { lcm.getSpotParams(li).scaleOffset, 0, 0 };
     }
 
     gpuLightData.invalidate(0, lightData.size() - DIRECTIONAL_LIGHTS_COUNT);
@@ -277,11 +518,19 @@ void FScene::computeLightRanges(
 }
 
 void FScene::addEntity(Entity entity) {
-    mEntities.insert(entity);
+    mEntitiesChanged |= mEntities.insert(entity).second;
 }
 
 void FScene::remove(Entity entity) {
-    mEntities.erase(entity);
+    mEntitiesChanged |= mEntities.erase(entity) != 0;
+}
+
+void FScene::EntityListener::onEntitiesDestroyed(size_t n, Entity const* entities) noexcept {
+    destroyed.store(true, std::memory_order_relaxed);
+}
+
+void FScene::EntityListener::onAllEntitiesDestroyed() noexcept {
+    destroyed.store(true, std::memory_order_relaxed);
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -308,6 +557,16 @@ size_t FScene::getLightCount() const noexcept {
     return count;
 }
 
+void FScene::setCullingHierarchyEnabled(bool enabled) noexcept {
+    mCullingHierarchyEnabled = enabled;
+    // the hierarchy is (re)built on the next update()
+    mCullingHierarchyGeneration = ~0ull;
+    if (!enabled) {
+        // free the memory, it'll be rebuilt from scratch if re-enabled
+        mCullingHierarchy.clear();
+    }
+}
+
 void FScene::setSkybox(FSkybox const* skybox) noexcept {
     std::swap(mSkybox, skybox);
     if (skybox) {
@@ -319,13 +578,14 @@ void FScene::setSkybox(FSkybox const* skybox) noexcept {
 }
 
 void FScene::computeBounds(
+        RenderableSoa const& renderableData,
         Aabb& UTILS_RESTRICT castersBox,
         Aabb& UTILS_RESTRICT receiversBox,
-        uint32_t visibleLayers) const noexcept {
+        uint32_t visibleLayers) noexcept {
     using State = FRenderableManager::Visibility;
 
     // Compute the scene bounding volume
-    RenderableSoa const& UTILS_RESTRICT soa = mRenderableData;
+    RenderableSoa const& UTILS_RESTRICT soa = renderableData;
     float3 const* const UTILS_RESTRICT worldAABBCenter = soa.data<WORLD_AABB_CENTER>();
     float3 const* const UTILS_RESTRICT worldAABBExtent = soa.data<WORLD_AABB_EXTENT>();
     uint8_t const* const UTILS_RESTRICT layers = soa.data<LAYERS>();
@@ -379,4 +639,12 @@ size_t Scene::getLightCount() const noexcept {
     return upcast(this)->getLightCount();
 }
 
+void Scene::setCullingHierarchyEnabled(bool enabled) noexcept {
+    upcast(this)->setCullingHierarchyEnabled(enabled);
+}
+
+bool Scene::isCullingHierarchyEnabled() const noexcept {
+    return upcast(this)->isCullingHierarchyEnabled();
+}
+
 } // namespace filament
@@ -24,6 +24,7 @@
 
 #include <filament/driver/DriverEnums.h>
 
+#include <cmath>
 #include <limits>
 
 using namespace math;
@@ -43,7 +44,9 @@ static constexpr bool ENABLE_LISPSM = true;
 ShadowMap::ShadowMap(FEngine& engine) noexcept :
         mEngine(engine),
         mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN) {
-    mCamera = mEngine.createCamera(EntityManager::get().create());
+    for (Cascade& cascade : mCascades) {
+        cascade.camera = mEngine.createCamera(EntityManager::get().create());
+    }
     mDebugCamera = mEngine.createCamera(EntityManager::get().create());
     FDebugRegistry& debugRegistry = engine.getDebugRegistry();
     debugRegistry.registerProperty("d.shadowmap.focus_shadowcasters", &engine.debug.shadowmap.focus_shadowcasters);
@@ -56,16 +59,19 @@ ShadowMap::ShadowMap(FEngine& engine) noexcept :
 }
 
 ShadowMap::~ShadowMap() {
-    mEngine.destroy(mCamera->getEntity());
+    for (Cascade& cascade : mCascades) {
+        mEngine.destroy(cascade.camera->getEntity());
+    }
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
 void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     assert(mShadowMapDimension);
 
-    uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
+    // the cascades are side by side
+    const uint32_t width = uint32_t(mShadowMapDimension * mCascadeCount);
+    const uint32_t height = mShadowMapDimension;
+    if (mShadowMapWidth == width && mShadowMapHeight == height) {
         // nothing to do here.
         assert(mShadowMapHandle);
         return;
@@ -80,17 +86,16 @@ void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
     }
 
     // allocate new ones...
-    // we set a viewport with a 1-texel border for when we index outside of the texture
-    // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
-    // see: computeLightSpaceMatrix()
-    mViewport = { 1, 1, dim - 2, dim - 2 };
+    invalidate();
+    mShadowMapWidth = width;
+    mShadowMapHeight = height;
 
     mShadowMapHandle = driver.createTexture(
-            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
-            TextureUsage::DEPTH_ATTACHMENT);
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1,
+            width, height, 1, TextureUsage::DEPTH_ATTACHMENT);
 
     mShadowMapRenderTarget = driver.createRenderTarget(
-            TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
+            TargetBufferFlags::SHADOW, width, height, 1, Driver::TextureFormat::DEPTH16,
             {}, { mShadowMapHandle }, {});
 
     SamplerParams s;
@@ -111,98 +116,193 @@ void ShadowMap::terminate(DriverApi& driverApi) noexcept {
     }
 }
 
-void ShadowMap::beginRenderPass(DriverApi& driver) const noexcept {
+void ShadowMap::beginRenderPass(DriverApi& driver, size_t cascade, bool clear) const noexcept {
     RenderPassParams params = {};
-    params.clear = TargetBufferFlags::SHADOW;
-    params.discardStart = TargetBufferFlags::DEPTH;
+    if (clear) {
+        // this clears all the cascades
+        params.clear = TargetBufferFlags::SHADOW;
+        params.discardStart = TargetBufferFlags::DEPTH;
+    }
     params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
     params.clearDepth = 1.0;
-    params.width = params.height = mShadowMapDimension;
+    params.width = mShadowMapWidth;
+    params.height = mShadowMapHeight;
     // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is reloaded
     // needlessly.
     params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
     driver.beginRenderPass(mShadowMapRenderTarget, params);
 
-    driver.viewport(mViewport.left, mViewport.bottom,
-            mViewport.width, mViewport.height);
+    Viewport const& viewport = mCascades[cascade].viewport;
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+bool ShadowMap::isCascadeUpToDate(size_t cascade,
+        uint64_t commandsGeneration, uint64_t materialsGeneration) const noexcept {
+    Cascade const& c = mCascades[cascade];
+    if (!c.rendered || c.renderedVisibleShadows != c.hasVisibleShadows) {
+        return false;
+    }
+    if (!c.hasVisibleShadows) {
+        // the cascade is just cleared
+        return true;
+    }
+    if (c.renderedCommands != commandsGeneration || c.renderedMaterials != materialsGeneration) {
+        return false;
+    }
+    for (size_t i = 0; i < 4; i++) {
+        if (c.renderedLightSpace[i] != c.lightSpace[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShadowMap::setCascadeRendered(size_t cascade,
+        uint64_t commandsGeneration, uint64_t materialsGeneration) noexcept {
+    Cascade& c = mCascades[cascade];
+    c.renderedLightSpace = c.lightSpace;
+    c.renderedCommands = commandsGeneration;
+    c.renderedMaterials = materialsGeneration;
+    c.renderedVisibleShadows = c.hasVisibleShadows;
+    c.rendered = true;
+}
+
+void ShadowMap::invalidate() noexcept {
+    for (Cascade& cascade : mCascades) {
+        cascade.rendered = false;
+    }
+}
+
+// returns 'projection' with its near and far planes moved to 'n' and 'f'
+static mat4f setNearFar(mat4f projection, float n, float f) noexcept {
+    if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
+        // ortho projection
+        projection[2].z =    2.0f / (n - f);
+        projection[3].z = (f + n) / (n - f);
+    } else {
+        // perspective projection
+        projection[2].z =     (f + n) / (n - f);
+        projection[3].z = (2 * f * n) / (n - f);
+    }
+    return projection;
 }
 
 void ShadowMap::update(
-        const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-        details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+        const FScene::LightSoa& lightData, size_t index,
+        FScene::RenderableSoa const& renderableData,
+        details::CameraInfo const& camera, uint8_t visibleLayers,
+        size_t cascadeCount, View::CascadeSplitScheme scheme) noexcept {
     // this is the hard part here, find a good frustum for our camera
 
     auto& lcm = mEngine.getLightManager();
 
     FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
     mShadowMapDimension = std::max(1u, lcm.getShadowMapSize(li));
-
-    FLightManager::ShadowParams params = lcm.getShadowParams(li);
-    mat4f projection(camera.cullingProjection);
-    if (params.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.shadowFar;
-        if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
-            // perspective projection
-            projection[2].z =     (f + n) / (n - f);
-            projection[3].z = (2 * f * n) / (n - f);
-        } else {
-            // ortho projection
-            projection[2].z =    2.0f / (n - f);
-            projection[3].z = (f + n) / (n - f);
-        }
+    mCascadeCount = std::max(size_t(1), std::min(cascadeCount, CONFIG_MAX_SHADOW_CASCADES));
+    mHasVisibleShadows = false;
+    for (Cascade& cascade : mCascades) {
+        cascade.hasVisibleShadows = false;
     }
 
-    CameraInfo cameraInfo = {
-            .projection = projection,
-            .model = camera.model,
-            .view = camera.view,
-            .zn = camera.zn,
-            .zf = camera.zf,
-            .dzn = std::max(0.0f, params.shadowNearHint - camera.zn),
-            .dzf = std::max(0.0f, camera.zf - params.shadowFarHint),
-            .frustum = Frustum(projection * camera.view),
-            .worldOrigin = camera.worldOrigin
-    };
-
-    // debugging...
-    const float dz = cameraInfo.zf - cameraInfo.zn;
-    float& dzn = mEngine.debug.shadowmap.dzn;
-    float& dzf = mEngine.debug.shadowmap.dzf;
-    if (dzn < 0)    dzn = cameraInfo.dzn / dz;
-    else            cameraInfo.dzn = dzn * dz;
-    if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
-    else            cameraInfo.dzf =-dzf * dz;
-
+    // the cascades split the view frustum up to the shadow far plane
+    FLightManager::ShadowParams params = lcm.getShadowParams(li);
+    const float zn = camera.zn;
+    const float zf = params.shadowFar > 0.0f ? params.shadowFar : camera.zf;
+    computeCascadeSplits(mCascadeSplits, mCascadeCount, scheme, zn, zf);
 
     using Type = FLightManager::Type;
-    switch (lcm.getType(li)) {
-        case Type::SUN:
-        case Type::DIRECTIONAL:
-            computeShadowCameraDirectional(
-                    lightData.elementAt<FScene::DIRECTION>(index), scene, cameraInfo,
-                    visibleLayers);
-            break;
-        case Type::FOCUSED_SPOT:
-        case Type::SPOT:
-            break;
-        case Type::POINT:
-            break;
+    const Type type = lcm.getType(li);
+    if (type != Type::SUN && type != Type::DIRECTIONAL) {
+        // spot and point lights don't have shadows yet
+        return;
     }
-}
-
-void ShadowMap::computeShadowCameraDirectional(
-        math::float3 const& dir, FScene const* scene, CameraInfo const& camera,
-        uint8_t visibleLayers) noexcept {
 
     // scene bounds in world space
     Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
-    scene->computeBounds(wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
+    FScene::computeBounds(renderableData,
+            wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
     if (wsShadowCastersVolume.isEmpty() || wsShadowReceiversVolume.isEmpty()) {
-        mHasVisibleShadows = false;
         return;
     }
 
+    for (size_t i = 0; i < mCascadeCount; i++) {
+        const float n = i ? mCascadeSplits[i - 1] : zn;
+        const float f = mCascadeSplits[i];
+        const mat4f projection = (params.shadowFar > 0.0f || mCascadeCount > 1) ?
+                setNearFar(camera.cullingProjection, n, f) : camera.cullingProjection;
+
+        CameraInfo cameraInfo = {
+                .projection = projection,
+                .model = camera.model,
+                .view = camera.view,
+                .zn = camera.zn,
+                .zf = camera.zf,
+                .dzn = std::max(0.0f, params.shadowNearHint - camera.zn),
+                .dzf = std::max(0.0f, camera.zf - params.shadowFarHint),
+                .frustum = Frustum(projection * camera.view),
+                .worldOrigin = camera.worldOrigin
+        };
+
+        // debugging...
+        const float dz = cameraInfo.zf - cameraInfo.zn;
+        float& dzn = mEngine.debug.shadowmap.dzn;
+        float& dzf = mEngine.debug.shadowmap.dzf;
+        if (dzn < 0)    dzn = cameraInfo.dzn / dz;
+        else            cameraInfo.dzn = dzn * dz;
+        if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
+        else            cameraInfo.dzf =-dzf * dz;
+
+        // the cascades are side by side, each with a 1-texel border for when we index outside
+        // of it. DON'T CHANGE this unless getTextureCoordsMapping() is updated too.
+        const uint32_t dim = mShadowMapDimension;
+        mCascades[i].viewport = { int32_t(i * dim + 1), 1, dim - 2, dim - 2 };
+
+        computeShadowCameraDirectional(lightData.elementAt<FScene::DIRECTION>(index),
+                wsShadowCastersVolume, wsShadowReceiversVolume, cameraInfo, i);
+        mHasVisibleShadows |= mCascades[i].hasVisibleShadows;
+    }
+}
+
+void ShadowMap::computeCascadeSplits(float* splits, size_t count,
+        View::CascadeSplitScheme scheme, float near, float far) noexcept {
+    // the logarithmic split needs a positive near plane, which ortho cameras may not have
+    const bool hasLogarithmicSplit = near > 0.0f;
+    for (size_t i = 1; i < count; i++) {
+        const float t = float(i) / float(count);
+        const float uniform = near + (far - near) * t;
+        const float logarithmic = hasLogarithmicSplit ? near * std::pow(far / near, t) : uniform;
+        switch (scheme) {
+            case View::CascadeSplitScheme::UNIFORM:
+                splits[i - 1] = uniform;
+                break;
+            case View::CascadeSplitScheme::LOGARITHMIC:
+                splits[i - 1] = logarithmic;
+                break;
+            case View::CascadeSplitScheme::PRACTICAL:
+                splits[i - 1] = 0.5f * (uniform + logarithmic);
+                break;
+        }
+    }
+    splits[count - 1] = far;
+}
+
+void ShadowMap::computeShadowCameraDirectional(
+        math::float3 const& dir, Aabb const& wsShadowCastersVolume,
+        Aabb const& wsShadowReceiversVolume, CameraInfo const& camera,
+        size_t cascade) noexcept {
+
+    Cascade& c = mCascades[cascade];
+
+    // by default, the cascade has no shadows: everything maps to the middle of its (cleared)
+    // texels, in front of the light
+    const float u = (float(cascade) + 0.5f) / float(mCascadeCount);
+    c.lightSpace = mat4f(mat4f::row_major_init{
+            0, 0, 0, u,
+            0, 0, 0, 0.5f,
+            0, 0, 0, 0,
+            0, 0, 0, 1
+    });
+
     float3 wsViewFrustumCorners[8];
     computeFrustumCorners(wsViewFrustumCorners,
             camera.model * FCamera::inverseProjection(camera.projection));
@@ -212,9 +312,11 @@ void ShadowMap::computeShadowCameraDirectional(
     size_t vertexCount = intersectFrustumWithBox(mWsClippedShadowReceiverVolume,
             camera.frustum, wsViewFrustumCorners, wsShadowReceiversVolume);
 
-    mHasVisibleShadows = vertexCount >= 2;
-    if (mHasVisibleShadows) {
-        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm;
+    c.hasVisibleShadows = vertexCount >= 2;
+    if (c.hasVisibleShadows) {
+        // the cascades already distribute the resolution along the view direction
+        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm &&
+                mCascadeCount == 1;
 
         /*
          * Compute the light's model matrix
@@ -331,9 +433,9 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // For directional lights, we further constraint the light frustum to the
         // intersection of the shadow casters & receivers in light-space.
-        // However, since this relies on the 1-texel shadow map border, this wouldn't directly
-        // work if we were storing several shadow maps in a single texture.
-        if (mEngine.debug.shadowmap.focus_shadowcasters) {
+        // However, since this relies on the 1-texel shadow map border, this doesn't work
+        // with cascades, which are stored side by side in a single texture.
+        if (mEngine.debug.shadowmap.focus_shadowcasters && mCascadeCount == 1) {
             intersectWithShadowCasters(lsLightFrustum, WLMpMv, wsShadowCastersVolume);
         }
 
@@ -341,7 +443,7 @@ void ShadowMap::computeShadowCameraDirectional(
                            (lsLightFrustum.min.y >= lsLightFrustum.max.y))) {
             // this could happen if the only thing visible is a perfectly horizontal or
             // vertical thin line
-            mHasVisibleShadows = false;
+            c.hasVisibleShadows = false;
             return;
         }
 
@@ -377,13 +479,15 @@ void ShadowMap::computeShadowCameraDirectional(
         // Final shadowmap texture transform
         const mat4f St = mat4f(MbMt * S);
 
-        mTexelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
-        mLightSpace = St;
-        mSceneRange = (zfar - znear);
-        mCamera->setCustomProjection(mat4(S), znear, zfar);
+        c.texelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
+        c.lightSpace = getAtlasMapping(cascade) * St;
+        c.sceneRange = (zfar - znear);
+        c.camera->setCustomProjection(mat4(S), znear, zfar);
 
-        // for the debug camera, we need to undo the world origin
-        mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+        if (cascade == 0) {
+            // for the debug camera, we need to undo the world origin
+            mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+        }
     }
 }
 
@@ -490,6 +594,19 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
     return Mb * Mt;
 }
 
+mat4f ShadowMap::getAtlasMapping(size_t cascade) const noexcept {
+    // maps the texture coordinates of a cascade to its place in the shadow map, where the
+    // cascades are side by side
+    const float s = 1.0f / float(mCascadeCount);
+    const float o = float(cascade) * s;
+    return mat4f(mat4f::row_major_init{
+            s, 0, 0, o,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1
+    });
+}
+
 // This construct a frustum (similar to glFrustum or math::frustum), except
 // it looks towards the +y axis, and assumes -1,1 for the left/right and bottom/top planes.
 mat4f ShadowMap::warpFrustum(float n, float f) noexcept {
@@ -52,6 +52,19 @@ static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
 static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
 static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
 
+// with several shadow cascades, each one has its own bit for its shadow casters
+static constexpr size_t VISIBLE_CASCADE_BIT = 2u;
+static constexpr uint8_t VISIBLE_CASCADES =
+        ((1u << CONFIG_MAX_SHADOW_CASCADES) - 1u) << VISIBLE_CASCADE_BIT;
+
+static_assert(VISIBLE_CASCADE_BIT + CONFIG_MAX_SHADOW_CASCADES <= 8,
+        "The cascades bits don't fit in the VISIBLE_MASK");
+static_assert(View::MAX_SHADOW_CASCADES == CONFIG_MAX_SHADOW_CASCADES,
+        "View::MAX_SHADOW_CASCADES must match CONFIG_MAX_SHADOW_CASCADES");
+
+// clip-space w below which a renderable's screen size is considered infinite
+static constexpr float MIN_SCREEN_SIZE_DEPTH = 1e-6f;
+
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(engine.getPerViewUib()),
@@ -86,6 +99,7 @@ void FView::terminate(FEngine& engine) {
     driverApi.destroySamplerBuffer(mPerViewSbh);
     mDirectionalShadowMap.terminate(driverApi);
     mFroxelizer.terminate(driverApi);
+    mRenderableUniformRing.terminate(driverApi);
 }
 
 void FView::setViewport(Viewport const& viewport) noexcept {
@@ -136,10 +150,28 @@ void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options)
     }
 }
 
+void FView::setScene(FScene* scene) noexcept {
+    mScene = scene;
+    if (scene) {
+        // the scene's lights are read from the per-view samplers, like the froxels
+        mPerViewSb.setBuffer(FEngine::PerViewSib::LIGHTS, scene->getGpuLightBuffer().getBuffer());
+    }
+}
+
 void FView::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     mFroxelizer.setOptions(zLightNear, zLightFar);
 }
 
+static_assert(View::MAX_FROXEL_COUNT == FROXEL_BUFFER_ENTRY_COUNT_MAX,
+        "View::MAX_FROXEL_COUNT must match the froxel buffer size");
+static_assert(View::MAX_FROXEL_SLICE_COUNT == FROXEL_SLICE_COUNT_MAX,
+        "View::MAX_FROXEL_SLICE_COUNT must match the Froxelizer");
+
+void FView::setFroxelOptions(FroxelOptions const& options) noexcept {
+    mFroxelOptions = options;
+    mFroxelizer.setFroxelOptions(options.froxelCount, options.sliceCount, options.adaptive);
+}
+
 
 math::float2 FView::updateScale(duration frameTime) noexcept {
     DynamicResolutionOptions const& options = mDynamicResolution;
@@ -256,7 +288,7 @@ bool FView::isSkyboxVisible() const noexcept {
     return skybox != nullptr && (skybox->getLayerMask() & mVisibleLayers);
 }
 
-void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
+void FView::prepareShadowing(FEngine& engine,
         FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
     SYSTRACE_CALL();
 
@@ -265,34 +297,51 @@ void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
 
     auto& lcm = engine.getLightManager();
     UniformBuffer& u = getUb();
-    FScene* const scene = mScene;
 
     // dominant directional light is always as index 0
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
     mHasShadowing = mShadowingEnabled && directionalLight && lcm.isShadowCaster(directionalLight);
     if (UTILS_UNLIKELY(mHasShadowing)) {
-        // compute the frustum for this light
+        // compute the frustum of each cascade for this light
         ShadowMap& shadowMap = mDirectionalShadowMap;
-        shadowMap.update(lightData, 0, scene, mViewingCameraInfo, mVisibleLayers);
+        shadowMap.update(lightData, 0, renderableData, mViewingCameraInfo, mVisibleLayers,
+                mShadowCascadeCount, mShadowCascadeSplitScheme);
         if (shadowMap.hasVisibleShadows()) {
-            // Cull shadow casters
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum);
-
-            // allocates shadowmap driver resources
-            shadowMap.prepare(driver, getUs());
-
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
+            const size_t cascadeCount = shadowMap.getCascadeCount();
+
+            // Cull shadow casters of each cascade
+            for (size_t i = 0; i < cascadeCount; i++) {
+                if (shadowMap.hasVisibleShadows(i)) {
+                    Frustum const& frustum = shadowMap.getCamera(i).getFrustum();
+                    prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum,
+                            cascadeCount > 1 ? VISIBLE_CASCADE_BIT + i : VISIBLE_SHADOW_CASTER_BIT);
+                }
+            }
 
-            // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
-            // needed with other APIs, but at least it won't worsen the acnee there.
-            const float sceneRange = shadowMap.getSceneRange();
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
             const float constantBias = lcm.getShadowConstantBias(directionalLight);
             const float normalBias = lcm.getShadowNormalBias(directionalLight);
-            u.setUniform(offsetof(FEngine::PerViewUib, shadowBias),
-                    float3{ 2 * constantBias / sceneRange, normalBias * texelSizeWorldSpace, 0 });
+            float4 cascadeSplits{ std::numeric_limits<float>::max() };
+            float4 cascadeNormalBias{ 0 };
+            for (size_t i = 0; i < cascadeCount; i++) {
+                // The constant bias is applied by the light space matrix, i.e. it's subtracted
+                // from the depth in the shadow map before the perspective divide.
+                // The 2x bias is needed in opengl because the depth maps to -1/1. It may not be
+                // needed with other APIs, but at least it won't worsen the acnee there.
+                const float depthBias = shadowMap.hasVisibleShadows(i) ?
+                        2 * constantBias / shadowMap.getSceneRange(i) : 0.0f;
+                mat4f lightFromWorldMatrix(shadowMap.getLightSpaceMatrix(i));
+                for (size_t j = 0; j < 4; j++) {
+                    lightFromWorldMatrix[j].z -= depthBias * lightFromWorldMatrix[j].w;
+                }
+                u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix) +
+                        i * sizeof(mat4f), lightFromWorldMatrix);
+
+                cascadeSplits[i] = shadowMap.getCascadeSplits()[i];
+                cascadeNormalBias[i] = normalBias * shadowMap.getTexelSizeWorldSpace(i);
+            }
+            u.setUniform(offsetof(FEngine::PerViewUib, cascadeCount), uint32_t(cascadeCount));
+            u.setUniform(offsetof(FEngine::PerViewUib, cascadeSplits), cascadeSplits);
+            u.setUniform(offsetof(FEngine::PerViewUib, cascadeNormalBias), cascadeNormalBias);
         }
     }
 }
@@ -305,10 +354,9 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     const CameraInfo& camera = mViewingCameraInfo;
     FScene* const scene = mScene;
 
-    scene->prepareDynamicLights(camera, arena);
-
     // here the array of visible lights has been shrunk to CONFIG_MAX_LIGHT_COUNT
-    auto const& lightData = scene->getLightData();
+    auto const& lightData = mLightData;
+    scene->commitDynamicLights(lightData);
 
     // trace the number of visible lights
     SYSTRACE_VALUE32("visibleLights", lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
@@ -372,36 +420,42 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     // Dynamic lighting
     if (mHasDynamicLighting) {
         Froxelizer& froxelizer = mFroxelizer;
-        if (froxelizer.prepare(driver, arena, viewport, camera.projection, camera.zn, camera.zf)) {
+        if (froxelizer.prepare(driver, arena, viewport, camera.projection, camera.zn, camera.zf,
+                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT)) {
             froxelizer.updateUniforms(u); // update our uniform buffer if needed
         }
     }
 }
 
-void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
-        Viewport const& viewport) noexcept {
-    JobSystem& js = engine.getJobSystem();
-
-    /*
-     * Prepare the scene -- this is where we gather all the objects added to the scene,
-     * and in particular their world-space AABB.
-     */
-
-    FScene* const scene = getScene();
-
+mat4f FView::getWorldOriginTransform() const noexcept {
     /*
      * We apply a "world origin" to "everything" in order to implement the IBL rotation.
      * The "world origin" could also be useful for other things, like keeping the origin
      * close to the camera position to improve fp precision in the shader for large scenes.
      */
     mat4f worldOriginScene;
-    FIndirectLight const* const ibl = scene->getIndirectLight();
+    FIndirectLight const* const ibl = mScene->getIndirectLight();
     if (ibl) {
         // the IBL transformation must be a rigid transform
-        mat3f rotation{ scene->getIndirectLight()->getRotation() };
+        mat3f rotation{ ibl->getRotation() };
         // for a rigid-body transform, the inverse is the transpose
         worldOriginScene = mat4f{ transpose(rotation) };
     }
+    return worldOriginScene;
+}
+
+void FView::prepareVisibility(FEngine& engine, ArenaScope& arena) noexcept {
+    SYSTRACE_CALL();
+
+    JobSystem& js = engine.getJobSystem();
+
+    /*
+     * Prepare the scene -- this is where we gather all the objects added to the scene,
+     * and in particular their world-space AABB.
+     */
+
+    FScene* const scene = getScene();
+    const mat4f worldOriginScene = getWorldOriginTransform();
 
     /*
      * Calculate all camera parameters needed to render this View for this frame.
@@ -433,32 +487,67 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
             // world origin transform, use only for debugging
             .worldOrigin        = worldOriginCamera
     };
-    mCullingFrustum = FCamera::getFrustum(
-            mCullingCamera->getCullingProjectionMatrix(),
-            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
+    const mat4f cullingView{
+            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()) };
+    const mat4f cullingProjection{ mCullingCamera->getCullingProjectionMatrix() };
+    mCullingFrustum = FCamera::getFrustum(mCullingCamera->getCullingProjectionMatrix(), cullingView);
 
     /*
      * Gather all information needed to render this scene. Apply the world origin to all
-     * objects in the scene.
+     * objects in the scene. The update is cheap if the scene was already updated (e.g. by a
+     * previous view) and nothing changed since.
      */
-    scene->prepare(worldOriginScene);
+    scene->update(worldOriginScene);
+    scene->prepare(mRenderableData, mLightData);
+
+    // the commands of the previous frame can't be reused if the renderables changed
+    if (mCommandCacheScene != scene ||
+            mCommandCacheGeneration != scene->getRenderableGeneration()) {
+        mCommandCacheScene = scene;
+        mCommandCacheGeneration = scene->getRenderableGeneration();
+        mColorPassCommandCache.invalidate();
+        for (auto& cache : mShadowPassCommandCaches) {
+            cache.invalidate();
+        }
+    }
 
     /*
      * Culling: as soon as possible we perform our camera-culling
      * (this will set the VISIBLE_RENDERABLE bit)
      */
 
-    FScene::RenderableSoa& renderableData = scene->getRenderableData();
+    FScene::RenderableSoa& renderableData = mRenderableData;
     Slice<Culler::result_type> cullingMask = renderableData.slice<FScene::VISIBLE_MASK>();
     std::fill(cullingMask.begin(), cullingMask.end(), 0); // TODO: can we avoid this fill?
     prepareVisibleRenderables(js, renderableData);
 
+    /*
+     * Screen sizes: compute the projected size of all the renderables, which selects their
+     * level of detail, and cull the visible ones that are too small
+     * (this will clear the VISIBLE_RENDERABLE bit)
+     */
+
+    const mat4f clipFromWorld = cullingProjection * cullingView;
+    const float contributionThreshold = isCullingEnabled() && mViewport.height ?
+            mContributionCullingThreshold / float(mViewport.height) : 0.0f;
+    computeScreenSizes(js, renderableData, clipFromWorld, cullingProjection[1][1],
+            contributionThreshold, VISIBLE_RENDERABLE_BIT);
+
+    /*
+     * Occlusion culling: hide the renderables behind the occluders
+     * (this will clear the VISIBLE_RENDERABLE bit)
+     */
+
+    if (mOcclusionCulling && isCullingEnabled()) {
+        prepareOccludedRenderables(engine, js, renderableData, clipFromWorld);
+    }
+
     /*
      * Shadowing: compute the shadow camera and cull shadow casters
-     * (this will set the VISIBLE_SHADOW_CASTER bit)
+     * (this will set the VISIBLE_SHADOW_CASTER bit, or the bit of each cascade)
      */
 
-    prepareShadowing(engine, driver, renderableData, scene->getLightData());
+    prepareShadowing(engine, renderableData, mLightData);
 
     /*
      * partition the array of renderable w.r.t their visibility:
@@ -484,10 +573,6 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     uint32_t iEnd = uint32_t(endCastersOnly - beginRenderables);
     mVisibleRenderables = Range{ 0, uint32_t(beginCastersOnly - beginRenderables) };
     mVisibleShadowCasters = Range{ uint32_t(beginCasters - beginRenderables), iEnd };
-    Range merged = { 0, iEnd };
-
-    // update those UBOs
-    scene->updateUBOs(merged);
 
     /*
      * Light culling
@@ -495,12 +580,32 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
      * TODO: this could be done in parallel with culling above
      */
 
-    prepareVisibleLights(engine.getLightManager(), js, scene->getLightData());
+    prepareVisibleLights(engine.getLightManager(), js, mLightData);
+
+    // keep the lights with the most influence and sort them, for the froxelization
+    scene->prepareDynamicLights(mViewingCameraInfo, arena, mLightData);
+}
+
+void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
+        Viewport const& viewport) noexcept {
+    SYSTRACE_CALL();
+
+    FScene* const scene = getScene();
+    FScene::RenderableSoa& renderableData = mRenderableData;
+    const Range merged = { 0, std::max(mVisibleRenderables.last, mVisibleShadowCasters.last) };
+
+    // allocates shadowmap driver resources
+    if (hasShadowing()) {
+        mDirectionalShadowMap.prepare(driver, getUs());
+    }
+
+    // update those UBOs
+    scene->updateUBOs(renderableData, merged);
 
     /*
      * Prepare lighting -- this is where we update the lights UBOs, set-up the IBL,
      * set-up the froxelization parameters.
-     * Relies on FScene::prepare() and prepareVisibleLights()
+     * Relies on prepareVisibility()
      */
 
     prepareLighting(engine, driver, arena, viewport);
@@ -512,9 +617,17 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     float fraction = (engine.getTime().count() % 1000000000) / 1000000000.0f;
     getUb().setUniform(offsetof(FEngine::PerViewUib, time), fraction);
 
-    // upload the renderables's dirty UBOs
-    engine.getRenderableManager().prepare(driver,
-            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+    // upload the renderables's dirty UBOs, or all of them at once in the ring buffer
+    // (the render passes can only find their renderable's slot up to MAX_RENDERABLE_COUNT)
+    FRenderableManager& rcm = engine.getRenderableManager();
+    mRenderableUniformRingUsed = mRenderableUniformPacking &&
+            merged.size() < RenderPass::MAX_RENDERABLE_COUNT;
+    if (mRenderableUniformRingUsed) {
+        mRenderableUniformRing.commit(driver, rcm,
+                renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+    }
+    rcm.prepare(driver, renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged,
+            !mRenderableUniformRingUsed);
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
@@ -534,9 +647,13 @@ void FView::computeVisibilityMasks(
         FRenderableManager::Visibility v = visibility[i];
         bool inVisibleLayer = layers[i] & visibleLayers;
         bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE))    && inVisibleLayer;
-        bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_CASTER)) && inVisibleLayer && v.castShadows;
+        bool visShadowCasters = (!v.culling || (mask & (VISIBLE_SHADOW_CASTER | VISIBLE_CASCADES)))
+                && inVisibleLayer && v.castShadows;
+        // renderables that are not culled cast shadows in all the cascades
+        Culler::result_type cascades = v.culling ? (mask & VISIBLE_CASCADES) : VISIBLE_CASCADES;
         visibleMask[i] = Culler::result_type(visRenderables) |
-                         Culler::result_type(visShadowCasters << 1);
+                         Culler::result_type(visShadowCasters << 1) |
+                         (visShadowCasters ? cascades : Culler::result_type(0));
     }
 }
 
@@ -546,7 +663,8 @@ UTILS_NOINLINE
         FScene::RenderableSoa::iterator end,
         uint8_t mask) noexcept {
     return std::partition(begin, end, [mask](auto it) {
-        return it.template get<FScene::VISIBLE_MASK>() == mask;
+        // the cascades bits don't matter here
+        return (it.template get<FScene::VISIBLE_MASK>() & VISIBLE_ALL) == mask;
     });
 }
 
@@ -590,7 +708,7 @@ void FView::froxelize(FEngine& engine) const noexcept {
 
     if (mHasDynamicLighting) {
         // froxelize lights
-        mFroxelizer.froxelizeLights(engine, mViewingCameraInfo, mScene->getLightData());
+        mFroxelizer.froxelizeLights(engine, mViewingCameraInfo, mLightData);
     }
 }
 
@@ -617,18 +735,113 @@ void FView::prepareVisibleRenderables(JobSystem& js,
         FScene::RenderableSoa& renderableData) const noexcept {
     SYSTRACE_CALL();
     if (UTILS_LIKELY(isCullingEnabled())) {
-        cullRenderables(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        CullingHierarchy const* hierarchy = mScene->getCullingHierarchy();
+        if (hierarchy) {
+            cullRenderables(js, renderableData, *hierarchy,
+                    mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        } else {
+            cullRenderables(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        }
     } else {
         std::fill(renderableData.begin<FScene::VISIBLE_MASK>(),
                   renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
     }
 }
 
+void FView::computeScreenSizes(JobSystem& js, FScene::RenderableSoa& renderableData,
+        mat4f const& clipFromWorld, float projectionScale, float threshold, size_t bit) noexcept {
+    SYSTRACE_CALL();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    float       * screenSizes     = renderableData.data<FScene::SCREEN_SIZE>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // The projected radius of a sphere at the clip-space w, as a fraction of the viewport
+    // height, is radius * projectionScale / (2 * w); w is 1 with orthographic projections.
+    // Spheres close to, or behind, the camera get a very large size.
+    const float4 wPlane{ clipFromWorld[0][3], clipFromWorld[1][3],
+                         clipFromWorld[2][3], clipFromWorld[3][3] };
+    const float scale = 0.5f * std::abs(projectionScale);
+    const uint8_t mask = uint8_t(1u << bit);
+
+    // screen size job (this runs on multiple threads)
+    auto functor = [=](uint32_t index, uint32_t c) {
+        float3 const* UTILS_RESTRICT center = worldAABBCenter + index;
+        float3 const* UTILS_RESTRICT extent = worldAABBExtent + index;
+        float* UTILS_RESTRICT sizes = screenSizes + index;
+        uint8_t* UTILS_RESTRICT visible = visibleArray + index;
+
+        #pragma clang loop vectorize_width(8)
+        for (size_t i = 0; i < c; i++) {
+            const float radius = std::sqrt(dot(extent[i], extent[i]));
+            const float w = wPlane.x * center[i].x + wPlane.y * center[i].y +
+                            wPlane.z * center[i].z + wPlane.w;
+            const float size = radius * scale / std::max(w, MIN_SCREEN_SIZE_DEPTH);
+            sizes[i] = size;
+            visible[i] = size < threshold ? uint8_t(visible[i] & ~mask) : visible[i];
+        }
+    };
+
+    // launch the computation on multiple threads
+    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.runAndWait(job);
+}
+
+UTILS_NOINLINE
+void FView::prepareOccludedRenderables(FEngine& engine, JobSystem& js,
+        FScene::RenderableSoa& renderableData, mat4f const& clipFromWorld) noexcept {
+    SYSTRACE_CALL();
+
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    auto const* UTILS_RESTRICT instances  = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* UTILS_RESTRICT transforms = renderableData.data<FScene::WORLD_TRANSFORM>();
+    auto const* UTILS_RESTRICT visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t* UTILS_RESTRICT visibleMask   = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // only the occluders that survived frustum culling can hide anything
+    mOcclusionCuller.reset(clipFromWorld);
+    mOccluders.clear();
+    for (uint32_t i = 0, c = uint32_t(renderableData.size()); i < c; i++) {
+        if (visibility[i].occluder && (visibleMask[i] & VISIBLE_RENDERABLE)) {
+            if (!mOcclusionCuller.addOccluder(transforms[i], rcm.getAABB(instances[i]))) {
+                break;
+            }
+            mOccluders.push_back(i);
+        }
+    }
+    if (mOccluders.empty()) {
+        return;
+    }
+
+    mOcclusionCuller.rasterize(js);
+    mOcclusionCuller.cull(js, visibleMask,
+            renderableData.data<FScene::WORLD_AABB_CENTER>(),
+            renderableData.data<FScene::WORLD_AABB_EXTENT>(),
+            renderableData.size(), VISIBLE_RENDERABLE_BIT);
+
+    // the occluders themselves are always kept, they could be hidden by their own box
+    for (uint32_t i : mOccluders) {
+        visibleMask[i] |= VISIBLE_RENDERABLE;
+    }
+}
+
 UTILS_NOINLINE
 void FView::prepareVisibleShadowCasters(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& lightFrustum) const noexcept {
+        FScene::RenderableSoa& renderableData, Frustum const& lightFrustum,
+        size_t bit) const noexcept {
     SYSTRACE_CALL();
-    cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    CullingHierarchy const* hierarchy = mScene->getCullingHierarchy();
+    if (hierarchy) {
+        cullRenderables(js, renderableData, *hierarchy, lightFrustum, bit);
+    } else {
+        cullRenderables(js, renderableData, lightFrustum, bit);
+    }
+}
+
+uint8_t FView::getShadowCascadeVisibleMask(size_t cascade, size_t count) noexcept {
+    return uint8_t(count > 1 ? 1u << (VISIBLE_CASCADE_BIT + cascade) : 0u);
 }
 
 void FView::cullRenderables(JobSystem& js,
@@ -654,6 +867,15 @@ void FView::cullRenderables(JobSystem& js,
     js.runAndWait(job);
 }
 
+void FView::cullRenderables(JobSystem& js,
+        FScene::RenderableSoa& renderableData, CullingHierarchy const& hierarchy,
+        Frustum const& frustum, size_t bit) noexcept {
+    // the hierarchy has been refit by FScene::update() and indexes renderableData directly, as
+    // long as it hasn't been partitioned yet
+    assert(hierarchy.getItemCount() == renderableData.size());
+    hierarchy.cull(js, renderableData.data<FScene::VISIBLE_MASK>(), frustum, bit);
+}
+
 void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::LightSoa& lightData) const {
 
     auto const* UTILS_RESTRICT sphereArray     = lightData.data<FScene::POSITION_RADIUS>();
@@ -713,10 +935,13 @@ void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::
 
 void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
         FScene::RenderableSoa& renderableData, Range visibles) noexcept {
+    // the level of detail always depends on the culling camera, even for the shadow passes, so
+    // that shadows match the renderables
     FRenderableManager const& rcm = engine.getRenderableManager();
+    float const* const UTILS_RESTRICT screenSizes = renderableData.data<FScene::SCREEN_SIZE>();
     for (uint32_t index : visibles) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
         auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
+        uint8_t level = rcm.getLevelOfDetail(ri, screenSizes[index]);
         renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
     }
 }
@@ -800,6 +1025,22 @@ void View::setShadowsEnabled(bool enabled) noexcept {
     upcast(this)->setShadowsEnabled(enabled);
 }
 
+void View::invalidateShadowMaps() noexcept {
+    upcast(this)->invalidateShadowMaps();
+}
+
+void View::setShadowCascades(uint8_t count, CascadeSplitScheme scheme) noexcept {
+    upcast(this)->setShadowCascades(count, scheme);
+}
+
+uint8_t View::getShadowCascadeCount() const noexcept {
+    return upcast(this)->getShadowCascadeCount();
+}
+
+View::CascadeSplitScheme View::getShadowCascadeSplitScheme() const noexcept {
+    return upcast(this)->getShadowCascadeSplitScheme();
+}
+
 void View::setRenderTarget(TargetBufferFlags discard) noexcept {
     upcast(this)->setRenderTarget(discard);
 }
@@ -836,6 +1077,30 @@ bool View::isPostProcessingEnabled() const noexcept {
     return upcast(this)->hasPostProcessPass();
 }
 
+void View::setRenderableUniformPackingEnabled(bool enabled) noexcept {
+    upcast(this)->setRenderableUniformPackingEnabled(enabled);
+}
+
+bool View::isRenderableUniformPackingEnabled() const noexcept {
+    return upcast(this)->isRenderableUniformPackingEnabled();
+}
+
+void View::setOcclusionCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setOcclusionCullingEnabled(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+void View::setContributionCullingThreshold(float pixels) noexcept {
+    upcast(this)->setContributionCullingThreshold(pixels);
+}
+
+float View::getContributionCullingThreshold() const noexcept {
+    return upcast(this)->getContributionCullingThreshold();
+}
+
 void View::setDepthPrepass(View::DepthPrepass prepass) noexcept {
     upcast(this)->setDepthPrepass(prepass);
 }
@@ -844,5 +1109,13 @@ void View::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept
     upcast(this)->setDynamicLightingOptions(zLightNear, zLightFar);
 }
 
+void View::setFroxelOptions(FroxelOptions const& options) noexcept {
+    upcast(this)->setFroxelOptions(options);
+}
+
+View::FroxelOptions View::getFroxelOptions() const noexcept {
+    return upcast(this)->getFroxelOptions();
+}
+
 
 } // namespace filament
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_CHANGELIST_H
+#define TNT_FILAMENT_DETAILS_CHANGELIST_H
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+#include <utils/Slice.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * A log of the entities whose component data changed, kept by a component manager for the
+ * benefit of the systems caching that data (e.g. FScene).
+ *
+ * Every logged change has a sequence number. A consumer remembers the sequence number returned
+ * by getSequence() once it's up-to-date, and asks for the changes since then the next time
+ * around. When they're not available anymore (the log was trimmed or invalidated in between),
+ * the consumer must assume that everything changed.
+ *
+ * invalidate() must be called when the instances of the component manager are reshuffled
+ * (components are added or removed), since consumers usually cache instances as well.
+ */
+class ChangeList {
+public:
+    // above this many changes, we don't bother logging and consumers start over
+    static constexpr size_t MAX_CHANGE_COUNT = 16384;
+
+    void add(utils::Entity e) noexcept {
+        if (UTILS_UNLIKELY(mEntities.size() >= MAX_CHANGE_COUNT)) {
+            invalidate();
+            return;
+        }
+        mEntities.push_back(e);
+    }
+
+    // everything changed
+    void invalidate() noexcept {
+        // skip a sequence number, so that even consumers that were up-to-date miss it
+        mBase += mEntities.size() + 1;
+        mEntities.clear();
+    }
+
+    // forget the changes logged so far, consumers that haven't seen them will start over
+    void trim() noexcept {
+        mBase += mEntities.size();
+        mEntities.clear();
+    }
+
+    // sequence number of the next change
+    uint64_t getSequence() const noexcept {
+        return mBase + mEntities.size();
+    }
+
+    // Returns the entities that changed since 'sequence', or false if they're not known anymore.
+    // The same entity can appear several times.
+    bool getChangesSince(uint64_t sequence,
+            utils::Slice<const utils::Entity>& changes) const noexcept {
+        if (sequence < mBase) {
+            return false;
+        }
+        changes.set(mEntities.data() + (sequence - mBase), mEntities.data() + mEntities.size());
+        return true;
+    }
+
+private:
+    std::vector<utils::Entity> mEntities;
+    uint64_t mBase = 1; // so that a consumer starting at 0 is never up-to-date
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_CHANGELIST_H
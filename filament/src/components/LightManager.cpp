@@ -157,6 +157,7 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
     }
     Instance i = manager.addComponent(entity);
     assert(i);
+    mChanges.invalidate();
 
     if (i) {
         // This needs to happen before we call the set() methods below
@@ -198,9 +199,20 @@ void FLightManager::destroy(utils::Entity e) noexcept {
     if (i) {
         auto& manager = mManager;
         manager.removeComponent(e);
+        mChanges.invalidate();
     }
 }
 
+void FLightManager::gc(utils::EntityManager& em) noexcept {
+    mManager.gc(em, 4, [this](Entity e) {
+        mManager.removeComponent(e);
+        mChanges.invalidate();
+    });
+
+    // gc() runs at the end of the frame, the changes logged so far have been consumed
+    mChanges.trim();
+}
+
 void FLightManager::terminate() noexcept {
     auto& manager = mManager;
     if (!manager.empty()) {
@@ -212,6 +224,7 @@ void FLightManager::terminate() noexcept {
             Instance ci = manager.end() - 1;
             manager.removeComponent(manager.getEntity(ci));
         }
+        mChanges.invalidate();
     }
 }
 
@@ -219,12 +232,14 @@ void FLightManager::setLocalPosition(Instance i, const math::float3& position) n
     assert(i);
     auto& manager = mManager;
     manager[i].position = position;
+    markDirty(i);
 }
 
 void FLightManager::setLocalDirection(Instance i, float3 direction) noexcept {
     assert(i);
     auto& manager = mManager;
     manager[i].direction = direction;
+    markDirty(i);
 }
 
 void FLightManager::setColor(Instance i, const LinearColor& color) noexcept {
@@ -268,6 +283,7 @@ void FLightManager::setIntensity(Instance i, float intensity) noexcept {
                 break;
         }
         manager[i].intensity = luminousIntensity;
+        markDirty(i);
     }
 }
 
@@ -278,6 +294,7 @@ void FLightManager::setFalloff(Instance i, float falloff) noexcept {
         SpotParams& spotParams = manager[i].spotParams;
         manager[i].squaredFallOffInv = sqFalloff ? (1 / sqFalloff) : 0;
         spotParams.radius = falloff;
+        markDirty(i);
     }
 }
 
@@ -19,6 +19,8 @@
 
 #include "upcast.h"
 
+#include "components/ChangeList.h"
+
 #include "driver/DriverApiForward.h"
 
 #include <filament/LightManager.h>
@@ -59,8 +61,11 @@ public:
 
     void prepare(driver::DriverApi& driver) const noexcept;
 
-    void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+    void gc(utils::EntityManager& em) noexcept;
+
+    // entities whose position, direction, falloff or intensity changed (see ChangeList)
+    ChangeList const& getChangeList() const noexcept {
+        return mChanges;
     }
 
     struct LightType {
@@ -205,6 +210,10 @@ public:
 private:
     friend class FScene;
 
+    void markDirty(Instance i) noexcept {
+        mChanges.add(mManager.getEntity(i));
+    }
+
     enum {
         LIGHT_TYPE,         // light type
         POSITION,           // position in local-space (i.e. pre-transform)
@@ -268,6 +277,7 @@ private:
     };
 
     Sim mManager;
+    ChangeList mChanges;
     FEngine& mEngine;
 };
 
@@ -24,8 +24,12 @@
 #include "details/Material.h"
 #include "details/RenderPrimitive.h"
 
+#include <utils/JobSystem.h>
 #include <utils/Log.h>
 #include <utils/Panic.h>
+#include <utils/Systrace.h>
+
+#include <vector>
 
 using namespace math;
 using namespace utils;
@@ -44,12 +48,18 @@ struct RenderableManager::BuilderDetails {
     bool mCulling : 1;
     bool mCastShadows : 1;
     bool mReceiveShadows : 1;
+    bool mOccluder : 1;
     uint8_t mSkinningBoneCount = 0;
     Bone const* mBones = nullptr;
     math::mat4f const* mBoneMatrices = nullptr;
+    Entity mSkinningSource;
+    uint32_t mLevelFirst[MAX_LEVEL_OF_DETAIL_COUNT] = {};
+    float mLevelScreenSize[MAX_LEVEL_OF_DETAIL_COUNT] = {};
+    uint8_t mLevelCount = 1;
 
     explicit BuilderDetails(size_t count)
-            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
+            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
+              mOccluder(false) {
     }
     // this is only needed for the explicit instantiation below
     BuilderDetails() = default;
@@ -133,6 +143,11 @@ RenderableManager::Builder& RenderableManager::Builder::receiveShadows(bool enab
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::occluder(bool enable) noexcept {
+    mImpl->mOccluder = enable;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::skinning(size_t boneCount) noexcept {
     mImpl->mSkinningBoneCount = (uint8_t)std::min(size_t(255), boneCount);
     return *this;
@@ -152,6 +167,11 @@ RenderableManager::Builder& RenderableManager::Builder::skinning(
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::skinning(Entity source) noexcept {
+    mImpl->mSkinningSource = source;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntriesCount) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -159,7 +179,35 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::levelOfDetail(uint8_t level,
+        size_t firstPrimitive, float screenSize) noexcept {
+    if (level > 0 && level < MAX_LEVEL_OF_DETAIL_COUNT) {
+        mImpl->mLevelFirst[level] = uint32_t(firstPrimitive);
+        mImpl->mLevelScreenSize[level] = screenSize;
+        mImpl->mLevelCount = std::max(mImpl->mLevelCount, uint8_t(level + 1));
+    }
+    return *this;
+}
+
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
+    for (size_t i = 1, c = mImpl->mLevelCount; i < c; i++) {
+        if (!ASSERT_PRECONDITION_NON_FATAL(
+                mImpl->mLevelFirst[i] > mImpl->mLevelFirst[i - 1] &&
+                mImpl->mLevelFirst[i] < mImpl->mEntriesCount,
+                "[entity=%u, level %u] first primitive (%u) must be larger than the previous "
+                "level's and smaller than the primitive count (%u)",
+                entity.getId(), i, mImpl->mLevelFirst[i], mImpl->mEntriesCount)) {
+            return Error;
+        }
+        if (!ASSERT_PRECONDITION_NON_FATAL(i == 1 ||
+                mImpl->mLevelScreenSize[i] < mImpl->mLevelScreenSize[i - 1],
+                "[entity=%u, level %u] screen size (%f) must be smaller than the previous "
+                "level's (%f)",
+                entity.getId(), i, mImpl->mLevelScreenSize[i], mImpl->mLevelScreenSize[i - 1])) {
+            return Error;
+        }
+    }
+
     bool isEmpty = true;
     for (size_t i = 0, c = mImpl->mEntriesCount; i < c; i++) {
         auto& entry = mImpl->mEntries[i];
@@ -255,14 +303,12 @@ void FRenderableManager::create(
     if (UTILS_UNLIKELY(ci)) {
         canReuse = true;
         destroyComponentPrimitives(engine, manager[ci].primitives);
-        std::unique_ptr<Bones> const& bones = manager[ci].bones;
-        if (bones && !builder->mSkinningBoneCount) {
-            driver.destroyUniformBuffer(bones->handle);
-        }
+        releaseBones(ci);
     }
 
     ci = manager.addComponent(entity);
     assert(ci);
+    mChanges.invalidate();
 
     if (ci) {
         // create and initialize all needed RenderPrimitives
@@ -280,33 +326,37 @@ void FRenderableManager::create(
         setCastShadows(ci, builder->mCastShadows);
         setReceiveShadows(ci, builder->mReceiveShadows);
         setCulling(ci, builder->mCulling);
-        static_cast<Visibility&>(manager[ci].visibility).skinning = builder->mSkinningBoneCount > 0;
+        setOccluder(ci, builder->mOccluder);
+
+        // skinned renderables either share the bones of another one, or have their own
+        Bones& bones = manager[ci].bones;
+        Instance source = getInstance(builder->mSkinningSource);
+        Bones const& sourceBones = manager[source].bones;
+        if (source && source != ci && sourceBones.offset) {
+            bones = sourceBones;
+            mBonePool.acquire(bones.offset);
+        } else if (builder->mSkinningBoneCount) {
+            bones.count = builder->mSkinningBoneCount;
+            bones.offset = mBonePool.allocate(bones.count);
+            if (builder->mBones) {
+                setBones(ci, builder->mBones, bones.count);
+            } else if (builder->mBoneMatrices) {
+                setBones(ci, builder->mBoneMatrices, bones.count);
+            }
+        }
+        static_cast<Visibility&>(manager[ci].visibility).skinning = bones.count > 0;
+
+        LevelsOfDetail& lods = manager[ci].lods;
+        lods.count = builder->mLevelCount;
+        for (size_t i = 0; i < lods.count; i++) {
+            lods.first[i] = builder->mLevelFirst[i];
+            lods.screenSizes[i] = builder->mLevelScreenSize[i];
+        }
+        lods.first[lods.count] = uint32_t(builder->mEntriesCount);
 
         if (!canReuse) {
             getUniformBuffer(ci) = UniformBuffer(engine.getPerRenderableUib());
             setUniformHandle(ci, driver.createUniformBuffer(getUniformBuffer(ci).getSize()));
-            if (builder->mSkinningBoneCount) {
-                std::unique_ptr<Bones>& bones = manager[ci].bones;
-
-                bones.reset(new Bones); // FIXME: maybe use a pool allocator
-                bones->bones = UniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-                bones->handle = driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-            }
-        }
-        if (builder->mSkinningBoneCount) {
-            std::unique_ptr<Bones> const& bones = manager[ci].bones;
-            assert(bones);
-            bones->count = builder->mSkinningBoneCount;
-            if (builder->mBones) {
-                setBones(ci, builder->mBones, builder->mSkinningBoneCount);
-            } else if (builder->mBoneMatrices) {
-                setBones(ci, builder->mBoneMatrices, builder->mSkinningBoneCount);
-            } else {
-                // initialize the bones to identity
-                Bone* UTILS_RESTRICT out =
-                        (Bone*)bones->bones.invalidateUniforms(0, bones->count * sizeof(Bone));
-                std::fill_n(out, bones->count, Bone{});
-            }
         }
     }
 }
@@ -317,9 +367,21 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     if (ci) {
         destroyComponent(ci);
         mManager.removeComponent(e);
+        mChanges.invalidate();
     }
 }
 
+void FRenderableManager::gc(utils::EntityManager& em) noexcept {
+    mManager.gc(em, 4, [this](Entity e) {
+        releaseBones(getInstance(e));
+        mManager.removeComponent(e);
+        mChanges.invalidate();
+    });
+
+    // gc() runs at the end of the frame, the changes logged so far have been consumed
+    mChanges.trim();
+}
+
 // this destroys all components in this manager
 void FRenderableManager::terminate() noexcept {
     auto& manager = mManager;
@@ -333,7 +395,9 @@ void FRenderableManager::terminate() noexcept {
             destroyComponent(ci);
             manager.removeComponent(manager.getEntity(ci));
         }
+        mChanges.invalidate();
     }
+    mBonePool.terminate(mEngine.getDriverApi());
 }
 
 // This is basically a Renderable's destructor.
@@ -347,10 +411,15 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     // See create(RenderableManager::Builder&, Entity)
     destroyComponentPrimitives(engine, manager[ci].primitives);
 
-    // destroy the bones structures if any
-    std::unique_ptr<Bones> const& bones = manager[ci].bones;
-    if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+    // release the bones if any
+    releaseBones(ci);
+}
+
+void FRenderableManager::releaseBones(Instance ci) noexcept {
+    Bones& bones = mManager[ci].bones;
+    if (bones.offset) {
+        mBonePool.release(bones.offset);
+        bones = {};
     }
 }
 
@@ -366,26 +435,24 @@ void FRenderableManager::destroyComponentPrimitives(
 void FRenderableManager::prepare(
         driver::DriverApi& UTILS_RESTRICT driver,
         Instance const* UTILS_RESTRICT instances,
-        utils::Range<uint32_t> list) const noexcept {
+        utils::Range<uint32_t> list, bool uploadUniforms) noexcept {
     auto& manager = mManager;
     UniformBuffer           const * const UTILS_RESTRICT uniforms = manager.raw_array<UNIFORMS>();
     Handle<HwUniformBuffer> const * const UTILS_RESTRICT ubhs     = manager.raw_array<UNIFORMS_HANDLE>();
-    std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones    = manager.raw_array<BONES>();
-    for (uint32_t index : list) {
-        size_t i = instances[index].asValue();
-        assert(i);  // we should never get the null instance here
-        if (uniforms[i].isDirty()) {
-            // update per-renderable uniform buffer
-            driver.updateUniformBuffer(ubhs[i], UniformBuffer(uniforms[i]));
-            uniforms[i].clean(); // clean AFTER we send to the driver
-        }
-        if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.updateUniformBuffer(bones[i]->handle, UniformBuffer(bones[i]->bones));
-                bones[i]->bones.clean();
+    if (uploadUniforms) {
+        for (uint32_t index : list) {
+            size_t i = instances[index].asValue();
+            assert(i);  // we should never get the null instance here
+            if (uniforms[i].isDirty()) {
+                // update per-renderable uniform buffer
+                driver.updateUniformBuffer(ubhs[i], UniformBuffer(uniforms[i]));
+                uniforms[i].clean(); // clean AFTER we send to the driver
             }
         }
     }
+
+    // all the bones are in the same buffer, which is only uploaded if some changed
+    mBonePool.commit(driver);
 }
 
 void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& model) noexcept {
@@ -405,12 +472,20 @@ void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& mo
     }
 }
 
-void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
+Slice<FRenderPrimitive> FRenderableManager::getRenderPrimitives(
+        Instance instance, uint8_t level) const noexcept {
+    Slice<FRenderPrimitive> primitives = mManager[instance].primitives;
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    return { primitives.begin() + lods.first[level], lods.first[level + 1] - lods.first[level] };
+}
+
+void FRenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
+            markDirty(instance);
 #ifndef NDEBUG
             AttributeBitset required = mi->getMaterial()->getRequiredAttributes();
             AttributeBitset declared = primitives[primitiveIndex].getEnabledAttributes();
@@ -425,9 +500,9 @@ void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
 }
 
 MaterialInstance* FRenderableManager::getMaterialInstanceAt(
-        Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
+        Instance instance, size_t primitiveIndex) const noexcept {
     if (instance) {
-        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             // We store the material instance as const because we don't want to change it internally
             // but when the user queries it, we want to allow them to call setParameter()
@@ -437,20 +512,21 @@ MaterialInstance* FRenderableManager::getMaterialInstanceAt(
     return nullptr;
 }
 
-void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
+void FRenderableManager::setBlendOrderAt(Instance instance,
         size_t primitiveIndex, uint16_t order) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setBlendOrder(order);
+            markDirty(instance);
         }
     }
 }
 
 AttributeBitset FRenderableManager::getEnabledAttributesAt(
-        Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
+        Instance instance, size_t primitiveIndex) const noexcept {
     if (instance) {
-        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             return primitives[primitiveIndex].getEnabledAttributes();
         }
@@ -458,24 +534,26 @@ AttributeBitset FRenderableManager::getEnabledAttributesAt(
     return AttributeBitset{};
 }
 
-void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
         size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
                     0, vertices->getVertexCount() - 1, count);
+            markDirty(instance);
         }
     }
 }
 
-void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
+            markDirty(instance);
         }
     }
 }
@@ -483,14 +561,13 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setBones(Instance ci,
         Bone const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
-                    boneCount * sizeof(Bone));
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.offset && offset + boneCount <= bones.count);
+        if (bones.offset && offset < bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = mBonePool.edit(bones.offset, offset, boneCount);
             std::copy_n(transforms, boneCount, out);
+            markDirty(ci);
         }
     }
 }
@@ -498,20 +575,60 @@ void FRenderableManager::setBones(Instance ci,
 void FRenderableManager::setBones(Instance ci,
         math::mat4f const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        assert(bones && offset + boneCount <= bones->count);
-        if (bones) {
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
-                    boneCount * sizeof(Bone));
-            for (size_t i = 0, c = bones->count; i < c; ++i) {
-                mat4f const& m = transforms[i];
-                out[i].unitQuaternion = m.toQuaternion();
-                out[i].translation = m[3].xyz;
+        Bones const& bones = mManager[ci].bones;
+        assert(bones.offset && offset + boneCount <= bones.count);
+        if (bones.offset && offset < bones.count) {
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = mBonePool.edit(bones.offset, offset, boneCount);
+            BonePool::convert(out, transforms, boneCount);
+            markDirty(ci);
+        }
+    }
+}
+
+void FRenderableManager::setBones(Instance const* instances, size_t count,
+        math::mat4f const* transforms) noexcept {
+    SYSTRACE_CALL();
+
+    struct Batch {
+        Bone* out;
+        math::mat4f const* in;
+        size_t count;
+    };
+
+    // find where the bones of each renderable go
+    auto& manager = mManager;
+    std::vector<Batch> batches;
+    batches.reserve(count);
+    size_t boneCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        Instance ci = instances[i];
+        if (ci) {
+            Bones const& bones = manager[ci].bones;
+            if (bones.offset) {
+                batches.push_back({ mBonePool.edit(bones.offset, 0, bones.count),
+                        transforms + boneCount, bones.count });
+                boneCount += bones.count;
+                markDirty(ci);
             }
         }
     }
+
+    // and convert them, in parallel if there are enough
+    auto convert = [&batches](uint32_t first, uint32_t c) {
+        for (size_t i = first, e = first + c; i < e; i++) {
+            Batch const& batch = batches[i];
+            BonePool::convert(batch.out, batch.in, batch.count);
+        }
+    };
+    if (boneCount >= PARALLEL_BONE_COUNT) {
+        JobSystem& js = mEngine.getJobSystem();
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(batches.size()),
+                std::cref(convert), jobs::CountSplitter<16, 8>());
+        js.runAndWait(job);
+    } else {
+        convert(0, uint32_t(batches.size()));
+    }
 }
 
 } // namespace details
@@ -564,42 +681,59 @@ bool RenderableManager::isShadowReceiver(Instance instance) const noexcept {
     return upcast(this)->isShadowReceiver(instance);
 }
 
+void RenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    upcast(this)->setOccluder(instance, enable);
+}
+
+bool RenderableManager::isOccluder(Instance instance) const noexcept {
+    return upcast(this)->isOccluder(instance);
+}
+
 const Box& RenderableManager::getAxisAlignedBoundingBox(Instance instance) const noexcept {
     return upcast(this)->getAxisAlignedBoundingBox(instance);
 }
 
 size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
-    return upcast(this)->getPrimitiveCount(instance, 0);
+    return upcast(this)->getPrimitiveCount(instance);
+}
+
+size_t RenderableManager::getLevelOfDetailCount(Instance instance) const noexcept {
+    return upcast(this)->getLevelCount(instance);
 }
 
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    upcast(this)->setMaterialInstanceAt(instance,primitiveIndex, upcast(materialInstance));
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
         Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getMaterialInstanceAt(instance, 0, primitiveIndex);
+    return upcast(this)->getMaterialInstanceAt(instance,primitiveIndex);
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    upcast(this)->setBlendOrderAt(instance,primitiveIndex, order);
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getEnabledAttributesAt(instance, 0, primitiveIndex);
+    return upcast(this)->getEnabledAttributesAt(instance,primitiveIndex);
 }
 
 void RenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
         size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex,
+    upcast(this)->setGeometryAt(instance,primitiveIndex,
             type, upcast(vertices), upcast(indices), offset, count);
 }
 
 void RenderableManager::setGeometryAt(RenderableManager::Instance instance, size_t primitiveIndex,
         RenderableManager::PrimitiveType type, size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex, type, offset, count);
+    upcast(this)->setGeometryAt(instance,primitiveIndex, type, offset, count);
+}
+
+void RenderableManager::setBones(Instance const* instances, size_t count,
+        math::mat4f const* transforms) noexcept {
+    upcast(this)->setBones(instances, count, transforms);
 }
 
 void RenderableManager::setBones(Instance instance,
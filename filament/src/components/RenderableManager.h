@@ -19,6 +19,10 @@
 
 #include "upcast.h"
 
+#include "components/ChangeList.h"
+
+#include "details/BonePool.h"
+
 #include "driver/DriverApiForward.h"
 #include "driver/UniformBuffer.h"
 #include "driver/Handle.h"
@@ -47,6 +51,7 @@ public:
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool occluder       : 1;
     };
 
     FRenderableManager(FEngine& engine) noexcept;
@@ -73,12 +78,19 @@ public:
 
     // - instances is a list of Instance (typically the list from a given scene)
     // - list is a list of index in 'instances' (typically the visible ones)
+    // - uploadUniforms is false when the per-renderable uniforms are uploaded by other means
+    //   (i.e. a RenderableUniformRing), they're left dirty then
+    //   the bones of all skinned renderables are uploaded as well if any changed
     void prepare(driver::DriverApi& driver,
             RenderableManager::Instance const* instances,
-            utils::Range<uint32_t> list) const noexcept;
+            utils::Range<uint32_t> list, bool uploadUniforms = true) noexcept;
 
-    void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+    void gc(utils::EntityManager& em) noexcept;
+
+    // entities whose culling data (AABB, layers, visibility...) or bones changed (see ChangeList),
+    // the latter so that the shadow maps they cast are re-rendered
+    ChangeList const& getChangeList() const noexcept {
+        return mChanges;
     }
 
     utils::Slice<const UniformBuffer> getUniformBuffers() const noexcept {
@@ -102,15 +114,18 @@ public:
     inline void setLayerMask(Instance instance, uint8_t enable) noexcept;
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
+    inline void setOccluder(Instance instance, bool enable) noexcept;
     inline void setUniformHandle(Instance instance, Handle<HwUniformBuffer> const& handle) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
     inline void setBones(Instance instance, Bone const* transforms, size_t boneCount, size_t offset = 0) noexcept;
     inline void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount, size_t offset = 0) noexcept;
+    void setBones(Instance const* instances, size_t count, math::mat4f const* transforms) noexcept;
 
 
     inline bool isShadowCaster(Instance instance) const noexcept;
     inline bool isShadowReceiver(Instance instance) const noexcept;
     inline bool isCullingEnabled(Instance instance) const noexcept;
+    inline bool isOccluder(Instance instance) const noexcept;
 
     inline Box const& getAABB(Instance instance) const noexcept;
     inline Box const& getAxisAlignedBoundingBox(Instance instance) const noexcept { return getAABB(instance); }
@@ -122,33 +137,61 @@ public:
     inline UniformBuffer& getUniformBuffer(Instance instance) noexcept;
 
     inline Handle<HwUniformBuffer> getUbh(Instance instance) const noexcept;
-    inline Handle<HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
+    // offset of the renderable's bones in the bones uniform buffer, 0 if it isn't skinned
+    inline uint32_t getBonesOffset(Instance instance) const noexcept;
+    // the uniform buffer holding the bones of all skinned renderables
+    Handle<HwUniformBuffer> getBonesUbh() const noexcept { return mBonePool.getHandle(); }
 
 
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
+    inline size_t getLevelCount(Instance instance) const noexcept;
+    // the level of detail to use for the given screen size (see Builder::levelOfDetail())
+    inline uint8_t getLevelOfDetail(Instance instance, float screenSize) const noexcept;
     inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
-    void setMaterialInstanceAt(Instance instance, uint8_t level,
+
+    // primitives are indexed across all levels of detail
+    inline size_t getPrimitiveCount(Instance instance) const noexcept;
+    void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
-    MaterialInstance* getMaterialInstanceAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    void setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+    MaterialInstance* getMaterialInstanceAt(Instance instance, size_t primitiveIndex) const noexcept;
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
             size_t offset, size_t count) noexcept;
-    void setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
-    void setBlendOrderAt(Instance instance, uint8_t level, size_t primitiveIndex, uint16_t blendOrder) noexcept;
-    AttributeBitset getEnabledAttributesAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
-    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance, uint8_t level) noexcept;
+    void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t blendOrder) noexcept;
+    AttributeBitset getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept;
+
+    // the primitives of a level of detail
+    utils::Slice<FRenderPrimitive> getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
+    // the primitives of all the levels of detail
+    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance) const noexcept;
+    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance) noexcept;
 
 
 private:
+    void markDirty(Instance ci) noexcept {
+        mChanges.add(mManager.getEntity(ci));
+    }
+
     void destroyComponent(Instance ci) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
             utils::Slice<FRenderPrimitive>& primitives) noexcept;
 
+    void releaseBones(Instance ci) noexcept;
+
+    // bulk bone updates with at least that many bones are converted in parallel
+    static constexpr size_t PARALLEL_BONE_COUNT = 1024;
+
     struct Bones {
-        filament::Handle<HwUniformBuffer> handle;
-        UniformBuffer bones;
+        uint32_t offset = 0;    // offset of the bones in mBonePool, 0 if not skinned
+        uint16_t count = 0;
+    };
+
+    struct LevelsOfDetail {
+        // the level i is made of the primitives [first[i], first[i + 1])
+        uint32_t first[MAX_LEVEL_OF_DETAIL_COUNT + 1];
+        // the level i > 0 is used below the screen size screenSizes[i], these are decreasing
+        float screenSizes[MAX_LEVEL_OF_DETAIL_COUNT];
         uint8_t count;
     };
 
@@ -159,7 +202,8 @@ private:
         PRIMITIVES,         // user data
         UNIFORMS,           // filament data, UBO data where world-transform is stored
         UNIFORMS_HANDLE,    // filament data, handle to the driver's UBO
-        BONES,              // filament data, UBO storing a pointer to the bones information
+        BONES,              // filament data, where the bones are in the bones UBO
+        LODS,               // user data
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -169,7 +213,8 @@ private:
             utils::Slice<FRenderPrimitive>,
             UniformBuffer,
             filament::Handle<HwUniformBuffer>,
-            std::unique_ptr<Bones>
+            Bones,
+            LevelsOfDetail
     >;
 
     struct Sim : public Base {
@@ -191,6 +236,7 @@ private:
                 Field<UNIFORMS>         uniforms;
                 Field<UNIFORMS_HANDLE>  uniformsHandle;
                 Field<BONES>            bones;
+                Field<LODS>             lods;
             };
         };
 
@@ -203,6 +249,8 @@ private:
     };
 
     Sim mManager;
+    ChangeList mChanges;
+    BonePool mBonePool;
     FEngine& mEngine;
 };
 
@@ -211,6 +259,7 @@ FILAMENT_UPCAST(RenderableManager)
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
         mManager[instance].aabb = aabb;
+        markDirty(instance);
     }
 }
 
@@ -219,12 +268,14 @@ void FRenderableManager::setLayerMask(Instance instance,
     if (instance) {
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
+        markDirty(instance);
     }
 }
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
         mManager[instance].layers = layerMask;
+        markDirty(instance);
     }
 }
 
@@ -232,6 +283,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
+        markDirty(instance);
     }
 }
 
@@ -239,6 +291,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
+        markDirty(instance);
     }
 }
 
@@ -246,6 +299,7 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
+        markDirty(instance);
     }
 }
 
@@ -253,6 +307,15 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
+        markDirty(instance);
+    }
+}
+
+void FRenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    if (instance) {
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.occluder = enable;
+        markDirty(instance);
     }
 }
 
@@ -260,6 +323,7 @@ void FRenderableManager::setUniformHandle(Instance instance,
         Handle<HwUniformBuffer> const& handle) noexcept {
     if (instance) {
         mManager[instance].uniformsHandle = handle;
+        markDirty(instance);
     }
 }
 
@@ -287,6 +351,10 @@ bool FRenderableManager::isCullingEnabled(Instance instance) const noexcept {
     return getVisibility(instance).culling;
 }
 
+bool FRenderableManager::isOccluder(Instance instance) const noexcept {
+    return getVisibility(instance).occluder;
+}
+
 uint8_t FRenderableManager::getLayerMask(Instance instance) const noexcept {
     return mManager[instance].layers;
 }
@@ -311,23 +379,42 @@ Handle<HwUniformBuffer> FRenderableManager::getUbh(Instance instance) const noex
     return mManager[instance].uniformsHandle;
 }
 
-Handle<HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
-    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : Handle<HwUniformBuffer>{};
+uint32_t FRenderableManager::getBonesOffset(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    return bones.offset;
 }
 
 utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) const noexcept {
+        Instance instance) const noexcept {
     return mManager[instance].primitives;
 }
 
 utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) noexcept {
+        Instance instance) noexcept {
     return mManager[instance].primitives;
 }
 
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    return lods.count;
+}
+
+uint8_t FRenderableManager::getLevelOfDetail(Instance instance, float screenSize) const noexcept {
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    uint8_t level = 0;
+    for (size_t i = 1, c = lods.count; i < c; i++) {
+        level += screenSize < lods.screenSizes[i] ? 1 : 0;
+    }
+    return level;
+}
+
 size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
-    return getRenderPrimitives(instance, level).size();
+    LevelsOfDetail const& lods = mManager[instance].lods;
+    return lods.first[level + 1] - lods.first[level];
+}
+
+size_t FRenderableManager::getPrimitiveCount(Instance instance) const noexcept {
+    return getRenderPrimitives(instance).size();
 }
 
 } // namespace details
@@ -16,13 +16,21 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
 using namespace utils;
 using namespace math;
 
 namespace filament {
 namespace details {
 
-FTransformManager::FTransformManager() noexcept = default;
+FTransformManager::FTransformManager(JobSystem* js) noexcept
+        : mJobSystem(js) {
+    mLevels.push_back(mManager.begin());
+}
 
 FTransformManager::~FTransformManager() noexcept = default;
 
@@ -34,23 +42,35 @@ void FTransformManager::create(Entity entity) {
 }
 
 void FTransformManager::create(Entity entity, Instance parent, const mat4f& localTransform) {
-    // this always adds at the end, so all existing instances stay valid
+    // the new node is added at the end and then moved to its level, this can change the
+    // instances of the nodes deeper in the hierarchy.
     auto& manager = mManager;
 
-    // TODO: try to keep entries sorted with their siblings/parents to improve cache access
     if (UTILS_UNLIKELY(manager.hasComponent(entity))) {
         destroy(entity);
     }
     Instance i = manager.addComponent(entity);
     assert(i);
     assert(i != parent);
+    mChanges.invalidate();
 
     if (i && i != parent) {
+        // for now the new node lives alone in a level past the deepest one
+        assert(mLevels.back() == i);
+        mLevels.push_back(manager.end());
+
         manager[i].parent = 0;
         manager[i].next = 0;
         manager[i].prev = 0;
         manager[i].firstChild = 0;
         insertNode(i, parent);
+
+        // moveToLevel() needs some temporary storage which we provide here
+        auto& soa = manager.getSoA();
+        soa.ensureCapacity(soa.size() + 1);
+        i = moveToLevel(i, parent ? getLevel(parent) + 1 : 0);
+        trimLevels();
+
         setTransform(i, localTransform);
     }
 }
@@ -62,8 +82,20 @@ void FTransformManager::setParent(Instance i, Instance parent) noexcept {
         Instance oldParent = manager[i].parent;
         if (oldParent != parent) {
             // TODO: on debug builds, ensure that the new parent isn't one of our descendant
+            const size_t oldLevel = getLevel(i);
+            const size_t newLevel = parent ? getLevel(parent) + 1 : 0;
             removeNode(i);
             insertNode(i, parent);
+            if (oldLevel != newLevel) {
+                // our whole subtree changes level, keep track of it by entity because the
+                // instances change as nodes move
+                Entity e = manager.getEntity(i);
+                std::vector<Entity>& subtree = mScratch;
+                subtree.clear();
+                collectSubtree(subtree, i);
+                updateLevels(subtree.data(), subtree.size());
+                i = manager.getInstance(e);
+            }
             updateNodeTransform(i);
         }
     }
@@ -78,20 +110,41 @@ void FTransformManager::destroy(Entity e) noexcept {
         // 1) remove the entry from the linked lists
         removeNode(i);
 
-        // our children don't have parents anymore
+        // our children don't have parents anymore, their subtrees move up to the roots level
+        std::vector<Entity>& orphans = mScratch;
+        orphans.clear();
         Instance child = manager[i].firstChild;
         while (child) {
+            Instance next = manager[child].next;
             manager[child].parent = 0;
-            child = manager[child].next;
+            manager[child].prev = 0;
+            manager[child].next = 0;
+            collectSubtree(orphans, child);
+            child = next;
         }
+        manager[i].parent = 0;
+        manager[i].firstChild = 0;
+        manager[i].prev = 0;
+        manager[i].next = 0;
 
-        // 2) remove the component
-        Instance moved = manager.removeComponent(e);
-
-        // 3) update the references to the entry now with Instance i
-        if (moved != i) {
-            updateNode(i);
+        // 2) move the entry at the end of the array, so removing it doesn't move any other node
+        auto& soa = manager.getSoA();
+        soa.ensureCapacity(soa.size() + 1);
+        i = moveToLevel(i, mLevels.size() - 2);
+        Instance last = manager.end() - 1;
+        if (i != last) {
+            swapNode(i, last);
         }
+        --mLevels.back();
+
+        // 3) remove the component
+        UTILS_UNUSED_IN_RELEASE Instance moved = manager.removeComponent(e);
+        assert(moved == last);
+        trimLevels();
+        mChanges.invalidate();
+
+        // 4) move our former descendants to their new level
+        updateLevels(orphans.data(), orphans.size());
     }
 }
 
@@ -105,6 +158,59 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     }
 }
 
+void FTransformManager::setTransforms(Instance const* instances, mat4f const* localTransforms,
+        size_t count) noexcept {
+    auto& manager = mManager;
+    for (size_t k = 0; k < count; k++) {
+        Instance ci = instances[k];
+        validateNode(ci);
+        if (ci) {
+            manager[ci].local = localTransforms[k];
+        }
+    }
+    updateNodeTransforms(instances, count);
+}
+
+void FTransformManager::setTransforms(Instance const* instances, float3 const* translations,
+        quatf const* rotations, float3 const* scales, size_t count) noexcept {
+    auto& manager = mManager;
+    for (size_t k = 0; k < count; k++) {
+        Instance ci = instances[k];
+        validateNode(ci);
+        if (ci) {
+            mat4f m(rotations[k]);
+            if (scales) {
+                m[0] *= scales[k].x;
+                m[1] *= scales[k].y;
+                m[2] *= scales[k].z;
+            }
+            m[3].xyz = translations[k];
+            manager[ci].local = m;
+        }
+    }
+    updateNodeTransforms(instances, count);
+}
+
+void FTransformManager::updateNodeTransforms(Instance const* instances, size_t count) noexcept {
+    if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
+        // don't update the world transforms until commitLocalTransformTransaction() is called
+        return;
+    }
+
+    if (count * 4 >= mManager.getComponentCount()) {
+        // when a good fraction of the nodes changed, it's faster to recompute everything in
+        // one pass than to walk each subtree (possibly several times).
+        computeWorldTransforms();
+        mChanges.invalidate();
+    } else {
+        for (size_t k = 0; k < count; k++) {
+            if (instances[k]) {
+                updateNodeTransform(instances[k]);
+            }
+        }
+    }
+}
+
 void FTransformManager::updateNodeTransform(Instance i) noexcept {
     validateNode(i);
     auto& manager = mManager;
@@ -112,14 +218,6 @@ void FTransformManager::updateNodeTransform(Instance i) noexcept {
 
     if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
         // don't update the world transform until commitLocalTransformTransaction() is called
-        Instance ci = manager[i].firstChild;
-        while (ci) {
-            Instance child = manager[ci].firstChild;
-            ci = manager[ci].next;
-            if (child) {
-                updateNodeTransform(child);
-            }
-        }
         return;
     }
 
@@ -130,11 +228,12 @@ void FTransformManager::updateNodeTransform(Instance i) noexcept {
 
     // compute our world transform
     manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    mChanges.add(manager.getEntity(i));
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(manager, mChanges, child);
     }
 }
 
@@ -145,25 +244,124 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
         mLocalTransformTransactionOpen = false;
-        auto& manager = mManager;
+        computeWorldTransforms();
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+        // all world transforms were recomputed
+        mChanges.invalidate();
+    }
+}
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
-        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
-            }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+void FTransformManager::computeWorldTransforms() noexcept {
+    SYSTRACE_CALL();
+
+    auto& manager = mManager;
+    mat4f* const UTILS_RESTRICT world = manager.getSoA().data<WORLD>();
+    mat4f const* const UTILS_RESTRICT local = manager.raw_array<LOCAL>();
+    Instance const* const UTILS_RESTRICT parents = manager.raw_array<PARENT>();
+
+    // parents are always in a previous level, so nodes within a level are independent
+    auto transform = [world, local, parents](uint32_t first, uint32_t count) {
+        for (uint32_t i = first, e = first + count; i < e; i++) {
+            world[i] = world[parents[i]] * local[i];
+        }
+    };
+
+    JobSystem* js = mJobSystem;
+    auto const& levels = mLevels;
+    for (size_t l = 0, c = levels.size() - 1; l < c; l++) {
+        const uint32_t first = levels[l];
+        const uint32_t count = levels[l + 1] - first;
+        if (js && count >= PARALLEL_TRANSFORM_COUNT) {
+            auto job = jobs::parallel_for(*js, nullptr, first, count, std::cref(transform),
+                    jobs::CountSplitter<PARALLEL_TRANSFORM_COUNT, 8>());
+            js->runAndWait(job);
+        } else {
+            transform(first, count);
         }
     }
 }
 
+// returns the level in the hierarchy of the given node (0 for roots)
+size_t FTransformManager::getLevel(Instance i) const noexcept {
+    auto const& levels = mLevels;
+    assert(i >= levels.front() && i < levels.back());
+    return size_t(std::upper_bound(levels.begin(), levels.end(), i) - levels.begin()) - 1;
+}
+
+// moves a node to the given level, one level at a time, by swapping it with the node at the
+// boundary of its current level and moving that boundary. Other nodes stay in their level.
+// Returns the new instance of the node.
+FTransformManager::Instance FTransformManager::moveToLevel(Instance i, size_t level) noexcept {
+    auto& levels = mLevels;
+    while (levels.size() < level + 2) {
+        levels.push_back(levels.back());
+    }
+    size_t current = getLevel(i);
+    while (current < level) {
+        // we become the first node of the next level
+        Instance last = levels[current + 1] - 1;
+        if (last != i) {
+            swapNode(i, last);
+            i = last;
+        }
+        --levels[++current];
+    }
+    while (current > level) {
+        // we become the last node of the previous level
+        Instance first = levels[current];
+        if (first != i) {
+            swapNode(i, first);
+            i = first;
+        }
+        ++levels[current--];
+    }
+    return i;
+}
+
+// moves the given nodes to the level below their parent. Parents must appear before their
+// children in the list.
+void FTransformManager::updateLevels(Entity const* entities, size_t count) noexcept {
+    auto& manager = mManager;
+
+    // moveToLevel() needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    bool moved = false;
+    for (size_t k = 0; k < count; k++) {
+        Instance i = manager.getInstance(entities[k]);
+        Instance parent = manager[i].parent;
+        moved |= moveToLevel(i, parent ? getLevel(parent) + 1 : 0) != i;
+    }
+    trimLevels();
+
+    if (moved) {
+        mChanges.invalidate();
+    }
+}
+
+// appends the entities of the subtree rooted at i, in breadth-first order
+void FTransformManager::collectSubtree(std::vector<Entity>& entities, Instance i) const noexcept {
+    auto const& manager = mManager;
+    size_t k = entities.size();
+    entities.push_back(manager.getEntity(i));
+    for (; k < entities.size(); k++) {
+        Instance child = manager[manager.getInstance(entities[k])].firstChild;
+        while (child) {
+            entities.push_back(manager.getEntity(child));
+            child = manager[child].next;
+        }
+    }
+}
+
+// removes the empty levels at the bottom of the hierarchy
+void FTransformManager::trimLevels() noexcept {
+    auto& levels = mLevels;
+    while (levels.size() > 1 && levels[levels.size() - 2] == levels.back()) {
+        levels.pop_back();
+    }
+}
+
 // Inserts a parentless node in the hierarchy
 void FTransformManager::insertNode(Instance i, Instance parent) noexcept {
     auto& manager = mManager;
@@ -283,18 +481,20 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
+void FTransformManager::transformChildren(Sim& manager, ChangeList& changes,
+        Instance ci) noexcept {
     while (ci) {
         // update child's world transform
         Instance parent = manager[ci].parent;
         mat4f const& pt = manager[parent].world;
         mat4f const& local = manager[ci].local;
         manager[ci].world = pt * local;
+        changes.add(manager.getEntity(ci));
 
         // assume we don't have a deep hierarchy
         Instance child = manager[ci].firstChild;
         if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
+            transformChildren(manager, changes, child);
         }
 
         // process our next child
@@ -349,6 +549,9 @@ void FTransformManager::gc(utils::EntityManager& em) noexcept {
     manager.gc(em, 4, [this](Entity e) {
                 destroy(e);
             });
+
+    // gc() runs at the end of the frame, the changes logged so far have been consumed
+    mChanges.trim();
 }
 
 } // namespace details
@@ -380,6 +583,16 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
+void TransformManager::setTransforms(Instance const* instances, mat4f const* localTransforms,
+        size_t count) noexcept {
+    upcast(this)->setTransforms(instances, localTransforms, count);
+}
+
+void TransformManager::setTransforms(Instance const* instances, float3 const* translations,
+        quatf const* rotations, float3 const* scales, size_t count) noexcept {
+    upcast(this)->setTransforms(instances, translations, rotations, scales, count);
+}
+
 const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
@@ -19,6 +19,8 @@
 
 #include "upcast.h"
 
+#include "components/ChangeList.h"
+
 #include <filament/TransformManager.h>
 
 #include <utils/compiler.h>
@@ -27,6 +29,14 @@
 #include <utils/Slice.h>
 
 #include <math/mat4.h>
+#include <math/quat.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
 
 namespace filament {
 namespace details {
@@ -35,7 +45,9 @@ class UTILS_PRIVATE FTransformManager : public TransformManager {
 public:
     using Instance = TransformManager::Instance;
 
-    FTransformManager() noexcept;
+    // world transforms of large hierarchies are computed in parallel using the JobSystem,
+    // if one is provided.
+    explicit FTransformManager(utils::JobSystem* js = nullptr) noexcept;
     ~FTransformManager() noexcept;
 
     // free-up all resources
@@ -74,6 +86,12 @@ public:
 
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
+    void setTransforms(Instance const* instances, math::mat4f const* localTransforms,
+            size_t count) noexcept;
+
+    void setTransforms(Instance const* instances, math::float3 const* translations,
+            math::quatf const* rotations, math::float3 const* scales, size_t count) noexcept;
+
     const math::mat4f& getTransform(Instance ci) const noexcept {
         return mManager[ci].local;
     }
@@ -82,6 +100,11 @@ public:
         return mManager[ci].world;
     }
 
+    // entities whose world transform changed (see ChangeList)
+    ChangeList const& getChangeList() const noexcept {
+        return mChanges;
+    }
+
 private:
     struct Sim;
 
@@ -89,9 +112,20 @@ private:
     void removeNode(Instance i) noexcept;
     void updateNode(Instance i) noexcept;
     void updateNodeTransform(Instance i) noexcept;
+    void updateNodeTransforms(Instance const* instances, size_t count) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    static void transformChildren(Sim& manager, ChangeList& changes, Instance firstChild) noexcept;
+
+    size_t getLevel(Instance i) const noexcept;
+    Instance moveToLevel(Instance i, size_t level) noexcept;
+    void updateLevels(utils::Entity const* entities, size_t count) noexcept;
+    void collectSubtree(std::vector<utils::Entity>& entities, Instance i) const noexcept;
+    void trimLevels() noexcept;
+    void computeWorldTransforms() noexcept;
+
+    // levels with at least that many nodes are transformed in parallel
+    static constexpr size_t PARALLEL_TRANSFORM_COUNT = 1024;
 
 
     enum {
@@ -144,6 +178,15 @@ private:
     };
 
     Sim mManager;
+    ChangeList mChanges;
+
+    // Components are kept sorted by depth in the hierarchy: the nodes of level L (i.e. roots
+    // for L = 0) are the instances in [mLevels[L], mLevels[L + 1]). The last entry is always
+    // the past-the-last instance. This guarantees that parents are stored before their
+    // children, and that all nodes of a level can be transformed independently.
+    std::vector<Instance> mLevels;
+    std::vector<utils::Entity> mScratch;
+    utils::JobSystem* const mJobSystem;
     bool mLocalTransformTransactionOpen = false;
 };
 
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BONEPOOL_H
+#define TNT_FILAMENT_DETAILS_BONEPOOL_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/EngineEnums.h>
+#include <filament/RenderableManager.h>
+
+#include <math/mat4.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Storage for the bones of all the skinned renderables, in a single uniform buffer.
+ *
+ * Each renderable gets just as many bones as it needs, rounded up to a slot, and its bones are
+ * bound as a range of the buffer. Several renderables can share the same bones (e.g. crowds
+ * playing the same animation pose).
+ *
+ * The bones of a renderable are identified by their byte offset in the buffer, which is never 0.
+ * Offsets don't change when the pool grows, but the buffer handle does.
+ */
+class BonePool {
+public:
+    using Bone = RenderableManager::Bone;
+
+    // bones start at a multiple of this size, which is the largest alignment of uniform buffer
+    // ranges that GLES 3.0 and Vulkan implementations can require
+    static constexpr size_t SLOT_SIZE = 256;
+    static constexpr size_t BONES_PER_SLOT = SLOT_SIZE / sizeof(Bone);
+
+    // size of the bound ranges, i.e. the size of the bones uniform block in the shaders
+    static constexpr size_t RANGE_SIZE = CONFIG_MAX_BONE_COUNT * sizeof(Bone);
+
+    BonePool() noexcept;
+    ~BonePool() noexcept;
+
+    BonePool(BonePool const& rhs) = delete;
+    BonePool& operator=(BonePool const& rhs) = delete;
+
+    void terminate(driver::DriverApi& driver);
+
+    // Allocates 'count' bones, initialized to identity, with a reference count of 1.
+    // Returns the offset of the first bone.
+    uint32_t allocate(size_t count) noexcept;
+
+    // adds a reference to the given bones
+    void acquire(uint32_t offset) noexcept;
+
+    // removes a reference to the given bones, which are freed with the last reference
+    void release(uint32_t offset) noexcept;
+
+    // returns a pointer to 'count' bones starting at bone 'first' of the given bones, which
+    // will be uploaded on the next commit()
+    Bone* edit(uint32_t offset, size_t first, size_t count) noexcept;
+
+    // Converts 'count' bone matrices (rotation and translation only) to Bones. The loop is
+    // branchless so it can be vectorized.
+    static void convert(Bone* out, math::mat4f const* in, size_t count) noexcept;
+
+    // (re)creates the uniform buffer if the pool grew, and uploads it if any bone changed
+    void commit(driver::DriverApi& driver) noexcept;
+
+    // the uniform buffer updated by the last commit()
+    Handle<HwUniformBuffer> getHandle() const noexcept { return mHandle; }
+
+private:
+    struct Range {
+        uint32_t first;     // in slots
+        uint32_t count;     // in slots
+    };
+
+    struct Allocation {
+        uint16_t count = 0; // in slots
+        uint16_t references = 0;
+    };
+
+    static size_t getSlotCount(size_t boneCount) noexcept {
+        return (boneCount + BONES_PER_SLOT - 1) / BONES_PER_SLOT;
+    }
+
+    std::vector<Bone> mBones;               // CPU copy of the uniform buffer
+    std::vector<Allocation> mAllocations;   // indexed by the first slot of each allocation
+    std::vector<Range> mFreeList;           // sorted by first slot
+    size_t mUsed = 1;                       // in slots, slot 0 is never allocated
+    Handle<HwUniformBuffer> mHandle;
+    size_t mHandleSize = 0;                 // in bytes
+    bool mDirty = false;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BONEPOOL_H
@@ -33,6 +33,9 @@ namespace details {
  *
  * The implementation assumes 'count' below is multiple of 8
  *
+ * The batch intersection routines are implemented with explicit SIMD kernels (SSE4, AVX2,
+ * AVX-512 or NEON), the best one supported by the CPU is selected at runtime. A scalar
+ * kernel is used as a fallback.
  */
 
 class Culler {
@@ -48,6 +51,18 @@ public:
 
     using result_type = uint8_t;
 
+    // instruction sets the culling kernels are implemented for
+    enum class Isa : uint8_t {
+        SCALAR,
+        SSE4,
+        AVX2,
+        AVX512,
+        NEON
+    };
+
+    // returns the instruction set used by the culling kernels on this CPU
+    static Isa getIsa() noexcept;
+
     /*
      * returns whether each AABB in an array intersects with the furstum
      */
@@ -82,16 +97,33 @@ public:
 
 
     struct UTILS_PUBLIC Test {
-        static void intersects(result_type* results,
+        // These run all the kernels supported by this CPU and return false if they don't all
+        // produce the same results. 'results' is written by the kernel returned by getIsa().
+        static bool intersects(result_type* results,
                 Frustum const& frustum,
                 math::float3 const* c,
                 math::float3 const* e,
                 size_t count) noexcept;
 
-        static void intersects(result_type* results,
+        static bool intersects(result_type* results,
                 Frustum const& frustum,
                 math::float4 const* b,
                 size_t count) noexcept;
+
+        // These run the kernel for the given instruction set only, and return false if it's
+        // not supported by this CPU.
+        static bool intersects(Isa isa, result_type* results,
+                Frustum const& frustum,
+                math::float3 const* c,
+                math::float3 const* e,
+                size_t count) noexcept;
+
+        static bool intersects(Isa isa, result_type* results,
+                Frustum const& frustum,
+                math::float4 const* b,
+                size_t count) noexcept;
+
+        static bool isSupported(Isa isa) noexcept;
     };
 };
 
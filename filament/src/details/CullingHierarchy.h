@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_CULLINGHIERARCHY_H
+#define TNT_FILAMENT_DETAILS_CULLINGHIERARCHY_H
+
+#include "details/Culler.h"
+
+#include <filament/Box.h>
+#include <filament/Frustum.h>
+#include <filament/RenderableManager.h>
+
+#include <utils/compiler.h>
+#include <utils/EntityInstance.h>
+#include <utils/StructureOfArrays.h>
+
+#include <math/vec3.h>
+
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy over the world-space AABBs of a scene's renderables.
+ *
+ * The hierarchy is built once (median split), then refit every frame from the AABBs gathered by
+ * FScene::prepare(). Only leaves whose boxes changed are recomputed, so refitting a mostly static
+ * scene is close to a copy. Culling traverses the tree, rejects (or accepts) whole subtrees with
+ * a single plane test and runs the SIMD Culler only on the leaves that straddle the frustum.
+ *
+ * Items are identified by their index in the source arrays (i.e. the RenderableSoa), and the
+ * hierarchy rebuilds itself when the source ordering changes.
+ */
+class CullingHierarchy {
+public:
+    using Instance = utils::EntityInstance<RenderableManager>;
+
+    // maximum number of items in a leaf, must be a multiple of Culler::MODULO
+    static constexpr size_t LEAF_SIZE = 32;
+
+    // the tree is rebuilt when refitting has grown its total surface area by this much
+    static constexpr float REBUILD_SURFACE_AREA_RATIO = 2.0f;
+
+    CullingHierarchy() noexcept;
+    ~CullingHierarchy() noexcept;
+
+    CullingHierarchy(CullingHierarchy const&) = delete;
+    CullingHierarchy& operator=(CullingHierarchy const&) = delete;
+
+    // drops the tree, the next update() will rebuild it
+    void clear() noexcept;
+
+    // refits the tree with the new AABBs, or rebuilds it if needed (size or ordering changed,
+    // or the refit tree became too loose).
+    // returns true if the tree was rebuilt.
+    bool update(math::float3 const* center, math::float3 const* extent,
+            Instance const* instances, size_t count) noexcept;
+
+    // Sets bit 'bit' of visibleMask[i] for every item i that intersects the frustum.
+    // visibleMask must have been cleared by the caller for that bit.
+    void cull(utils::JobSystem& js, Culler::result_type* visibleMask,
+            Frustum const& frustum, size_t bit) const noexcept;
+
+    size_t getItemCount() const noexcept { return mItemCount; }
+    size_t getNodeCount() const noexcept { return mNodes.size(); }
+    bool isEmpty() const noexcept { return mNodes.empty(); }
+
+private:
+    struct Node {
+        math::float3 center;
+        math::float3 extent;
+        uint32_t first;         // first item covered by this node
+        uint32_t count;         // number of items covered by this node
+        uint32_t right;         // index of the right child, 0 for leaves (left child is this + 1)
+        uint32_t dirty;         // set during refit when the node's bounds must be recomputed
+    };
+
+    enum {
+        CENTER,     // 12 world-space bounding box center of the item
+        EXTENT,     // 12 world-space bounding box half-extent of the item
+        INDEX,      //  4 index of the item in the source arrays
+        INSTANCE,   //  4 renderable instance, used to detect reordering of the source arrays
+    };
+
+    using ItemSoa = utils::StructureOfArrays<
+            math::float3,
+            math::float3,
+            uint32_t,
+            Instance
+    >;
+
+    enum class Classification : uint8_t { OUTSIDE, INTERSECTS, INSIDE };
+
+    // a leaf that needs testing, or a subtree that is entirely visible
+    struct WorkItem {
+        uint32_t first;
+        uint32_t count;
+        bool inside;
+    };
+
+    void build(math::float3 const* center, math::float3 const* extent,
+            Instance const* instances, size_t count) noexcept;
+
+    uint32_t buildRecursive(uint32_t* indices, uint32_t first, uint32_t count,
+            math::float3 const* center) noexcept;
+
+    void computeNodeBounds(Node& node) const noexcept;
+
+    float computeSurfaceArea() const noexcept;
+
+    static Classification classify(math::float4 const* planes,
+            math::float3 const& center, math::float3 const& extent) noexcept;
+
+    void processWorkItem(WorkItem const& item, Culler::result_type* visibleMask,
+            Frustum const& frustum, size_t bit) const noexcept;
+
+    // mItems has Culler::MODULO padding items past the mItemCount actual items
+    ItemSoa mItems;
+    size_t mItemCount = 0;
+    std::vector<Node> mNodes;
+    float mBuildSurfaceArea = 0;
+
+    // scratch space for cull(), kept around to avoid reallocations every frame
+    mutable std::vector<WorkItem> mWorkList;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_CULLINGHIERARCHY_H
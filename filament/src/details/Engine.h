@@ -37,6 +37,7 @@
 #include "driver/DriverApi.h"
 
 #include <filament/Engine.h>
+#include <filament/EngineEnums.h>
 #include <filament/VertexBuffer.h>
 #include <filament/IndirectLight.h>
 #include <filament/Material.h>
@@ -117,7 +118,7 @@ public:
         math::mat4f clipFromViewMatrix;
         math::mat4f viewFromClipMatrix;
         math::mat4f clipFromWorldMatrix;
-        math::mat4f lightFromWorldMatrix;
+        math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES]; // one per shadow cascade
 
         math::float4 resolution; // width, height, 1/width, 1/height
 
@@ -131,10 +132,10 @@ public:
         math::float3 lightDirection;
         uint32_t fParamsX; // stride-x
 
-        math::float3 shadowBias; // constant bias, normal bias, unused
+        uint32_t cascadeCount; // number of shadow cascades
         float oneOverFroxelDimensionY;
 
-        math::float4 zParams; // froxel Z parameters
+        alignas(16) math::float4 zParams; // froxel Z parameters
 
         math::uint2 fParams; // stride-y, stride-z
         math::float2 origin; // viewport left, viewport bottom
@@ -145,6 +146,9 @@ public:
         float ev100;
 
         alignas(16) math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
+
+        math::float4 cascadeSplits;     // view-space distance to the far plane of each cascade
+        math::float4 cascadeNormalBias; // normal bias of each cascade, in world units
     };
 
     struct PerRenderableUib {
@@ -167,9 +171,9 @@ public:
         static constexpr size_t SHADOW_MAP     = 0;
         static constexpr size_t RECORDS        = 1;
         static constexpr size_t FROXELS        = 2;
-        static constexpr size_t IBL_DFG_LUT    = 3;
-        static constexpr size_t IBL_SPECULAR   = 4;
-        static constexpr size_t IBL_IRRADIANCE = 5;
+        static constexpr size_t LIGHTS         = 3;
+        static constexpr size_t IBL_DFG_LUT    = 4;
+        static constexpr size_t IBL_SPECULAR   = 5;
     };
 
     struct PostProcessSib {
@@ -198,10 +202,14 @@ public:
     const SamplerInterfaceBlock& getPerViewSib() const noexcept { return mPerViewSib; }
     const SamplerInterfaceBlock& getPostProcessSib() const noexcept { return mPostProcessSib; }
 
-    // the per-frame Area is used by all Renderer, so they must run in sequence and
+    // the per-frame Areas are used by all Renderer, so they must run in sequence and
     // have freed all allocated memory when done. If this needs to change in the future,
     // we'll simply have to use separate Areas (for instance).
-    LinearAllocatorArena& getPerRenderPassAllocator() noexcept { return mPerRenderPassAllocator; }
+    // A Renderer prepares a view while the previous one is rendered, the views alternate
+    // between the two Areas.
+    LinearAllocatorArena& getPerRenderPassAllocator(size_t index) noexcept {
+        return mPerRenderPassAllocators[index & 1];
+    }
 
     // Material IDs...
     uint32_t getMaterialId() const noexcept { return mMaterialId++; }
@@ -328,9 +336,18 @@ public:
     // flush the current buffer
     void flush();
 
+    // size of the driver commands flushed since the previous call, the renderer calls this
+    // once per frame
+    size_t takeFlushedCommandBytes() noexcept { return mCommandBufferQueue.takeFlushedBytes(); }
+
     void prepare();
     void gc();
 
+    // Changes every time prepare() commits new parameters of a material with a custom depth
+    // shader, i.e. whose parameters can change what the depth passes (e.g. the shadow maps)
+    // render.
+    uint64_t getDepthMaterialsGeneration() const noexcept { return mDepthMaterialsGeneration; }
+
     filaflat::ShaderBuilder& getVertexShaderBuilder() noexcept {
         return mVertexShaderBuilder;
     }
@@ -397,6 +414,7 @@ private:
 
     // FMaterialInstance are handled directly by FMaterial
     std::unordered_map<const FMaterial*, ResourceList<FMaterialInstance>> mMaterialInstances;
+    uint64_t mDepthMaterialsGeneration = 0;
 
     std::unique_ptr<DFG> mDFG;
 
@@ -417,7 +435,7 @@ private:
     CommandBufferQueue mCommandBufferQueue;
     DriverApi mCommandStream;
 
-    LinearAllocatorArena mPerRenderPassAllocator;
+    LinearAllocatorArena mPerRenderPassAllocators[2];
     HeapAllocatorArena mHeapAllocator;
 
     utils::JobSystem mJobSystem;
@@ -52,8 +52,8 @@ public:
 };
 
 //
-// Light UBO           Froxel Record Buffer     per-froxel light list texture
-// {4 x float4}         R_U8  {index into        RG_U16 {offset, point-count, spot-sount}
+// Light texture       Froxel Record Buffer     per-froxel light list texture
+// {4 x float4}         R_U16 {index into        RG_U32 {offset, point-count, spot-sount}
 // (spot/point            light texture}
 //
 //  +----+                     +-+                     +----+
@@ -66,11 +66,11 @@ public:
 //  :    :                     | |                     |    |
 //  :    :                     | |                     |    |
 //  :    :                     +-+                     |    |
-//  :    :                  65536 max                  +----+
+//  :    :                  131072 max                 +----+
 //  |....|                                          h = num froxels
 //  |....|
 //  +----+
-// 256 lights max
+// 512 lights max
 //
 
 // Max number of froxels limited by:
@@ -78,11 +78,15 @@ public:
 // - chosen texture width [64]
 // - size of CPU-side indices [16 bits]
 // Also, increasing the number of froxels adds more pressure on the "record buffer" which stores
-// the light indices per froxel. The record buffer is limited to 65536 entries, so with
-// 8192 froxels, we can store 8 lights per froxels assuming they're all used. In practice, some
+// the light indices per froxel. The record buffer is limited to 131072 entries, so with
+// 8192 froxels, we can store 16 lights per froxels assuming they're all used. In practice, some
 // froxels are not used, so we can store more.
 static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 8192;
 
+// Max number of slices along the view direction, the froxels of a slice are always at least
+// FROXEL_BUFFER_ENTRY_COUNT_MAX / FROXEL_SLICE_COUNT_MAX.
+static constexpr size_t FROXEL_SLICE_COUNT_MAX = 64;
+
 class Froxelizer {
 public:
     explicit Froxelizer(FEngine& engine);
@@ -98,6 +102,14 @@ public:
 
     void setOptions(float zLightNear, float zLightFar) noexcept;
 
+    /*
+     * froxelCount      maximum number of froxels, clamped to FROXEL_BUFFER_ENTRY_COUNT_MAX
+     * sliceCount       number of slices along the view direction, clamped to
+     *                  [2, FROXEL_SLICE_COUNT_MAX]
+     * adaptive         use fewer froxels when few lights are visible
+     */
+    void setFroxelOptions(size_t froxelCount, size_t sliceCount, bool adaptive) noexcept;
+
     /*
      * Allocate per-frame data structures for froxelization.
      *
@@ -107,17 +119,33 @@ public:
      * projection        camera projection matrix
      * projectionNear    near plane
      * projectionFar     far plane
+     * lightCount        number of visible point and spot lights
      *
      * return true if updateUniforms() needs to be called
      */
     bool prepare(driver::DriverApi& driverApi, ArenaScope& arena, Viewport const& viewport,
-            const math::mat4f& projection, float projectionNear, float projectionFar) noexcept;
+            const math::mat4f& projection, float projectionNear, float projectionFar,
+            size_t lightCount) noexcept;
 
     Froxel getFroxelAt(size_t x, size_t y, size_t z) const noexcept;
     size_t getFroxelCountX() const noexcept { return mFroxelCountX; }
     size_t getFroxelCountY() const noexcept { return mFroxelCountY; }
     size_t getFroxelCountZ() const noexcept { return mFroxelCountZ; }
     size_t getFroxelCount() const noexcept { return mFroxelCount; }
+    math::uint2 getFroxelDimension() const noexcept { return mFroxelDimension; }
+
+    /*
+     * Computes a froxel grid covering the viewport with at most froxelCount froxels in
+     * sliceCount slices. Froxels are rectangular and as close to square as the aspect ratio of
+     * the viewport allows, so that the whole budget is used regardless of the aspect ratio.
+     */
+    static void computeFroxelLayout(
+            math::uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
+            Viewport const& viewport, size_t froxelCount, size_t sliceCount) noexcept;
+
+    // froxel count to use with lightCount lights, between MIN_ADAPTIVE_FROXEL_COUNT
+    // and froxelCount
+    static size_t computeAdaptiveFroxelCount(size_t lightCount, size_t froxelCount) noexcept;
 
     // update Records and Froxels texture with lights data. this is thread-safe.
     void froxelizeLights(FEngine& engine, CameraInfo const& camera,
@@ -141,20 +169,20 @@ public:
 
     struct FroxelEntry {
         union {
-            uint32_t u32;
+            uint64_t u64;
             struct {
-                uint16_t offset = 0;
+                uint32_t offset = 0;
                 union {
-                    uint8_t count[2] = { 0, 0 };
+                    uint16_t count[2] = { 0, 0 };
                     struct {
-                        uint8_t pointLightCount;
-                        uint8_t spotLightCount;
+                        uint16_t pointLightCount;
+                        uint16_t spotLightCount;
                     };
                 };
             };
         };
     };
-    // This depends on the maximum number of lights (currently 255),and can't be more than 16 bits.
+    // This depends on the maximum number of lights (currently 511),and can't be more than 16 bits.
     static_assert(CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint16_t>::max(), "can't have more than 65536 lights");
     using RecordBufferType = std::conditional_t<CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint8_t>::max(), uint8_t, uint16_t>;
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
@@ -184,12 +212,11 @@ private:
         float min;          // lights z-range min
         float max;          // lights z-range max
 
+        uint32_t offset;    // offset in record buffer
         uint16_t next;      // next node when range test fails
-        uint16_t offset;    // offset in record buffer
 
         uint8_t isLeaf;
         uint8_t count;      // light count in record buffer
-        uint16_t reserved;
     };
 
     // The first entry always encodes the type of light, i.e. point/spot
@@ -202,7 +229,7 @@ private:
     void froxelizeLoop(FEngine& engine,
             const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
 
-    void froxelizeAssignRecordsCompress() noexcept;
+    void froxelizeAssignRecordsCompress(utils::JobSystem& js) noexcept;
 
     void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
             math::mat4f const& projection, const LightParams& light) const noexcept;
@@ -219,10 +246,6 @@ private:
 
     std::pair<size_t, size_t> clipToIndices(math::float2 const& clip) const noexcept;
 
-    static void computeFroxelLayout(
-            math::uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-            Viewport const& viewport) noexcept;
-
     // internal state dependant on the viewport and needed for froxelizing
     LinearAllocatorArena mArena;                    // ~256 KiB
 
@@ -231,12 +254,12 @@ private:
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
 
-    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
-    utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
+    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 512 KiB w/  512 lights
+    utils::Slice<FroxelEntry> mFroxelBufferUser;        //  64 KiB w/ 8192 froxels
 
-    // max 32 KiB  (actual: resolution dependant)
-    utils::Slice<RecordBufferType> mRecordBufferUser;   //  64 KiB
-    utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights
+    // max 64 KiB  (actual: resolution dependant)
+    utils::Slice<RecordBufferType> mRecordBufferUser;   // 256 KiB
+    utils::Slice<LightRecord> mLightRecords;            // 512 KiB w/ 512 lights
 
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
@@ -261,6 +284,12 @@ private:
     float mZLightFar = FEngine::CONFIG_Z_LIGHT_FAR;
     float mZLightNear = FEngine::CONFIG_Z_LIGHT_NEAR;  // light near (first slice)
 
+    // froxel options, and froxel count currently in use (which is smaller when adaptive)
+    uint16_t mMaxFroxelCount = FROXEL_BUFFER_ENTRY_COUNT_MAX;
+    uint16_t mFroxelBudget = FROXEL_BUFFER_ENTRY_COUNT_MAX;
+    uint8_t mSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
+    bool mAdaptive = false;
+
     // track if we need to update our internal state before froxelizing
     uint8_t mDirtyFlags = 0;
     enum {
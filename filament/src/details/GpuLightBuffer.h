@@ -17,16 +17,23 @@
 #ifndef TNT_FILAMENT_DETAILS_LIGHTDATA_H
 #define TNT_FILAMENT_DETAILS_LIGHTDATA_H
 
-#include <driver/Handle.h>
-#include <driver/UniformBuffer.h>
+#include "driver/GPUBuffer.h"
+
+#include <utils/Slice.h>
 
 #include <math/vec4.h>
 
+#include <assert.h>
+
 namespace filament {
 namespace details {
 
 class FEngine;
 
+/*
+ * The lights data are stored in a float texture, LIGHT_BUFFER_WIDTH lights per row, each light
+ * using 4 RGBA texels. Unlike a uniform buffer, this isn't limited to 16 KiB.
+ */
 class GpuLightBuffer {
 public:
     using LightIndex = uint16_t;
@@ -38,8 +45,16 @@ public:
         math::float4 spotScaleOffset;   // { scale, offset, unused, unused }
     };
 
+    // Make sure this matches the same constants in light_punctual.fs
+    static constexpr size_t LIGHT_BUFFER_WIDTH_SHIFT = 4u;
+    static constexpr size_t LIGHT_BUFFER_WIDTH       = 1u << LIGHT_BUFFER_WIDTH_SHIFT;
+    static constexpr size_t LIGHT_BUFFER_WIDTH_MASK  = LIGHT_BUFFER_WIDTH - 1u;
+
     explicit GpuLightBuffer(FEngine& engine) noexcept;
 
+    // allocates the parameters of count lights for this frame, from the command stream
+    void prepare(FEngine& engine, size_t count) noexcept;
+
     void commit(FEngine& engine) noexcept;
 
     void terminate(FEngine& engine);
@@ -50,21 +65,27 @@ public:
     GpuLightBuffer& operator=(GpuLightBuffer&& rhs) = delete;
     ~GpuLightBuffer() noexcept;
 
+    // only valid between prepare() and commit()
     LightParameters& getLightParameters(LightIndex h) noexcept {
-        // This assumes the layout of the LightsUniforms uniform buffer
-        // it is defined in UibGenerator.cpp
-        LightParameters* lights = (LightParameters *)mLightsUb.getBuffer();
-        return lights[h];
+        assert(h < mLights.size());
+        return mLights[h];
     }
 
+    // lights are always uploaded from the first one, so only count matters
     void invalidate(LightIndex h, size_t count) noexcept {
-        mLightsUb.invalidateUniforms(h * sizeof(LightParameters), count * sizeof(LightParameters));
+        assert(h == 0);
+        if (count) {
+            mLightsBuffer.invalidate(h,
+                    (count + LIGHT_BUFFER_WIDTH_MASK) >> LIGHT_BUFFER_WIDTH_SHIFT);
+        }
     }
 
+    // gpu buffer containing the lights, valid after construction
+    GPUBuffer const& getBuffer() const noexcept { return mLightsBuffer; }
+
 private:
-    void commitSlow(FEngine& engine) noexcept;
-    Handle<HwUniformBuffer> mLightUbh;
-    mutable UniformBuffer mLightsUb;
+    GPUBuffer mLightsBuffer;
+    utils::Slice<LightParameters> mLights;
 };
 
 } // namespace details
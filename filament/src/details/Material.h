@@ -103,6 +103,7 @@ public:
     bool isDoubleSided() const noexcept { return mDoubleSided; }
     float getMaskThreshold() const noexcept { return mMaskTreshold; }
     bool hasShadowMultiplier() const noexcept { return mHasShadowMultiplier; }
+    bool hasCustomDepthShader() const noexcept { return mHasCustomDepthShader; }
     AttributeBitset getRequiredAttributes() const noexcept { return mRequiredAttributes; }
 
     size_t getParameterCount() const noexcept {
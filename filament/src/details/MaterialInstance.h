@@ -43,11 +43,14 @@ public:
     void terminate(FEngine& engine);
 
     void commit(FEngine& engine) const {
-        if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty())) {
+        if (UTILS_UNLIKELY(isDirty())) {
             commitSlow(engine);
         }
     }
 
+    // true if parameters have been set since the last commit()
+    bool isDirty() const noexcept { return mUniforms.isDirty() || mSamplers.isDirty(); }
+
     void use(FEngine::DriverApi& driver) const {
         if (mUbHandle) {
             driver.bindUniforms(BindingPoints::PER_MATERIAL_INSTANCE, mUbHandle);
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+#define TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+
+#include "details/Culler.h"
+
+#include <filament/Box.h>
+
+#include <utils/compiler.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace filament {
+namespace details {
+
+/*
+ * CPU occlusion culling.
+ *
+ * A few designated occluders are rasterized into a low resolution depth buffer, then the
+ * bounding boxes of the other renderables are tested against it. A box is occluded when it's
+ * behind the occluders everywhere it covers on screen.
+ *
+ * Occluders are boxes, which are assumed to be entirely filled by the object they stand for
+ * (e.g. walls, buildings, terrain blocks), so they must be chosen accordingly.
+ *
+ * The test is conservative: an occluder only covers the pixels that are entirely inside its
+ * silhouette, and a covered pixel stores the farthest depth of the occluder's front surface
+ * over the whole pixel. So a box is never reported occluded when any part of it is visible,
+ * even if it peeks past an occluder's edge by less than a pixel.
+ *
+ * The depth buffer stores NDC z (OpenGL convention, i.e. -1 at the near plane). Rasterization
+ * is split in bands of rows processed in parallel, and the inner loops are written for the
+ * compiler's auto-vectorizer.
+ */
+class OcclusionCuller {
+public:
+    // size of the depth buffer
+    static constexpr uint32_t WIDTH = 256;
+    static constexpr uint32_t HEIGHT = 128;
+
+    // number of rows rasterized by a job
+    static constexpr uint32_t BAND_HEIGHT = 16;
+
+    // occluders added past this count are ignored
+    static constexpr size_t MAX_OCCLUDER_COUNT = 128;
+
+    OcclusionCuller() noexcept;
+    ~OcclusionCuller() noexcept;
+
+    OcclusionCuller(OcclusionCuller const& rhs) = delete;
+    OcclusionCuller& operator=(OcclusionCuller const& rhs) = delete;
+
+    // Removes all occluders and sets the transform from world space to clip space, the depth
+    // buffer is cleared by the next rasterize().
+    void reset(math::mat4f const& clipFromWorld) noexcept;
+
+    // Adds an occluder, 'box' is in model space. Returns false if the occluder was ignored
+    // because MAX_OCCLUDER_COUNT is reached.
+    bool addOccluder(math::mat4f const& worldFromModel, Box const& box) noexcept;
+
+    size_t getOccluderCount() const noexcept { return mOccluderCount; }
+
+    // rasterizes the occluders (this runs on multiple threads)
+    void rasterize(utils::JobSystem& js) noexcept;
+
+    // Clears 'bit' in results[i] when the world-space AABB i is occluded. Only the AABBs with
+    // 'bit' set are tested. This runs on multiple threads.
+    void cull(utils::JobSystem& js, Culler::result_type* results,
+            math::float3 const* center, math::float3 const* extent,
+            size_t count, size_t bit) const noexcept;
+
+    // returns whether a world-space AABB is occluded
+    bool isOccluded(math::float3 const& center, math::float3 const& extent) const noexcept;
+
+    // depth buffer, rows are stored bottom to top
+    float const* getDepthBuffer() const noexcept { return mDepth.get(); }
+
+private:
+    // an occluder ready to be rasterized, in depth buffer coordinates
+    struct Occluder {
+        // edges of the silhouette in mEdges, a * x + b * y + c is positive inside
+        uint32_t firstEdge;
+        uint32_t edgeCount;
+        // the front faces (up to 3), z = dzdx[i] * x + dzdy[i] * y + z0[i]. The front surface
+        // of a convex occluder is the maximum of these planes.
+        math::float3 dzdx;
+        math::float3 dzdy;
+        math::float3 z0;
+        // range of the occluder's depth, which bounds its front surface
+        float zmin;
+        float zmax;
+        // bounds of the pixels that can be entirely covered, min inclusive, max exclusive
+        uint16_t xmin, xmax;
+        uint16_t ymin, ymax;
+    };
+
+    void rasterizeBand(uint32_t y0, uint32_t y1) noexcept;
+
+    std::unique_ptr<float[]> mDepth;
+    std::vector<Occluder> mOccluders;
+    std::vector<math::float3> mEdges;
+    math::mat4f mClipFromWorld;
+    size_t mOccluderCount = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
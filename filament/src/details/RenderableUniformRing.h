@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_RENDERABLEUNIFORMRING_H
+#define TNT_FILAMENT_DETAILS_RENDERABLEUNIFORMRING_H
+
+#include "components/RenderableManager.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <utils/Range.h>
+
+#include <stddef.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * A ring of uniform buffers, each holding the per-renderable uniforms of all the visible
+ * renderables of a frame. They're uploaded in a single transfer, and each renderable's uniforms
+ * are bound as a range of the buffer, instead of each renderable having its own uniform buffer.
+ */
+class RenderableUniformRing {
+public:
+    // size of the per-renderable uniforms (see UibGenerator::getPerRenderableUib())
+    static constexpr size_t UNIFORMS_SIZE = 112;
+
+    // the uniforms of each renderable start at a multiple of this size, which is the largest
+    // alignment of uniform buffer ranges that GLES 3.0 and Vulkan implementations can require
+    static constexpr size_t SLOT_SIZE = 256;
+
+    // one buffer per frame that can be in flight
+    static constexpr size_t BUFFER_COUNT = 3;
+
+    RenderableUniformRing() noexcept;
+    ~RenderableUniformRing() noexcept;
+
+    RenderableUniformRing(RenderableUniformRing const& rhs) = delete;
+    RenderableUniformRing& operator=(RenderableUniformRing const& rhs) = delete;
+
+    void terminate(driver::DriverApi& driver);
+
+    // Switches to the next buffer of the ring and uploads the uniforms of the renderables in
+    // 'list' into it. The uniforms of instances[i] are in the slot i.
+    void commit(driver::DriverApi& driver, FRenderableManager const& rcm,
+            FRenderableManager::Instance const* instances,
+            utils::Range<uint32_t> list) noexcept;
+
+    // the buffer updated by the last commit()
+    Handle<HwUniformBuffer> getHandle() const noexcept { return mBuffers[mCurrent].handle; }
+
+    static uint32_t getSlotOffset(uint32_t slot) noexcept { return uint32_t(slot * SLOT_SIZE); }
+
+private:
+    struct Buffer {
+        Handle<HwUniformBuffer> handle;
+        size_t capacity = 0;    // in slots
+    };
+    Buffer mBuffers[BUFFER_COUNT];
+    size_t mCurrent = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_RENDERABLEUNIFORMRING_H
@@ -61,7 +61,7 @@ public:
 
     // do all the work here!
     void render(FView const* view);
-    void renderJob(ArenaScope& arena, FView* view);
+    void render(View const* const* views, size_t count);
 
     bool beginFrame(FSwapChain* swapChain);
     void endFrame();
@@ -74,6 +74,7 @@ public:
 
 private:
     using Command = RenderPass::Command;
+    using InstanceBufferPool = RenderPass::InstanceBufferPool;
 
     // this class is defined in RenderPass.cpp
     class ColorPass final : public RenderPass {
@@ -85,26 +86,74 @@ private:
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ColorPass(const char* name, utils::JobSystem& js, utils::JobSystem::Job* jobFroxelize,
+        ColorPass(const char* name, InstanceBufferPool& instanceBuffers,
+                utils::JobSystem& js, utils::JobSystem::Job* jobFroxelize,
                 FView* view, Handle<HwRenderTarget> rth);
+
+        // generates the sorted commands of the color pass, this doesn't touch the driver
+        static utils::Slice<Command> generateColorPass(utils::JobSystem& js,
+                FView const* view, utils::GrowingSlice<Command>& commands) noexcept;
+
+        // records the commands returned by generateColorPass(), after 'jobFroxelize' is done
         static void renderColorPass(FEngine& engine, utils::JobSystem& js,
-                Handle<HwRenderTarget> rth,
+                InstanceBufferPool& instanceBuffers, Handle<HwRenderTarget> rth,
                 FView* view, Viewport const& scaledViewport,
-                utils::GrowingSlice<Command>& commands) noexcept;
+                utils::JobSystem::Job* jobFroxelize, utils::Slice<Command> commands) noexcept;
     };
 
     // this class is defined in RenderPass.cpp
     class ShadowPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
         ShadowMap const& shadowMap;
+        size_t const cascade;   // the cascade of the shadow map rendered by this pass
+        bool const clear;       // whether this pass clears the shadow map, i.e. renders first
         void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ShadowPass(const char* name, ShadowMap const& shadowMap) noexcept;
-        static void renderShadowMap(FEngine& engine, utils::JobSystem& js,
-                FView* view, utils::GrowingSlice<Command>& commands) noexcept;
+        ShadowPass(const char* name, InstanceBufferPool& instanceBuffers,
+                Handle<HwUniformBuffer> uniformRing, ShadowMap const& shadowMap,
+                size_t cascade, bool clear) noexcept;
+
+        // the output of generateShadowMap()
+        struct Cascades {
+            CameraInfo cameraInfos[CONFIG_MAX_SHADOW_CASCADES];
+            utils::Slice<Command> commands[CONFIG_MAX_SHADOW_CASCADES];
+        };
+
+        // generates the sorted commands of all the cascades, this doesn't touch the driver
+        static void generateShadowMap(utils::JobSystem& js,
+                FView const* view, utils::GrowingSlice<Command>& commands,
+                Cascades& cascades) noexcept;
+
+        // records the commands returned by generateShadowMap()
+        static void renderShadowMap(FEngine& engine, InstanceBufferPool& instanceBuffers,
+                FView* view, Cascades const& cascades) noexcept;
     };
 
+    // A view being rendered, the data of its passes are allocated in its own arena.
+    struct ViewFrame {
+        ViewFrame(LinearAllocatorArena& arena, FView* view) noexcept
+                : arena(arena), view(view) {
+        }
+        ArenaScope arena;
+        FView* const view;
+        utils::JobSystem::Job* job = nullptr;   // runs prepareViewJob()
+        Viewport svp;                           // the scaled viewport
+        math::float2 scale;
+        bool useFXAA = false;
+        utils::GrowingSlice<Command> commands;
+        utils::GrowingSlice<Command> shadowCommands;
+        ShadowPass::Cascades cascades;
+        utils::Slice<Command> colorCommands;
+    };
+
+    // culls the view and generates the commands of its passes, this doesn't touch the driver
+    // and runs as a job while the previous view is rendered
+    void prepareViewJob(ViewFrame* frame);
+
+    // records the driver commands of a view prepared by prepareViewJob()
+    void renderJob(ViewFrame& frame);
+
     Handle<HwRenderTarget> getRenderTarget() const noexcept { return mRenderTarget; }
 
     void recordHighWatermark(utils::Slice<Command> const& commands) noexcept {
@@ -137,11 +186,12 @@ private:
     size_t mCommandsHighWatermark = 0;
     uint32_t mFrameId = 0;
     FrameInfoManager mFrameInfoManager;
+    InstanceBufferPool mInstanceBuffers;
     bool mIsRGB16FSupported : 1;
     bool mIsRGB8Supported : 1;
 
-    // per-frame arena for this Renderer
-    LinearAllocatorArena& mPerRenderPassArena;
+    // per-frame arenas for this Renderer, the views alternate between them
+    LinearAllocatorArena* const mPerRenderPassArenas[2];
 
 #if EXTRA_TIMING_INFO
     Series<float> mRendering;
@@ -23,6 +23,7 @@
 #include "components/TransformManager.h"
 
 #include "details/Culler.h"
+#include "details/CullingHierarchy.h"
 #include "details/GpuLightBuffer.h"
 
 #include "Allocators.h"
@@ -32,11 +33,16 @@
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
+#include <utils/EntityManager.h>
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
 
+#include <atomic>
 #include <cstddef>
+#include <vector>
+
+#include <tsl/robin_map.h>
 #include <tsl/robin_set.h>
 
 namespace filament {
@@ -69,6 +75,9 @@ public:
     size_t getRenderableCount() const noexcept;
     size_t getLightCount() const noexcept;
 
+    void setCullingHierarchyEnabled(bool enabled) noexcept;
+    bool isCullingHierarchyEnabled() const noexcept { return mCullingHierarchyEnabled; }
+
 public:
     /*
      * Filaments-scope Public API
@@ -82,9 +91,10 @@ public:
     ~FScene() noexcept;
     void terminate(FEngine& engine);
 
-    void prepare(const math::mat4f& worldOriginTansform);
-    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena) noexcept;
-    void computeBounds(Aabb& castersBox, Aabb& receiversBox, uint32_t visibleLayers) const noexcept;
+    // Brings the scene's caches up to date, this is cheap when nothing changed since the last
+    // update. The per-frame arrays belong to the views, so this can run while a View of this
+    // scene is rendered, but not while one is prepared.
+    void update(const math::mat4f& worldOriginTansform);
 
     /*
      * Storage for per-frame renderable data
@@ -95,7 +105,7 @@ public:
         WORLD_TRANSFORM,        // 16 instance of the Transform component
         VISIBILITY_STATE,       //  1 visibility data of the component
         UBH,                    //  4 uniform buffer handle
-        BONES_UBH,              //  4 bones uniform buffer handle
+        BONES_OFFSET,           //  4 offset of the bones in the bones uniform buffer
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
 
@@ -106,6 +116,7 @@ public:
         // These are temporaries and should be stored out of line
         PRIMITIVES,             //  8 level-of-detail'ed primitives
         SUMMED_PRIMITIVE_COUNT, //  4 summed visible primitive counts
+        SCREEN_SIZE,            //  4 projected radius, as a fraction of the viewport height
     };
 
     using RenderableSoa = utils::StructureOfArrays<
@@ -113,17 +124,19 @@ public:
             math::mat4f,
             FRenderableManager::Visibility,
             Handle<HwUniformBuffer>,
-            Handle<HwUniformBuffer>,
+            uint32_t,
             math::float3,
             Culler::result_type,
             uint8_t,
             math::float3,
             utils::Slice<FRenderPrimitive>,
-            uint32_t
+            uint32_t,
+            float
     >;
 
-    RenderableSoa const& getRenderableData() const noexcept { return mRenderableData; }
-    RenderableSoa& getRenderableData() noexcept { return mRenderableData; }
+    // Changes every time update() sees a change of the renderables (including their transforms)
+    // since the previous call. This is used by caches of data derived from the renderables.
+    uint64_t getRenderableGeneration() const noexcept { return mRenderableGeneration; }
 
     static inline uint32_t getPrimitiveCount(RenderableSoa const& soa,
             uint32_t first, uint32_t last) noexcept {
@@ -157,12 +170,75 @@ public:
             math::float2
     >;
 
-    LightSoa const& getLightData() const noexcept { return mLightData; }
-    LightSoa& getLightData() noexcept { return mLightData; }
+    // Copies the caches brought up to date by update() into the per-frame arrays of a FView.
+    void prepare(RenderableSoa& renderableData, LightSoa& lightData) const noexcept;
+
+    // Keeps the lights with the largest influence on the view and sorts them, this doesn't
+    // touch the GPU light buffer which commitDynamicLights() updates.
+    void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena,
+            LightSoa& lightData) const noexcept;
+    void commitDynamicLights(LightSoa const& lightData) noexcept;
+
+    static void computeBounds(RenderableSoa const& renderableData,
+            Aabb& castersBox, Aabb& receiversBox, uint32_t visibleLayers) noexcept;
 
-    void updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept;
+    GpuLightBuffer const& getGpuLightBuffer() const noexcept { return mGpuLightData; }
+
+    void updateUBOs(RenderableSoa const& renderableData,
+            utils::Range<uint32_t> visibleRenderables) const noexcept;
+
+    // The hierarchy is refit (or rebuilt) by update(), and its indices are rows of the
+    // renderable cache. prepare() copies the cache in the same order, so the indices are valid
+    // for a RenderableSoa from the last prepare() until FView partitions it by visibility (after
+    // the camera, occlusion and shadow culling), and not after the next update(), which another
+    // view of the same scene may run.
+    CullingHierarchy const* getCullingHierarchy() const noexcept {
+        return mCullingHierarchyEnabled ? &mCullingHierarchy : nullptr;
+    }
 
 private:
+    // rows of an entity in the caches below
+    struct EntityRows {
+        uint32_t renderable;    // row in mRenderableCache, or NO_ROW
+        uint32_t light;         // row in mLightCache, or DIRECTIONAL_ROW | index, or NO_ROW
+        uint32_t stamp;         // value of mPrepareStamp when the rows were last updated
+    };
+
+    // gather() doesn't split its work below this many entities per job
+    static constexpr uint32_t GATHER_MIN_LOOP_COUNT = 256;
+
+    static constexpr uint32_t NO_ROW = 0xFFFFFFFFu;
+    static constexpr uint32_t DIRECTIONAL_ROW = 0x80000000u;
+
+    struct DirectionalLight {
+        FLightManager::Instance instance;
+        math::float3 direction;
+    };
+
+    // components of an entity, found by the first pass of gather()
+    struct EntityComponents {
+        RenderableManager::Instance ri;
+        LightManager::Instance li;
+        TransformManager::Instance ti;
+        bool alive;
+    };
+
+    // we need to regather everything when any entity is destroyed, but this can happen on
+    // any thread
+    class EntityListener final : public utils::EntityManager::Listener {
+    public:
+        void onEntitiesDestroyed(size_t n, utils::Entity const* entities) noexcept override;
+        void onAllEntitiesDestroyed() noexcept override;
+        std::atomic<bool> destroyed = { true };
+    };
+
+    void gather(const math::mat4f& worldOriginTransform);
+    void updateChanges(utils::Slice<const utils::Entity> changes,
+            const math::mat4f& worldOriginTransform) noexcept;
+    // only writes the given rows, so it can be called concurrently for different entities
+    void updateRows(EntityRows const& rows, TransformManager::Instance ti,
+            const math::mat4f& worldOriginTransform) noexcept;
+
     static inline void computeLightRanges(math::float2* zrange,
             CameraInfo const& camera, const math::float4* spheres, size_t count) noexcept;
 
@@ -178,8 +254,37 @@ private:
     // (a vector<> could work, but removes would be O(n)). robin_set<> iterates almost as
     // nicely as vector<>, which is a good compromise.
     tsl::robin_set<utils::Entity> mEntities;
-    RenderableSoa mRenderableData;
-    LightSoa mLightData;
+
+    // The data gathered from the component managers is kept in these caches, across frames,
+    // in a stable order (the per-frame arrays are copied from them and reordered by FView).
+    // Only the rows of the entities logged in the managers' ChangeList are updated, everything
+    // is regathered when entities are added, removed or destroyed, or when components are
+    // created or destroyed.
+    RenderableSoa mRenderableCache;
+    LightSoa mLightCache;
+    std::vector<DirectionalLight> mDirectionalLights;
+
+    // mEntities as an array, so gather() can process it in parallel, and the rows of each entity
+    std::vector<utils::Entity> mEntityList;
+    std::vector<EntityRows> mEntityRows;
+    std::vector<EntityComponents> mEntityComponents; // scratch space for gather()
+
+    // index of each entity in mEntityList, only needed (and built) for incremental updates
+    tsl::robin_map<utils::Entity, uint32_t> mEntityIndices;
+    bool mEntityIndicesValid = false;
+    EntityListener mEntityListener;
+    math::mat4f mWorldOriginTransform;
+    uint64_t mTransformSequence = 0;
+    uint64_t mRenderableSequence = 0;
+    uint64_t mLightSequence = 0;
+    uint32_t mPrepareStamp = 0;
+    uint64_t mRenderableGeneration = 0;
+    bool mEntitiesChanged = true;
+
+    // optional acceleration structure for culling mostly static scenes
+    CullingHierarchy mCullingHierarchy;
+    uint64_t mCullingHierarchyGeneration = ~0ull; // mRenderableGeneration at the last refit
+    bool mCullingHierarchyEnabled = false;
 };
 
 FILAMENT_UPCAST(Scene)
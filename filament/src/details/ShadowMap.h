@@ -25,6 +25,8 @@
 #include "driver/DriverApiForward.h"
 #include "driver/SamplerBuffer.h"
 
+#include <filament/EngineEnums.h>
+#include <filament/View.h>
 #include <filament/Viewport.h>
 
 #include <math/mat4.h>
@@ -41,39 +43,79 @@ public:
     void terminate(driver::DriverApi& driverApi) noexcept;
 
     // Call once per frame if the light, scene (or visible layers) or camera changes.
-    // This computes the light's camera.
+    // This computes the light's camera of each cascade.
     void update(
-            const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
+            const FScene::LightSoa& lightData, size_t index,
+            FScene::RenderableSoa const& renderableData,
+            details::CameraInfo const& camera, uint8_t visibleLayers,
+            size_t cascadeCount, View::CascadeSplitScheme scheme) noexcept;
 
-    // Do we have visible shadows. Valid after calling update().
+    // Do we have visible shadows in any cascade. Valid after calling update().
     bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
 
+    // Do we have visible shadows in this cascade. Valid after calling update().
+    bool hasVisibleShadows(size_t cascade) const noexcept {
+        return mCascades[cascade].hasVisibleShadows;
+    }
+
+    // Number of cascades. Valid after calling update().
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    // View-space distance to the far plane of each cascade. Valid after calling update().
+    float const* getCascadeSplits() const noexcept { return mCascadeSplits; }
+
     // Allocates shadow texture based on user parameters (e.g. dimensions)
     void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
 
-    // Returns the shadow map's viewport. Valid after prepare().
-    Viewport const& getViewport() const noexcept { return mViewport; }
+    // Returns the viewport of a cascade in the shadow map. Valid after calling update().
+    Viewport const& getViewport(size_t cascade) const noexcept {
+        return mCascades[cascade].viewport;
+    }
 
-    // Computes the transform to use in the shader to access the shadow map.
+    // Computes the transform to use in the shader to access a cascade of the shadow map.
     // Valid after calling update().
-    math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
+    math::mat4f const& getLightSpaceMatrix(size_t cascade) const noexcept {
+        return mCascades[cascade].lightSpace;
+    }
+
+    // return the size of a texel of a cascade in world space (pre-warping)
+    float getTexelSizeWorldSpace(size_t cascade) const noexcept {
+        return mCascades[cascade].texelSizeWs;
+    }
+
+    // Returns the depth range of a cascade. Valid after calling update().
+    float getSceneRange(size_t cascade) const noexcept { return mCascades[cascade].sceneRange; }
 
-    // return the size of a texel in world space (pre-warping)
-    float getTexelSizeWorldSpace() const noexcept { return mTexelSizeWs; }
+    // Returns the light's projection of a cascade. Valid after calling update().
+    FCamera const& getCamera(size_t cascade) const noexcept { return *mCascades[cascade].camera; }
 
-    // Returns the shadow map's depth range. Valid after init().
-    float getSceneRange() const noexcept { return mSceneRange; }
+    // Set-up the render target, call before rendering each cascade. Only the first render pass
+    // of the frame clears the shadow map.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t cascade, bool clear) const noexcept;
 
-    // Returns the light's projection. Valid after calling update().
-    FCamera const& getCamera() const noexcept { return *mCamera; }
+    // Returns true if rendering a cascade with the given commands (see
+    // RenderPass::CommandCache::getGeneration()) and materials (see
+    // FEngine::getDepthMaterialsGeneration()) would produce the same content as the last time
+    // it was rendered, i.e. neither its shadow camera nor its shadow casters changed.
+    // Valid after calling update() and prepare().
+    bool isCascadeUpToDate(size_t cascade,
+            uint64_t commandsGeneration, uint64_t materialsGeneration) const noexcept;
 
-    // Set-up the render target, call before rendering the shadow map.
-    void beginRenderPass(driver::DriverApi& driverApi) const noexcept;
+    // Records what was rendered into a cascade, for isCascadeUpToDate()
+    void setCascadeRendered(size_t cascade,
+            uint64_t commandsGeneration, uint64_t materialsGeneration) noexcept;
 
-    // use only for debugging
+    // the cascades will be rendered again, even if isCascadeUpToDate() would be true
+    void invalidate() noexcept;
+
+    // use only for debugging (this is the first cascade)
     FCamera const& getDebugCamera() const noexcept { return *mDebugCamera; }
 
+    // Computes the view-space distance to the far plane of each of the 'count' cascades
+    // splitting [near, far]
+    static void computeCascadeSplits(float* splits, size_t count,
+            View::CascadeSplitScheme scheme, float near, float far) noexcept;
+
 private:
     struct CameraInfo {
         math::mat4f projection;
@@ -104,9 +146,26 @@ private:
     // 8 corners, 12 segments w/ 2 intersection max -- all of this twice (8 + 12 * 2) * 2 (768 bytes)
     using FrustumBoxIntersection = std::array<math::float3, 64>;
 
+    struct Cascade {
+        FCamera* camera = nullptr;
+        math::mat4f lightSpace;
+        Viewport viewport;
+        float sceneRange = 0.0f;
+        float texelSizeWs = 0.0f;
+        bool hasVisibleShadows = false;
+
+        // what was last rendered into the cascade
+        math::mat4f renderedLightSpace;
+        uint64_t renderedCommands = 0;
+        uint64_t renderedMaterials = 0;
+        bool renderedVisibleShadows = false;
+        bool rendered = false;
+    };
+
     void computeShadowCameraDirectional(
-            math::float3 const& direction, FScene const* scene, CameraInfo const& camera,
-            uint8_t visibleLayers) noexcept;
+            math::float3 const& direction, Aabb const& wsShadowCastersVolume,
+            Aabb const& wsShadowReceiversVolume, CameraInfo const& camera,
+            size_t cascade) noexcept;
 
     static math::mat4f applyLISPSM(
             CameraInfo const& camera, float dzn, float dzf, const math::mat4f& LMpMv,
@@ -149,6 +208,7 @@ private:
     static math::mat4f warpFrustum(float n, float f) noexcept;
 
     math::mat4f getTextureCoordsMapping() const noexcept;
+    math::mat4f getAtlasMapping(size_t cascade) const noexcept;
 
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix) const noexcept;
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix, math::float3 const& str) const noexcept;
@@ -167,19 +227,20 @@ private:
             { 2, 6, 7, 3 },  // top
     };
 
-    FCamera* mCamera = nullptr;
+    // the cascades are side by side in the shadow map, from left to right
+    Cascade mCascades[CONFIG_MAX_SHADOW_CASCADES];
     FCamera* mDebugCamera = nullptr;
-    math::mat4f mLightSpace;
-    float mSceneRange = 0.0f;
-    float mTexelSizeWs = 0.0f;
 
     // set-up in prepare()
-    Viewport mViewport;
     Handle<HwTexture> mShadowMapHandle;
     Handle<HwRenderTarget> mShadowMapRenderTarget;
+    uint32_t mShadowMapWidth = 0;
+    uint32_t mShadowMapHeight = 0;
 
     // set-up in update()
-    uint32_t mShadowMapDimension = 0;
+    uint32_t mShadowMapDimension = 0;   // of each cascade
+    size_t mCascadeCount = 1;
+    float mCascadeSplits[CONFIG_MAX_SHADOW_CASCADES] = { };
     bool mHasVisibleShadows = false;
 
     // use a member here (instead of stack) because we don't want to pay the
@@ -20,10 +20,13 @@
 #include <filament/View.h>
 
 #include "upcast.h"
+#include "RenderPass.h"
 
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/RenderableUniformRing.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
 
@@ -38,6 +41,7 @@
 #include <utils/Range.h>
 
 #include <deque>
+#include <vector>
 
 namespace utils {
 class JobSystem;
@@ -61,13 +65,27 @@ public:
 
     void terminate(FEngine& engine);
 
+    // Culls and partitions the scene's renderables and lights into this view's per-frame data.
+    // This doesn't use the driver, so it can run as a job while another view is rendered.
+    void prepareVisibility(FEngine& engine, ArenaScope& arena) noexcept;
+
+    // Uploads what prepareVisibility() computed, must be called on the driver's thread.
     void prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
             Viewport const& viewport) noexcept;
 
-    void setScene(FScene* scene) { mScene = scene; }
+    // the transform applied to the whole scene by prepare()
+    math::mat4f getWorldOriginTransform() const noexcept;
+
+    void setScene(FScene* scene) noexcept;
     FScene const* getScene() const noexcept { return mScene; }
     FScene* getScene() noexcept { return mScene; }
 
+    // this view's copy of its scene's renderables and lights, partitioned by visibility
+    FScene::RenderableSoa const& getRenderableData() const noexcept { return mRenderableData; }
+    FScene::RenderableSoa& getRenderableData() noexcept { return mRenderableData; }
+    FScene::LightSoa const& getLightData() const noexcept { return mLightData; }
+    FScene::LightSoa& getLightData() noexcept { return mLightData; }
+
     void setCullingCamera(FCamera* camera) noexcept { mCullingCamera = camera; }
     void setViewingCamera(FCamera* camera) noexcept { mViewingCamera = camera; }
 
@@ -114,7 +132,7 @@ public:
     }
 
     void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
-    void prepareShadowing(FEngine& engine, driver::DriverApi& driver,
+    void prepareShadowing(FEngine& engine,
             FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
     void prepareLighting(
             FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena, Viewport const& viewport) noexcept;
@@ -128,8 +146,11 @@ public:
 
     void prepareVisibleRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData) const noexcept;
 
+    void prepareOccludedRenderables(FEngine& engine, utils::JobSystem& js,
+            FScene::RenderableSoa& renderableData, math::mat4f const& clipFromWorld) noexcept;
+
     void prepareVisibleShadowCasters(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
-                                     Frustum const& lightFrustum) const noexcept;
+                                     Frustum const& lightFrustum, size_t bit) const noexcept;
 
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
@@ -138,9 +159,40 @@ public:
     static void cullRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
                                 Frustum const& frustum, size_t bit) noexcept;
 
+    // Computes the SCREEN_SIZE of all renderables, and clears 'bit' of those smaller than
+    // 'threshold'. projectionScale is the [1][1] element of the projection matrix.
+    static void computeScreenSizes(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
+            math::mat4f const& clipFromWorld, float projectionScale, float threshold,
+            size_t bit) noexcept;
+
+    static void cullRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
+                                CullingHierarchy const& hierarchy,
+                                Frustum const& frustum, size_t bit) noexcept;
+
     void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
+    void invalidateShadowMaps() noexcept { mDirectionalShadowMap.invalidate(); }
+
+    void setShadowCascades(uint8_t count, CascadeSplitScheme scheme) noexcept {
+        mShadowCascadeCount = uint8_t(count < 1u ? 1u :
+                count > MAX_SHADOW_CASCADES ? MAX_SHADOW_CASCADES : count);
+        mShadowCascadeSplitScheme = scheme;
+    }
+
+    uint8_t getShadowCascadeCount() const noexcept {
+        return mShadowCascadeCount;
+    }
+
+    CascadeSplitScheme getShadowCascadeSplitScheme() const noexcept {
+        return mShadowCascadeSplitScheme;
+    }
+
+    // VISIBLE_MASK bits set on the shadow casters of each cascade, 0 with a single cascade
+    // (all the shadow casters are then in the only cascade)
+    static uint8_t getShadowCascadeVisibleMask(size_t cascade, size_t count) noexcept;
+
     ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
+    ShadowMap& getShadowMap() { return mDirectionalShadowMap; }
 
     FCamera const* getDirectionalLightCamera() const noexcept {
         return &mDirectionalShadowMap.getDebugCamera();
@@ -182,10 +234,47 @@ public:
 
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
 
+    void setFroxelOptions(FroxelOptions const& options) noexcept;
+
+    FroxelOptions getFroxelOptions() const noexcept {
+        return mFroxelOptions;
+    }
+
     void setPostProcessingEnabled(bool enabled) noexcept {
         mHasPostProcessPass = enabled;
     }
 
+    void setRenderableUniformPackingEnabled(bool enabled) noexcept {
+        mRenderableUniformPacking = enabled;
+    }
+
+    bool isRenderableUniformPackingEnabled() const noexcept {
+        return mRenderableUniformPacking;
+    }
+
+    void setOcclusionCullingEnabled(bool enabled) noexcept {
+        mOcclusionCulling = enabled;
+    }
+
+    bool isOcclusionCullingEnabled() const noexcept {
+        return mOcclusionCulling;
+    }
+
+    void setContributionCullingThreshold(float pixels) noexcept {
+        mContributionCullingThreshold = std::max(0.0f, pixels);
+    }
+
+    float getContributionCullingThreshold() const noexcept {
+        return mContributionCullingThreshold;
+    }
+
+    // the buffer holding the per-renderable uniforms of this frame, or a null handle if each
+    // renderable uses its own uniform buffer
+    Handle<HwUniformBuffer> getRenderableUniformRing() const noexcept {
+        return mRenderableUniformRingUsed ? mRenderableUniformRing.getHandle()
+                                          : Handle<HwUniformBuffer>{};
+    }
+
     void setDepthPrepass(DepthPrepass prepass) noexcept {
         mDepthPrepass = prepass;
     }
@@ -202,6 +291,14 @@ public:
         return mVisibleShadowCasters;
     }
 
+    RenderPass::CommandCache& getColorPassCommandCache() const noexcept {
+        return mColorPassCommandCache;
+    }
+
+    RenderPass::CommandCache& getShadowPassCommandCache(size_t cascade) const noexcept {
+        return mShadowPassCommandCaches[cascade];
+    }
+
     FCamera& getCameraUser() noexcept { return *mCullingCamera; }
     void setCameraUser(FCamera* camera) noexcept { setCullingCamera(camera); }
 
@@ -255,11 +352,14 @@ private:
     uint8_t mSampleCount = 1;
     AntiAliasing mAntiAliasing = AntiAliasing::FXAA;
     bool mShadowingEnabled = true;
+    uint8_t mShadowCascadeCount = 1;
+    CascadeSplitScheme mShadowCascadeSplitScheme = CascadeSplitScheme::PRACTICAL;
     bool mHasPostProcessPass = true;
     DepthPrepass mDepthPrepass = DepthPrepass::DEFAULT;
 
     using duration = std::chrono::duration<float, std::milli>;
     DynamicResolutionOptions mDynamicResolution;
+    FroxelOptions mFroxelOptions;
     std::deque<duration> mFrameTimeHistory;
 
     math::float2 mScale = 1.0f;
@@ -272,13 +372,30 @@ private:
     utils::CString mName;
     const bool mClipSpace01;
 
-    // the following values are set by prepare()
+    // the following values are set by prepareVisibility()
+    FScene::RenderableSoa mRenderableData;
+    FScene::LightSoa mLightData;
     Range mVisibleRenderables;
     Range mVisibleShadowCasters;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
     mutable bool mHasShadowing = false;
     mutable ShadowMap mDirectionalShadowMap;
+
+    // commands of the previous frame, valid as long as the scene's renderables don't change
+    mutable RenderPass::CommandCache mColorPassCommandCache;
+    mutable RenderPass::CommandCache mShadowPassCommandCaches[MAX_SHADOW_CASCADES];
+    FScene const* mCommandCacheScene = nullptr;
+    uint64_t mCommandCacheGeneration = 0;
+
+    RenderableUniformRing mRenderableUniformRing;
+    bool mRenderableUniformPacking = false;
+    bool mRenderableUniformRingUsed = false;    // whether the ring is used this frame
+
+    OcclusionCuller mOcclusionCuller;
+    std::vector<uint32_t> mOccluders;   // scratch space for prepareOccludedRenderables()
+    bool mOcclusionCulling = false;
+    float mContributionCullingThreshold = 0.0f;     // in pixels
 };
 
 FILAMENT_UPCAST(View)
@@ -24,6 +24,7 @@
 #    define HAS_MMAP 0
 #endif
 
+#include <assert.h>
 #include <stdio.h>
 
 #include <utils/ashmem.h>
@@ -46,6 +47,11 @@ CircularBuffer::CircularBuffer(size_t size) {
     mHead = mData;
 }
 
+CircularBuffer::CircularBuffer(void* data, size_t size) noexcept
+        : mSize(size), mTail(data), mHead(data) {
+    // mData stays null, we don't own the memory
+}
+
 CircularBuffer::~CircularBuffer() noexcept {
 #if HAS_MMAP
     if (mData) {
@@ -134,6 +140,7 @@ void* CircularBuffer::alloc(size_t size) noexcept {
 }
 
 void CircularBuffer::circularize() noexcept {
+    assert(mData);
     if (mUsesAshmem > 0) {
         intptr_t overflow = intptr_t(mHead) - (intptr_t(mData) + ssize_t(mSize));
         if (overflow >= 0) {
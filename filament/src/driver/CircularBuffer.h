@@ -37,6 +37,10 @@ public:
     //      to set it to 3*requiredSize to avoid blocking the render thread (usually the UI thread).
     explicit CircularBuffer(size_t bufferSize);
 
+    // A linear buffer over 'size' bytes of memory owned by someone else, e.g. the part of another
+    // CircularBuffer reserved by CommandStream::reserve(). It can't be circularized.
+    CircularBuffer(void* data, size_t size) noexcept;
+
     // can't be moved or copy-constructed
     CircularBuffer(CircularBuffer const& rhs) = delete;
     CircularBuffer(CircularBuffer&& rhs) noexcept = delete;
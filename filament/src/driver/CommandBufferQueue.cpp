@@ -64,6 +64,7 @@ void CommandBufferQueue::flush() noexcept {
 
     // size of this slice
     uint32_t used = uint32_t(intptr_t(head) - intptr_t(tail));
+    mFlushedBytes += used;
 
     circularBuffer.circularize();
 
@@ -47,6 +47,7 @@ class CommandBufferQueue {
     mutable std::vector<Slice> mCommandBuffersToExecute;
     size_t mFreeSpace = 0;
     size_t mHighWatermark = 0;
+    size_t mFlushedBytes = 0;
     bool mExitRequested = false;
 
 public:
@@ -58,6 +59,13 @@ public:
 
     size_t getHigWatermark() noexcept { return mHighWatermark; }
 
+    // returns the size of the commands flushed since the previous call
+    size_t takeFlushedBytes() noexcept {
+        size_t bytes = mFlushedBytes;
+        mFlushedBytes = 0;
+        return bytes;
+    }
+
     // wait for commands to be available and returns an array containing these commands
     std::vector<Slice> waitForCommands() const;
 
@@ -60,6 +60,16 @@ CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer) noexcept
 {
 }
 
+CommandStream::CommandStream(CommandStream const& stream, CircularBuffer& buffer) noexcept
+        : mDispatcher(stream.mDispatcher),
+          mDriver(stream.mDriver),
+          mCurrentBuffer(&buffer)
+#ifndef NDEBUG
+          , mThreadId(std::this_thread::get_id())
+#endif
+{
+}
+
 void CommandStream::execute(void* buffer) {
     SYSTRACE_CALL();
     Profiler::Counters c0;
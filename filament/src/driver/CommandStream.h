@@ -261,6 +261,10 @@ public:
     CommandStream() noexcept { }
     CommandStream(Driver& driver, CircularBuffer& buffer) noexcept;
 
+    // A stream executed by the same driver as 'stream', that records into 'buffer'. This is used
+    // to record commands into memory returned by stream.reserve(), on another thread.
+    CommandStream(CommandStream const& stream, CircularBuffer& buffer) noexcept;
+
     // This is for debugging only. Currently CircularBuffer can only be written from a
     // single thread. In debug builds we assert this condition.
     // Call this first in the render loop.
@@ -272,6 +276,24 @@ public:
 
     void execute(void* buffer);
 
+    /*
+     * Parallel recording:
+     * reserve() returns 'size' bytes of this stream, in which another CommandStream, created
+     * from a CircularBuffer over that memory, can record commands from any thread. That stream
+     * must then end with a jump() to the end of the reserved memory, even if nothing else was
+     * recorded. Memory reserved by consecutive calls is contiguous, so these commands are
+     * executed in order, and all of them must be recorded before this stream is flushed.
+     */
+    inline void* reserve(size_t size) noexcept {
+        assert(CommandBase::align(size) == size);
+        return allocateCommand(size);
+    }
+
+    // records a jump to the command at 'next'
+    inline void jump(void* next) noexcept {
+        new(allocateCommand(CommandBase::align(sizeof(NoopCommand)))) NoopCommand(next);
+    }
+
     /*
      * queueCommand() allows to queue a lambda function as a command.
      * This is much less efficient than using the Driver* API.
@@ -311,6 +333,10 @@ private:
     }
 };
 
+// size of the command recorded by the given DriverApi method, e.g. COMMAND_SIZE(draw)
+#define COMMAND_SIZE(methodName)                                                                \
+    CommandBase::align(sizeof(CommandType<decltype(&Driver::methodName)>::Command<&Driver::methodName>))
+
 void* CommandStream::allocate(size_t size, size_t alignment) noexcept {
     // make sure alignment is a power of two
     assert(alignment && !(alignment & alignment-1));
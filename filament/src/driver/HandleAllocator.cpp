@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/HandleAllocator.h"
+
+#include <utils/Mutex.h>
+#include <utils/ThreadLocal.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace filament {
+
+// The pools alive, so that a thread cache only returns its objects to a pool that still exists.
+// This is only needed when a cache entry is evicted, or when a thread exits.
+struct PoolRegistry {
+    utils::Mutex lock;
+    std::vector<HandlePool const*> pools;
+
+    static PoolRegistry& get() noexcept {
+        static PoolRegistry registry;
+        return registry;
+    }
+};
+
+static std::atomic<uint32_t> sSerial = { 0 };
+
+struct HandlePool::ThreadCache {
+    // the cache is direct-mapped by the serial of the pools, which are consecutive for the
+    // pools of a HandleAllocator
+    static constexpr size_t ENTRY_COUNT = 8;
+
+    // the number of objects freed by a thread before they're returned to the pool
+    static constexpr uint32_t BATCH_SIZE = 32;
+
+    struct Entry {
+        HandlePool* pool = nullptr;
+        uint32_t serial = 0;            // 0 if unused
+        Node* free = nullptr;           // allocations are made from this list...
+        Node* pending = nullptr;        // ...and the objects freed by this thread go here
+        Node* pendingTail = nullptr;
+        uint32_t pendingCount = 0;
+    };
+
+    Entry entries[ENTRY_COUNT];
+
+    ~ThreadCache() noexcept {
+        for (Entry& entry : entries) {
+            evict(entry);
+        }
+    }
+
+    static Entry& get(HandlePool* pool) noexcept {
+        // declaring this thread local, will ensure it's destroyed with the calling thread
+        static UTILS_DECLARE_TLS(ThreadCache) cache;
+        ThreadCache& threadCache = cache;
+        Entry& entry = threadCache.entries[pool->mSerial % ENTRY_COUNT];
+        if (UTILS_UNLIKELY(entry.serial != pool->mSerial)) {
+            evict(entry);
+            entry.pool = pool;
+            entry.serial = pool->mSerial;
+        }
+        return entry;
+    }
+
+    UTILS_NOINLINE
+    static void evict(Entry& entry) noexcept {
+        if (!entry.serial) {
+            return;
+        }
+        PoolRegistry& registry = PoolRegistry::get();
+        std::lock_guard<utils::Mutex> guard(registry.lock);
+        auto const& pools = registry.pools;
+        if (std::find(pools.begin(), pools.end(), entry.pool) != pools.end() &&
+                entry.pool->mSerial == entry.serial) {
+            if (entry.free) {
+                Node* tail = entry.free;
+                while (tail->next) {
+                    tail = tail->next;
+                }
+                entry.pool->push(entry.free, tail);
+            }
+            if (entry.pending) {
+                entry.pool->push(entry.pending, entry.pendingTail);
+            }
+        }
+        // otherwise the pool was destroyed, and its memory with it
+        entry = {};
+    }
+};
+
+HandlePool::HandlePool(void* begin, void* end, size_t elementSize) noexcept
+        : mBegin(static_cast<char*>(begin)),
+          mSize(size_t(static_cast<char*>(end) - static_cast<char*>(begin))),
+          mElementSize(elementSize),
+          mSerial(++sSerial) {
+    assert(elementSize >= sizeof(Node));
+    PoolRegistry& registry = PoolRegistry::get();
+    std::lock_guard<utils::Mutex> guard(registry.lock);
+    registry.pools.push_back(this);
+}
+
+HandlePool::~HandlePool() noexcept {
+    PoolRegistry& registry = PoolRegistry::get();
+    std::lock_guard<utils::Mutex> guard(registry.lock);
+    auto& pools = registry.pools;
+    pools.erase(std::remove(pools.begin(), pools.end(), this), pools.end());
+}
+
+void* HandlePool::alloc() noexcept {
+    ThreadCache::Entry& cache = ThreadCache::get(this);
+    Node* node = cache.free;
+    if (UTILS_UNLIKELY(!node)) {
+        // reuse the objects freed by this thread first, then the ones returned to the pool
+        if (cache.pending) {
+            node = cache.pending;
+            cache.pending = cache.pendingTail = nullptr;
+            cache.pendingCount = 0;
+        } else {
+            node = pop();
+        }
+        if (!node) {
+            // the pool is empty, use its unused part
+            size_t used = mUsed.load(std::memory_order_relaxed);
+            do {
+                if (UTILS_UNLIKELY(used + mElementSize > mSize)) {
+                    return nullptr;
+                }
+            } while (!mUsed.compare_exchange_weak(used, used + mElementSize,
+                    std::memory_order_relaxed, std::memory_order_relaxed));
+            return mBegin + used;
+        }
+    }
+    cache.free = node->next;
+    return node;
+}
+
+void HandlePool::free(void* p) noexcept {
+    assert(p >= mBegin && p < mBegin + mSize);
+    ThreadCache::Entry& cache = ThreadCache::get(this);
+    Node* const node = static_cast<Node*>(p);
+    node->next = cache.pending;
+    if (!cache.pending) {
+        cache.pendingTail = node;
+    }
+    cache.pending = node;
+    if (++cache.pendingCount == ThreadCache::BATCH_SIZE) {
+        push(cache.pending, cache.pendingTail);
+        cache.pending = cache.pendingTail = nullptr;
+        cache.pendingCount = 0;
+    }
+}
+
+void HandlePool::push(Node* head, Node* tail) noexcept {
+    Node* next = mHead.load(std::memory_order_relaxed);
+    do {
+        tail->next = next;
+    } while (!mHead.compare_exchange_weak(next, head,
+            std::memory_order_release, std::memory_order_relaxed));
+}
+
+HandlePool::Node* HandlePool::pop() noexcept {
+    // taking the whole list (as opposed to a single node) makes this immune to ABA
+    return mHead.exchange(nullptr, std::memory_order_acquire);
+}
+
+} // namespace filament
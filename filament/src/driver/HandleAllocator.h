@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
+#define TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
+
+#include "driver/Handle.h"
+
+#include <utils/Allocator.h>
+#include <utils/compiler.h>
+#include <utils/Panic.h>
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * A pool of fixed-size objects, carved out of [begin, end).
+ *
+ * Each thread keeps a cache of free objects per pool: objects freed by a thread go to its cache
+ * and are returned to the pool in batches, and a thread whose cache is empty takes all the
+ * objects returned to the pool at once. Neither operation can suffer from the ABA problem, so
+ * allocating and freeing only use a single atomic pointer. Objects are first taken from the
+ * unused part of the pool.
+ *
+ * A global mutex is taken when a pool is created or destroyed, and when a thread's cache entry
+ * is evicted, i.e. when the thread exits or uses another pool that maps to the same entry.
+ */
+class HandlePool {
+public:
+    HandlePool(void* begin, void* end, size_t elementSize) noexcept;
+    ~HandlePool() noexcept;
+
+    HandlePool(HandlePool const& rhs) = delete;
+    HandlePool& operator=(HandlePool const& rhs) = delete;
+
+    // returns nullptr when the pool is exhausted
+    void* alloc() noexcept;
+    void free(void* p) noexcept;
+
+    size_t getSize() const noexcept { return mElementSize; }
+
+private:
+    struct Node {
+        Node* next;
+    };
+
+    struct ThreadCache;
+
+    // returns the list [head, tail] to the pool
+    void push(Node* head, Node* tail) noexcept;
+
+    // takes all the objects returned to the pool
+    Node* pop() noexcept;
+
+    std::atomic<Node*> mHead = { nullptr };
+    std::atomic<size_t> mUsed = { 0 };  // in bytes, from mBegin
+    char* const mBegin;
+    const size_t mSize;
+    const size_t mElementSize;
+    const uint32_t mSerial;             // identifies this pool in the thread caches
+};
+
+/*
+ * HandleAllocator allocates the objects the driver handles refer to, from a single dense area:
+ * a handle's id is the offset of its object in that area, so that finding an object is a simple
+ * addition.
+ *
+ * Objects are segregated in three size classes, each a HandlePool. Handles are allocated by
+ * the *Synchronous() methods on the engine's thread, and freed on the driver thread, without
+ * contention.
+ *
+ * The objects of a size class are aligned to the largest power of two dividing its size, up to
+ * MAX_ALIGNMENT, see getAlignment().
+ */
+template<size_t P0, size_t P1, size_t P2>
+class HandleAllocator {
+public:
+    static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
+    static constexpr size_t MIN_ALIGNMENT = 1u << MIN_ALIGNMENT_SHIFT;
+    static constexpr size_t MAX_ALIGNMENT = 32;
+
+    static_assert(P0 < P1 && P1 < P2, "size classes must be in increasing order");
+    static_assert(P0 % MIN_ALIGNMENT == 0 && P1 % MIN_ALIGNMENT == 0 && P2 % MIN_ALIGNMENT == 0,
+            "size classes must be multiples of MIN_ALIGNMENT");
+
+    // alignment of the objects of 'size' bytes
+    static constexpr size_t getAlignment(size_t size) noexcept {
+        return size <= P0 ? getPoolAlignment(P0) :
+               size <= P1 ? getPoolAlignment(P1) : getPoolAlignment(P2);
+    }
+
+    explicit HandleAllocator(size_t size) noexcept
+            : mArea(size + MAX_ALIGNMENT),
+              mBegin(align(mArea.begin())),
+              mPool0(split(0), split(1), P0),
+              mPool1(split(1), split(6), P1),
+              mPool2(split(6), split(16), P2) {
+    }
+
+    HandleBase::HandleId allocate(size_t size) noexcept {
+        void* p = nullptr;
+        if (size <= P0) p = mPool0.alloc();
+        else if (size <= P1) p = mPool1.alloc();
+        else if (size <= P2) p = mPool2.alloc();
+        ASSERT_POSTCONDITION(p, "out of handles for objects of %u bytes", unsigned(size));
+        return HandleBase::HandleId(
+                (static_cast<char*>(p) - mBegin) >> MIN_ALIGNMENT_SHIFT);
+    }
+
+    void free(void* p, size_t size) noexcept {
+        if (size <= P0) { mPool0.free(p); return; }
+        if (size <= P1) { mPool1.free(p); return; }
+        if (size <= P2) { mPool2.free(p); return; }
+    }
+
+    void* getPointer(HandleBase::HandleId id) const noexcept {
+        return mBegin + (size_t(id) << MIN_ALIGNMENT_SHIFT);
+    }
+
+private:
+    static constexpr size_t getPoolAlignment(size_t size) noexcept {
+        return (size & -size) < MAX_ALIGNMENT ? (size & -size) : MAX_ALIGNMENT;
+    }
+
+    static char* align(void* p) noexcept {
+        return static_cast<char*>(p) + (-uintptr_t(p) & (MAX_ALIGNMENT - 1));
+    }
+
+    // The area is split in 16th: 1 for P0, 5 for P1 and 10 for P2. Each pool starts at
+    // MAX_ALIGNMENT and its size class is a multiple of its alignment, so all its objects are
+    // aligned.
+    void* split(size_t sixteenths) const noexcept {
+        const size_t size = mArea.getSize() - MAX_ALIGNMENT;
+        return mBegin + ((sixteenths * size / 16) & ~(MAX_ALIGNMENT - 1));
+    }
+
+    utils::HeapArea mArea;
+    char* const mBegin;
+    HandlePool mPool0;
+    HandlePool mPool1;
+    HandlePool mPool2;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
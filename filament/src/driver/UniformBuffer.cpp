@@ -97,12 +97,12 @@ static Pool sMemoryPool;
 
 UniformBuffer::UniformBuffer(size_t size) noexcept
     : mBuffer(mStorage),
-      mSize(uint32_t(size)),
-      mSomethingDirty(true) {
+      mSize(uint32_t(size)) {
     if (UTILS_LIKELY(size > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(size);
     }
     memset(mBuffer, 0, size);
+    mDirtyRanges.set(0, mSize);
 }
 
 UniformBuffer::UniformBuffer(UniformInterfaceBlock const& uib) noexcept
@@ -112,7 +112,7 @@ UniformBuffer::UniformBuffer(UniformInterfaceBlock const& uib) noexcept
 UniformBuffer::UniformBuffer(const UniformBuffer& rhs)
         : mBuffer(mStorage),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mDirtyRanges(rhs.mDirtyRanges) {
     if (UTILS_LIKELY(mSize > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(rhs.mSize);
     }
@@ -122,7 +122,7 @@ UniformBuffer::UniformBuffer(const UniformBuffer& rhs)
 UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
         : mBuffer(rhs.mBuffer),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mDirtyRanges(rhs.mDirtyRanges) {
     if (UTILS_LIKELY(rhs.isLocalStorage())) {
         mBuffer = mStorage;
         memcpy(mBuffer, rhs.mBuffer, mSize);
@@ -133,7 +133,7 @@ UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
 
 UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept {
     if (this != &rhs) {
-        mSomethingDirty = rhs.mSomethingDirty;
+        mDirtyRanges = rhs.mDirtyRanges;
         if (UTILS_LIKELY(rhs.isLocalStorage())) {
             mBuffer = mStorage;
             mSize = rhs.mSize;
@@ -146,6 +146,17 @@ UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept {
     return *this;
 }
 
+UTILS_NOINLINE
+void UniformBuffer::invalidate(size_t offset, size_t size) noexcept {
+    // round the range to DIRTY_RANGE_GRANULARITY, so that nearby ranges touch and are merged
+    constexpr size_t mask = DIRTY_RANGE_GRANULARITY - 1;
+    const size_t start = offset & ~mask;
+    const size_t end = std::min(size_t(mSize), (offset + size + mask) & ~mask);
+    if (UTILS_LIKELY(end > start)) {
+        mDirtyRanges.set(uint32_t(start), uint32_t(end - start));
+    }
+}
+
 void* UniformBuffer::alloc(size_t size) noexcept {
     return sMemoryPool.get(size);
 }
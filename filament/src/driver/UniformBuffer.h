@@ -27,6 +27,7 @@
 
 #include <utils/compiler.h>
 #include <utils/Log.h>
+#include <utils/RangeSet.h>
 
 #include <filament/UniformInterfaceBlock.h>
 
@@ -34,6 +35,13 @@ namespace filament {
 
 class UniformBuffer {
 public:
+    // ranges closer than this are merged, so that small changes scattered in a buffer
+    // don't translate into many tiny uploads
+    static constexpr size_t DIRTY_RANGE_GRANULARITY = 64;
+
+    static constexpr size_t MAX_DIRTY_RANGES = 4;
+    using DirtyRanges = utils::RangeSet<MAX_DIRTY_RANGES>;
+
     UniformBuffer() noexcept = default;
 
     // create a uniform buffer of a given size in bytes
@@ -64,7 +72,7 @@ public:
     // invalidate a range of uniforms and return a pointer to it. offset and size given in bytes
     void* invalidateUniforms(size_t offset, size_t size) {
         assert(offset + size <= mSize);
-        mSomethingDirty = true;
+        invalidate(offset, size);
         return static_cast<char*>(mBuffer) + offset;
     }
 
@@ -75,10 +83,13 @@ public:
     size_t getSize() const noexcept { return mSize; }
 
     // return if any uniform has been changed
-    bool isDirty() const noexcept { return mSomethingDirty; }
+    bool isDirty() const noexcept { return !mDirtyRanges.isEmpty(); }
+
+    // the ranges of bytes changed since the last clean(), in increasing order
+    DirtyRanges const& getDirtyRanges() const noexcept { return mDirtyRanges; }
 
     // mark the whole buffer as clean (no modified uniforms)
-    void clean() const noexcept { mSomethingDirty = false; }
+    void clean() const noexcept { mDirtyRanges.clear(); }
 
     /*
      * -----------------------------------------------
@@ -153,15 +164,17 @@ private:
     static void* alloc(size_t size) noexcept;
     static void free(void* addr, size_t size) noexcept;
 
+    void invalidate(size_t offset, size_t size) noexcept;
+
     inline bool isLocalStorage() const noexcept { return mBuffer == mStorage; }
 
     // TODO: we need a better to calculate this local storage.
     // Probably the better thing to do would be to use a special allocator.
     // Local storage is limited by the total size of a handle (128 byte for GL)
-    char mStorage[96];
+    char mStorage[64];
     void *mBuffer = nullptr;
     uint32_t mSize = 0;
-    mutable bool mSomethingDirty = false;
+    mutable DirtyRanges mDirtyRanges;
 };
 
 // specialization for float3 (which has a different alignment)
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/capture/CaptureDriver.h"
+
+#include <utils/Log.h>
+
+#include <stdlib.h>
+
+using namespace utils;
+
+namespace filament {
+
+std::unique_ptr<Driver> CaptureDriver::create(std::unique_ptr<Driver> driver) noexcept {
+    const char* path = getenv("FILAMENT_CAPTURE_FILE");
+    if (!driver || !path || !*path) {
+        return driver;
+    }
+    const char* frames = getenv("FILAMENT_CAPTURE_FRAMES");
+    const uint32_t frameCount = frames ? uint32_t(strtoul(frames, nullptr, 10)) : 0;
+    return create(std::move(driver), path, frameCount ? frameCount : DEFAULT_FRAME_COUNT);
+}
+
+std::unique_ptr<Driver> CaptureDriver::create(std::unique_ptr<Driver> driver,
+        const char* path, uint32_t frameCount) noexcept {
+    std::unique_ptr<CaptureWriter> writer(new CaptureWriter(path));
+    if (!writer->isOpen()) {
+        slog.e << "Capture: couldn't create " << path << io::endl;
+        return driver;
+    }
+    slog.i << "Capture: recording " << frameCount << " frames to " << path << io::endl;
+    return std::unique_ptr<Driver>(
+            new CaptureDriver(std::move(driver), path, std::move(writer), frameCount));
+}
+
+CaptureDriver::CaptureDriver(std::unique_ptr<Driver> driver, const char* path,
+        std::unique_ptr<CaptureWriter> writer, uint32_t frameCount) noexcept
+        : mDriver(std::move(driver)),
+          mDispatcher(this),
+          mWriter(std::move(writer)),
+          mPath(path),
+          mFrameCount(frameCount) {
+}
+
+CaptureDriver::~CaptureDriver() noexcept {
+    finish();
+}
+
+bool CaptureDriver::startFrame() noexcept {
+    if (mCapturedFrames == mFrameCount) {
+        // the previous frame was the last one, it ended with this command
+        finish();
+        return false;
+    }
+    mCapturedFrames++;
+    return true;
+}
+
+void CaptureDriver::finish() noexcept {
+    if (mWriter) {
+        slog.i << "Capture: " << mCapturedFrames << " frames (" << mWriter->getSize()
+               << " bytes) written to " << mPath.c_str() << io::endl;
+        mWriter.reset();
+    }
+}
+
+// explicit instantiation of the Dispatcher
+template class ConcreteDispatcher<CaptureDriver>;
+
+} // namespace filament
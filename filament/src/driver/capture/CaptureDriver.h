@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_CAPTUREDRIVER_H
+#define TNT_FILAMENT_DRIVER_CAPTUREDRIVER_H
+
+#include "driver/Driver.h"
+#include "driver/CommandStream.h"
+#include "driver/capture/CaptureStream.h"
+
+#include <utils/compiler.h>
+#include <utils/CString.h>
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace filament {
+
+/*
+ * A Driver that records the commands executed by another Driver to a capture (see
+ * CaptureStream.h), from its creation until the given number of frames are executed, so that all
+ * the objects used by these frames are in the capture.
+ *
+ * The commands are then executed by the other driver as usual.
+ */
+class CaptureDriver final : public Driver {
+public:
+    static constexpr uint32_t DEFAULT_FRAME_COUNT = 10;
+
+    // Returns a CaptureDriver over 'driver', if the FILAMENT_CAPTURE_FILE environment variable is
+    // set, which captures FILAMENT_CAPTURE_FRAMES frames (or DEFAULT_FRAME_COUNT) to that file.
+    // Otherwise returns 'driver'.
+    static std::unique_ptr<Driver> create(std::unique_ptr<Driver> driver) noexcept;
+
+    // Returns a CaptureDriver over 'driver' which captures 'frameCount' frames to 'path', or
+    // 'driver' if the file can't be created.
+    static std::unique_ptr<Driver> create(std::unique_ptr<Driver> driver,
+            const char* path, uint32_t frameCount) noexcept;
+
+    ~CaptureDriver() noexcept override;
+
+private:
+    CaptureDriver(std::unique_ptr<Driver> driver, const char* path,
+            std::unique_ptr<CaptureWriter> writer, uint32_t frameCount) noexcept;
+
+    void purge() noexcept override { mDriver->purge(); }
+
+    ShaderModel getShaderModel() const noexcept override { return mDriver->getShaderModel(); }
+
+    Dispatcher& getDispatcher() noexcept override { return mDispatcher; }
+
+#ifndef NDEBUG
+    void debugCommand(const char* methodName) override { mDriver->debugCommand(methodName); }
+#endif
+
+    template<typename... ARGS>
+    inline void capture(CaptureCommand command, ARGS const& ... args) {
+        if (UTILS_UNLIKELY(mWriter)) {
+            if (command == CaptureCommand::beginFrame && !startFrame()) {
+                return;
+            }
+            mWriter->record(command, args...);
+        }
+    }
+
+    // executes the command Cmd with the given arguments on the captured driver
+    template<typename Cmd, typename... ARGS>
+    inline void forward(Dispatcher::Execute execute, ARGS&& ... args) {
+        typename std::aligned_storage<sizeof(Cmd), alignof(Cmd)>::type storage;
+        CommandBase* command = new(&storage) Cmd(execute, std::forward<ARGS>(args)...);
+        command->execute(*mDriver);
+    }
+
+    // returns false when the capture is complete
+    bool startFrame() noexcept;
+    void finish() noexcept;
+
+    /*
+     * Driver interface
+     */
+
+    template<typename T>
+    friend class ConcreteDispatcher;
+
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+    UTILS_ALWAYS_INLINE void methodName(paramsDecl) {                                           \
+        using Cmd = CommandType<decltype(&Driver::methodName)>::Command<&Driver::methodName>;   \
+        capture(CaptureCommand::methodName, params);                                            \
+        forward<Cmd>(mDriver->getDispatcher().methodName##_, params);                           \
+    }
+
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)                    \
+    RetType methodName(paramsDecl) override {                                                   \
+        return mDriver->methodName(params);                                                     \
+    }
+
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+    RetType methodName##Synchronous() noexcept override {                                       \
+        return mDriver->methodName##Synchronous();                                              \
+    }                                                                                           \
+    UTILS_ALWAYS_INLINE void methodName(RetType handle, paramsDecl) {                           \
+        using Cmd = CommandType<decltype(&Driver::methodName)>::Command<&Driver::methodName>;   \
+        capture(CaptureCommand::methodName, handle, params);                                    \
+        forward<Cmd>(mDriver->getDispatcher().methodName##_, handle, params);                   \
+    }
+
+#include "driver/DriverAPI.inc"
+
+    std::unique_ptr<Driver> mDriver;
+    ConcreteDispatcher<CaptureDriver> mDispatcher;
+    std::unique_ptr<CaptureWriter> mWriter;
+    utils::CString mPath;
+    uint32_t mFrameCount;
+    uint32_t mCapturedFrames = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_CAPTUREDRIVER_H
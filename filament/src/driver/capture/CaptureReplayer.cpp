@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/capture/CaptureReplayer.h"
+
+#include "driver/capture/CaptureStream.h"
+#include "driver/CommandBufferQueue.h"
+#include "driver/CommandStream.h"
+#include "driver/Driver.h"
+
+#include <utils/compiler.h>
+#include <utils/Panic.h>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace filament {
+
+using clock = std::chrono::steady_clock;
+
+// same sizes as the engine's command buffers
+static constexpr size_t MIN_COMMAND_BUFFERS_SIZE = 1 * 1024 * 1024;
+static constexpr size_t COMMAND_BUFFERS_SIZE     = 3 * MIN_COMMAND_BUFFERS_SIZE;
+
+// the command stream is executed when it grows past this size, commands are much smaller than
+// MIN_COMMAND_BUFFERS_SIZE - FLUSH_SIZE
+static constexpr size_t FLUSH_SIZE = MIN_COMMAND_BUFFERS_SIZE / 2;
+
+template<typename F, typename T, size_t... I>
+static auto call(F&& f, T& args, std::index_sequence<I...>) {
+    return f(std::move(std::get<I>(args))...);
+}
+
+// decodes the arguments of 'method' (in order, which is guaranteed in a braced-init-list) and
+// calls 'f' with them
+template<typename... ARGS, typename F>
+static auto replayCommand(CaptureReader& reader, void (Driver::*)(ARGS...), F&& f) {
+    std::tuple<typename std::decay<ARGS>::type...> args{
+            reader.read(CaptureReader::Type<typename std::decay<ARGS>::type>{})... };
+    return call(std::forward<F>(f), args, std::index_sequence_for<ARGS...>{});
+}
+
+// same as replayCommand() for the commands that create an object, 'f' returns its new handle
+template<typename R, typename... ARGS, typename F>
+static void replayCreateCommand(CaptureReader& reader, void (Driver::*)(R, ARGS...), F&& f) {
+    const HandleBase::HandleId captured = reader.readHandleId();
+    std::tuple<typename std::decay<ARGS>::type...> args{
+            reader.read(CaptureReader::Type<typename std::decay<ARGS>::type>{})... };
+    R const handle = call(std::forward<F>(f), args, std::index_sequence_for<ARGS...>{});
+    reader.setHandle(captured, handle.getId());
+}
+
+CaptureReplayer::Result CaptureReplayer::replay(Driver& driver, void const* data, size_t size) {
+    Result result;
+    CaptureReader reader(data, size);
+    if (!reader.isCompatible()) {
+        return result;
+    }
+    result.valid = true;
+
+    CommandBufferQueue queue(MIN_COMMAND_BUFFERS_SIZE, COMMAND_BUFFERS_SIZE);
+    CircularBuffer const& buffer = queue.getCircularBuffer();
+    CommandStream stream(driver, queue.getCircularBuffer());
+    stream.debugThreading();
+
+    Timing* timing = &result.setup;
+    clock::time_point start = clock::now();
+
+    auto execute = [&]() {
+        if (buffer.empty()) {
+            return;
+        }
+        driver.purge();
+        queue.flush();
+        clock::time_point executeStart = clock::now();
+        for (auto& item : queue.waitForCommands()) {
+            if (UTILS_LIKELY(item.begin)) {
+                stream.execute(item.begin);
+                queue.releaseBuffer(item);
+            }
+        }
+        timing->execute += clock::now() - executeStart;
+    };
+
+    auto endTiming = [&]() {
+        execute();
+        timing->decode = duration(clock::now() - start) - timing->execute;
+    };
+
+    while (reader.hasCommands()) {
+        const CaptureCommand command = reader.readCommand();
+        ASSERT_POSTCONDITION(command < CaptureCommand::COUNT, "capture is corrupted");
+
+        if (command == CaptureCommand::beginFrame) {
+            // the previous frame, or the setup, ends here
+            endTiming();
+            result.frames.emplace_back();
+            timing = &result.frames.back();
+            start = clock::now();
+        } else if (uintptr_t(buffer.getHead()) - uintptr_t(buffer.getTail()) >= FLUSH_SIZE) {
+            execute();
+        }
+
+        switch (command) {
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+            case CaptureCommand::methodName:                                                    \
+                replayCommand(reader, &Driver::methodName, [&stream](auto&& ... args) {         \
+                    stream.methodName(std::forward<decltype(args)>(args)...);                   \
+                });                                                                             \
+                break;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+            case CaptureCommand::methodName:                                                    \
+                replayCreateCommand(reader, &Driver::methodName, [&stream](auto&& ... args) {   \
+                    return stream.methodName(std::forward<decltype(args)>(args)...);            \
+                });                                                                             \
+                break;
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#include "driver/DriverAPI.inc"
+            case CaptureCommand::COUNT:
+                break;
+        }
+        timing->commandCount++;
+    }
+    endTiming();
+
+    return result;
+}
+
+} // namespace filament
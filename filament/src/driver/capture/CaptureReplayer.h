@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_CAPTUREREPLAYER_H
+#define TNT_FILAMENT_DRIVER_CAPTUREREPLAYER_H
+
+#include <chrono>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+class Driver;
+
+/*
+ * Replays a capture (see CaptureDriver) through any Driver.
+ *
+ * The commands are decoded into a CommandStream, which is executed by the driver at the end of
+ * each frame (and whenever its buffer fills up), the same way the engine's driver thread does.
+ * Everything recorded before the first frame (i.e. the creation of the objects) is replayed first
+ * and timed separately.
+ */
+class CaptureReplayer {
+public:
+    using duration = std::chrono::duration<double, std::milli>;
+
+    struct Timing {
+        duration decode{};      // decoding the capture into the CommandStream
+        duration execute{};     // executing the CommandStream, i.e. the driver's CPU cost
+        size_t commandCount = 0;
+    };
+
+    struct Result {
+        bool valid = false;         // false if the data isn't a compatible capture
+        Timing setup;               // commands recorded before the first frame
+        std::vector<Timing> frames;
+    };
+
+    // 'data' must stay valid until replay() returns, its buffers are used in place
+    static Result replay(Driver& driver, void const* data, size_t size);
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_CAPTUREREPLAYER_H
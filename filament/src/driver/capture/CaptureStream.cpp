@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/capture/CaptureStream.h"
+
+#include <utils/Panic.h>
+
+using namespace utils;
+
+namespace filament {
+
+using namespace driver;
+
+CaptureWriter::CaptureWriter(const char* path)
+        : mStream(path, std::ios::binary | std::ios::trunc) {
+    CaptureHeader header;
+    write(header);
+}
+
+CaptureWriter::~CaptureWriter() noexcept = default;
+
+void CaptureWriter::write(const char* string) {
+    // the terminating null is recorded too, so the string can be used in place when replayed
+    const uint32_t size = string ? uint32_t(strlen(string) + 1) : 0;
+    write(size);
+    writeBytes(string, size);
+}
+
+void CaptureWriter::write(CString const& string) {
+    // CString always copies the terminating null, so it's recorded too
+    const uint32_t size = uint32_t(string.size());
+    write(size);
+    writeBytes(string.c_str() ? string.c_str() : "", size + 1);
+}
+
+void CaptureWriter::write(Driver::TargetBufferInfo const& info) {
+    write(info.handle);
+    write(info.level);
+    write(info.layer);  // also the face
+}
+
+void CaptureWriter::write(Driver::FaceOffsets const& offsets) {
+    writeBytes(offsets.offsets, sizeof(offsets.offsets));
+}
+
+void CaptureWriter::write(Driver::BufferDescriptor const& buffer) {
+    const size_t size = buffer.buffer ? buffer.size : 0;
+    write(uint64_t(size));
+    writeBytes(buffer.buffer, size);
+}
+
+void CaptureWriter::write(Driver::PixelBufferDescriptor const& buffer) {
+    // for read-backs the content is meaningless, but it is a rare case
+    write(static_cast<Driver::BufferDescriptor const&>(buffer));
+    write(buffer.left);
+    write(buffer.top);
+    write(uint8_t(buffer.type));
+    write(uint8_t(buffer.alignment));
+    if (buffer.type == PixelDataType::COMPRESSED) {
+        write(buffer.imageSize);
+        write(buffer.compressedFormat);
+    } else {
+        write(buffer.stride);
+        write(buffer.format);
+    }
+}
+
+void CaptureWriter::write(UniformBuffer const& buffer) {
+    write(uint64_t(buffer.getSize()));
+    writeBytes(buffer.getBuffer(), buffer.getSize());
+    // the dirty ranges are kept, so that the uploads are replayed as they happened
+    UniformBuffer::DirtyRanges const& ranges = buffer.getDirtyRanges();
+    write(uint8_t(ranges.end() - ranges.begin()));
+    for (utils::BufferRange const& range : ranges) {
+        write(range);
+    }
+}
+
+void CaptureWriter::write(SamplerBuffer const& buffer) {
+    const size_t size = buffer.getSize();
+    write(uint8_t(size));
+    SamplerBuffer::Sampler const* samplers = buffer.getBuffer();
+    for (size_t i = 0; i < size; i++) {
+        write(samplers[i].t);
+        write(samplers[i].s);
+    }
+}
+
+void CaptureWriter::write(Program const& program) {
+    write(program.getName());
+    write(program.getVariant());
+    for (CString const& source : program.getShadersSource()) {
+        write(source);
+    }
+    for (UniformInterfaceBlock const* block : program.getUniformInterfaceBlocks()) {
+        write(block);
+    }
+    for (SamplerInterfaceBlock const* block : program.getSamplerInterfaceBlocks()) {
+        write(block);
+    }
+    write(program.getSamplerBindings());
+}
+
+void CaptureWriter::write(UniformInterfaceBlock const* block) {
+    write(bool(block));
+    if (block) {
+        write(block->getName());
+        auto const& list = block->getUniformInfoList();
+        write(uint32_t(list.size()));
+        for (auto const& info : list) {
+            write(info.name);
+            write(info.size);
+            write(info.type);
+            write(info.precision);
+        }
+    }
+}
+
+void CaptureWriter::write(SamplerInterfaceBlock const* block) {
+    write(bool(block));
+    if (block) {
+        write(block->getName());
+        auto const& list = block->getSamplerInfoList();
+        write(uint32_t(list.size()));
+        for (auto const& info : list) {
+            write(info.name);
+            write(info.type);
+            write(info.format);
+            write(info.precision);
+            write(info.multisample);
+        }
+    }
+}
+
+void CaptureWriter::write(SamplerBindingMap const* map) {
+    write(bool(map));
+    if (map) {
+        auto const& list = map->getBindingList();
+        write(uint32_t(list.size()));
+        for (SamplerBindingInfo const& info : list) {
+            write(info);
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+
+CaptureReader::CaptureReader(void const* data, size_t size) noexcept
+        : mCurrent(static_cast<uint8_t const*>(data)),
+          mEnd(static_cast<uint8_t const*>(data) + size) {
+    if (size >= sizeof(CaptureHeader)) {
+        mCompatible = read(Type<CaptureHeader>{}).isCompatible();
+    }
+}
+
+CaptureReader::~CaptureReader() noexcept = default;
+
+void const* CaptureReader::readBytes(size_t size) {
+    ASSERT_POSTCONDITION(size <= size_t(mEnd - mCurrent), "capture is truncated");
+    void const* data = mCurrent;
+    mCurrent += size;
+    return data;
+}
+
+const char* CaptureReader::read(Type<const char*>) {
+    const uint32_t size = read(Type<uint32_t>{});
+    return size ? static_cast<const char*>(readBytes(size)) : nullptr;
+}
+
+CString CaptureReader::read(Type<CString>) {
+    const uint32_t size = read(Type<uint32_t>{});
+    return CString(static_cast<const char*>(readBytes(size + 1)), size);
+}
+
+Driver::TargetBufferInfo CaptureReader::read(Type<Driver::TargetBufferInfo>) {
+    Driver::TargetBufferInfo info;
+    info.handle = read(Type<Driver::TextureHandle>{});
+    info.level = read(Type<uint8_t>{});
+    info.layer = read(Type<uint16_t>{});
+    return info;
+}
+
+Driver::FaceOffsets CaptureReader::read(Type<Driver::FaceOffsets>) {
+    Driver::FaceOffsets offsets;
+    memcpy(offsets.offsets, readBytes(sizeof(offsets.offsets)), sizeof(offsets.offsets));
+    return offsets;
+}
+
+Driver::BufferDescriptor CaptureReader::read(Type<Driver::BufferDescriptor>) {
+    // the buffer points into the capture, so there is no callback
+    const size_t size = size_t(read(Type<uint64_t>{}));
+    return Driver::BufferDescriptor(readBytes(size), size);
+}
+
+Driver::PixelBufferDescriptor CaptureReader::read(Type<Driver::PixelBufferDescriptor>) {
+    const size_t size = size_t(read(Type<uint64_t>{}));
+    void const* data = readBytes(size);
+    const uint32_t left = read(Type<uint32_t>{});
+    const uint32_t top = read(Type<uint32_t>{});
+    const auto type = PixelDataType(read(Type<uint8_t>{}));
+    const uint8_t alignment = read(Type<uint8_t>{});
+    if (type == PixelDataType::COMPRESSED) {
+        const uint32_t imageSize = read(Type<uint32_t>{});
+        const auto format = read(Type<CompressedPixelDataType>{});
+        return Driver::PixelBufferDescriptor(data, size, format, imageSize, nullptr);
+    }
+    const uint32_t stride = read(Type<uint32_t>{});
+    const auto format = read(Type<PixelDataFormat>{});
+    return Driver::PixelBufferDescriptor(data, size, format, type, alignment, left, top, stride);
+}
+
+UniformBuffer CaptureReader::read(Type<UniformBuffer>) {
+    const size_t size = size_t(read(Type<uint64_t>{}));
+    UniformBuffer buffer(size);
+    memcpy(buffer.invalidateUniforms(0, size), readBytes(size), size);
+    buffer.clean();
+    const size_t count = read(Type<uint8_t>{});
+    for (size_t i = 0; i < count; i++) {
+        const utils::BufferRange range = read(Type<utils::BufferRange>{});
+        buffer.invalidateUniforms(range.start, range.getCount());
+    }
+    return buffer;
+}
+
+SamplerBuffer CaptureReader::read(Type<SamplerBuffer>) {
+    const size_t size = read(Type<uint8_t>{});
+    SamplerBuffer buffer(size);
+    for (size_t i = 0; i < size; i++) {
+        Driver::TextureHandle t = read(Type<Driver::TextureHandle>{});
+        SamplerBuffer::SamplerParams s = read(Type<SamplerBuffer::SamplerParams>{});
+        buffer.setSampler(i, t, s);
+    }
+    return buffer;
+}
+
+Program CaptureReader::read(Type<Program>) {
+    Program program;
+    CString name = read(Type<CString>{});
+    const uint8_t variant = read(Type<uint8_t>{});
+    program.diagnostics(name, variant);
+    program.shader(Program::Shader::VERTEX, read(Type<CString>{}));
+    program.shader(Program::Shader::FRAGMENT, read(Type<CString>{}));
+    for (size_t i = 0; i < Program::NUM_UNIFORM_BINDINGS; i++) {
+        UniformInterfaceBlock const* block = readUniformBlock();
+        if (block) {
+            program.addUniformBlock(i, block);
+        }
+    }
+    for (size_t i = 0; i < Program::NUM_SAMPLER_BINDINGS; i++) {
+        SamplerInterfaceBlock const* block = readSamplerBlock();
+        if (block) {
+            program.addSamplerBlock(i, block);
+        }
+    }
+    program.withSamplerBindings(readSamplerBindings());
+    return program;
+}
+
+UniformInterfaceBlock const* CaptureReader::readUniformBlock() {
+    if (!read(Type<bool>{})) {
+        return nullptr;
+    }
+    UniformInterfaceBlock::Builder builder;
+    builder.name(read(Type<CString>{}).c_str());
+    const uint32_t count = read(Type<uint32_t>{});
+    for (uint32_t i = 0; i < count; i++) {
+        CString name = read(Type<CString>{});
+        const uint32_t size = read(Type<uint32_t>{});
+        const auto type = read(Type<UniformInterfaceBlock::Type>{});
+        const auto precision = read(Type<UniformInterfaceBlock::Precision>{});
+        builder.add(name.c_str(), size, type, precision);
+    }
+    mUniformBlocks.emplace_back(new UniformInterfaceBlock(builder.build()));
+    return mUniformBlocks.back().get();
+}
+
+SamplerInterfaceBlock const* CaptureReader::readSamplerBlock() {
+    if (!read(Type<bool>{})) {
+        return nullptr;
+    }
+    SamplerInterfaceBlock::Builder builder;
+    builder.name(read(Type<CString>{}).c_str());
+    const uint32_t count = read(Type<uint32_t>{});
+    for (uint32_t i = 0; i < count; i++) {
+        CString name = read(Type<CString>{});
+        const auto type = read(Type<SamplerInterfaceBlock::Type>{});
+        const auto format = read(Type<SamplerInterfaceBlock::Format>{});
+        const auto precision = read(Type<SamplerInterfaceBlock::Precision>{});
+        const bool multisample = read(Type<bool>{});
+        builder.add(name.c_str(), type, format, precision, multisample);
+    }
+    mSamplerBlocks.emplace_back(new SamplerInterfaceBlock(builder.build()));
+    return mSamplerBlocks.back().get();
+}
+
+SamplerBindingMap const* CaptureReader::readSamplerBindings() {
+    if (!read(Type<bool>{})) {
+        return nullptr;
+    }
+    std::unique_ptr<SamplerBindingMap> map(new SamplerBindingMap());
+    const uint32_t count = read(Type<uint32_t>{});
+    for (uint32_t i = 0; i < count; i++) {
+        map->addSampler(read(Type<SamplerBindingInfo>{}));
+    }
+    mSamplerBindings.push_back(std::move(map));
+    return mSamplerBindings.back().get();
+}
+
+} // namespace filament
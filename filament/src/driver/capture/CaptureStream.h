@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_CAPTURESTREAM_H
+#define TNT_FILAMENT_DRIVER_CAPTURESTREAM_H
+
+#include "driver/Driver.h"
+#include "driver/Handle.h"
+#include "driver/Program.h"
+#include "driver/SamplerBuffer.h"
+#include "driver/UniformBuffer.h"
+
+#include <filament/SamplerBindingMap.h>
+#include <filament/SamplerInterfaceBlock.h>
+#include <filament/UniformInterfaceBlock.h>
+
+#include <utils/compiler.h>
+
+#include <tsl/robin_map.h>
+
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace filament {
+
+/*
+ * A capture is a file containing the DriverAPI commands executed by a Driver, with the data they
+ * reference (buffers, images, uniforms, programs...), so it can be replayed without the
+ * application that recorded it.
+ *
+ * It starts with a CaptureHeader, followed by the commands. Each command is its CaptureCommand
+ * followed by its arguments, in order. Handles are recorded as their id in the capturing driver
+ * and are remapped to the handles of the replaying driver. Native objects (windows, external
+ * images) can't be captured and are replayed as null.
+ *
+ * Values are recorded as they are in memory, so a capture can only be replayed on a platform
+ * with the same endianness and the same size_t (this is checked by the header).
+ */
+
+// one value per asynchronous command of DriverAPI.inc, in the same order
+enum class CaptureCommand : uint16_t {
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     methodName,
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#include "driver/DriverAPI.inc"
+    COUNT
+};
+
+struct CaptureHeader {
+    static constexpr uint32_t MAGIC = 0x50414346;  // "FCAP"
+    static constexpr uint32_t VERSION = 2;
+
+    uint32_t magic = MAGIC;
+    uint32_t version = VERSION;
+    // a capture recorded with a different DriverAPI.inc can't be replayed
+    uint32_t commandCount = uint32_t(CaptureCommand::COUNT);
+    uint32_t sizeOfSize = sizeof(size_t);
+
+    bool isCompatible() const noexcept {
+        return magic == MAGIC && version == VERSION &&
+               commandCount == uint32_t(CaptureCommand::COUNT) && sizeOfSize == sizeof(size_t);
+    }
+};
+
+// ------------------------------------------------------------------------------------------------
+
+class CaptureWriter {
+public:
+    // check isOpen() to know if the file could be created
+    explicit CaptureWriter(const char* path);
+    ~CaptureWriter() noexcept;
+
+    CaptureWriter(CaptureWriter const& rhs) = delete;
+    CaptureWriter& operator=(CaptureWriter const& rhs) = delete;
+
+    bool isOpen() const noexcept { return mStream.good(); }
+
+    // number of bytes written so far
+    size_t getSize() noexcept { return size_t(mStream.tellp()); }
+
+    template<typename... ARGS>
+    void record(CaptureCommand command, ARGS const& ... args) {
+        write(command);
+        using expand = int[];
+        (void)expand{ 0, (write(args), 0)... };
+    }
+
+private:
+    void writeBytes(void const* data, size_t size) {
+        mStream.write(static_cast<const char*>(data), std::streamsize(size));
+    }
+
+    template<typename T>
+    void write(T const& value) {
+        // enums, integers and the driver structures which are plain data
+        static_assert(std::is_trivially_copyable<T>::value, "T must be serialized explicitly");
+        writeBytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void write(Handle<T> const& handle) {
+        write(handle.getId());
+    }
+
+    // native objects are not captured
+    void write(void*) { }
+
+    void write(const char* string);
+    void write(utils::CString const& string);
+    void write(Driver::TargetBufferInfo const& info);
+    void write(Driver::FaceOffsets const& offsets);
+    void write(Driver::BufferDescriptor const& buffer);
+    void write(Driver::PixelBufferDescriptor const& buffer);
+    void write(UniformBuffer const& buffer);
+    void write(SamplerBuffer const& buffer);
+    void write(Program const& program);
+    void write(UniformInterfaceBlock const* block);
+    void write(SamplerInterfaceBlock const* block);
+    void write(SamplerBindingMap const* map);
+
+    std::ofstream mStream;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+class CaptureReader {
+public:
+    template<typename T>
+    struct Type { };
+
+    // 'data' must stay valid until the replayed commands are executed, buffers point into it
+    CaptureReader(void const* data, size_t size) noexcept;
+    ~CaptureReader() noexcept;
+
+    CaptureReader(CaptureReader const& rhs) = delete;
+    CaptureReader& operator=(CaptureReader const& rhs) = delete;
+
+    bool isCompatible() const noexcept { return mCompatible; }
+
+    bool hasCommands() const noexcept { return mCurrent < mEnd; }
+
+    CaptureCommand readCommand() {
+        return read(Type<CaptureCommand>{});
+    }
+
+    // handles are remapped to the handles of the replaying driver
+    HandleBase::HandleId readHandleId() {
+        return read(Type<HandleBase::HandleId>{});
+    }
+
+    void setHandle(HandleBase::HandleId captured, HandleBase::HandleId replayed) {
+        mHandles[captured] = replayed;
+    }
+
+    template<typename T>
+    T read(Type<T>) {
+        static_assert(std::is_trivially_copyable<T>::value, "T must be deserialized explicitly");
+        T value;
+        memcpy(&value, readBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    Handle<T> read(Type<Handle<T>>) {
+        auto pos = mHandles.find(readHandleId());
+        return pos != mHandles.end() ? Handle<T>(pos->second) : Handle<T>();
+    }
+
+    void* read(Type<void*>) { return nullptr; }
+
+    const char* read(Type<const char*>);
+    utils::CString read(Type<utils::CString>);
+    Driver::TargetBufferInfo read(Type<Driver::TargetBufferInfo>);
+    Driver::FaceOffsets read(Type<Driver::FaceOffsets>);
+    Driver::BufferDescriptor read(Type<Driver::BufferDescriptor>);
+    Driver::PixelBufferDescriptor read(Type<Driver::PixelBufferDescriptor>);
+    UniformBuffer read(Type<UniformBuffer>);
+    SamplerBuffer read(Type<SamplerBuffer>);
+    Program read(Type<Program>);
+
+private:
+    void const* readBytes(size_t size);
+
+    UniformInterfaceBlock const* readUniformBlock();
+    SamplerInterfaceBlock const* readSamplerBlock();
+    SamplerBindingMap const* readSamplerBindings();
+
+    uint8_t const* mCurrent;
+    uint8_t const* mEnd;
+    bool mCompatible = false;
+    tsl::robin_map<HandleBase::HandleId, HandleBase::HandleId> mHandles;
+
+    // the programs reference these, they must outlive the replaying driver's programs
+    std::vector<std::unique_ptr<UniformInterfaceBlock>> mUniformBlocks;
+    std::vector<std::unique_ptr<SamplerInterfaceBlock>> mSamplerBlocks;
+    std::vector<std::unique_ptr<SamplerBindingMap>> mSamplerBindings;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_CAPTURESTREAM_H
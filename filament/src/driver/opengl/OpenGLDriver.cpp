@@ -96,7 +96,7 @@ std::unique_ptr<Driver> OpenGLDriver::create(
 
 OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
         : DriverBase(new ConcreteDispatcher<OpenGLDriver>(this)),
-          mHandleArena("Handles", 2U * 1024U * 1024U), // TODO: set the amount in configuration
+          mHandleArena(2U * 1024U * 1024U), // TODO: set the amount in configuration
           mSamplerMap(32),
           mContextManager(*externalContext) {
     state.enables.caps.set(getIndexForCap(GL_DITHER));
@@ -119,6 +119,17 @@ OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
         << version << io::endl
         << shader << io::endl
         << "OS version: " << mContextManager.getOSVersion() << io::endl;
+
+    slog.d << "HwFence: " << sizeof(HwFence) << io::endl;
+    slog.d << "GLIndexBuffer: " << sizeof(GLIndexBuffer) << io::endl;
+    slog.d << "GLSamplerBuffer: " << sizeof(GLSamplerBuffer) << io::endl;
+    slog.d << "GLRenderPrimitive: " << sizeof(GLRenderPrimitive) << io::endl;
+    slog.d << "GLTexture: " << sizeof(GLTexture) << io::endl;
+    slog.d << "OpenGLProgram: " << sizeof(OpenGLProgram) << io::endl;
+    slog.d << "GLRenderTarget: " << sizeof(GLRenderTarget) << io::endl;
+    slog.d << "GLVertexBuffer: " << sizeof(GLVertexBuffer) << io::endl;
+    slog.d << "GLUniformBuffer: " << sizeof(GLUniformBuffer) << io::endl;
+    slog.d << "GLStream: " << sizeof(GLStream) << io::endl;
 #endif
 
     // OpenGL (ES) version
@@ -410,13 +421,32 @@ void OpenGLDriver::bindBufferBase(GLenum target, GLuint index, GLuint buffer) no
     size_t targetIndex = getIndexForBufferTarget(target);
     // this ALSO sets the generic binding
     if (state.buffers.targets[targetIndex].buffers[index] != buffer
+            || state.buffers.targets[targetIndex].sizes[index] != 0
             || state.buffers.targets[targetIndex].genericBinding != buffer) {
         state.buffers.targets[targetIndex].buffers[index] = buffer;
+        state.buffers.targets[targetIndex].offsets[index] = 0;
+        state.buffers.targets[targetIndex].sizes[index] = 0;
         state.buffers.targets[targetIndex].genericBinding = buffer;
         glBindBufferBase(target, index, buffer);
     }
 }
 
+void OpenGLDriver::bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+        GLintptr offset, GLsizeiptr size) noexcept {
+    size_t targetIndex = getIndexForBufferTarget(target);
+    // this ALSO sets the generic binding
+    if (state.buffers.targets[targetIndex].buffers[index] != buffer
+            || state.buffers.targets[targetIndex].offsets[index] != offset
+            || state.buffers.targets[targetIndex].sizes[index] != size
+            || state.buffers.targets[targetIndex].genericBinding != buffer) {
+        state.buffers.targets[targetIndex].buffers[index] = buffer;
+        state.buffers.targets[targetIndex].offsets[index] = offset;
+        state.buffers.targets[targetIndex].sizes[index] = size;
+        state.buffers.targets[targetIndex].genericBinding = buffer;
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+}
+
 void OpenGLDriver::bindFramebuffer(GLenum target, GLuint buffer) noexcept {
     switch (target) {
         case GL_FRAMEBUFFER:
@@ -679,51 +709,8 @@ default_case:
 // -- less than 128 bytes
 
 
-OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
-        : mPool0(area.begin(),
-                  pointermath::add(area.begin(), (1 * area.getSize()) / 16)),
-          mPool1( pointermath::add(area.begin(), (1 * area.getSize()) / 16),
-                  pointermath::add(area.begin(), (6 * area.getSize()) / 16)),
-          mPool2( pointermath::add(area.begin(), (6 * area.getSize()) / 16),
-                  area.end()) {
-
-#ifndef NDEBUG
-    slog.d << "HwFence: " << sizeof(HwFence) << io::endl;
-    slog.d << "GLIndexBuffer: " << sizeof(GLIndexBuffer) << io::endl;
-    slog.d << "GLSamplerBuffer: " << sizeof(GLSamplerBuffer) << io::endl;
-    slog.d << "GLRenderPrimitive: " << sizeof(GLRenderPrimitive) << io::endl;
-    slog.d << "GLTexture: " << sizeof(GLTexture) << io::endl;
-    slog.d << "OpenGLProgram: " << sizeof(OpenGLProgram) << io::endl;
-    slog.d << "GLRenderTarget: " << sizeof(GLRenderTarget) << io::endl;
-    slog.d << "GLVertexBuffer: " << sizeof(GLVertexBuffer) << io::endl;
-    slog.d << "GLUniformBuffer: " << sizeof(GLUniformBuffer) << io::endl;
-    slog.d << "GLStream: " << sizeof(GLStream) << io::endl;
-#endif
-}
-
-void* OpenGLDriver::HandleAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
-    assert(size <= mPool2.getSize());
-    if (size <= mPool0.getSize()) return mPool0.alloc(size, 16, extra);
-    if (size <= mPool1.getSize()) return mPool1.alloc(size, 32, extra);
-    if (size <= mPool2.getSize()) return mPool2.alloc(size, 32, extra);
-    return nullptr;
-}
-
-void OpenGLDriver::HandleAllocator::free(void* p, size_t size) noexcept {
-    if (size <= mPool0.getSize()) { mPool0.free(p); return; }
-    if (size <= mPool1.getSize()) { mPool1.free(p); return; }
-    if (size <= mPool2.getSize()) { mPool2.free(p); return; }
-}
-
-
-// This is "NOINLINE" because it ends-up generating more code than we'd like because of
-// the locking (unfortunately, mHandleArena is accessed from 2 threads)
-UTILS_NOINLINE
 HandleBase::HandleId OpenGLDriver::allocateHandle(size_t size) noexcept {
-    void* addr = mHandleArena.alloc(size);
-    char* const base = (char *)mHandleArena.getArea().begin();
-    size_t offset = (char*)addr - base;
-    return HandleBase::HandleId(offset >> HandleAllocator::MIN_ALIGNMENT_SHIFT);
+    return mHandleArena.allocate(size);
 }
 
 template<typename D, typename B, typename ... ARGS>
@@ -731,6 +718,8 @@ typename std::enable_if<std::is_base_of<B, D>::value, D>::type*
 OpenGLDriver::construct(Handle<B> const& handle, ARGS&& ... args) noexcept {
     assert(handle);
     static_assert(sizeof(D) <= 128, "Handle<> too large");
+    static_assert(alignof(D) <= HandleArena::getAlignment(sizeof(D)),
+            "Handle<> alignment not supported");
     D* addr = handle_cast<D *>(const_cast<Handle<B>&>(handle));
     new(addr) D(std::forward<ARGS>(args)...);
 #if !defined(NDEBUG) && UTILS_HAS_RTTI
@@ -1204,6 +1193,9 @@ void OpenGLDriver::destroyProgram(Driver::ProgramHandle ph) {
 
     if (ph) {
         OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+        if (mBoundProgram == p) {
+            mBoundProgram = nullptr;
+        }
         destruct(ph, p);
     }
 }
@@ -1854,10 +1846,13 @@ void OpenGLDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
     assert(ub);
 
     if (UTILS_UNLIKELY(uniformBuffer.isDirty())) {
-        // TODO: upload only the dirty parts
+        // upload only the parts that changed, the rest of the buffer is already up to date
         assert(ub->gl.ubo);
         bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, uniformBuffer.getSize(), uniformBuffer.getBuffer());
+        char const* const data = static_cast<char const*>(uniformBuffer.getBuffer());
+        for (utils::BufferRange const& range : uniformBuffer.getDirtyRanges()) {
+            glBufferSubData(GL_UNIFORM_BUFFER, range.start, range.getCount(), data + range.start);
+        }
         CHECK_GL_ERROR(utils::slog.e)
     }
     ub->ub = std::move(uniformBuffer);
@@ -2344,6 +2339,15 @@ void OpenGLDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        uint32_t offset, uint32_t size) {
+    DEBUG_MARKER()
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo, offset, size);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     DEBUG_MARKER()
 
@@ -2614,19 +2618,39 @@ void OpenGLDriver::blit(TargetBufferFlags buffers,
 void OpenGLDriver::draw(
         Driver::ProgramHandle ph,
         Driver::RasterState rs,
-        Driver::RenderPrimitiveHandle rph) {
+        Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
     DEBUG_MARKER()
 
-    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
-    useProgram(p);
+    bindPipeline(ph, rs);
+    drawPrimitive(rph, instanceCount);
+}
 
-    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
-    bindVertexArray(rp);
+void OpenGLDriver::bindPipeline(Driver::ProgramHandle ph, Driver::RasterState rs) {
+    DEBUG_MARKER()
 
+    mBoundProgram = handle_cast<OpenGLProgram*>(ph);
     setRasterState(rs);
+}
 
-    glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
-            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+void OpenGLDriver::drawPrimitive(Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    DEBUG_MARKER()
+
+    // the samplers may have changed since bindPipeline(), so they're set-up on each draw
+    assert(mBoundProgram);
+    useProgram(mBoundProgram);
+
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    bindVertexArray(rp);
+
+    if (instanceCount <= 1) {
+        glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    } else {
+        glDrawElementsInstanced(GLenum(rp->type), rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset),
+                GLsizei(instanceCount));
+    }
 
     CHECK_GL_ERROR(utils::slog.e)
 }
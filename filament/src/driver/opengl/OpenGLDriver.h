@@ -19,6 +19,7 @@
 
 #include "driver/Driver.h"
 #include "driver/DriverBase.h"
+#include "driver/HandleAllocator.h"
 #include "driver/opengl/GLUtils.h"
 
 #include <utils/compiler.h>
@@ -204,26 +205,9 @@ private:
 
     // Memory management...
 
-    class HandleAllocator {
-        utils::PoolAllocator< 16, 16>   mPool0;
-        utils::PoolAllocator< 64, 32>   mPool1;
-        utils::PoolAllocator<128, 32>   mPool2;
-    public:
-        static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
-        explicit HandleAllocator(const utils::HeapArea& area);
-        void* alloc(size_t size, size_t alignment, size_t extra = 0) noexcept;
-        void free(void* p, size_t size) noexcept;
-    };
-
-    // the arenas for handle allocation needs to be thread-safe
-#ifndef NDEBUG
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock,
-            utils::TrackingPolicy::HighWatermark>;
-#else
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock>;
-#endif
+    // the objects referenced by the handles are allocated from 3 pools of up to 16, 64 and 128
+    // bytes, aligned to 16, 32 and 32 bytes (see OpenGLDriver.cpp for the size of each object)
+    using HandleArena = HandleAllocator<16, 64, 128>;
 
     HandleArena mHandleArena;
 
@@ -250,9 +234,7 @@ private:
             std::is_pointer<Dp>::value &&
             std::is_base_of<B, typename std::remove_pointer<Dp>::type>::value, Dp>::type
     handle_cast(Handle<B>& handle) noexcept {
-        char* const base = (char *)mHandleArena.getArea().begin();
-        size_t offset = handle.getId() << HandleAllocator::MIN_ALIGNMENT_SHIFT;
-        return static_cast<Dp>(static_cast<void *>(base + offset));
+        return static_cast<Dp>(mHandleArena.getPointer(handle.getId()));
     }
 
     typedef math::details::TVec4<GLint> vec4gli;
@@ -325,6 +307,8 @@ private:
 
     inline void bindBuffer(GLenum target, GLuint buffer) noexcept;
     inline void bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept;
+    inline void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+            GLintptr offset, GLsizeiptr size) noexcept;
 
     inline void bindFramebuffer(GLenum target, GLuint buffer) noexcept;
 
@@ -411,6 +395,8 @@ private:
         struct {
             struct {
                 GLuint buffers[MAX_BUFFER_BINDINGS] = { 0 };
+                GLintptr offsets[MAX_BUFFER_BINDINGS] = { 0 };
+                GLsizeiptr sizes[MAX_BUFFER_BINDINGS] = { 0 };  // 0 for the whole buffer
                 GLuint genericBinding = 0;
             } targets[13];
         } buffers;
@@ -483,6 +469,9 @@ private:
     // sampler buffer binding points (nullptr if not used)
     std::array<HwSamplerBuffer*, Program::NUM_SAMPLER_BINDINGS> mSamplerBindings;   // 8 pointers
 
+    // program set by bindPipeline(), its samplers are set-up by each drawPrimitive()
+    OpenGLProgram* mBoundProgram = nullptr;
+
     mutable tsl::robin_map<uint32_t, GLuint> mSamplerMap;
     mutable std::vector<GLTexture*> mExternalStreams;
 
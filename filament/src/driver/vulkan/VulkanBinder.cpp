@@ -72,13 +72,22 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
     }
 
     // If no bindings have been dirtied, update the timestamp (most recent access) and return false
-    // to indicate there's no need to re-bind.
+    // to indicate there's no need to re-bind, unless the dynamic offsets have changed.
     if (!mDirtyDescriptor) {
         assert(mCurrentDescriptor && mCurrentDescriptor->bound);
         *descriptor = mCurrentDescriptor->handle;
         mCurrentDescriptor->timestamp = mCurrentTime;
+        if (mDirtyDynamicOffsets) {
+            mDirtyDynamicOffsets = false;
+            *pipelineLayout = mPipelineLayout;
+            if (changes) {
+                *changes = nullptr;
+            }
+            return true;
+        }
         return false;
     }
+    mDirtyDynamicOffsets = false;
 
     // Release the previously bound descriptor and update its time stamp.
     if (mCurrentDescriptor) {
@@ -132,7 +141,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
             VkDescriptorBufferInfo& bufferInfo = mDescriptorBuffers[binding];
             bufferInfo.buffer = mDescriptorKey.uniformBuffers[binding];
             bufferInfo.offset = 0;
-            bufferInfo.range = VK_WHOLE_SIZE;
+            bufferInfo.range = mDescriptorKey.uniformBufferSizes[binding];
             VkWriteDescriptorSet& writeInfo = writes[nwrites++];
             writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             writeInfo.pNext = nullptr;
@@ -140,7 +149,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
             writeInfo.dstBinding = binding;
             writeInfo.dstArrayElement = 0;
             writeInfo.descriptorCount = 1;
-            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             writeInfo.pImageInfo = nullptr;
             writeInfo.pBufferInfo = &bufferInfo;
             writeInfo.pTexelBufferView = nullptr;
@@ -414,11 +423,22 @@ void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> fi
 }
 
 void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer) noexcept {
+    bindUniformBufferRange(bindingIndex, uniformBuffer, 0, VK_WHOLE_SIZE);
+}
+
+void VulkanBinder::bindUniformBufferRange(uint32_t bindingIndex, VkBuffer uniformBuffer,
+        uint32_t offset, uint32_t size) noexcept {
     assert(bindingIndex < NUM_UBUFFER_BINDINGS);
-    if (mDescriptorKey.uniformBuffers[bindingIndex] != uniformBuffer) {
+    if (mDescriptorKey.uniformBuffers[bindingIndex] != uniformBuffer ||
+            mDescriptorKey.uniformBufferSizes[bindingIndex] != size) {
         mDescriptorKey.uniformBuffers[bindingIndex] = uniformBuffer;
+        mDescriptorKey.uniformBufferSizes[bindingIndex] = size;
         mDirtyDescriptor = true;
     }
+    if (mDynamicOffsets[bindingIndex] != offset) {
+        mDynamicOffsets[bindingIndex] = offset;
+        mDirtyDynamicOffsets = true;
+    }
 }
 
 void VulkanBinder::bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo samplerInfo) noexcept {
@@ -504,8 +524,9 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     binding.descriptorCount = 1; // NOTE: We never use arrays-of-blocks.
     binding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS; // NOTE: This is potentially non-optimal.
 
-    // The first range of binding slots is reserved for UBO's.
-    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    // The first range of binding slots is reserved for UBO's, they're dynamic so that sub-ranges
+    // of a buffer can be bound without creating new descriptor sets.
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     for (uint32_t i = 0; i < NUM_UBUFFER_BINDINGS; i++) {
         binding.binding = i;
         bindings[i] = binding;
@@ -543,7 +564,7 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
         .maxSets = MAX_NUM_DESCRIPTORS,
         .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
     };
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSizes[0].descriptorCount = poolInfo.maxSets * NUM_UBUFFER_BINDINGS;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = poolInfo.maxSets * NUM_SAMPLER_BINDINGS;
@@ -582,7 +603,8 @@ bool VulkanBinder::PipelineEqual::operator()(const VulkanBinder::PipelineKey& k1
 bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
         const VulkanBinder::DescriptorKey& k2) const {
     for (uint32_t i = 0; i < NUM_UBUFFER_BINDINGS; i++) {
-        if (k1.uniformBuffers[i] != k2.uniformBuffers[i]) {
+        if (k1.uniformBuffers[i] != k2.uniformBuffers[i] ||
+            k1.uniformBufferSizes[i] != k2.uniformBufferSizes[i]) {
             return false;
         }
     }
@@ -120,9 +120,13 @@ public:
 
     // Returns true if vkCmdBindDescriptorSets is required. Additionally, if mutations to the set
     // are required (i.e., vkUpdateDescriptorSets) then "changes" is set to non-null.
+    // The uniform buffers are dynamic descriptors, so vkCmdBindDescriptorSets must be given the
+    // NUM_UBUFFER_BINDINGS offsets returned by getDynamicOffsets().
     bool getOrCreateDescriptor(VkDescriptorSet* descriptor, VkPipelineLayout* pipelineLayout,
             DescriptorUpdateOp** changes = nullptr) noexcept;
 
+    uint32_t const* getDynamicOffsets() const noexcept { return mDynamicOffsets; }
+
     // Returns true if any pipeline bindings have changed. (i.e., vkCmdBindPipeline is required)
     bool getOrCreatePipeline(VkPipeline* pipeline) noexcept;
 
@@ -132,6 +136,8 @@ public:
     void bindRenderPass(VkRenderPass renderPass) noexcept;
     void bindPrimitiveTopology(VkPrimitiveTopology topology) noexcept;
     void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer) noexcept;
+    void bindUniformBufferRange(uint32_t bindingIndex, VkBuffer uniformBuffer,
+            uint32_t offset, uint32_t size) noexcept;
     void bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo imageInfo) noexcept;
     void bindVertexArray(const VertexArray& varray) noexcept;
 
@@ -203,13 +209,16 @@ private:
     // The descriptor key is a POD that represents all currently bound states that go into the
     // descriptor set. We apply a hash function to its contents only if has been mutated since
     // the previous call to getOrCreateDescriptor.
+    // The offsets of the uniform buffers are not part of the key, they're dynamic.
     struct alignas(8) DescriptorKey {
         VkBuffer uniformBuffers[NUM_UBUFFER_BINDINGS];
+        VkDeviceSize uniformBufferSizes[NUM_UBUFFER_BINDINGS]; // VK_WHOLE_SIZE unless a range
         VkDescriptorImageInfo samplers[NUM_SAMPLER_BINDINGS];
     };
 
     static_assert(sizeof(DescriptorKey) ==
         sizeof(DescriptorKey::uniformBuffers) +
+        sizeof(DescriptorKey::uniformBufferSizes) +
         sizeof(DescriptorKey::samplers),
         "Implicit padding is not allowed for fast hashing");
 
@@ -251,6 +260,7 @@ private:
     // uniform buffers).
     PipelineKey mPipelineKey;
     DescriptorKey mDescriptorKey;
+    uint32_t mDynamicOffsets[NUM_UBUFFER_BINDINGS] = {};
 
     // Weak references to the currently bound pipeline and descriptor set.
     PipelineVal* mCurrentPipeline = nullptr;
@@ -261,6 +271,10 @@ private:
     bool mDirtyPipeline = true;
     bool mDirtyDescriptor = true;
 
+    // Set when only the dynamic offsets have changed, i.e. the current descriptor set must be
+    // bound again, with the new offsets.
+    bool mDirtyDynamicOffsets = false;
+
     // Cached Vulkan objects. These objects are owned by the Binder.
     VkDescriptorSetLayout mDescriptorSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
@@ -42,7 +42,9 @@ namespace driver {
 VulkanDriver::VulkanDriver(ContextManagerVk* externalContext,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept :
         DriverBase(new ConcreteDispatcher<VulkanDriver>(this)),
-        mContextManager(*externalContext), mStagePool(mContext), mFramebufferCache(mContext),
+        mContextManager(*externalContext),
+        mHandleArena(4U * 1024U * 1024U), // TODO: set the amount in configuration
+        mStagePool(mContext), mFramebufferCache(mContext),
         mSamplerCache(mContext) {
     mContext.rasterState = mBinder.getDefaultRasterState();
 
@@ -238,52 +240,52 @@ void VulkanDriver::flush(int) {
 
 void VulkanDriver::createVertexBuffer(Driver::VertexBufferHandle vbh, uint8_t bufferCount,
         uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes) {
-    construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool, bufferCount,
+    construct_handle<VulkanVertexBuffer>(mHandleArena, vbh, mContext, mStagePool, bufferCount,
             attributeCount, elementCount, attributes);
 }
 
 void VulkanDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
         uint32_t indexCount) {
     auto elementSize = (uint8_t) getElementTypeSize(elementType);
-    construct_handle<VulkanIndexBuffer>(mHandleMap, ibh, mContext, mStagePool, elementSize,
+    construct_handle<VulkanIndexBuffer>(mHandleArena, ibh, mContext, mStagePool, elementSize,
             indexCount);
 }
 
 void VulkanDriver::createTexture(Driver::TextureHandle th, SamplerType target, uint8_t levels,
         TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
         TextureUsage usage) {
-    construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels, format, samples,
+    construct_handle<VulkanTexture>(mHandleArena, th, mContext, target, levels, format, samples,
             w, h, depth, usage, mStagePool);
 }
 
 void VulkanDriver::createSamplerBuffer(Driver::SamplerBufferHandle sbh, size_t count) {
-    construct_handle<VulkanSamplerBuffer>(mHandleMap, sbh, mContext, count);
+    construct_handle<VulkanSamplerBuffer>(mHandleArena, sbh, mContext, count);
 }
 
 void VulkanDriver::createUniformBuffer(Driver::UniformBufferHandle ubh, size_t size) {
-    construct_handle<VulkanUniformBuffer>(mHandleMap, ubh, mContext, mStagePool, size);
+    construct_handle<VulkanUniformBuffer>(mHandleArena, ubh, mContext, mStagePool, size);
 }
 
 void VulkanDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int) {
-    construct_handle<VulkanRenderPrimitive>(mHandleMap, rph, mContext);
+    construct_handle<VulkanRenderPrimitive>(mHandleArena, rph, mContext);
 }
 
 void VulkanDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
-    construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
+    construct_handle<VulkanProgram>(mHandleArena, ph, mContext, program);
 }
 
 void VulkanDriver::createDefaultRenderTarget(Driver::RenderTargetHandle rth, int) {
-    construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext);
+    construct_handle<VulkanRenderTarget>(mHandleArena, rth, mContext);
 }
 
 void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         Driver::TargetBufferFlags targets, uint32_t width, uint32_t height, uint8_t samples,
         TextureFormat format, Driver::TargetBufferInfo color, Driver::TargetBufferInfo depth,
         Driver::TargetBufferInfo stencil) {
-    auto& renderTarget = *construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext,
+    auto& renderTarget = *construct_handle<VulkanRenderTarget>(mHandleArena, rth, mContext,
             width, height);
     if (color.handle) {
-        auto colorTexture = handle_cast<VulkanTexture>(mHandleMap, color.handle);
+        auto colorTexture = handle_cast<VulkanTexture>(mHandleArena, color.handle);
         renderTarget.setColorImage({
             .view = colorTexture->imageView,
             .format = colorTexture->format
@@ -292,7 +294,7 @@ void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         renderTarget.createColorImage(getVkFormat(format));
     }
     if (depth.handle) {
-        auto depthTexture = handle_cast<VulkanTexture>(mHandleMap, depth.handle);
+        auto depthTexture = handle_cast<VulkanTexture>(mHandleArena, depth.handle);
         renderTarget.setDepthImage({
             .view = depthTexture->imageView,
             .format = depthTexture->format
@@ -307,7 +309,7 @@ void VulkanDriver::createFence(Driver::FenceHandle fh, int) {
 
 void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWindow,
         uint64_t flags) {
-    auto* swapChain = construct_handle<VulkanSwapChain>(mHandleMap, sch);
+    auto* swapChain = construct_handle<VulkanSwapChain>(mHandleArena, sch);
     VulkanSurfaceContext& sc = swapChain->surfaceContext;
     sc.surface = (VkSurfaceKHR) mContextManager.createVkSurfaceKHR(nativeWindow,
             mContext.instance, &sc.clientSize.width, &sc.clientSize.height);
@@ -379,28 +381,28 @@ Handle<HwStream> VulkanDriver::createStreamFromTextureIdSynchronous() noexcept {
 void VulkanDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
     if (vbh) {
         waitForIdle(mContext);
-        destruct_handle<VulkanVertexBuffer>(mHandleMap, vbh);
+        destruct_handle<VulkanVertexBuffer>(mHandleArena, vbh);
     }
 }
 
 void VulkanDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
     if (ibh) {
         waitForIdle(mContext);
-        destruct_handle<VulkanIndexBuffer>(mHandleMap, ibh);
+        destruct_handle<VulkanIndexBuffer>(mHandleArena, ibh);
     }
 }
 
 void VulkanDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
     if (rph) {
         waitForIdle(mContext);
-        destruct_handle<VulkanRenderPrimitive>(mHandleMap, rph);
+        destruct_handle<VulkanRenderPrimitive>(mHandleArena, rph);
     }
 }
 
 void VulkanDriver::destroyProgram(Driver::ProgramHandle ph) {
     if (ph) {
         waitForIdle(mContext);
-        destruct_handle<VulkanProgram>(mHandleMap, ph);
+        destruct_handle<VulkanProgram>(mHandleArena, ph);
     }
 }
 
@@ -410,47 +412,47 @@ void VulkanDriver::destroySamplerBuffer(Driver::SamplerBufferHandle sbh) {
         // not map to any Vulkan objects. To handle destruction, the only thing we need to do is
         // ensure that the next draw call doesn't try to access a zombie sampler buffer. Therefore,
         // simply replace all weak references with null.
-        auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+        auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleArena, sbh);
         for (auto& binding : mSamplerBindings) {
             if (binding == hwsb) {
                 binding = nullptr;
             }
         }
-        destruct_handle<VulkanSamplerBuffer>(mHandleMap, sbh);
+        destruct_handle<VulkanSamplerBuffer>(mHandleArena, sbh);
     }
 }
 
 void VulkanDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     if (ubh) {
-        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleArena, ubh);
         mBinder.unbindUniformBuffer(buffer->getGpuBuffer());
         waitForIdle(mContext);
-        destruct_handle<VulkanUniformBuffer>(mHandleMap, ubh);
+        destruct_handle<VulkanUniformBuffer>(mHandleArena, ubh);
     }
 }
 
 void VulkanDriver::destroyTexture(Driver::TextureHandle th) {
     if (th) {
-        auto* tex = handle_cast<VulkanTexture>(mHandleMap, th);
+        auto* tex = handle_cast<VulkanTexture>(mHandleArena, th);
         mBinder.unbindImageView(tex->imageView);
         waitForIdle(mContext);
-        destruct_handle<VulkanTexture>(mHandleMap, th);
+        destruct_handle<VulkanTexture>(mHandleArena, th);
     }
 }
 
 void VulkanDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
     if (rth) {
         waitForIdle(mContext);
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
+        destruct_handle<VulkanRenderTarget>(mHandleArena, rth);
     }
 }
 
 void VulkanDriver::destroySwapChain(Driver::SwapChainHandle sch) {
     if (sch) {
         waitForIdle(mContext);
-        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(mHandleArena, sch)->surfaceContext;
         destroySurfaceContext(mContext, sc);
-        destruct_handle<VulkanSwapChain>(mHandleMap, sch);
+        destruct_handle<VulkanSwapChain>(mHandleArena, sch);
     }
 }
 
@@ -504,14 +506,14 @@ bool VulkanDriver::isFrameTimeSupported() {
 
 void VulkanDriver::loadVertexBuffer(Driver::VertexBufferHandle vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset, uint32_t byteSize) {
-    auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
+    auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleArena, vbh);
     vb.buffers[index]->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
 
 void VulkanDriver::loadIndexBuffer(Driver::IndexBufferHandle ibh, BufferDescriptor&& p,
         uint32_t byteOffset, uint32_t byteSize) {
-    auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
+    auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleArena, ibh);
     ib.buffer->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
@@ -521,14 +523,14 @@ void VulkanDriver::load2DImage(Driver::TextureHandle th,
         PixelBufferDescriptor&& data) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
     assert(xoffset == 0 && yoffset == 0 && "Offsets not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->load2DImage(std::move(data), width, height, level);
+    handle_cast<VulkanTexture>(mHandleArena, th)->load2DImage(std::move(data), width, height, level);
     scheduleDestroy(std::move(data));
 }
 
 void VulkanDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->loadCubeImage(std::move(data), faceOffsets, level);
+    handle_cast<VulkanTexture>(mHandleArena, th)->loadCubeImage(std::move(data), faceOffsets, level);
     scheduleDestroy(std::move(data));
 }
 
@@ -543,16 +545,16 @@ void VulkanDriver::generateMipmaps(Driver::TextureHandle th) {
 
 void VulkanDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
         UniformBuffer&& uniformBuffer) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleArena, ubh);
     if (uniformBuffer.isDirty()) {
-        buffer->loadFromCpu(uniformBuffer.getBuffer(), (uint32_t) uniformBuffer.getSize());
+        buffer->loadFromCpu(uniformBuffer);
     }
     buffer->ub = std::move(uniformBuffer);
 }
 
 void VulkanDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
         SamplerBuffer&& samplerBuffer) {
-    auto* sb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+    auto* sb = handle_cast<VulkanSamplerBuffer>(mHandleArena, sbh);
     *sb->sb = samplerBuffer;
 }
 
@@ -563,7 +565,7 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     assert(mContext.currentSurface);
     VulkanSurfaceContext& surface = *mContext.currentSurface;
     const SwapContext& swapContext = surface.swapContexts[surface.currentSwapIndex];
-    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
+    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleArena, rth);
     VulkanRenderTarget* rt = mCurrentRenderTarget;
     const VkExtent2D extent = rt->getExtent();
     assert(extent.width > 0 && extent.height > 0);
@@ -655,15 +657,15 @@ void VulkanDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 void VulkanDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
         Driver::VertexBufferHandle vbh, Driver::IndexBufferHandle ibh,
         uint32_t enabledAttributes) {
-    auto primitive = handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
-    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(mHandleMap, vbh),
-            handle_cast<VulkanIndexBuffer>(mHandleMap, ibh), enabledAttributes);
+    auto primitive = handle_cast<VulkanRenderPrimitive>(mHandleArena, rph);
+    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(mHandleArena, vbh),
+            handle_cast<VulkanIndexBuffer>(mHandleArena, ibh), enabledAttributes);
 }
 
 void VulkanDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
         Driver::PrimitiveType pt, uint32_t offset,
         uint32_t minIndex, uint32_t maxIndex, uint32_t count) {
-    auto& primitive = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    auto& primitive = *handle_cast<VulkanRenderPrimitive>(mHandleArena, rph);
     primitive.setPrimitiveType(pt);
     primitive.offset = offset * primitive.indexBuffer->elementSize;
     primitive.count = count;
@@ -691,7 +693,7 @@ void VulkanDriver::setViewportScissor(
 }
 
 void VulkanDriver::makeCurrent(Driver::SwapChainHandle sch) {
-    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(mHandleArena, sch)->surfaceContext;
     mContext.currentSurface = &sContext;
 }
 
@@ -702,7 +704,7 @@ void VulkanDriver::commit(Driver::SwapChainHandle sch) {
     releaseCommandBuffer(mContext);
 
     // Present the backbuffer.
-    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(mHandleArena, sch)->surfaceContext;
     VkPresentInfoKHR presentInfo {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
@@ -740,12 +742,18 @@ void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t h
 }
 
 void VulkanDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleArena, ubh);
     mBinder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer());
 }
 
+void VulkanDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        uint32_t offset, uint32_t size) {
+    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleArena, ubh);
+    mBinder.bindUniformBufferRange((uint32_t) index, buffer->getGpuBuffer(), offset, size);
+}
+
 void VulkanDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
-    auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+    auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleArena, sbh);
     mSamplerBindings[index] = hwsb;
 }
 
@@ -793,13 +801,26 @@ void VulkanDriver::blit(TargetBufferFlags buffers,
 }
 
 void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterState,
-        Driver::RenderPrimitiveHandle rph) {
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    bindPipeline(ph, rasterState);
+    drawPrimitive(rph, instanceCount);
+}
+
+void VulkanDriver::bindPipeline(Driver::ProgramHandle ph, Driver::RasterState rasterState) {
+    // The program and raster state are only pushed to the binder by the next draw, because
+    // the fragment shader depends on the render target and the samplers can still change.
+    mBoundProgram = ph;
+    mBoundRasterState = rasterState;
+}
+
+void VulkanDriver::drawPrimitive(Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
     VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
     ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
-    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleArena, rph);
+    const Driver::RasterState rasterState = mBoundRasterState;
 
     // If this is a debug build, validate the current shader.
-    auto* program = handle_cast<VulkanProgram>(mHandleMap, ph);
+    auto* program = handle_cast<VulkanProgram>(mHandleArena, mBoundProgram);
 #if !defined(NDEBUG)
     if (program->bundle.vertex == VK_NULL_HANDLE || program->bundle.fragment == VK_NULL_HANDLE) {
         utils::slog.e << "Binding missing shader: " << program->name.c_str() << utils::io::endl;
@@ -863,7 +884,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
                     &group)) {
                 const SamplerParams& samplerParams = sampler->s;
                 VkSampler vksampler = mSamplerCache.getSampler(samplerParams);
-                const auto* tex = handle_const_cast<VulkanTexture>(mHandleMap, sampler->t);
+                const auto* tex = handle_const_cast<VulkanTexture>(mHandleArena, sampler->t);
                 mBinder.bindSampler(binding, {
                     .sampler = vksampler,
                     .imageView = tex->imageView,
@@ -880,7 +901,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     VkPipelineLayout pipelineLayout;
     if (mBinder.getOrCreateDescriptor(&descriptor, &pipelineLayout)) {
         vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-                &descriptor, 0, nullptr);
+                &descriptor, VulkanBinder::NUM_UBUFFER_BINDINGS, mBinder.getDynamicOffsets());
     }
 
     // Bind the pipeline if it changed. This can happen, for example, if the raster state changed.
@@ -900,10 +921,10 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
 
     // Finally, make the actual draw call. TODO: support subranges
     const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
     const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
     const int32_t vertexOffset = 0;
-    const uint32_t firstInstId = 1;
+    // the shaders index the per-instance uniforms with gl_InstanceIndex, which starts here
+    const uint32_t firstInstId = 0;
     vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
 }
 
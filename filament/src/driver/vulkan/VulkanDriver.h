@@ -25,11 +25,11 @@
 
 #include "driver/Driver.h"
 #include "driver/DriverBase.h"
+#include "driver/HandleAllocator.h"
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
 
-#include <unordered_map>
 #include <vector>
 
 namespace filament {
@@ -77,55 +77,43 @@ private:
 
     driver::ContextManagerVk& mContextManager;
 
-    // For now we're not bothering to store handles in pools, just simple on-demand allocation.
-    // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
-    using Blob = std::vector<uint8_t>;
-    using HandleMap = std::unordered_map<HandleBase::HandleId, Blob>;
-    HandleMap mHandleMap;
-    HandleBase::HandleId mNextId = 1;
+    // the objects referenced by the handles are allocated from 3 pools of up to 32, 160 and 320
+    // bytes
+    using HandleArena = HandleAllocator<32, 160, 320>;
+    HandleArena mHandleArena;
 
     template<typename Dp, typename B>
-    Handle<B> alloc_handle() {
-        mHandleMap[mNextId] = Blob(sizeof(Dp));
-        return Handle<B>(mNextId++);
+    Handle<B> alloc_handle() noexcept {
+        static_assert(sizeof(Dp) <= 320, "Handle<> too large");
+        static_assert(alignof(Dp) <= HandleArena::getAlignment(sizeof(Dp)),
+                "Handle<> alignment not supported");
+        return Handle<B>(mHandleArena.allocate(sizeof(Dp)));
     }
 
     template<typename Dp, typename B>
-    Dp* handle_cast(HandleMap& handleMap, Handle<B>& handle) noexcept {
+    Dp* handle_cast(HandleArena& handleArena, Handle<B>& handle) noexcept {
         assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<Dp*>(blob.data());
+        return static_cast<Dp*>(handleArena.getPointer(handle.getId()));
     }
 
     template<typename Dp, typename B>
-    const Dp* handle_const_cast(HandleMap& handleMap, const Handle<B>& handle) noexcept {
+    const Dp* handle_const_cast(HandleArena& handleArena, const Handle<B>& handle) noexcept {
         assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<const Dp*>(blob.data());
+        return static_cast<const Dp*>(handleArena.getPointer(handle.getId()));
     }
 
     template<typename Dp, typename B, typename ... ARGS>
-    Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        Dp* addr = reinterpret_cast<Dp*>(blob.data());
+    Dp* construct_handle(HandleArena& handleArena, Handle<B>& handle, ARGS&& ... args) noexcept {
+        Dp* addr = handle_cast<Dp>(handleArena, handle);
         new(addr) Dp(std::forward<ARGS>(args)...);
         return addr;
     }
 
     template<typename Dp, typename B>
-    void destruct_handle(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        // Call the destructor, remove the blob, don't bother reclaiming the integer id.
-        handle_cast<Dp>(handleMap, handle)->~Dp();
-        handleMap.erase(handle.getId());
+    void destruct_handle(HandleArena& handleArena, Handle<B>& handle) noexcept {
+        Dp* addr = handle_cast<Dp>(handleArena, handle);
+        addr->~Dp();
+        handleArena.free(addr, sizeof(Dp));
     }
 
     VulkanContext mContext = {};
@@ -135,6 +123,8 @@ private:
     VulkanSamplerCache mSamplerCache;
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
     VulkanSamplerBuffer* mSamplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
+    Driver::ProgramHandle mBoundProgram;
+    Driver::RasterState mBoundRasterState;
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
 };
 
@@ -336,12 +336,25 @@ VulkanUniformBuffer::VulkanUniformBuffer(VulkanContext& context, VulkanStagePool
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mGpuBuffer, &mGpuMemory, 0);
 }
 
-void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
+void VulkanUniformBuffer::loadFromCpu(UniformBuffer const& uniformBuffer) {
     VkDevice device = mContext.device;
+    const uint32_t numBytes = (uint32_t) uniformBuffer.getSize();
+    char const* const cpuData = static_cast<char const*>(uniformBuffer.getBuffer());
+
+    // The dirty ranges are staged at their offset in the buffer, and copied with one region each.
+    VkBufferCopy regions[UniformBuffer::MAX_DIRTY_RANGES];
+    uint32_t regionCount = 0;
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
     void* mapped;
     vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
+    for (utils::BufferRange const& range : uniformBuffer.getDirtyRanges()) {
+        memcpy((char*) mapped + range.start, cpuData + range.start, range.getCount());
+        regions[regionCount++] = VkBufferCopy {
+            .srcOffset = range.start,
+            .dstOffset = range.start,
+            .size = range.getCount()
+        };
+    }
     vmaUnmapMemory(mContext.allocator, stage->memory);
     vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
 
@@ -356,11 +369,10 @@ void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
         .commandBufferCount = 1
     };
     VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VkBufferCopy region { .size = numBytes };
     vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
     vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
     vkBeginCommandBuffer(cmdbuffer, &beginInfo);
-    vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
+    vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, regionCount, regions);
 
     // Ensure that the copy finishes before the next draw call.
     VkBufferMemoryBarrier barrier {
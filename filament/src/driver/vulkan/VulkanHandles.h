@@ -101,7 +101,8 @@ struct VulkanIndexBuffer : public HwIndexBuffer {
 struct VulkanUniformBuffer : public HwUniformBuffer {
     VulkanUniformBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint32_t numBytes);
     ~VulkanUniformBuffer();
-    void loadFromCpu(const void* cpuData, uint32_t numBytes);
+    // uploads the ranges of the buffer that changed
+    void loadFromCpu(UniformBuffer const& uniformBuffer);
     VkBuffer getGpuBuffer() const { return mGpuBuffer; }
 private:
     VulkanContext& mContext;
@@ -16,16 +16,27 @@
 
 #include <filament/Box.h>
 #include <filament/Frustum.h>
+#include <filament/LightManager.h>
+#include "details/Allocators.h"
 #include "details/Culler.h"
+#include "details/CullingHierarchy.h"
+#include "details/Engine.h"
+#include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "RenderPass.h"
 
+#include <utils/JobSystem.h>
 #include <utils/Profiler.h>
 #include <utils/compiler.h>
 #include <math/fast.h>
 #include <math/scalar.h>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <random>
+#include <string>
+#include <utility>
 
 using namespace filament;
 using namespace filament::details;
@@ -103,29 +114,248 @@ int main(void) {
             Profiler::EV_BPU_MISSES
     );
 
-    benchmark(p, "Box Culling Direct", [&]() {
-        Culler::Test::intersects(visibles, frustum, boxesCenter.data(), boxesExtent.data(), batch);
-    });
+    static constexpr std::pair<Culler::Isa, const char*> isas[] = {
+            { Culler::Isa::SCALAR, "Scalar" },
+            { Culler::Isa::SSE4,   "SSE4"   },
+            { Culler::Isa::AVX2,   "AVX2"   },
+            { Culler::Isa::AVX512, "AVX512" },
+            { Culler::Isa::NEON,   "NEON"   },
+    };
+
+    // the scalar results are the reference for all the other variants
+    std::vector<Culler::result_type> expectedBoxes(batch, 0);
+    std::vector<Culler::result_type> expectedSpheres(batch, 0);
+    Culler::Test::intersects(Culler::Isa::SCALAR, expectedBoxes.data(), frustum,
+            boxesCenter.data(), boxesExtent.data(), batch);
+    Culler::Test::intersects(Culler::Isa::SCALAR, expectedSpheres.data(), frustum,
+            spheres.data(), batch);
+
+    for (auto const& isa : isas) {
+        if (!Culler::Test::isSupported(isa.first)) {
+            continue;
+        }
+
+        // the box kernels accumulate into their output, each variant starts from a clear one
+        std::fill_n(visibles, batch, Culler::result_type(0));
+        std::string boxName = std::string("Box Culling Direct (") + isa.second + ")";
+        benchmark(p, boxName.c_str(), [&]() {
+            Culler::Test::intersects(isa.first, visibles, frustum,
+                    boxesCenter.data(), boxesExtent.data(), batch);
+        });
+
+        size_t vb = 0;
+        bool boxesMatch = true;
+        for (size_t i = 0; i < batch; i++) {
+            vb = vb + (visibles[i] ? 1 : 0);
+            boxesMatch = boxesMatch && visibles[i] == expectedBoxes[i];
+        }
+
+        std::fill_n(visibles, batch, Culler::result_type(0));
+        std::string sphereName = std::string("Sphere Culling Direct (") + isa.second + ")";
+        benchmark(p, sphereName.c_str(), [&]() {
+            Culler::Test::intersects(isa.first, visibles, frustum, spheres.data(), batch);
+        });
 
-    size_t vb = 0;
-    for (size_t i = 0; i < batch; i++) {
-        vb = vb + (visibles[i] ? 1 : 0);
+        size_t vs = 0;
+        bool spheresMatch = true;
+        for (size_t i = 0; i < batch; i++) {
+            vs = vs + (visibles[i] ? 1 : 0);
+            spheresMatch = spheresMatch && visibles[i] == expectedSpheres[i];
+        }
+
+        std::cout << "visible boxes: " << vb << (boxesMatch ? "" : " (MISMATCH)") << std::endl;
+        std::cout << "visible spheres: " << vs << (spheresMatch ? "" : " (MISMATCH)") << std::endl;
+        std::cout << std::endl;
     }
 
-    benchmark(p, "Sphere Culling Direct", [&]() {
-        Culler::Test::intersects(visibles, frustum, spheres.data(), batch);
-    });
+    free(visibles);
 
-    size_t vs = 0;
-    for (size_t i = 0; i < batch; i++) {
-        vs = vs + (visibles[i] ? 1 : 0);
+
+    // Flat vs. hierarchical culling of a large world, of which the camera sees a small part
+    JobSystem js;
+    js.adopt();
+    for (size_t count : { 10000, 100000, 1000000 }) {
+        std::uniform_real_distribution<float> world(-1000.0f, 1000.0f);
+        std::uniform_real_distribution<float> height(-10.0f, 10.0f);
+        std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+        const size_t capacity = Culler::round(count);
+        std::vector<float3> centers(capacity);
+        std::vector<float3> extents(capacity);
+        std::vector<CullingHierarchy::Instance> instances(capacity);
+        std::vector<Culler::result_type> results(capacity);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = { world(gen), height(gen), world(gen) };
+            extents[i] = { size(gen), size(gen), size(gen) };
+            instances[i] = CullingHierarchy::Instance(uint32_t(i + 1));
+        }
+
+        CullingHierarchy hierarchy;
+        hierarchy.update(centers.data(), extents.data(), instances.data(), count);
+
+        std::string flatName = "Flat Box Culling " + std::to_string(count);
+        benchmark(p, flatName.c_str(), [&]() {
+            std::fill(results.begin(), results.end(), 0);
+            Culler::intersects(results.data(), frustum,
+                    centers.data(), extents.data(), count, 0);
+        });
+
+        size_t vf = 0;
+        for (size_t i = 0; i < count; i++) {
+            vf = vf + (results[i] ? 1 : 0);
+        }
+
+        std::string refitName = "Hierarchy Refit (static) " + std::to_string(count);
+        benchmark(p, refitName.c_str(), [&]() {
+            hierarchy.update(centers.data(), extents.data(), instances.data(), count);
+        });
+
+        std::string hierarchyName = "Hierarchical Box Culling " + std::to_string(count);
+        benchmark(p, hierarchyName.c_str(), [&]() {
+            std::fill(results.begin(), results.end(), 0);
+            hierarchy.cull(js, results.data(), frustum, 0);
+        });
+
+        size_t vh = 0;
+        for (size_t i = 0; i < count; i++) {
+            vh = vh + (results[i] ? 1 : 0);
+        }
+
+        std::cout << "visible boxes (flat): " << vf << std::endl;
+        std::cout << "visible boxes (hierarchy): " << vh << std::endl;
+        std::cout << std::endl;
     }
 
-    std::cout << "visible boxes: " << vb << std::endl;
-    std::cout << "visible spheres: " << vs << std::endl;
-    std::cout << std::endl;
+    // Occlusion culling of a city: rows of buildings hiding small objects behind them
+    {
+        const mat4f clipFromWorld = mat4f::perspective(60.0f, 1.0f, 0.1f, 1000.0f) *
+                mat4f::translate(float3{ 0, -2, 0 });
 
-    free(visibles);
+        std::uniform_real_distribution<float> street(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> depth(-500.0f, -5.0f);
+        const size_t count = 10000;
+        std::vector<float3> centers(count);
+        std::vector<float3> extents(count, float3{ 1 });
+        std::vector<Culler::result_type> results(count);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = { street(gen), 1.0f, depth(gen) };
+        }
+
+        OcclusionCuller culler;
+        auto addBuildings = [&]() {
+            culler.reset(clipFromWorld);
+            for (size_t i = 0; i < OcclusionCuller::MAX_OCCLUDER_COUNT; i++) {
+                const float x = float(i % 16) * 20.0f - 150.0f;
+                const float z = -float(i / 16) * 50.0f - 20.0f;
+                culler.addOccluder(mat4f::translate(float3{ x, 10, z }),
+                        Box{ {}, { 8, 10, 8 } });
+            }
+        };
+
+        benchmark(p, "Occluders Setup", [&]() {
+            addBuildings();
+        });
+
+        benchmark(p, "Occluders Rasterization", [&]() {
+            culler.rasterize(js);
+        });
+
+        benchmark(p, "Occlusion Culling 10000", [&]() {
+            std::fill(results.begin(), results.end(), 1);
+            culler.cull(js, results.data(), centers.data(), extents.data(), count, 0);
+        });
+
+        size_t vo = 0;
+        for (size_t i = 0; i < count; i++) {
+            vo = vo + (results[i] ? 1 : 0);
+        }
+        std::cout << "visible boxes (occlusion): " << vo << std::endl;
+        std::cout << std::endl;
+    }
+
+    // Sorting of the render commands, std::sort vs. radix sort
+    for (size_t count : { 1000, 10000, 32768 }) {
+        using Command = RenderPass::Command;
+        std::mt19937_64 keys;
+        // color commands: constant pass, a few priorities and z-buckets, random material ids
+        std::vector<Command> source(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t r = keys();
+            source[i].key = (uint64_t(1) << 56) |
+                            ((r & 0x3) << 50) |
+                            (((r >> 8) & 0x3FF) << 32) |
+                            ((r >> 32) & 0xFFFFFF);
+        }
+        std::vector<Command> commands(count);
+        std::vector<Command> scratch(count);
+
+        std::string stdName = "Sort Commands (std::sort) " + std::to_string(count);
+        benchmark(p, stdName.c_str(), [&]() {
+            std::copy(source.begin(), source.end(), commands.begin());
+            std::sort(commands.begin(), commands.end());
+        });
+
+        std::string radixName = "Sort Commands (radix) " + std::to_string(count);
+        benchmark(p, radixName.c_str(), [&]() {
+            std::copy(source.begin(), source.end(), commands.begin());
+            RenderPass::sortCommands(js, commands.data(), count, scratch.data());
+        });
+    }
+    js.emancipate();
+
+    // Froxelization of the maximum number of point and spot lights, at 1080p and 4K
+    {
+        FEngine* engine = FEngine::create();
+
+        std::uniform_real_distribution<float> spread(-20.0f, 20.0f);
+        std::uniform_real_distribution<float> depth(-80.0f, -2.0f);
+        std::uniform_real_distribution<float> radius(1.0f, 5.0f);
+
+        FScene::LightSoa lights;
+        lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
+        std::vector<Entity> entities(CONFIG_MAX_LIGHT_COUNT);
+        engine->getEntityManager().create(entities.size(), entities.data());
+        for (size_t i = 0; i < entities.size(); i++) {
+            // half spot lights, half point lights
+            const bool spot = i & 1;
+            LightManager::Builder(spot ? LightManager::Type::SPOT : LightManager::Type::POINT)
+                    .direction({ 0, 0, -1 })
+                    .spotLightCone(0.5f, 0.7f)
+                    .build(*engine, entities[i]);
+            LightManager::Instance instance = engine->getLightManager().getInstance(entities[i]);
+            lights.push_back(float4{ spread(gen), spread(gen), depth(gen), radius(gen) },
+                    float3{ 0, 0, -1 }, instance, 1, {});
+        }
+
+        LinearAllocatorArena arena("Froxelizer benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+        for (Viewport const& vp : { Viewport{ 0, 0, 1920, 1080 }, Viewport{ 0, 0, 3840, 2160 } }) {
+            filament::details::ArenaScope scope(arena);
+            const float aspect = float(vp.width) / float(vp.height);
+            CameraInfo camera = {};
+            camera.projection = mat4f::perspective(60.0f, aspect, 0.1f, 100.0f);
+            camera.cullingProjection = camera.projection;
+            camera.zn = 0.1f;
+            camera.zf = 100.0f;
+
+            Froxelizer froxelizer(*engine);
+            froxelizer.prepare(engine->getDriverApi(), scope, vp, camera.projection,
+                    camera.zn, camera.zf, CONFIG_MAX_LIGHT_COUNT);
+
+            std::string name = "Froxelize " + std::to_string(CONFIG_MAX_LIGHT_COUNT) +
+                    " lights " + std::to_string(vp.width) + "x" + std::to_string(vp.height);
+            benchmark(p, name.c_str(), [&]() {
+                froxelizer.froxelizeLights(*engine, camera, lights);
+            });
+
+            froxelizer.terminate(engine->getDriverApi());
+        }
+
+        for (Entity e : entities) {
+            engine->getLightManager().destroy(e);
+        }
+        engine->shutdown();
+        delete engine;
+    }
 
 
     benchmark(p, "cos", [&]() {
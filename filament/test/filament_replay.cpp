@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a capture of the driver commands (see CaptureDriver) through the noop driver, and prints
+// how long decoding and executing each frame took.
+//
+// usage: filament_replay <capture> [repeat]
+
+#include "driver/capture/CaptureReplayer.h"
+#include "driver/noop/NoopDriver.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace filament;
+
+using Timing = CaptureReplayer::Timing;
+
+static void printTiming(const char* name, Timing const& t) {
+    std::cout << name << ": " << t.commandCount << " commands, decode "
+              << t.decode.count() << " ms, execute " << t.execute.count() << " ms" << std::endl;
+}
+
+static void printStatistics(std::vector<Timing> const& frames) {
+    if (frames.empty()) {
+        return;
+    }
+    auto stats = [&frames](const char* name, CaptureReplayer::duration Timing::*d) {
+        auto minmax = std::minmax_element(frames.begin(), frames.end(),
+                [d](Timing const& lhs, Timing const& rhs) { return lhs.*d < rhs.*d; });
+        CaptureReplayer::duration sum{};
+        for (Timing const& t : frames) {
+            sum += t.*d;
+        }
+        std::cout << name << " (ms): avg " << sum.count() / frames.size()
+                  << ", min " << ((*minmax.first).*d).count()
+                  << ", max " << ((*minmax.second).*d).count() << std::endl;
+    };
+    stats("decode ", &Timing::decode);
+    stats("execute", &Timing::execute);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <capture> [repeat]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "couldn't open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<char> capture((std::istreambuf_iterator<char>(in)),
+            std::istreambuf_iterator<char>());
+
+    const int repeat = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+
+    std::vector<Timing> frames;
+    for (int i = 0; i < repeat; i++) {
+        std::unique_ptr<Driver> driver(NoopDriver::create());
+        CaptureReplayer::Result result =
+                CaptureReplayer::replay(*driver, capture.data(), capture.size());
+        driver->terminate();
+        if (!result.valid) {
+            std::cerr << argv[1] << " isn't a compatible capture" << std::endl;
+            return 1;
+        }
+        if (i == 0) {
+            printTiming("setup", result.setup);
+            for (size_t f = 0; f < result.frames.size(); f++) {
+                printTiming(("frame " + std::to_string(f)).c_str(), result.frames[f]);
+            }
+        }
+        frames.insert(frames.end(), result.frames.begin(), result.frames.end());
+    }
+
+    std::cout << frames.size() << " frames replayed" << std::endl;
+    printStatistics(frames);
+    return 0;
+}
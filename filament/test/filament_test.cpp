@@ -28,17 +28,44 @@
 #include <filament/Material.h>
 #include <filament/Engine.h>
 
+#include "driver/HandleAllocator.h"
 #include "driver/UniformBuffer.h"
 #include <filament/UniformInterfaceBlock.h>
 
 #include "details/Allocators.h"
+#include "details/BonePool.h"
 #include "details/Material.h"
 #include "details/Camera.h"
+#include "details/Culler.h"
+#include "details/CullingHierarchy.h"
 #include "details/Froxelizer.h"
 #include "details/Engine.h"
+#include "details/OcclusionCuller.h"
+#include "details/ShadowMap.h"
+#include "details/View.h"
+#include "RenderPass.h"
 #include "components/TransformManager.h"
 #include "utils/RangeSet.h"
 
+#if defined(FILAMENT_ENABLE_CAPTURE)
+#include "driver/CommandStream.h"
+#include "driver/capture/CaptureDriver.h"
+#include "driver/capture/CaptureReplayer.h"
+#include "driver/noop/NoopDriver.h"
+
+#include <fstream>
+#include <iterator>
+#endif
+
+#include <utils/JobSystem.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+
 using namespace filament;
 using namespace math;
 using namespace utils;
@@ -110,33 +137,33 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 4 }});
 
     //
-    // test out-of-order parent/child
+    // test parent/child order
     //
 
+    // adding a root moves the child after it
     tcm.create(entities[2]);
     EXPECT_TRUE(tcm.hasComponent(entities[2]));
     TransformManager::Instance newParent = tcm.getInstance(entities[2]);
     EXPECT_TRUE(bool(newParent));
 
+    // creating a component can change Instances
+    parent = tcm.getInstance(entities[0]);
+    child = tcm.getInstance(entities[1]);
+    EXPECT_GT(child, newParent);
+    EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 4 }});
+
     // test reparenting
     tcm.setParent(child, newParent);
-
-    // make sure child/parent are out of order
-    ASSERT_LT(child, newParent);
-
-    // local transaction reprders parent/child
-    tcm.openLocalTransformTransaction();
-    tcm.setTransform(newParent, mat4f{ float4{ 8 }});
-    tcm.commitLocalTransformTransaction();
-
-    // local transaction invalidates Instances
-    parent = tcm.getInstance(entities[0]);
     child = tcm.getInstance(entities[1]);
     newParent = tcm.getInstance(entities[2]);
 
     // check parent / child order is correct
     EXPECT_GT(child, newParent);
 
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(newParent, mat4f{ float4{ 8 }});
+    tcm.commitLocalTransformTransaction();
+
     // check transform propagation
     EXPECT_EQ(tcm.getTransform(newParent), mat4f{ float4{ 8 }});
     EXPECT_EQ(tcm.getWorldTransform(newParent), mat4f{ float4{ 8 }});
@@ -144,6 +171,225 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
 }
 
+TEST(FilamentTest, TransformManagerHierarchy) {
+    filament::details::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 8> entities;
+    em.create(entities.size(), entities.data());
+
+    // a chain e[0] <- e[1] <- ... <- e[5], created leaves first, plus two roots in between
+    tcm.create(entities[5]);
+    tcm.create(entities[6]);
+    for (size_t i = 5; i > 0; i--) {
+        tcm.create(entities[i - 1]);
+        tcm.setParent(tcm.getInstance(entities[i]), tcm.getInstance(entities[i - 1]));
+    }
+    tcm.create(entities[7]);
+
+    // each level translates by one unit
+    tcm.openLocalTransformTransaction();
+    for (Entity e : entities) {
+        tcm.setTransform(tcm.getInstance(e), mat4f::translate(float3{ 1, 0, 0 }));
+    }
+    tcm.commitLocalTransformTransaction();
+
+    for (size_t i = 0; i < 6; i++) {
+        TransformManager::Instance ti = tcm.getInstance(entities[i]);
+        EXPECT_EQ(tcm.getWorldTransform(ti)[3].x, float(i + 1));
+        if (i > 0) {
+            EXPECT_GT(ti, tcm.getInstance(entities[i - 1]));
+        }
+    }
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[6]))[3].x, 1.0f);
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[7]))[3].x, 1.0f);
+
+    // destroying the middle of the chain makes e[3] a root
+    tcm.destroy(entities[2]);
+    tcm.openLocalTransformTransaction();
+    tcm.commitLocalTransformTransaction();
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[3]))[3].x, 1.0f);
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[5]))[3].x, 3.0f);
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[1]))[3].x, 2.0f);
+
+    // moving e[3] under e[7] moves its whole subtree down
+    tcm.setParent(tcm.getInstance(entities[3]), tcm.getInstance(entities[7]));
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[5]))[3].x, 4.0f);
+    EXPECT_GT(tcm.getInstance(entities[3]), tcm.getInstance(entities[7]));
+    EXPECT_GT(tcm.getInstance(entities[4]), tcm.getInstance(entities[3]));
+    EXPECT_GT(tcm.getInstance(entities[5]), tcm.getInstance(entities[4]));
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+}
+
+TEST(FilamentTest, TransformManagerBulkUpdate) {
+    filament::details::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 3> entities;
+    em.create(entities.size(), entities.data());
+
+    tcm.create(entities[0]);
+    tcm.create(entities[1], tcm.getInstance(entities[0]), mat4f{});
+    tcm.create(entities[2]);
+
+    std::array<TransformManager::Instance, 3> instances;
+    for (size_t i = 0; i < entities.size(); i++) {
+        instances[i] = tcm.getInstance(entities[i]);
+    }
+
+    // world transforms are propagated to children
+    const std::array<mat4f, 3> transforms = {
+            mat4f::translate(float3{ 1, 0, 0 }),
+            mat4f::translate(float3{ 0, 2, 0 }),
+            mat4f::scale(float3{ 3 }) };
+    tcm.setTransforms(instances.data(), transforms.data(), instances.size());
+    EXPECT_EQ(tcm.getTransform(instances[1]), transforms[1]);
+    EXPECT_EQ(tcm.getWorldTransform(instances[1]), transforms[0] * transforms[1]);
+    EXPECT_EQ(tcm.getWorldTransform(instances[2]), transforms[2]);
+
+    // translation / rotation / scale form
+    const std::array<float3, 2> t = { float3{ 1, 2, 3 }, float3{ 4, 5, 6 } };
+    const std::array<quatf, 2> r = {
+            quatf::fromAxisAngle(float3{ 0, 0, 1 }, float(M_PI_2)),
+            quatf{ 1, 0, 0, 0 } };
+    const std::array<float3, 2> s = { float3{ 2 }, float3{ 1, 2, 3 } };
+    tcm.setTransforms(instances.data(), t.data(), r.data(), s.data(), 2);
+    for (size_t i = 0; i < 2; i++) {
+        mat4f expected = mat4f::translate(t[i]) * mat4f(r[i]) * mat4f::scale(s[i]);
+        for (size_t c = 0; c < 4; c++) {
+            for (size_t j = 0; j < 4; j++) {
+                EXPECT_NEAR(tcm.getTransform(instances[i])[c][j], expected[c][j], 1e-5f);
+            }
+        }
+    }
+    float3 origin = (tcm.getWorldTransform(instances[1]) * float4{ 0, 0, 0, 1 }).xyz;
+    EXPECT_NEAR(origin.x, -9.0f, 1e-5f);
+    EXPECT_NEAR(origin.y, 10.0f, 1e-5f);
+    EXPECT_NEAR(origin.z, 15.0f, 1e-5f);
+
+    // inside a transaction only the local transforms are set
+    tcm.openLocalTransformTransaction();
+    tcm.setTransforms(instances.data(), transforms.data(), 1);
+    EXPECT_EQ(tcm.getTransform(instances[0]), transforms[0]);
+    EXPECT_NE(tcm.getWorldTransform(instances[0]), transforms[0]);
+    tcm.commitLocalTransformTransaction();
+    EXPECT_EQ(tcm.getWorldTransform(instances[0]), transforms[0]);
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+}
+
+TEST(FilamentTest, TransformManagerChangeList) {
+    using filament::details::ChangeList;
+
+    filament::details::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 3> entities;
+    em.create(entities.size(), entities.data());
+
+    tcm.create(entities[0]);
+    TransformManager::Instance parent = tcm.getInstance(entities[0]);
+    tcm.create(entities[1], parent, mat4f{});
+    tcm.create(entities[2]);
+
+    // a consumer that never caught up must regather everything
+    Slice<const Entity> changes;
+    EXPECT_FALSE(tcm.getChangeList().getChangesSince(0, changes));
+
+    // nothing changed since we caught up
+    uint64_t sequence = tcm.getChangeList().getSequence();
+    EXPECT_TRUE(tcm.getChangeList().getChangesSince(sequence, changes));
+    EXPECT_EQ(0, changes.size());
+
+    // moving the parent moves the child as well
+    tcm.setTransform(parent, mat4f{ float4{ 2 }});
+    EXPECT_TRUE(tcm.getChangeList().getChangesSince(sequence, changes));
+    ASSERT_EQ(2, changes.size());
+    EXPECT_EQ(entities[0], changes[0]);
+    EXPECT_EQ(entities[1], changes[1]);
+
+    // changes logged before the end of the frame are gone, but they were consumed
+    sequence = tcm.getChangeList().getSequence();
+    tcm.gc(em);
+    EXPECT_TRUE(tcm.getChangeList().getChangesSince(sequence, changes));
+    EXPECT_EQ(0, changes.size());
+
+    // adding or removing components reshuffles instances
+    tcm.destroy(entities[2]);
+    EXPECT_FALSE(tcm.getChangeList().getChangesSince(sequence, changes));
+
+    // so does a local transform transaction
+    sequence = tcm.getChangeList().getSequence();
+    tcm.openLocalTransformTransaction();
+    tcm.setTransform(parent, mat4f{ float4{ 4 }});
+    tcm.commitLocalTransformTransaction();
+    EXPECT_FALSE(tcm.getChangeList().getChangesSince(sequence, changes));
+
+    // too many changes
+    sequence = tcm.getChangeList().getSequence();
+    for (size_t i = 0; i < ChangeList::MAX_CHANGE_COUNT; i++) {
+        tcm.setTransform(tcm.getInstance(entities[i % 2]), mat4f{});
+    }
+    EXPECT_FALSE(tcm.getChangeList().getChangesSince(sequence, changes));
+
+    tcm.destroy(entities[0]);
+    tcm.destroy(entities[1]);
+    em.destroy(entities.size(), entities.data());
+}
+
+TEST(FilamentTest, BonePool) {
+    using filament::details::BonePool;
+    BonePool pool;
+
+    // allocations are slot-aligned and never at offset 0
+    uint32_t a = pool.allocate(1);
+    uint32_t b = pool.allocate(20);
+    uint32_t c = pool.allocate(255);
+    const uint32_t slotSize = BonePool::SLOT_SIZE;
+    EXPECT_EQ(slotSize, a);
+    EXPECT_EQ(2 * slotSize, b);
+    EXPECT_EQ(5 * slotSize, c);
+
+    // bones start as identity
+    BonePool::Bone* bone = pool.edit(b, 19, 1);
+    EXPECT_EQ(quatf(1, 0, 0, 0), bone->unitQuaternion);
+    EXPECT_EQ(float3(0), bone->translation);
+
+    // shared bones are freed with their last reference
+    pool.acquire(b);
+    pool.release(b);
+    EXPECT_NE(b, pool.allocate(8));
+    pool.release(b);
+
+    // freed slots are reused, and merged with their free neighbors
+    EXPECT_EQ(b, pool.allocate(8));
+    pool.release(a);
+    pool.release(b);
+    EXPECT_EQ(a, pool.allocate(16));
+
+    // the conversion matches mat4f::toQuaternion(), up to the sign
+    const mat4f transforms[] = {
+            mat4f::translate(float3{ 1, 2, 3 }),
+            mat4f::rotate(float(M_PI) * 0.25f, float3{ 0, 1, 0 }),
+            mat4f::rotate(float(M_PI) * 0.99f, normalize(float3{ 1, -2, 3 })),
+            mat4f::rotate(float(M_PI), normalize(float3{ 1, 2, -3 })),
+            mat4f::rotate(float(M_PI), float3{ 0, 0, 1 }),
+            mat4f::translate(float3{ -1, 0, 4 }) * mat4f::rotate(2.0f, float3{ 1, 0, 0 }) };
+    constexpr size_t count = sizeof(transforms) / sizeof(transforms[0]);
+    BonePool::Bone bones[count];
+    BonePool::convert(bones, transforms, count);
+    for (size_t i = 0; i < count; i++) {
+        quatf q = transforms[i].toQuaternion();
+        float d = dot(q, bones[i].unitQuaternion);
+        EXPECT_NEAR(1.0f, std::abs(d), 1e-5f);
+        EXPECT_PRED2(vec3eq, transforms[i][3].xyz, bones[i].translation);
+    }
+}
+
 TEST(FilamentTest, UniformInterfaceBlock) {
 
     UniformInterfaceBlock::Builder b;
@@ -328,6 +574,48 @@ TEST(FilamentTest, UniformBuffer) {
     //buffer.log(std::cout, ib);
 }
 
+TEST(FilamentTest, UniformBufferDirtyRanges) {
+    constexpr size_t G = UniformBuffer::DIRTY_RANGE_GRANULARITY;
+    auto ranges = [](UniformBuffer const& buffer) {
+        std::vector<std::pair<uint32_t, uint32_t>> result;
+        for (utils::BufferRange const& range : buffer.getDirtyRanges()) {
+            result.emplace_back(range.start, range.end);
+        }
+        return result;
+    };
+    using Ranges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+    // a new buffer is entirely dirty
+    UniformBuffer buffer(16 * G + 8);
+    EXPECT_EQ(Ranges({{ 0, 16 * G + 8 }}), ranges(buffer));
+    buffer.clean();
+    EXPECT_FALSE(buffer.isDirty());
+
+    // a single float only dirties its neighborhood
+    buffer.setUniform(4 * G + 4, 1.0f);
+    EXPECT_TRUE(buffer.isDirty());
+    EXPECT_EQ(Ranges({{ 4 * G, 5 * G }}), ranges(buffer));
+
+    // nearby changes are merged, others are not
+    buffer.setUniform(5 * G + 8, 1.0f);
+    buffer.setUniform(10 * G, 1.0f);
+    EXPECT_EQ(Ranges({{ 4 * G, 6 * G }, { 10 * G, 11 * G }}), ranges(buffer));
+
+    // ranges are clamped to the buffer
+    buffer.setUniform(16 * G + 4, 1.0f);
+    EXPECT_EQ(Ranges({{ 4 * G, 6 * G }, { 10 * G, 11 * G }, { 16 * G, 16 * G + 8 }}),
+            ranges(buffer));
+
+    // copies (i.e. the buffers sent to the driver) keep the dirty ranges
+    UniformBuffer copy(buffer);
+    EXPECT_EQ(ranges(buffer), ranges(copy));
+    UniformBuffer moved(std::move(copy));
+    EXPECT_EQ(ranges(buffer), ranges(moved));
+    buffer.clean();
+    EXPECT_FALSE(buffer.isDirty());
+    EXPECT_TRUE(moved.isDirty());
+}
+
 TEST(FilamentTest, BoxCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -408,6 +696,381 @@ TEST(FilamentTest, SphereCulling) {
     EXPECT_TRUE(frustum.intersects({ 0, 200 }));
 }
 
+TEST(FilamentTest, CullingKernels) {
+    using namespace filament::details;
+
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> size(0.1f, 10.0f);
+
+    // not a multiple of Culler::MODULO on purpose
+    const size_t count = 1001;
+    const size_t capacity = Culler::round(count);
+    std::vector<float3> centers(capacity);
+    std::vector<float3> extents(capacity);
+    std::vector<float4> spheres(capacity);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = { position(gen), position(gen), position(gen) - 50.0f };
+        extents[i] = { size(gen), size(gen), size(gen) };
+        spheres[i] = { centers[i], extents[i].x };
+    }
+
+    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+
+    std::vector<Culler::result_type> boxes(capacity, 0);
+    EXPECT_TRUE(Culler::Test::intersects(boxes.data(), frustum,
+            centers.data(), extents.data(), count));
+
+    std::vector<Culler::result_type> results(capacity, 0);
+    EXPECT_TRUE(Culler::Test::intersects(results.data(), frustum, spheres.data(), count));
+
+    size_t visibleBoxes = 0;
+    size_t visibleSpheres = 0;
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(Culler::intersects(frustum, Box{ centers[i], extents[i] }), bool(boxes[i]));
+        EXPECT_EQ(Culler::intersects(frustum, spheres[i]), bool(results[i]));
+        visibleBoxes += boxes[i] ? 1 : 0;
+        visibleSpheres += results[i] ? 1 : 0;
+    }
+    EXPECT_GT(visibleBoxes, 0);
+    EXPECT_LT(visibleBoxes, count);
+    EXPECT_GT(visibleSpheres, 0);
+    EXPECT_LT(visibleSpheres, count);
+
+    // the box kernels must only touch their own bit
+    std::fill(results.begin(), results.end(), 0x80);
+    Culler::intersects(results.data(), frustum, centers.data(), extents.data(), count, 3);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(0x80 | (boxes[i] << 3), results[i]);
+    }
+
+    EXPECT_TRUE(Culler::Test::isSupported(Culler::Isa::SCALAR));
+    EXPECT_TRUE(Culler::Test::isSupported(Culler::getIsa()));
+}
+
+TEST(FilamentTest, CullingHierarchy) {
+    using namespace filament::details;
+
+    JobSystem js;
+    js.adopt();
+
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+    const size_t count = 5000;
+    const size_t capacity = Culler::round(count);
+    std::vector<float3> centers(capacity);
+    std::vector<float3> extents(capacity);
+    std::vector<CullingHierarchy::Instance> instances(capacity);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = { position(gen), position(gen), position(gen) };
+        extents[i] = { size(gen), size(gen), size(gen) };
+        instances[i] = CullingHierarchy::Instance(uint32_t(i + 1));
+    }
+
+    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+
+    auto check = [&](CullingHierarchy const& hierarchy) {
+        std::vector<Culler::result_type> expected(capacity, 0);
+        std::vector<Culler::result_type> results(capacity, 0);
+        Culler::Test::intersects(expected.data(), frustum, centers.data(), extents.data(), count);
+        hierarchy.cull(js, results.data(), frustum, 1);
+        size_t visible = 0;
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(bool(expected[i]), bool(results[i]));
+            EXPECT_EQ(0, results[i] & ~2);
+            visible += expected[i] ? 1 : 0;
+        }
+        EXPECT_GT(visible, 0);
+        EXPECT_LT(visible, count);
+    };
+
+    CullingHierarchy hierarchy;
+    EXPECT_TRUE(hierarchy.update(centers.data(), extents.data(), instances.data(), count));
+    EXPECT_EQ(count, hierarchy.getItemCount());
+    check(hierarchy);
+
+    // nothing changed, the hierarchy must not be rebuilt
+    EXPECT_FALSE(hierarchy.update(centers.data(), extents.data(), instances.data(), count));
+    check(hierarchy);
+
+    // move a few objects a little, the hierarchy is just refit
+    for (size_t i = 0; i < count; i += 97) {
+        centers[i] += float3{ 1, 0, -1 };
+    }
+    EXPECT_FALSE(hierarchy.update(centers.data(), extents.data(), instances.data(), count));
+    check(hierarchy);
+
+    // reorder the source arrays, the hierarchy must be rebuilt
+    std::swap(centers[0], centers[1]);
+    std::swap(extents[0], extents[1]);
+    std::swap(instances[0], instances[1]);
+    EXPECT_TRUE(hierarchy.update(centers.data(), extents.data(), instances.data(), count));
+    check(hierarchy);
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, OcclusionCulling) {
+    using namespace filament::details;
+
+    JobSystem js;
+    js.adopt();
+
+    // camera at the origin looking down -z
+    const mat4f clipFromWorld = mat4f::perspective(60.0f, 1.0f, 0.1f, 100.0f);
+
+    // a wall 10 units in front of the camera, made of two occluders
+    OcclusionCuller culler;
+    culler.reset(clipFromWorld);
+    EXPECT_TRUE(culler.addOccluder(mat4f::translate(float3{ -2, 0, -10 }),
+            Box{ {}, { 2, 4, 0.5f } }));
+    EXPECT_TRUE(culler.addOccluder(mat4f::translate(float3{ 2, 0, -10 }),
+            Box{ {}, { 2, 4, 0.5f } }));
+    EXPECT_EQ(2, culler.getOccluderCount());
+    culler.rasterize(js);
+
+    // the center of the screen is covered
+    float const* depth = culler.getDepthBuffer();
+    const size_t center = (OcclusionCuller::HEIGHT / 2) * OcclusionCuller::WIDTH +
+            OcclusionCuller::WIDTH / 2;
+    EXPECT_LT(depth[center], 1.0f);
+    EXPECT_TRUE(std::isinf(depth[0]));
+
+    float3 const centers[] = {
+            {  0, 0, -20 },     // behind the wall
+            {  0, 0,  -5 },     // in front of the wall
+            { 30, 0, -20 },     // beside the wall
+            {  0, 0, -10 },     // intersects the wall
+            {  0, 0,   0 },     // crosses the near plane
+            {  2, 3, -30 },     // behind the wall, across both occluders
+            { 0, 0, -20 },     { 0, 0, -20 },
+    };
+    float3 const extents[] = {
+            { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 },
+            { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 },
+    };
+    bool const expected[] = { true, false, false, false, false, true, true, true };
+
+    for (size_t i = 0; i < 8; i++) {
+        EXPECT_EQ(expected[i], culler.isOccluded(centers[i], extents[i])) << i;
+    }
+
+    // only the entries with the bit set are tested, and only that bit is cleared
+    Culler::result_type results[8] = { 3, 3, 3, 3, 3, 3, 2, 0 };
+    culler.cull(js, results, centers, extents, 8, 0);
+    Culler::result_type const expectedResults[8] = { 2, 3, 3, 3, 3, 2, 2, 0 };
+    for (size_t i = 0; i < 8; i++) {
+        EXPECT_EQ(expectedResults[i], results[i]) << i;
+    }
+
+    // a new frame without occluders hides nothing
+    culler.reset(clipFromWorld);
+    culler.rasterize(js);
+    EXPECT_FALSE(culler.isOccluded(centers[0], extents[0]));
+
+    // one unit per pixel, the occluder's right edge is at x = 128.6 in the depth buffer, so the
+    // pixel 128 has its center inside the occluder but isn't entirely covered
+    culler.reset(mat4f::ortho(-128, 128, -64, 64, 0.1f, 100.0f));
+    EXPECT_TRUE(culler.addOccluder(mat4f::translate(float3{ -49.7f, 0, -10 }),
+            Box{ {}, { 50.3f, 20, 1 } }));
+    culler.rasterize(js);
+    // behind the occluder, and peeking past its edge by less than a pixel
+    EXPECT_FALSE(culler.isOccluded({ -9.55f, 0, -50 }, { 10.45f, 5, 1 }));
+    // behind the occluder, up to x = 127.5
+    EXPECT_TRUE(culler.isOccluded({ -10.25f, 0, -50 }, { 9.75f, 5, 1 }));
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, ScreenSizes) {
+    using namespace filament::details;
+
+    JobSystem js;
+    js.adopt();
+
+    FScene::RenderableSoa soa;
+    soa.setCapacity(16);
+    soa.resize(4);
+    float3 const centers[] = { { 0, 0, -10 }, { 3, 0, -100 }, { 0, 0, 5 }, { 0, 0, -100 } };
+    float3 const extents[] = { { 1, 0, 0 }, { 0, 0.1f, 0 }, { 1, 1, 1 }, { 0, 0.1f, 0 } };
+    Culler::result_type const visibility[] = { 3, 3, 3, 2 };
+    for (size_t i = 0; i < 4; i++) {
+        soa.elementAt<FScene::WORLD_AABB_CENTER>(i) = centers[i];
+        soa.elementAt<FScene::WORLD_AABB_EXTENT>(i) = extents[i];
+        soa.elementAt<FScene::VISIBLE_MASK>(i) = visibility[i];
+    }
+
+    // 90 degrees vertical field of view, i.e. projection[1][1] is 1
+    const mat4f projection = mat4f::perspective(90.0f, 1.0f, 0.1f, 1000.0f);
+    FView::computeScreenSizes(js, soa, projection, projection[1][1], 0.001f, 0);
+
+    float const* sizes = soa.data<FScene::SCREEN_SIZE>();
+    EXPECT_FLOAT_EQ(0.05f, sizes[0]);
+    EXPECT_FLOAT_EQ(0.0005f, sizes[1]);
+    EXPECT_GT(sizes[2], 1000.0f);   // behind the camera
+
+    // only the visible bit of the small renderable is cleared
+    Culler::result_type const expected[] = { 3, 2, 3, 2 };
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(expected[i], soa.elementAt<FScene::VISIBLE_MASK>(i)) << i;
+    }
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, SortCommands) {
+    using namespace filament::details;
+    using Command = RenderPass::Command;
+
+    JobSystem js;
+    js.adopt();
+
+    std::mt19937_64 gen;
+    for (size_t count : { 100, 5000, 100000 }) {
+        // mimic color commands: constant pass, a few priorities and materials, random z-buckets
+        std::vector<Command> commands(count);
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t r = gen();
+            commands[i].key = (uint64_t(1) << 56) |
+                              ((r & 0x3) << 50) |
+                              (((r >> 8) & 0x3FF) << 32) |
+                              ((r >> 32) & 0x7);
+            // tag each command with its original position, to check the sort is stable
+            commands[i].primitive.mi = reinterpret_cast<FMaterialInstance const*>(uintptr_t(i));
+        }
+        commands.back().key = uint64_t(-1);
+
+        std::vector<Command> expected(commands);
+        std::stable_sort(expected.begin(), expected.end());
+
+        std::vector<Command> scratch(count);
+        RenderPass::sortCommands(js, commands.data(), count, scratch.data());
+        for (size_t i = 0; i < count; i++) {
+            EXPECT_EQ(expected[i].key, commands[i].key);
+            if (count > 1000) { // small buffers use std::sort, which isn't stable
+                EXPECT_EQ(expected[i].primitive.mi, commands[i].primitive.mi);
+            }
+        }
+    }
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, RecordDrawsCommandBytes) {
+    using namespace filament::details;
+    using Command = RenderPass::Command;
+    using RecordMode = RenderPass::RecordMode;
+
+    FEngine* engine = FEngine::create();
+    FMaterial const* material = engine->getDefaultMaterial();
+    material->getProgram(0); // so that recording doesn't create it
+
+    // A representative color pass: the commands are sorted by material instance, and the
+    // renderables are spread across them.
+    constexpr size_t MATERIAL_COUNT = 20;
+    std::vector<FMaterialInstance*> instances(MATERIAL_COUNT);
+    for (auto& mi : instances) {
+        mi = material->createInstance();
+    }
+
+    struct Scene {
+        const char* name;
+        uint32_t renderables;
+        uint32_t primitives;
+        uint32_t skinned;
+        bool uniformRing;
+    };
+    const Scene scenes[] = {
+            { "1000 renderables x 1 primitive, uniform ring",   1000, 1, 0,   true  },
+            { "1000 renderables x 3 primitives, uniform ring",  1000, 3, 0,   true  },
+            { "same, 200 skinned renderables",                  1000, 3, 200, true  },
+            { "1000 x 3, per-renderable uniform buffers",       1000, 3, 0,   false },
+    };
+
+    const Handle<HwUniformBuffer> instanceBuffer(1);
+    const Slice<const Handle<HwUniformBuffer>> instanceBuffers(&instanceBuffer, 1);
+    const Handle<HwUniformBuffer> bones(2);
+
+    auto recordedBytes = [&](Scene const& scene, std::vector<Command> const& commands,
+            auto record) -> size_t {
+        CircularBuffer buffer(4 * 1024 * 1024);
+        CommandStream stream(engine->getDriverApi(), buffer);
+        char const* const begin = static_cast<char const*>(buffer.getHead());
+        const size_t drawCount = record(stream, commands.data(), nullptr, instanceBuffers, 0,
+                scene.uniformRing ? Handle<HwUniformBuffer>(3) : Handle<HwUniformBuffer>{},
+                0, bones);
+        EXPECT_EQ(commands.size() - 1, drawCount);
+        // the commands are never executed, they only need to be measured
+        return size_t(static_cast<char const*>(buffer.getHead()) - begin);
+    };
+
+    for (Scene const& scene : scenes) {
+        std::vector<Command> commands;
+        for (size_t m = 0; m < MATERIAL_COUNT; m++) {
+            for (uint32_t r = uint32_t(m); r < scene.renderables; r += MATERIAL_COUNT) {
+                for (uint32_t p = 0; p < scene.primitives; p++) {
+                    Command command;
+                    command.key = m;
+                    command.primitive.mi = instances[m];
+                    command.primitive.primitiveHandle =
+                            Handle<HwRenderPrimitive>(1000 + r * scene.primitives + p);
+                    command.primitive.perRenderableUniforms = Handle<HwUniformBuffer>(100 + r);
+                    command.primitive.bonesOffset = r < scene.skinned ? (r + 1) * 1024 : 0;
+                    command.primitive.renderable[0] = uint8_t(r);
+                    command.primitive.renderable[1] = uint8_t(r >> 8u);
+                    commands.push_back(command);
+                }
+            }
+        }
+        commands.emplace_back();
+        commands.back().key = uint64_t(-1);
+
+        const size_t fullState = recordedBytes(scene, commands,
+                &RenderPass::recordDraws<RecordMode::FULL_STATE>);
+        const size_t changedState = recordedBytes(scene, commands,
+                &RenderPass::recordDraws<RecordMode::CHANGED_STATE>);
+        std::cout << scene.name << ": " << fullState << " bytes per frame before, "
+                  << changedState << " after" << std::endl;
+        EXPECT_LT(changedState, fullState);
+    }
+
+    for (auto mi : instances) {
+        engine->destroy(mi);
+    }
+}
+
+TEST(FilamentTest, CascadeSplits) {
+    using namespace filament::details;
+    using Scheme = View::CascadeSplitScheme;
+
+    float splits[4];
+    ShadowMap::computeCascadeSplits(splits, 4, Scheme::UNIFORM, 1.0f, 1001.0f);
+    EXPECT_FLOAT_EQ(251.0f, splits[0]);
+    EXPECT_FLOAT_EQ(501.0f, splits[1]);
+    EXPECT_FLOAT_EQ(751.0f, splits[2]);
+    EXPECT_FLOAT_EQ(1001.0f, splits[3]);
+
+    ShadowMap::computeCascadeSplits(splits, 3, Scheme::LOGARITHMIC, 1.0f, 1000.0f);
+    EXPECT_FLOAT_EQ(10.0f, splits[0]);
+    EXPECT_FLOAT_EQ(100.0f, splits[1]);
+    EXPECT_FLOAT_EQ(1000.0f, splits[2]);
+
+    // the practical scheme is between the two
+    ShadowMap::computeCascadeSplits(splits, 2, Scheme::PRACTICAL, 1.0f, 10000.0f);
+    EXPECT_FLOAT_EQ(0.5f * (5000.5f + 100.0f), splits[0]);
+    EXPECT_FLOAT_EQ(10000.0f, splits[1]);
+
+    // without a positive near plane, the logarithmic split falls back to the uniform one
+    ShadowMap::computeCascadeSplits(splits, 2, Scheme::LOGARITHMIC, 0.0f, 100.0f);
+    EXPECT_FLOAT_EQ(50.0f, splits[0]);
+
+    // a single cascade covers everything
+    ShadowMap::computeCascadeSplits(splits, 1, Scheme::PRACTICAL, 0.1f, 100.0f);
+    EXPECT_FLOAT_EQ(100.0f, splits[0]);
+}
+
 TEST(FilamentTest, ColorConversion) {
     // Linear to Gamma
     // 0.0 stays 0.0
@@ -451,6 +1114,242 @@ TEST(FilamentTest, ColorConversion) {
 }
 
 
+TEST(FilamentTest, SceneIncrementalPrepare) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FRenderableManager& rcm = engine->getRenderableManager();
+    FTransformManager& tcm = engine->getTransformManager();
+    EntityManager& em = engine->getEntityManager();
+
+    std::vector<Entity> entities(64);
+    em.create(entities.size(), entities.data());
+    for (size_t i = 0; i < entities.size(); i++) {
+        RenderableManager::Builder(1)
+                .boundingBox({ float3{ float(i) }, float3{ 1 } })
+                .build(*engine, entities[i]);
+        tcm.setTransform(tcm.getInstance(entities[i]), mat4f::translate(float3{ 0, float(i), 0 }));
+    }
+
+    FScene* scene = engine->createScene();
+    for (Entity e : entities) {
+        scene->addEntity(e);
+    }
+
+    // the incrementally updated scene must match one gathered from scratch, the rows can be in
+    // a different order though
+    auto expectSameRenderables = [&]() {
+        FScene* reference = engine->createScene();
+        for (Entity e : entities) {
+            reference->addEntity(e);
+        }
+        FScene::RenderableSoa actual, expected;
+        FScene::LightSoa lights;
+        scene->update(mat4f{});
+        scene->prepare(actual, lights);
+        reference->update(mat4f{});
+        reference->prepare(expected, lights);
+
+        ASSERT_EQ(expected.size(), actual.size());
+        std::map<uint32_t, size_t> rows;
+        for (size_t i = 0; i < expected.size(); i++) {
+            rows[expected.elementAt<FScene::RENDERABLE_INSTANCE>(i).asValue()] = i;
+        }
+        for (size_t i = 0; i < actual.size(); i++) {
+            auto pos = rows.find(actual.elementAt<FScene::RENDERABLE_INSTANCE>(i).asValue());
+            ASSERT_NE(rows.end(), pos);
+            const size_t j = pos->second;
+            FRenderableManager::Visibility v = actual.elementAt<FScene::VISIBILITY_STATE>(i);
+            FRenderableManager::Visibility w = expected.elementAt<FScene::VISIBILITY_STATE>(j);
+            EXPECT_EQ(w.priority, v.priority);
+            EXPECT_EQ(w.castShadows, v.castShadows);
+            EXPECT_EQ(w.receiveShadows, v.receiveShadows);
+            EXPECT_EQ(w.culling, v.culling);
+            EXPECT_EQ(w.occluder, v.occluder);
+            EXPECT_EQ(expected.elementAt<FScene::WORLD_TRANSFORM>(j),
+                    actual.elementAt<FScene::WORLD_TRANSFORM>(i));
+            EXPECT_EQ(expected.elementAt<FScene::UBH>(j).getId(),
+                    actual.elementAt<FScene::UBH>(i).getId());
+            EXPECT_EQ(expected.elementAt<FScene::BONES_OFFSET>(j),
+                    actual.elementAt<FScene::BONES_OFFSET>(i));
+            EXPECT_EQ(expected.elementAt<FScene::WORLD_AABB_CENTER>(j),
+                    actual.elementAt<FScene::WORLD_AABB_CENTER>(i));
+            EXPECT_EQ(expected.elementAt<FScene::WORLD_AABB_EXTENT>(j),
+                    actual.elementAt<FScene::WORLD_AABB_EXTENT>(i));
+            EXPECT_EQ(expected.elementAt<FScene::LAYERS>(j),
+                    actual.elementAt<FScene::LAYERS>(i));
+        }
+        engine->destroy(reference);
+    };
+
+    expectSameRenderables();
+
+    // move and edit a few entities, this only updates their rows
+    tcm.setTransform(tcm.getInstance(entities[3]), mat4f::translate(float3{ 1, 2, 3 }));
+    tcm.setTransform(tcm.getInstance(entities[40]), mat4f::rotate(1.0f, float3{ 0, 0, 1 }));
+    rcm.setCastShadows(rcm.getInstance(entities[7]), true);
+    rcm.setLayerMask(rcm.getInstance(entities[12]), 0x3);
+    rcm.setAxisAlignedBoundingBox(rcm.getInstance(entities[20]), { float3{ 5 }, float3{ 2 } });
+    expectSameRenderables();
+
+    // remove an entity and add a new one, along with more edits
+    scene->remove(entities[30]);
+    entities.erase(entities.begin() + 30);
+    Entity added = em.create();
+    RenderableManager::Builder(1)
+            .boundingBox({ float3{ -4 }, float3{ 1 } })
+            .build(*engine, added);
+    scene->addEntity(added);
+    entities.push_back(added);
+    tcm.setTransform(tcm.getInstance(entities[5]), mat4f::scale(float3{ 2 }));
+    rcm.setPriority(rcm.getInstance(entities[50]), 5);
+    expectSameRenderables();
+
+    // and edit the scene incrementally again
+    tcm.setTransform(tcm.getInstance(added), mat4f::translate(float3{ 0, 0, -8 }));
+    rcm.setReceiveShadows(rcm.getInstance(entities[9]), false);
+    expectSameRenderables();
+
+    engine->destroy(scene);
+}
+
+TEST(FilamentTest, LightSelection) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FScene* scene = engine->createScene();
+
+    // when there are too many lights, the most influential ones are kept: here the dim lights
+    // close to the camera have less influence than the bright lights further away
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {});   // first one is always skipped
+    std::vector<Entity> entities(CONFIG_MAX_LIGHT_COUNT * 2);
+    engine->getEntityManager().create(entities.size(), entities.data());
+    for (size_t i = 0; i < entities.size(); i++) {
+        const bool bright = i & 1;
+        LightManager::Builder(LightManager::Type::POINT)
+                .intensity(bright ? 100000.0f : 100.0f)
+                .build(*engine, entities[i]);
+        LightManager::Instance instance = engine->getLightManager().getInstance(entities[i]);
+        lights.push_back(float4{ 0, 0, bright ? -10 : -2, 1 }, float3{ 0, 0, -1 }, instance, 1, {});
+    }
+
+    LinearAllocatorArena arena("FRenderer: per-frame allocator", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    utils::ArenaScope<LinearAllocatorArena> scope(arena);
+    scene->prepareDynamicLights(CameraInfo{}, scope, lights);
+
+    ASSERT_EQ(CONFIG_MAX_LIGHT_COUNT + FScene::DIRECTIONAL_LIGHTS_COUNT, lights.size());
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT; i < lights.size(); i++) {
+        EXPECT_EQ(-10, lights.elementAt<FScene::POSITION_RADIUS>(i).z);
+    }
+
+    engine->destroy(scene);
+}
+
+TEST(FilamentTest, BonesInvalidateShadows) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FScene* scene = engine->createScene();
+    FRenderableManager& rcm = engine->getRenderableManager();
+
+    Entity skinned = engine->getEntityManager().create();
+    RenderableManager::Builder(1)
+            .boundingBox({ float3{ -1 }, float3{ 1 } })
+            .castShadows(true)
+            .skinning(2)
+            .build(*engine, skinned);
+    scene->addEntity(skinned);
+    auto ci = rcm.getInstance(skinned);
+
+    // the shadow maps are re-rendered when the renderable generation changes, which must
+    // happen when only the bones were animated
+    scene->update(mat4f{});
+    uint64_t generation = scene->getRenderableGeneration();
+    scene->update(mat4f{});
+    EXPECT_EQ(generation, scene->getRenderableGeneration());
+
+    const mat4f transforms[2] = { mat4f::translate(float3{ 0, 1, 0 }), mat4f{} };
+    rcm.setBones(ci, transforms, 2);
+    scene->update(mat4f{});
+    EXPECT_NE(generation, scene->getRenderableGeneration());
+
+    generation = scene->getRenderableGeneration();
+    const RenderableManager::Bone bone = { quatf{ 1, 0, 0, 0 }, float3{ 1, 0, 0 } };
+    rcm.setBones(ci, &bone, 1, 1);
+    scene->update(mat4f{});
+    EXPECT_NE(generation, scene->getRenderableGeneration());
+
+    generation = scene->getRenderableGeneration();
+    rcm.setBones(&ci, 1, transforms);
+    scene->update(mat4f{});
+    EXPECT_NE(generation, scene->getRenderableGeneration());
+
+    rcm.destroy(skinned);
+    engine->getEntityManager().destroy(skinned);
+    engine->destroy(scene);
+}
+
+TEST(FilamentTest, InvalidateShadowMaps) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    ShadowMap shadowMap(*engine);
+
+    shadowMap.setCascadeRendered(0, 1, 2);
+    EXPECT_TRUE(shadowMap.isCascadeUpToDate(0, 1, 2));
+
+    // View::invalidateShadowMaps() forces the next frame to render them again
+    shadowMap.invalidate();
+    EXPECT_FALSE(shadowMap.isCascadeUpToDate(0, 1, 2));
+
+    shadowMap.setCascadeRendered(0, 1, 2);
+    EXPECT_TRUE(shadowMap.isCascadeUpToDate(0, 1, 2));
+}
+
+TEST(FilamentTest, FroxelLayout) {
+    using namespace filament;
+    using namespace filament::details;
+
+    // landscape, ultrawide, portrait and tall viewports must all use most of the froxel budget
+    const Viewport viewports[] = {
+            { 0, 0, 1920, 1080 }, { 0, 0, 3440, 1440 }, { 0, 0, 1080, 2400 }, { 0, 0, 64, 4096 }
+    };
+    const size_t budgets[][2] = { { 8192, 16 }, { 2048, 16 }, { 8192, 32 }, { 1024, 8 } };
+
+    for (Viewport const& vp : viewports) {
+        for (auto const& budget : budgets) {
+            uint2 dim;
+            uint16_t countX, countY, countZ;
+            Froxelizer::computeFroxelLayout(&dim, &countX, &countY, &countZ,
+                    vp, budget[0], budget[1]);
+
+            const size_t froxelCount = countX * countY * countZ;
+            EXPECT_EQ(budget[1], countZ);
+            EXPECT_LE(froxelCount, budget[0]);
+            EXPECT_GE(froxelCount, budget[0] * 9 / 10);
+
+            // the grid covers the viewport, without a row or column of froxels to spare
+            EXPECT_GE(countX * dim.x, vp.width);
+            EXPECT_GE(countY * dim.y, vp.height);
+            EXPECT_LT((countX - 1) * dim.x, vp.width);
+            EXPECT_LT((countY - 1) * dim.y, vp.height);
+        }
+    }
+
+    // the adaptive froxel count grows with the number of lights, up to the maximum
+    EXPECT_EQ(1024, Froxelizer::computeAdaptiveFroxelCount(1, 8192));
+    EXPECT_EQ(2048, Froxelizer::computeAdaptiveFroxelCount(5, 8192));
+    EXPECT_EQ(8192, Froxelizer::computeAdaptiveFroxelCount(32, 8192));
+    EXPECT_EQ(8192, Froxelizer::computeAdaptiveFroxelCount(256, 8192));
+    EXPECT_EQ(4096, Froxelizer::computeAdaptiveFroxelCount(256, 4096));
+    EXPECT_EQ(512, Froxelizer::computeAdaptiveFroxelCount(1, 512));
+}
+
 TEST(FilamentTest, FroxelData) {
     using namespace filament;
     using namespace filament::details;
@@ -470,7 +1369,7 @@ TEST(FilamentTest, FroxelData) {
 
     Froxelizer froxelData(*engine);
     froxelData.setOptions(5, 100);
-    froxelData.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100);
+    froxelData.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100, 1);
 
     Froxel f = froxelData.getFroxelAt(0,0,0);
 
@@ -807,6 +1706,118 @@ TEST(FilamentTest, RangeSet) {
 }
 
 
+TEST(FilamentTest, HandleAllocator) {
+    using Allocator = HandleAllocator<16, 64, 128>;
+    static_assert(Allocator::getAlignment(16) == 16 && Allocator::getAlignment(48) == 32 &&
+            Allocator::getAlignment(128) == 32, "the OpenGL backend's alignments changed");
+    Allocator allocator(64 * 1024);
+
+    // objects of each size class are allocated from distinct, aligned, non-overlapping storage
+    std::set<HandleBase::HandleId> ids;
+    for (size_t size : { 8, 16, 48, 64, 100, 128 }) {
+        HandleBase::HandleId id = allocator.allocate(size);
+        EXPECT_TRUE(ids.insert(id).second);
+        EXPECT_EQ(0, uintptr_t(allocator.getPointer(id)) % Allocator::getAlignment(size));
+        memset(allocator.getPointer(id), 0xFF, size);
+    }
+
+    // handles are allocated on one thread and freed on another, as with the driver thread. The
+    // pool of 64 bytes objects holds 320 of them, but many more are allocated over time.
+    constexpr size_t COUNT = 100000;
+    constexpr size_t MAX_IN_USE = 256;
+    std::vector<HandleBase::HandleId> handles(COUNT);
+    std::atomic<size_t> allocated = { 0 };
+    std::atomic<size_t> freed = { 0 };
+    std::thread driverThread([&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            while (allocated.load(std::memory_order_acquire) <= i) {
+                std::this_thread::yield();
+            }
+            EXPECT_EQ(uint8_t(i), *static_cast<uint8_t*>(allocator.getPointer(handles[i])));
+            allocator.free(allocator.getPointer(handles[i]), 64);
+            freed.store(i + 1, std::memory_order_release);
+        }
+    });
+    for (size_t i = 0; i < COUNT; i++) {
+        while (i - freed.load(std::memory_order_acquire) >= MAX_IN_USE) {
+            std::this_thread::yield();
+        }
+        handles[i] = allocator.allocate(64);
+        memset(allocator.getPointer(handles[i]), uint8_t(i), 64);
+        allocated.store(i + 1, std::memory_order_release);
+    }
+    driverThread.join();
+}
+
+#if defined(FILAMENT_ENABLE_CAPTURE)
+
+static std::vector<char> readCapture(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST(FilamentTest, CaptureReplay) {
+    UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
+            .name("Test").add("a", 1, UniformInterfaceBlock::Type::FLOAT4).build();
+    static const char vertices[] = "0123456789abcdef";
+
+    // capture 2 frames of a few commands through the noop driver
+    {
+        std::unique_ptr<Driver> driver =
+                CaptureDriver::create(NoopDriver::create(), "capture_a.fcap", 2);
+        CircularBuffer buffer(filament::details::CONFIG_MIN_COMMAND_BUFFERS_SIZE);
+        CommandStream stream(*driver, buffer);
+        stream.debugThreading();
+
+        Program program;
+        program.diagnostics(CString("test"), 0)
+                .withVertexShader(CString("vertex"))
+                .withFragmentShader(CString("fragment"))
+                .addUniformBlock(0, &uib);
+        auto ph = stream.createProgram(std::move(program));
+        auto ubh = stream.createUniformBuffer(64);
+        auto vbh = stream.createVertexBuffer(1, 1, 4, {});
+        auto rph = stream.createRenderPrimitive();
+        stream.loadVertexBuffer(vbh, 0,
+                Driver::BufferDescriptor(vertices, sizeof(vertices)), 0, sizeof(vertices));
+        for (uint32_t frame = 0; frame < 3; frame++) {
+            UniformBuffer ub(64);
+            ub.setUniform(0, float(frame));
+            stream.beginFrame(frame, frame);
+            stream.updateUniformBuffer(ubh, std::move(ub));
+            stream.bindUniforms(0, ubh);
+            stream.bindPipeline(ph, {});
+            stream.drawPrimitive(rph, 1);
+            stream.endFrame(frame);
+        }
+        new(buffer.allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+        stream.execute(buffer.getTail());
+    }
+    std::vector<char> a = readCapture("capture_a.fcap");
+
+    // replaying it, and capturing the replay, must produce the same capture
+    {
+        std::unique_ptr<Driver> driver =
+                CaptureDriver::create(NoopDriver::create(), "capture_b.fcap", 2);
+        CaptureReplayer::Result result = CaptureReplayer::replay(*driver, a.data(), a.size());
+        EXPECT_TRUE(result.valid);
+        EXPECT_EQ(5, result.setup.commandCount);
+        ASSERT_EQ(2, result.frames.size());
+        EXPECT_EQ(6, result.frames[0].commandCount);
+        EXPECT_EQ(6, result.frames[1].commandCount);
+    }
+    std::vector<char> b = readCapture("capture_b.fcap");
+    EXPECT_EQ(a, b);
+
+    std::unique_ptr<Driver> driver = NoopDriver::create();
+    EXPECT_FALSE(CaptureReplayer::replay(*driver, vertices, sizeof(vertices)).valid);
+
+    remove("capture_a.fcap");
+    remove("capture_b.fcap");
+}
+
+#endif
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
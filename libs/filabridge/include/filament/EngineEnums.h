@@ -40,8 +40,8 @@ namespace BindingPoints {
     constexpr uint8_t PER_VIEW                = 0;    // uniforms/samplers updated per view
     constexpr uint8_t PER_RENDERABLE          = 1;    // uniforms/samplers updated per renderable
     constexpr uint8_t PER_RENDERABLE_BONES    = 2;    // bones data, per renderable
-    constexpr uint8_t LIGHTS                  = 3;    // lights data array
-    constexpr uint8_t POST_PROCESS            = 4;    // samplers for the post process pass
+    constexpr uint8_t POST_PROCESS            = 3;    // samplers for the post process pass
+    constexpr uint8_t PER_RENDERABLE_INSTANCES = 4;   // per-renderable uniforms of instanced draws
     constexpr uint8_t PER_MATERIAL_INSTANCE   = 5;    // uniforms/samplers updates per material
     constexpr uint8_t COUNT                   = 6;
 }
@@ -52,15 +52,25 @@ static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
 constexpr uint32_t ATTRIBUTE_INDEX_COUNT = 7;
 constexpr size_t MAX_ATTRIBUTE_BUFFERS_COUNT = 8; // FIXME: should match Driver::MAX_ATTRIBUTE_BUFFER_COUNT
 
-// This value is limited by UBO size, ES3.0 only guarantees 16 KiB.
-// Values <= 256, use less CPU and GPU resources.
-constexpr size_t CONFIG_MAX_LIGHT_COUNT = 256;
+// Lights data are stored in a float texture (4 texels per light), so this value isn't limited by
+// the UBO size. It is limited by the per-froxel light bitsets used during froxelization, which
+// need CONFIG_MAX_LIGHT_COUNT bits per froxel, twice. It must be a multiple of 64.
+// Values <= 256, use less CPU and GPU resources (and 8-bit light indices).
+constexpr size_t CONFIG_MAX_LIGHT_COUNT = 512;
 constexpr size_t CONFIG_MAX_LIGHT_INDEX = CONFIG_MAX_LIGHT_COUNT - 1;
 
 // This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
 // 256 is enough, but we could use 512 if needed
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// Maximum number of renderables drawn by a single instanced draw. Also limited by UBO size,
+// each instance uses 112 bytes (i.e. the size of the per-renderable uniforms).
+constexpr size_t CONFIG_MAX_INSTANCE_COUNT = 128;
+
+// Maximum number of cascades of the directional shadow map. The cascade is selected in the
+// shaders by comparing the view-space depth to a float4 of split distances.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
 // can't really use std::underlying_type<AttributeIndex>::type because the driver takes a uint32_t
 using AttributeBitset = utils::bitset32;
 
@@ -25,7 +25,7 @@ class UibGenerator {
 public:
     static UniformInterfaceBlock& getPerViewUib() noexcept;
     static UniformInterfaceBlock& getPerRenderableUib() noexcept;
-    static UniformInterfaceBlock& getLightsUib() noexcept;
+    static UniformInterfaceBlock& getPerRenderableInstancesUib() noexcept;
     static UniformInterfaceBlock& getPostProcessingUib() noexcept;
     static UniformInterfaceBlock& getPerRenderableBonesUib() noexcept;
 };
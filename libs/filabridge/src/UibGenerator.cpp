@@ -32,7 +32,7 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("clipFromViewMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             // camera
@@ -45,7 +45,7 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("lightDirection",          1, UniformInterfaceBlock::Type::FLOAT3)
             .add("fParamsX",                1, UniformInterfaceBlock::Type::UINT)
             // shadow
-            .add("shadowBias",              1, UniformInterfaceBlock::Type::FLOAT3)
+            .add("cascadeCount",            1, UniformInterfaceBlock::Type::UINT)
             .add("oneOverFroxelDimensionY", 1, UniformInterfaceBlock::Type::FLOAT)
             // froxels
             .add("zParams",                 1, UniformInterfaceBlock::Type::FLOAT4)
@@ -60,6 +60,9 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("ev100",                   1, UniformInterfaceBlock::Type::FLOAT)
             // ibl
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
+            // shadow cascades
+            .add("cascadeSplits",           1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("cascadeNormalBias",       1, UniformInterfaceBlock::Type::FLOAT4)
             .build();
     return uib;
 }
@@ -73,10 +76,12 @@ UniformInterfaceBlock& UibGenerator::getPerRenderableUib() noexcept {
     return uib;
 }
 
-UniformInterfaceBlock& UibGenerator::getLightsUib() noexcept {
-    static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
-            .name("LightsUniforms")
-            .add("lights", CONFIG_MAX_LIGHT_COUNT, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+UniformInterfaceBlock& UibGenerator::getPerRenderableInstancesUib() noexcept {
+    // each instance is a copy of the per-renderable uniforms (see getPerRenderableUib()),
+    // i.e. 7 float4: worldFromModelMatrix, then worldFromModelNormalMatrix (padded)
+    static UniformInterfaceBlock uib =  UniformInterfaceBlock::Builder()
+            .name("InstancesUniforms")
+            .add("instances", CONFIG_MAX_INSTANCE_COUNT * 7, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
             .build();
     return uib;
 }
@@ -186,6 +186,8 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
     cg.generateUniforms(vs, ShaderType::VERTEX,
             BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib());
+    cg.generateUniforms(vs, ShaderType::VERTEX,
+            BindingPoints::PER_RENDERABLE_INSTANCES, UibGenerator::getPerRenderableInstancesUib());
     if (variant.hasSkinning()) {
         cg.generateUniforms(vs, ShaderType::VERTEX,
                 BindingPoints::PER_RENDERABLE_BONES,
@@ -290,8 +292,6 @@ const std::string ShaderGenerator::createFragmentProgram(filament::driver::Shade
     // uniforms and samplers
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
-    cg.generateUniforms(fs, ShaderType::FRAGMENT,
-            BindingPoints::LIGHTS, UibGenerator::getLightsUib());
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_MATERIAL_INSTANCE, material.uib);
     cg.generateSeparator(fs);
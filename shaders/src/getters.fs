@@ -24,7 +24,18 @@ vec2 getUV1() {
 #endif
 
 #if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
+/**
+ * Returns the position of the fragment in the shadow map. The shadow cascade is selected from
+ * the view-space depth of the fragment.
+ */
 HIGHP vec3 getLightSpacePosition() {
-    return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
+    HIGHP vec3 p = vertex_worldPosition;
+    HIGHP float z = -(frameUniforms.viewFromWorldMatrix * vec4(p, 1.0)).z;
+    uint cascade = uint(dot(vec4(greaterThan(vec4(z), frameUniforms.cascadeSplits)), vec4(1.0)));
+    cascade = min(cascade, frameUniforms.cascadeCount - 1u);
+
+    p += vertex_shadowNormalOffset * frameUniforms.cascadeNormalBias[cascade];
+    HIGHP vec4 position = frameUniforms.lightFromWorldMatrix[cascade] * vec4(p, 1.0);
+    return position.xyz * (1.0 / position.w);
 }
 #endif
@@ -2,18 +2,39 @@
 // Uniforms access
 //------------------------------------------------------------------------------
 
-mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
+int getInstanceIndex() {
+#if defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+    return gl_InstanceIndex;
+#else
+    return gl_InstanceID;
+#endif
 }
 
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
-    return objectUniforms.worldFromModelMatrix;
+    // instanced draws: the first instance uses the per-renderable uniforms, the others
+    // find a copy of theirs in the instances uniforms (7 float4 per instance)
+    int instance = getInstanceIndex();
+    if (instance == 0) {
+        return objectUniforms.worldFromModelMatrix;
+    }
+    int i = instance * 7;
+    return mat4(instancesUniforms.instances[i],
+                instancesUniforms.instances[i + 1],
+                instancesUniforms.instances[i + 2],
+                instancesUniforms.instances[i + 3]);
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
-    return objectUniforms.worldFromModelNormalMatrix;
+    int instance = getInstanceIndex();
+    if (instance == 0) {
+        return objectUniforms.worldFromModelNormalMatrix;
+    }
+    int i = instance * 7 + 4;
+    return mat3(instancesUniforms.instances[i].xyz,
+                instancesUniforms.instances[i + 1].xyz,
+                instancesUniforms.instances[i + 2].xyz);
 }
 
 //------------------------------------------------------------------------------
@@ -7,10 +7,15 @@
 #define FROXEL_BUFFER_WIDTH         (1u << FROXEL_BUFFER_WIDTH_SHIFT)
 #define FROXEL_BUFFER_WIDTH_MASK    (FROXEL_BUFFER_WIDTH - 1u)
 
-#define RECORD_BUFFER_WIDTH_SHIFT   5u
+#define RECORD_BUFFER_WIDTH_SHIFT   6u
 #define RECORD_BUFFER_WIDTH         (1u << RECORD_BUFFER_WIDTH_SHIFT)
 #define RECORD_BUFFER_WIDTH_MASK    (RECORD_BUFFER_WIDTH - 1u)
 
+// Make sure this matches the same constants in GpuLightBuffer.h
+#define LIGHT_BUFFER_WIDTH_SHIFT    4u
+#define LIGHT_BUFFER_WIDTH          (1u << LIGHT_BUFFER_WIDTH_SHIFT)
+#define LIGHT_BUFFER_WIDTH_MASK     (LIGHT_BUFFER_WIDTH - 1u)
+
 struct FroxelParams {
     uint recordOffset; // offset at which the list of lights for this froxel starts
     uint pointCount;   // number of point lights in this froxel
@@ -25,7 +30,7 @@ uvec3 getFroxelCoords(const vec3 fragCoords) {
     uvec3 froxelCoord;
 
     froxelCoord.xy = uvec2((fragCoords.xy - frameUniforms.origin.xy) *
-            frameUniforms.oneOverFroxelDimension);
+            vec2(frameUniforms.oneOverFroxelDimension, frameUniforms.oneOverFroxelDimensionY));
 
     froxelCoord.z = uint(max(0.0,
             log2(frameUniforms.zParams.x * fragCoords.z + frameUniforms.zParams.y) *
@@ -64,20 +69,28 @@ FroxelParams getFroxelParams(uint froxelIndex) {
 
     FroxelParams froxel;
     froxel.recordOffset = entry.r;
-    froxel.pointCount = entry.g & 0xFFu;
-    froxel.spotCount = entry.g >> 8u;
+    froxel.pointCount = entry.g & 0xFFFFu;
+    froxel.spotCount = entry.g >> 16u;
     return froxel;
 }
 
 /**
  * Returns the coordinates of the light record in the light_records texture
  * given the specified index. A light record is a single uint index into the
- * lights data buffer (lightsUniforms UBO).
+ * lights data texture (light_lights).
  */
 ivec2 getRecordTexCoord(uint index) {
     return ivec2(index & RECORD_BUFFER_WIDTH_MASK, index >> RECORD_BUFFER_WIDTH_SHIFT);
 }
 
+/**
+ * Returns the coordinates of the first of the 4 texels holding the parameters
+ * of the specified light in the light_lights texture.
+ */
+ivec2 getLightTexCoord(uint lightIndex) {
+    return ivec2((lightIndex & LIGHT_BUFFER_WIDTH_MASK) << 2u, lightIndex >> LIGHT_BUFFER_WIDTH_SHIFT);
+}
+
 float getSquareFalloffAttenuation(float distanceSquare, float falloff) {
     float factor = distanceSquare * falloff;
     float smoothFactor = saturate(1.0 - factor * factor);
@@ -119,17 +132,18 @@ void setupPunctualLight(inout Light light, const HIGHP vec4 positionFalloff) {
  * in the w component.
  *
  * The light parameters used to compute the Light structure are fetched from the
- * lightsUniforms uniform buffer.
+ * light_lights texture.
  */
 Light getSpotLight(uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
+    ivec2 lightCoord = getLightTexCoord(lightIndex);
 
-    HIGHP vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
-    HIGHP vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
-          vec4 directionIES    = lightsUniforms.lights[lightIndex][2];
-          vec2 scaleOffset     = lightsUniforms.lights[lightIndex][3].xy;
+    HIGHP vec4 positionFalloff = texelFetch(light_lights, lightCoord, 0);
+    HIGHP vec4 colorIntensity  = texelFetch(light_lights, lightCoord + ivec2(1, 0), 0);
+          vec4 directionIES    = texelFetch(light_lights, lightCoord + ivec2(2, 0), 0);
+          vec2 scaleOffset     = texelFetch(light_lights, lightCoord + ivec2(3, 0), 0).xy;
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
@@ -147,15 +161,16 @@ Light getSpotLight(uint index) {
  * in the w component.
  *
  * The light parameters used to compute the Light structure are fetched from the
- * lightsUniforms uniform buffer.
+ * light_lights texture.
  */
 Light getPointLight(uint index) {
     Light light;
     ivec2 texCoord = getRecordTexCoord(index);
     uint lightIndex = texelFetch(light_records, texCoord, 0).r;
+    ivec2 lightCoord = getLightTexCoord(lightIndex);
 
-    HIGHP vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
-    HIGHP vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
+    HIGHP vec4 positionFalloff = texelFetch(light_lights, lightCoord, 0);
+    HIGHP vec4 colorIntensity  = texelFetch(light_lights, lightCoord + ivec2(1, 0), 0);
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
@@ -179,7 +194,7 @@ void evaluatePunctualLights(const PixelParams pixel, inout vec3 color) {
     // the current fragment. A froxel also contains a record offset that
     // tells us where the indices of those lights are in the records
     // texture. The records texture contains the indices of the actual
-    // light data in the lightsUniforms uniform buffer
+    // light data in the light_lights texture
 
     uint index = froxel.recordOffset;
     uint end = index + froxel.pointCount;